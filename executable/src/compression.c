@@ -0,0 +1,617 @@
+//
+//  compression.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#define _GNU_SOURCE
+#include "compression.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if BONJSON_HAVE_ZLIB
+#   include <zlib.h>
+#endif
+#if BONJSON_HAVE_ZSTD
+#   include <zstd.h>
+#endif
+
+
+// How much data the compression threads process at a time.
+#define COMPRESSION_BUFFER_SIZE (256 * 1024)
+
+// Pipe capacity to request, so that the threads on either side of it
+// aren't constantly waking each other up.
+#define PIPE_SIZE (1024 * 1024)
+
+// Input and output can both be compressed at the same time.
+#define MAX_COMPRESSION_JOBS 2
+
+
+// ============================================================================
+// Utilities
+// ============================================================================
+
+#define MARK_UNUSED(x) (void)(x)
+
+static const uint8_t g_gzipMagic[] = {0x1f, 0x8b};
+static const uint8_t g_zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+static void printError_exit(const char* const fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static bool hasPrefix(const uint8_t* const header, const size_t headerLength,
+                      const uint8_t* const magic, const size_t magicLength)
+{
+    const size_t length = headerLength < magicLength ? headerLength : magicLength;
+    return memcmp(header, magic, length) == 0;
+}
+
+static const char* compressionName(const CompressionType type)
+{
+    switch(type)
+    {
+        case COMPRESSION_GZIP:
+            return "gzip";
+        case COMPRESSION_ZSTD:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+
+// ============================================================================
+// Jobs
+// ============================================================================
+
+typedef struct
+{
+    CompressionType type;
+    int level;
+    // The file holding the compressed data
+    FILE* file;
+    // The thread's end of the pipe
+    int pipeFd;
+    // The converter's end of the pipe
+    FILE* stream;
+    uint8_t prefix[COMPRESSION_MAGIC_LENGTH];
+    size_t prefixLength;
+    pthread_t thread;
+} CompressionJob;
+
+static CompressionJob g_jobs[MAX_COMPRESSION_JOBS];
+
+static CompressionJob* allocateJob(void)
+{
+    for(int i = 0; i < MAX_COMPRESSION_JOBS; i++)
+    {
+        if(g_jobs[i].stream == NULL)
+        {
+            memset(&g_jobs[i], 0, sizeof(g_jobs[i]));
+            return &g_jobs[i];
+        }
+    }
+    printError_exit("BUG: Too many compression jobs");
+    return NULL;
+}
+
+static CompressionJob* findJob(FILE* const stream)
+{
+    for(int i = 0; i < MAX_COMPRESSION_JOBS; i++)
+    {
+        if(stream != NULL && g_jobs[i].stream == stream)
+        {
+            return &g_jobs[i];
+        }
+    }
+    return NULL;
+}
+
+#if BONJSON_HAVE_ZLIB || BONJSON_HAVE_ZSTD
+
+/**
+ * Read compressed data from the job's file, starting with any already-read prefix.
+ *
+ * @return The number of bytes read, or 0 on end of file.
+ */
+static size_t readCompressed(CompressionJob* const job, uint8_t* const buffer, const size_t length)
+{
+    if(job->prefixLength > 0)
+    {
+        const size_t prefixLength = job->prefixLength;
+        memcpy(buffer, job->prefix, prefixLength);
+        job->prefixLength = 0;
+        return prefixLength;
+    }
+
+    for(;;)
+    {
+        const ssize_t bytesRead = read(fileno(job->file), buffer, length);
+        if(bytesRead >= 0)
+        {
+            return (size_t)bytesRead;
+        }
+        if(errno != EINTR)
+        {
+            printError_exit("Could not read compressed input: %s", strerror(errno));
+        }
+    }
+}
+
+static bool writeFully(const int fd, const uint8_t* data, size_t length)
+{
+    while(length > 0)
+    {
+        const ssize_t bytesWritten = write(fd, data, length);
+        if(bytesWritten < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytesWritten <= 0)
+        {
+            return false;
+        }
+        data += bytesWritten;
+        length -= bytesWritten;
+    }
+    return true;
+}
+
+/**
+ * Write decompressed data for the converter to read.
+ *
+ * @return false if the converter closed its end of the pipe (so we should stop).
+ */
+static bool writeDecompressed(CompressionJob* const job, const uint8_t* const data, const size_t length)
+{
+    return writeFully(job->pipeFd, data, length);
+}
+
+static void writeCompressed(CompressionJob* const job, const uint8_t* const data, const size_t length)
+{
+    if(!writeFully(fileno(job->file), data, length))
+    {
+        printError_exit("Could not write compressed output: %s", strerror(errno));
+    }
+}
+
+/**
+ * Read uncompressed data from the converter.
+ *
+ * @return The number of bytes read, or 0 once the converter has closed its end of the pipe.
+ */
+static size_t readUncompressed(CompressionJob* const job, uint8_t* const buffer, const size_t length)
+{
+    for(;;)
+    {
+        const ssize_t bytesRead = read(job->pipeFd, buffer, length);
+        if(bytesRead >= 0)
+        {
+            return (size_t)bytesRead;
+        }
+        if(errno != EINTR)
+        {
+            printError_exit("Could not read from pipe: %s", strerror(errno));
+        }
+    }
+}
+
+/**
+ * Check if the converter has no more data waiting in the pipe. The converter
+ * writes its stream mode flushes all at once, so this is when to pass what we
+ * have so far on to the output instead of holding it back in the compressor.
+ */
+static bool isUncompressedInputIdle(CompressionJob* const job)
+{
+    struct pollfd pfd = {.fd = job->pipeFd, .events = POLLIN};
+    while(poll(&pfd, 1, 0) < 0)
+    {
+        if(errno != EINTR)
+        {
+            printError_exit("Could not poll pipe: %s", strerror(errno));
+        }
+    }
+    return (pfd.revents & POLLIN) == 0;
+}
+
+#endif // BONJSON_HAVE_ZLIB || BONJSON_HAVE_ZSTD
+
+
+// ============================================================================
+// gzip
+// ============================================================================
+
+#if BONJSON_HAVE_ZLIB
+
+static void decompressGzip(CompressionJob* const job, uint8_t* const in, uint8_t* const out)
+{
+    z_stream z = {0};
+    if(inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+    {
+        printError_exit("Could not initialize gzip decompressor");
+    }
+
+    bool isAtStreamEnd = false;
+    size_t bytesRead;
+    while((bytesRead = readCompressed(job, in, COMPRESSION_BUFFER_SIZE)) > 0)
+    {
+        z.next_in = in;
+        z.avail_in = (uInt)bytesRead;
+        do
+        {
+            if(isAtStreamEnd)
+            {
+                if(z.avail_in == 0)
+                {
+                    break;
+                }
+                // Concatenated gzip members make up a single stream
+                inflateReset(&z);
+                isAtStreamEnd = false;
+            }
+            z.next_out = out;
+            z.avail_out = COMPRESSION_BUFFER_SIZE;
+            const int result = inflate(&z, Z_NO_FLUSH);
+            if(result == Z_STREAM_END)
+            {
+                isAtStreamEnd = true;
+            }
+            else if(result != Z_OK && result != Z_BUF_ERROR)
+            {
+                printError_exit("Corrupt gzip input: %s", z.msg != NULL ? z.msg : "unknown error");
+            }
+            if(!writeDecompressed(job, out, COMPRESSION_BUFFER_SIZE - z.avail_out))
+            {
+                inflateEnd(&z);
+                return;
+            }
+        }
+        while(z.avail_in > 0 || z.avail_out == 0);
+    }
+
+    inflateEnd(&z);
+    if(!isAtStreamEnd)
+    {
+        printError_exit("Compressed gzip input was truncated");
+    }
+}
+
+static void compressGzip(CompressionJob* const job, uint8_t* const in, uint8_t* const out)
+{
+    z_stream z = {0};
+    const int level = job->level >= 0 ? job->level : Z_DEFAULT_COMPRESSION;
+    if(deflateInit2(&z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        printError_exit("Could not initialize gzip compressor");
+    }
+
+    int flush;
+    do
+    {
+        const size_t bytesRead = readUncompressed(job, in, COMPRESSION_BUFFER_SIZE);
+        flush = bytesRead == 0 ? Z_FINISH : isUncompressedInputIdle(job) ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        z.next_in = in;
+        z.avail_in = (uInt)bytesRead;
+        do
+        {
+            z.next_out = out;
+            z.avail_out = COMPRESSION_BUFFER_SIZE;
+            deflate(&z, flush);
+            writeCompressed(job, out, COMPRESSION_BUFFER_SIZE - z.avail_out);
+        }
+        while(z.avail_out == 0);
+    }
+    while(flush != Z_FINISH);
+
+    deflateEnd(&z);
+}
+
+#endif // BONJSON_HAVE_ZLIB
+
+
+// ============================================================================
+// zstd
+// ============================================================================
+
+#if BONJSON_HAVE_ZSTD
+
+static void decompressZstd(CompressionJob* const job, uint8_t* const in, uint8_t* const out)
+{
+    ZSTD_DCtx* const dctx = ZSTD_createDCtx();
+    if(dctx == NULL)
+    {
+        printError_exit("Could not initialize zstd decompressor");
+    }
+
+    size_t lastResult = 0;
+    size_t bytesRead;
+    while((bytesRead = readCompressed(job, in, COMPRESSION_BUFFER_SIZE)) > 0)
+    {
+        ZSTD_inBuffer input = {in, bytesRead, 0};
+        ZSTD_outBuffer output;
+        do
+        {
+            output = (ZSTD_outBuffer){out, COMPRESSION_BUFFER_SIZE, 0};
+            lastResult = ZSTD_decompressStream(dctx, &output, &input);
+            if(ZSTD_isError(lastResult))
+            {
+                printError_exit("Corrupt zstd input: %s", ZSTD_getErrorName(lastResult));
+            }
+            if(!writeDecompressed(job, out, output.pos))
+            {
+                ZSTD_freeDCtx(dctx);
+                return;
+            }
+        }
+        while(input.pos < input.size || output.pos == output.size);
+    }
+
+    ZSTD_freeDCtx(dctx);
+    if(lastResult != 0)
+    {
+        printError_exit("Compressed zstd input was truncated");
+    }
+}
+
+static void compressZstd(CompressionJob* const job, uint8_t* const in, uint8_t* const out)
+{
+    ZSTD_CCtx* const cctx = ZSTD_createCCtx();
+    if(cctx == NULL)
+    {
+        printError_exit("Could not initialize zstd compressor");
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, job->level >= 0 ? job->level : ZSTD_CLEVEL_DEFAULT);
+
+    ZSTD_EndDirective mode;
+    do
+    {
+        const size_t bytesRead = readUncompressed(job, in, COMPRESSION_BUFFER_SIZE);
+        mode = bytesRead == 0 ? ZSTD_e_end : isUncompressedInputIdle(job) ? ZSTD_e_flush : ZSTD_e_continue;
+        ZSTD_inBuffer input = {in, bytesRead, 0};
+        bool isFinished;
+        do
+        {
+            ZSTD_outBuffer output = {out, COMPRESSION_BUFFER_SIZE, 0};
+            const size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+            if(ZSTD_isError(remaining))
+            {
+                printError_exit("zstd compression failed: %s", ZSTD_getErrorName(remaining));
+            }
+            writeCompressed(job, out, output.pos);
+            isFinished = mode == ZSTD_e_continue ? input.pos == input.size : remaining == 0;
+        }
+        while(!isFinished);
+    }
+    while(mode != ZSTD_e_end);
+
+    ZSTD_freeCCtx(cctx);
+}
+
+#endif // BONJSON_HAVE_ZSTD
+
+
+// ============================================================================
+// Threads
+// ============================================================================
+
+static void* decompressionThread(void* const userData)
+{
+    CompressionJob* const job = (CompressionJob*)userData;
+    uint8_t* const in = malloc(COMPRESSION_BUFFER_SIZE);
+    uint8_t* const out = malloc(COMPRESSION_BUFFER_SIZE);
+
+    switch(job->type)
+    {
+#if BONJSON_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            decompressGzip(job, in, out);
+            break;
+#endif
+#if BONJSON_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            decompressZstd(job, in, out);
+            break;
+#endif
+        default:
+            printError_exit("Input is %s compressed, but %s support was not built in",
+                            compressionName(job->type), compressionName(job->type));
+    }
+
+    free(in);
+    free(out);
+    close(job->pipeFd);
+    return NULL;
+}
+
+static void* compressionThread(void* const userData)
+{
+    CompressionJob* const job = (CompressionJob*)userData;
+    uint8_t* const in = malloc(COMPRESSION_BUFFER_SIZE);
+    uint8_t* const out = malloc(COMPRESSION_BUFFER_SIZE);
+
+    switch(job->type)
+    {
+#if BONJSON_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            compressGzip(job, in, out);
+            break;
+#endif
+#if BONJSON_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            compressZstd(job, in, out);
+            break;
+#endif
+        default:
+            printError_exit("%s support was not built in", compressionName(job->type));
+    }
+
+    free(in);
+    free(out);
+    close(job->pipeFd);
+    return NULL;
+}
+
+static void startJob(CompressionJob* const job, void* (*threadFunc)(void*), const bool isDecompressing)
+{
+    int fds[2];
+    if(pipe(fds) < 0)
+    {
+        printError_exit("Could not create pipe: %s", strerror(errno));
+    }
+#ifdef F_SETPIPE_SZ
+    // Best effort; the default size works too, just with more context switches.
+    fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+
+    const int streamFd = isDecompressing ? fds[0] : fds[1];
+    job->pipeFd = isDecompressing ? fds[1] : fds[0];
+    job->stream = fdopen(streamFd, isDecompressing ? "rb" : "wb");
+    if(job->stream == NULL)
+    {
+        printError_exit("Could not open pipe: %s", strerror(errno));
+    }
+
+    // Writing to a pipe whose reader has gone away should fail with EPIPE in
+    // the worker thread rather than kill the process, so the thread inherits
+    // a mask that blocks SIGPIPE.
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    const int result = pthread_create(&job->thread, NULL, threadFunc, job);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if(result != 0)
+    {
+        printError_exit("Could not start compression thread: %s", strerror(result));
+    }
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+bool couldBeCompressionMagic(const uint8_t* const header, const size_t headerLength)
+{
+    return (headerLength < sizeof(g_gzipMagic) && hasPrefix(header, headerLength, g_gzipMagic, sizeof(g_gzipMagic))) ||
+           (headerLength < sizeof(g_zstdMagic) && hasPrefix(header, headerLength, g_zstdMagic, sizeof(g_zstdMagic)));
+}
+
+CompressionType detectCompression(const uint8_t* const header, const size_t headerLength)
+{
+    if(headerLength >= sizeof(g_gzipMagic) && hasPrefix(header, headerLength, g_gzipMagic, sizeof(g_gzipMagic)))
+    {
+        return COMPRESSION_GZIP;
+    }
+    if(headerLength >= sizeof(g_zstdMagic) && hasPrefix(header, headerLength, g_zstdMagic, sizeof(g_zstdMagic)))
+    {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+CompressionType parseCompressionSpec(const char* const spec, int* const level)
+{
+    const char* const separator = strchr(spec, ':');
+    const size_t nameLength = separator != NULL ? (size_t)(separator - spec) : strlen(spec);
+    *level = separator != NULL ? atoi(separator + 1) : -1;
+
+    if(nameLength == 4 && memcmp(spec, "gzip", 4) == 0)
+    {
+        return COMPRESSION_GZIP;
+    }
+    if(nameLength == 4 && memcmp(spec, "zstd", 4) == 0)
+    {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+FILE* startDecompressing(FILE* const file,
+                         const CompressionType type,
+                         const uint8_t* const prefix,
+                         const size_t prefixLength)
+{
+    CompressionJob* const job = allocateJob();
+    job->type = type;
+    job->file = file;
+    memcpy(job->prefix, prefix, prefixLength);
+    job->prefixLength = prefixLength;
+    startJob(job, decompressionThread, true);
+    return job->stream;
+}
+
+FILE* startCompressing(FILE* const file, const CompressionType type, const int level)
+{
+    CompressionJob* const job = allocateJob();
+    job->type = type;
+    job->level = level;
+    job->file = file;
+    startJob(job, compressionThread, false);
+    return job->stream;
+}
+
+bool closeCompressionStream(FILE* const stream)
+{
+    CompressionJob* const job = findJob(stream);
+    if(job == NULL)
+    {
+        return false;
+    }
+
+    // Closing our end of the pipe tells a compressor that the data is complete,
+    // or tells a decompressor that nobody wants the rest.
+    fclose(job->stream);
+    pthread_join(job->thread, NULL);
+
+    if(job->file == stdout)
+    {
+        if(fflush(stdout) == EOF)
+        {
+            printError_exit("Could not flush output: %s", strerror(errno));
+        }
+    }
+    else if(job->file != stdin && fclose(job->file) == EOF)
+    {
+        printError_exit("Could not close file: %s", strerror(errno));
+    }
+    job->stream = NULL;
+    return true;
+}
@@ -0,0 +1,108 @@
+//
+//  compression.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef compression_h
+#define compression_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Compression and decompression run on their own threads, connected to the
+// converter by a pipe. The converter just sees an ordinary FILE.
+
+/**
+ * The most bytes that detectCompression() will need to look at.
+ */
+#define COMPRESSION_MAGIC_LENGTH 4
+
+typedef enum
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD,
+} CompressionType;
+
+/**
+ * Check if a file header could still turn out to be a compression magic number
+ * once more bytes have been read.
+ *
+ * @param header The first bytes of the file.
+ * @param headerLength The number of bytes read so far.
+ * @return true if more bytes are needed to decide.
+ */
+bool couldBeCompressionMagic(const uint8_t* header, size_t headerLength);
+
+/**
+ * Identify the compression format of a file from its first bytes.
+ *
+ * @param header The first bytes of the file.
+ * @param headerLength The number of bytes available (up to COMPRESSION_MAGIC_LENGTH).
+ * @return The compression type, or COMPRESSION_NONE.
+ */
+CompressionType detectCompression(const uint8_t* header, size_t headerLength);
+
+/**
+ * Parse a compression specifier of the form "name" or "name:level".
+ *
+ * @param spec The specifier (e.g. "gzip", "zstd:19").
+ * @param level Will hold the compression level (or -1 for the default level).
+ * @return The compression type, or COMPRESSION_NONE if the name isn't recognized.
+ */
+CompressionType parseCompressionSpec(const char* spec, int* level);
+
+/**
+ * Start decompressing a file on a background thread.
+ *
+ * @param file The compressed file.
+ * @param type The compression type.
+ * @param prefix Bytes that were already read from the file to detect the compression type.
+ * @param prefixLength The number of prefix bytes.
+ * @return A stream to read the decompressed data from. Close it with closeCompressionStream().
+ */
+FILE* startDecompressing(FILE* file, CompressionType type, const uint8_t* prefix, size_t prefixLength);
+
+/**
+ * Start compressing data to a file on a background thread.
+ *
+ * @param file The file to write compressed data to.
+ * @param type The compression type.
+ * @param level The compression level (or -1 for the default level).
+ * @return A stream to write uncompressed data to. Close it with closeCompressionStream().
+ */
+FILE* startCompressing(FILE* file, CompressionType type, int level);
+
+/**
+ * Close a stream returned by startDecompressing() or startCompressing(), wait for
+ * its thread to finish, and close the underlying file.
+ *
+ * @param stream The stream to close.
+ * @return false if the stream didn't come from this module (and so wasn't closed).
+ */
+bool closeCompressionStream(FILE* stream);
+
+#endif // compression_h
@@ -26,12 +26,34 @@
 
 #include <ksbonjson/KSBONJSONEncoder.h>
 #include <ksbonjson/KSBONJSONDecoder.h>
+#include <ksbonjson/KSBONJSONCanonical.h>
+#include <ksbonjson/KSBONJSONAggregate.h>
+#include <ksbonjson/KSBONJSONRecordLog.h>
+#include <ksbonjson/KSBONJSONIndex.h>
+#include <ksbonjson/KSBONJSONZoneMap.h>
+#include <ksbonjson/KSBONJSONShard.h>
 #include <json.h>
+#include "compression.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -39,6 +61,27 @@
 // Note: The entire file gets loaded into memory, so choose wisely.
 #define MAX_FILE_SIZE 5000000000
 
+// In streaming mode, this is the most we'll buffer for a single value that
+// hasn't been fully received yet (i.e. a long string).
+#define MAX_STREAM_VALUE_SIZE 100000000
+
+// How much to read from the input at a time in streaming mode.
+#define STREAM_READ_SIZE 65536
+
+// Default output flush thresholds in streaming mode.
+#define DEFAULT_FLUSH_SIZE 65536
+#define DEFAULT_FLUSH_INTERVAL_MS 100
+
+// Size of the buffer that conversion errors get formatted into.
+#define ERROR_MESSAGE_SIZE 256
+
+// Default number of elements between the offsets recorded in an index.
+#define DEFAULT_INDEX_STRIDE 64
+
+// The conversion server serves one connection at a time, so it drops a client
+// that stops sending (or receiving) for this long rather than wait forever.
+#define SERVER_TIMEOUT_SEC 10
+
 
 // ============================================================================
 // Utilities
@@ -84,36 +127,129 @@ static void printPError_exit(const char* const fmt, ...)
     exit(1);
 }
 
+// Output compression requested on the command line
+static CompressionType g_outputCompression = COMPRESSION_NONE;
+static int g_outputCompressionLevel = -1;
+
+// Input that happens to start like a compressed file (such as a BONJSON
+// sequence starting with -86, 22) can be read as it is with --no-decompress.
+static bool g_detectInputCompression = true;
+
+// Bytes that were read from the input to sniff its compression type. They get
+// handed out again by readInput() before anything else is read from the file.
+static struct
+{
+    uint8_t bytes[COMPRESSION_MAGIC_LENGTH];
+    size_t length;
+    size_t pos;
+} g_inputPrefix;
+
+static size_t readFromFd(const int fd, uint8_t* const buffer, const size_t length)
+{
+    for(;;)
+    {
+        const ssize_t bytesRead = read(fd, buffer, length);
+        if(bytesRead >= 0)
+        {
+            return (size_t)bytesRead;
+        }
+        if(errno != EINTR)
+        {
+            printPError_exit("Could not read from input");
+        }
+    }
+}
+
+/**
+ * Read whatever is available from an input file (up to length bytes).
+ *
+ * @return The number of bytes read, or 0 on end of file.
+ */
+static size_t readInput(FILE* const file, uint8_t* const buffer, const size_t length)
+{
+    const size_t prefixRemaining = g_inputPrefix.length - g_inputPrefix.pos;
+    if(prefixRemaining > 0)
+    {
+        const size_t copyLength = prefixRemaining < length ? prefixRemaining : length;
+        memcpy(buffer, g_inputPrefix.bytes + g_inputPrefix.pos, copyLength);
+        g_inputPrefix.pos += copyLength;
+        return copyLength;
+    }
+    return readFromFd(fileno(file), buffer, length);
+}
+
+/**
+ * If the file is compressed, replace it with a stream of decompressed data.
+ */
+static FILE* decompressIfNeeded(FILE* const file)
+{
+    g_inputPrefix.length = 0;
+    g_inputPrefix.pos = 0;
+    if(!g_detectInputCompression)
+    {
+        return file;
+    }
+    while(g_inputPrefix.length < COMPRESSION_MAGIC_LENGTH &&
+          couldBeCompressionMagic(g_inputPrefix.bytes, g_inputPrefix.length))
+    {
+        const size_t bytesRead = readFromFd(fileno(file),
+                                            g_inputPrefix.bytes + g_inputPrefix.length,
+                                            COMPRESSION_MAGIC_LENGTH - g_inputPrefix.length);
+        if(bytesRead == 0)
+        {
+            break;
+        }
+        g_inputPrefix.length += bytesRead;
+    }
+
+    const CompressionType type = detectCompression(g_inputPrefix.bytes, g_inputPrefix.length);
+    if(type == COMPRESSION_NONE)
+    {
+        return file;
+    }
+    FILE* const stream = startDecompressing(file, type, g_inputPrefix.bytes, g_inputPrefix.length);
+    g_inputPrefix.length = 0;
+    return stream;
+}
+
 static FILE* openFileForReading(const char* const filename)
 {
     if(strcmp(filename, "-") == 0)
     {
-        return stdin;
+        return decompressIfNeeded(stdin);
     }
     FILE* const file = fopen(filename, "rb");
     if(file == NULL)
     {
         printPError_exit("Could not open %s", filename);
     }
-    return file;
+    return decompressIfNeeded(file);
 }
 
 static FILE* openFileForWriting(const char* const filename)
 {
-    if(strcmp(filename, "-") == 0)
+    FILE* file = stdout;
+    if(strcmp(filename, "-") != 0)
     {
-        return stdout;
+        file = fopen(filename, "wb");
+        if(file == NULL)
+        {
+            printPError_exit("Could not open %s", filename);
+        }
     }
-    FILE* const file = fopen(filename, "wb");
-    if(file == NULL)
+    if(g_outputCompression != COMPRESSION_NONE)
     {
-        printPError_exit("Could not open %s", filename);
+        return startCompressing(file, g_outputCompression, g_outputCompressionLevel);
     }
     return file;
 }
 
 static void closeFile(FILE* const file)
 {
+    if(closeCompressionStream(file))
+    {
+        return;
+    }
     if(file != stdin && file != stdout && file != stderr && file != NULL)
     {
         if(fclose(file) == EOF)
@@ -131,16 +267,12 @@ static uint8_t* readEntireFile(FILE* const file, size_t* const fileLength)
     for(;;)
     {
         size_t length = bufferSize - bufferOffset;
-        size_t bytes_read = fread(buffer+bufferOffset, 1, length, file);
-        if(ferror(file))
-        {
-            printPError_exit("Could not read %d bytes from file", length);
-        }
-        bufferOffset += bytes_read;
-        if(feof(file))
+        size_t bytes_read = readInput(file, buffer+bufferOffset, length);
+        if(bytes_read == 0)
         {
             break;
         }
+        bufferOffset += bytes_read;
         if(bufferOffset > (bufferSize/3)*2)
         {
             if(bufferOffset >= MAX_FILE_SIZE)
@@ -160,14 +292,21 @@ static uint8_t* readEntireFile(FILE* const file, size_t* const fileLength)
     return buffer;
 }
 
-static void writeToFile(FILE* const file, const uint8_t* const data, const int length)
+static void writeToFile(FILE* const file, const uint8_t* const data, const size_t length)
 {
-    if(fwrite(data, 1, length, file) != (unsigned)length)
+    if(fwrite(data, 1, length, file) != length)
     {
-        printPError_exit("Could not write %d bytes to file", length);
+        printPError_exit("Could not write %zu bytes to file", length);
     }
 }
 
+static int64_t currentTimeMilliseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static void replaceString(char** str, const char* replacement, size_t length)
 {
     if(*str != NULL)
@@ -179,6 +318,113 @@ static void replaceString(char** str, const char* replacement, size_t length)
 }
 
 
+// ============================================================================
+// Streaming I/O
+// ============================================================================
+
+typedef struct
+{
+    size_t flushSize;
+    int flushIntervalMs;
+} StreamOptions;
+
+/**
+ * Buffered output that gets flushed when it grows past flushSize, or when
+ * the input has gone quiet for flushIntervalMs (so that downstream readers
+ * of a slow pipeline still see timely results).
+ */
+typedef struct
+{
+    FILE* file;
+    uint8_t* buffer;
+    size_t size;
+    size_t pos;
+    size_t flushSize;
+    int flushIntervalMs;
+    int64_t lastFlushTime;
+} OutputStream;
+
+static void initOutputStream(OutputStream* const stream, FILE* const file, const StreamOptions* const options)
+{
+    stream->file = file;
+    stream->flushSize = options->flushSize;
+    stream->flushIntervalMs = options->flushIntervalMs;
+    stream->size = options->flushSize > 0 ? options->flushSize : 1;
+    stream->buffer = malloc(stream->size);
+    stream->pos = 0;
+    stream->lastFlushTime = currentTimeMilliseconds();
+}
+
+static void flushOutputStream(OutputStream* const stream)
+{
+    if(stream->pos > 0)
+    {
+        writeToFile(stream->file, stream->buffer, stream->pos);
+        stream->pos = 0;
+    }
+    if(fflush(stream->file) == EOF)
+    {
+        printPError_exit("Could not flush output");
+    }
+    stream->lastFlushTime = currentTimeMilliseconds();
+}
+
+static void closeOutputStream(OutputStream* const stream)
+{
+    flushOutputStream(stream);
+    free(stream->buffer);
+    stream->buffer = NULL;
+}
+
+static void writeToOutputStream(OutputStream* const stream, const void* const data, const size_t length)
+{
+    if(stream->pos + length > stream->size)
+    {
+        flushOutputStream(stream);
+        if(length > stream->size)
+        {
+            writeToFile(stream->file, data, length);
+            return;
+        }
+    }
+    memcpy(stream->buffer + stream->pos, data, length);
+    stream->pos += length;
+
+    if(stream->pos >= stream->flushSize ||
+       currentTimeMilliseconds() - stream->lastFlushTime >= stream->flushIntervalMs)
+    {
+        flushOutputStream(stream);
+    }
+}
+
+/**
+ * Read whatever is available from the input (up to length bytes), blocking if nothing is.
+ * If there's pending output and no input arrives within the flush interval, the output
+ * gets flushed before blocking.
+ *
+ * @return The number of bytes read, or 0 on end of file.
+ */
+static size_t readFromInputStream(FILE* const file, uint8_t* const buffer, const size_t length, OutputStream* const out)
+{
+    if(out->pos > 0 && g_inputPrefix.pos == g_inputPrefix.length)
+    {
+        const int fd = fileno(file);
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int64_t waitMs = out->flushIntervalMs - (currentTimeMilliseconds() - out->lastFlushTime);
+        if(waitMs < 0)
+        {
+            waitMs = 0;
+        }
+        if(poll(&pfd, 1, (int)waitMs) == 0)
+        {
+            flushOutputStream(out);
+        }
+    }
+
+    return readInput(file, buffer, length);
+}
+
+
 // ============================================================================
 // JSON to BONJSON
 // ============================================================================
@@ -295,22 +541,106 @@ static ksbonjson_encodeStatus parseJsonObject(json_object *obj, KSBONJSONEncodeC
     return KSBONJSON_ENCODE_OK;
 }
 
-static ksbonjson_encodeStatus addEncodedDataCallback(const uint8_t* KSBONJSON_RESTRICT data,
-                                              size_t dataLength,
-                                              void* KSBONJSON_RESTRICT userData)
+static void appendToBuffer(bonjson_encode_context* const ctx, const void* const data, const size_t dataLength)
 {
-    bonjson_encode_context* ctx = (bonjson_encode_context*)userData;
     if(ctx->pos + dataLength > ctx->size)
     {
-        printError_exit("BUG: BONJSON buffer was too small (%d + %d > %d)", ctx->pos, dataLength, ctx->size);
+        size_t newSize = ctx->size > 0 ? ctx->size : 1;
+        while(ctx->pos + dataLength > newSize)
+        {
+            newSize *= 2;
+        }
+        ctx->buffer = realloc(ctx->buffer, newSize);
+        if(ctx->buffer == NULL)
+        {
+            printError_exit("Could not grow buffer to %zu bytes", newSize);
+        }
+        ctx->size = newSize;
     }
     memcpy(ctx->buffer+ctx->pos, data, dataLength);
     ctx->pos += dataLength;
+}
 
+static ksbonjson_encodeStatus addEncodedDataCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                              size_t dataLength,
+                                              void* KSBONJSON_RESTRICT userData)
+{
+    appendToBuffer((bonjson_encode_context*)userData, data, dataLength);
     return KSBONJSON_ENCODE_OK;
 }
 
-static ksbonjson_encodeStatus jsonToBonjson(const char* src_path, const char* dst_path)
+/**
+ * Convert a JSON document in memory, appending the BONJSON result to out.
+ *
+ * @return true on success. On failure, errorMessage describes what went wrong.
+ */
+static bool convertJsonToBonjson(json_tokener* const tokener,
+                                 const uint8_t* const document,
+                                 const size_t documentSize,
+                                 bonjson_encode_context* const out,
+                                 char* const errorMessage)
+{
+    json_tokener_reset(tokener);
+    json_object *root = json_tokener_parse_ex(tokener, (const char*)document, documentSize);
+    if(root == NULL && json_tokener_get_error(tokener) == json_tokener_continue)
+    {
+        // Let json-c know that there's no more data (a top-level number needs a delimiter).
+        root = json_tokener_parse_ex(tokener, "", 1);
+    }
+    if(root == NULL)
+    {
+        snprintf(errorMessage, ERROR_MESSAGE_SIZE, "Failed to parse JSON: %s",
+                 json_tokener_error_desc(json_tokener_get_error(tokener)));
+        return false;
+    }
+
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, out);
+    ksbonjson_encodeStatus status = parseJsonElement(root, &eContext);
+    json_object_put(root);
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        snprintf(errorMessage, ERROR_MESSAGE_SIZE, "Failed to convert JSON to BONJSON: status %d (%s)",
+                 status,
+                 ksbonjson_encodeStatusDescription(status));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Re-encode the converted document in canonical form (sorted member names).
+ */
+static void canonicalizeBonjson(bonjson_encode_context* const ctx)
+{
+    // Every member takes at least 3 bytes.
+    const size_t memberCount = ctx->pos / 3 + 1;
+    KSBONJSONCanonicalMember* members = calloc(memberCount, sizeof(*members));
+    bonjson_encode_context* canonical = new_bonjson_encode_context(ctx->pos);
+    if(members == NULL || canonical == NULL)
+    {
+        printError_exit("Could not allocate memory to canonicalize the document");
+    }
+
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, canonical);
+    ksbonjson_documentStatus status = ksbonjson_canonicalize(ctx->buffer, ctx->pos, members, memberCount, &eContext);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("Failed to canonicalize BONJSON: status %d (%s)",
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+    free(members);
+
+    // Swap the buffers
+    bonjson_encode_context original = *ctx;
+    *ctx = *canonical;
+    *canonical = original;
+    free_bonjson_encode_context(canonical);
+}
+
+static ksbonjson_encodeStatus jsonToBonjson(const char* src_path, const char* dst_path, bool canonical)
 {
     FILE* file = openFileForReading(src_path);
     size_t documentSize = 0;
@@ -323,30 +653,108 @@ static ksbonjson_encodeStatus jsonToBonjson(const char* src_path, const char* ds
         printError_exit("Failed to build tokener");
     }
 
-    json_object *root = json_tokener_parse_ex(tokener, (const char*)document, documentSize);
+    bonjson_encode_context* ctx = new_bonjson_encode_context(documentSize*2);
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    if(!convertJsonToBonjson(tokener, document, documentSize, ctx, errorMessage))
+    {
+        printError_exit("%s", errorMessage);
+    }
     json_tokener_free(tokener);
-    if(root == NULL)
+    free(document);
+
+    if(canonical)
     {
-        printError_exit("Failed to parse JSON");
+        canonicalizeBonjson(ctx);
     }
 
-    bonjson_encode_context* ctx = new_bonjson_encode_context(documentSize*2);
+    file = openFileForWriting(dst_path);
+    writeToFile(file, ctx->buffer, ctx->pos);
+    closeFile(file);
+    free_bonjson_encode_context(ctx);
+
+    return KSBONJSON_ENCODE_OK;
+}
+
+
+static ksbonjson_encodeStatus addEncodedDataToStreamCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                                             size_t dataLength,
+                                                             void* KSBONJSON_RESTRICT userData)
+{
+    writeToOutputStream((OutputStream*)userData, data, dataLength);
+    return KSBONJSON_ENCODE_OK;
+}
+
+static void encodeJsonValueToStream(json_object* const root, OutputStream* const out)
+{
     KSBONJSONEncodeContext eContext;
-    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, ctx);
+    ksbonjson_beginEncode(&eContext, addEncodedDataToStreamCallback, out);
     ksbonjson_encodeStatus status = parseJsonElement(root, &eContext);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&eContext);
+    }
     if(status != KSBONJSON_ENCODE_OK)
     {
         printError_exit("Failed to convert JSON to BONJSON: status %d (%s)",
                         status,
                         ksbonjson_encodeStatusDescription(status));
     }
+    json_object_put(root);
+}
 
-    file = openFileForWriting(dst_path);
-    writeToFile(file, ctx->buffer, ctx->pos);
-    closeFile(file);
-    free_bonjson_encode_context(ctx);
+/**
+ * Convert a sequence of JSON values to a sequence of BONJSON values as the data arrives.
+ * Memory use is bounded by the size of the largest top-level value.
+ */
+static void jsonToBonjsonStream(const char* src_path, const char* dst_path, const StreamOptions* const options)
+{
+    FILE* src = openFileForReading(src_path);
+    OutputStream out;
+    initOutputStream(&out, openFileForWriting(dst_path), options);
 
-    return KSBONJSON_ENCODE_OK;
+    json_tokener* tokener = json_tokener_new_ex(JSON_TOKENER_DEFAULT_DEPTH);
+    if(tokener == NULL)
+    {
+        printError_exit("Failed to build tokener");
+    }
+
+    uint8_t* buffer = malloc(STREAM_READ_SIZE);
+    size_t bytesRead;
+    while((bytesRead = readFromInputStream(src, buffer, STREAM_READ_SIZE, &out)) > 0)
+    {
+        const char* pos = (const char*)buffer;
+        size_t remaining = bytesRead;
+        while(remaining > 0)
+        {
+            json_object* root = json_tokener_parse_ex(tokener, pos, (int)remaining);
+            if(root == NULL)
+            {
+                enum json_tokener_error error = json_tokener_get_error(tokener);
+                if(error != json_tokener_continue)
+                {
+                    printError_exit("Failed to parse JSON: %s", json_tokener_error_desc(error));
+                }
+                break;
+            }
+            const size_t parsedLength = json_tokener_get_parse_end(tokener);
+            pos += parsedLength;
+            remaining -= parsedLength;
+            encodeJsonValueToStream(root, &out);
+        }
+    }
+
+    // A top-level number is only complete once json-c sees a delimiter.
+    json_object* root = json_tokener_parse_ex(tokener, "", 1);
+    if(root != NULL)
+    {
+        encodeJsonValueToStream(root, &out);
+    }
+
+    json_tokener_free(tokener);
+    free(buffer);
+    closeFile(src);
+    closeOutputStream(&out);
+    closeFile(out.file);
 }
 
 
@@ -501,6 +909,45 @@ static void init_decoder_context(DecoderContext* ctx)
     ctx->callbacks.onUInteger = onUInteger;
 }
 
+static void reset_decoder_context(DecoderContext* ctx)
+{
+    free(ctx->nextName);
+    json_object_put(ctx->stack[0].obj);
+    init_decoder_context(ctx);
+}
+
+/**
+ * Convert a BONJSON document in memory, appending the JSON result to out.
+ *
+ * @return true on success. On failure, errorMessage describes what went wrong.
+ */
+static bool convertBonjsonToJson(DecoderContext* const ctx,
+                                 const uint8_t* const document,
+                                 const size_t documentSize,
+                                 const bool prettyPrint,
+                                 bonjson_encode_context* const out,
+                                 char* const errorMessage)
+{
+    reset_decoder_context(ctx);
+    size_t decodedOffset = 0;
+    ksbonjson_decodeStatus status = ksbonjson_decode(document, documentSize, &ctx->callbacks, ctx, &decodedOffset);
+    if(status != KSBONJSON_DECODE_OK)
+    {
+        snprintf(errorMessage, ERROR_MESSAGE_SIZE, "Failed to decode BONJSON at offset %zu: status %d (%s)",
+                 decodedOffset,
+                 status,
+                 ksbonjson_decodeStatusDescription(status));
+        return false;
+    }
+
+    size_t jsonLength = 0;
+    const char* jsonDoc = json_object_to_json_string_length(ctx->stack[0].obj,
+                                                            prettyPrint ? JSON_C_TO_STRING_PRETTY : JSON_C_TO_STRING_PLAIN,
+                                                            &jsonLength);
+    appendToBuffer(out, jsonDoc, jsonLength);
+    return true;
+}
+
 static void bonjsonToJson(const char* const src_path, const char* const dst_path, bool prettyPrint)
 {
     DecoderContext ctx;
@@ -509,87 +956,2200 @@ static void bonjsonToJson(const char* const src_path, const char* const dst_path
     size_t documentSize = 0;
     uint8_t* document = readEntireFile(file, &documentSize);
     closeFile(file);
-    size_t decodedOffset;
 
-    ksbonjson_decodeStatus status = ksbonjson_decode(document, documentSize, &ctx.callbacks, &ctx, &decodedOffset);
-    if(status != KSBONJSON_DECODE_OK)
+    bonjson_encode_context* out = new_bonjson_encode_context(documentSize*2);
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    if(!convertBonjsonToJson(&ctx, document, documentSize, prettyPrint, out, errorMessage))
     {
-        printError_exit("Failed to decode BONJSON file %s at offset %d: status %d (%s)",
-                        src_path,
-                        decodedOffset,
-                        status,
-                        ksbonjson_decodeStatusDescription(status));
+        printError_exit("%s: %s", src_path, errorMessage);
     }
+    free(document);
 
     file = openFileForWriting(dst_path);
-    const char* jsonDoc = json_object_to_json_string_ext(ctx.stack[0].obj, prettyPrint ? JSON_C_TO_STRING_PRETTY : JSON_C_TO_STRING_PLAIN);
-     writeToFile(file, (const uint8_t*)jsonDoc, strlen(jsonDoc));
+    writeToFile(file, out->buffer, out->pos);
     closeFile(file);
+    free_bonjson_encode_context(out);
 }
 
 
 // ============================================================================
-// Startup & command line args
+// Validation
 // ============================================================================
 
-#define QUOTE(str) #str
-#define EXPAND_AND_QUOTE(str) QUOTE(str)
+static ksbonjson_decodeStatus onIgnoredBoolean(bool value, void* userData)
+{
+    MARK_UNUSED(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
 
-static char* g_argv_0;
+static ksbonjson_decodeStatus onIgnoredInteger(int64_t value, void* userData)
+{
+    MARK_UNUSED(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
 
-static void print_usage(void)
+static ksbonjson_decodeStatus onIgnoredUInteger(uint64_t value, void* userData)
 {
-    printError("\
-Purpose:   Convert JSON <-> BONJSON.\n\
-Version:   %s\n\
-Copyright: (c) 2024 Karl Stenerud\n\
-License:   MIT, NO WARRANTIES IMPLIED\n\
-\n\
-Usage: %s [options]\n\
-Where the default behavior is to convert from stdin to stdout.\n\
-\n\
-Options:\n\
-  -h: Print help and exit\n\
-  -v: Print version and exit\n\
-  -i <path>: Input file (use - to specify stdin) (default stdin)\n\
-  -o <path>: Output file (use - to specify stdout) (default stdout)\n\
-  -b: Convert JSON to BONJSON (default)\n\
-  -j: Convert BONJSON to JSON\n\
-  -p: Pretty-print (if converting to JSON)\n\
-\n\
-", EXPAND_AND_QUOTE(PROJECT_VERSION), basename(g_argv_0));
+    MARK_UNUSED(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
 }
 
-static void print_usage_printError_exit(void)
+static ksbonjson_decodeStatus onIgnoredFloat(double value, void* userData)
 {
-    print_usage();
-    exit(1);
+    MARK_UNUSED(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
 }
 
-static void print_version(void)
+static ksbonjson_decodeStatus onIgnoredString(const char* KSBONJSON_RESTRICT value,
+                                              size_t length,
+                                              void* KSBONJSON_RESTRICT userData)
 {
-    printf("%s\n", EXPAND_AND_QUOTE(PROJECT_VERSION));
+    MARK_UNUSED(value);
+    MARK_UNUSED(length);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
 }
 
+static ksbonjson_decodeStatus onIgnoredEvent(void* userData)
+{
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
 
-// ============================================================================
-// Main
-// ============================================================================
+static const KSBONJSONDecodeCallbacks g_validationCallbacks =
+{
+    .onBoolean = onIgnoredBoolean,
+    .onInteger = onIgnoredInteger,
+    .onUInteger = onIgnoredUInteger,
+    .onFloat = onIgnoredFloat,
+    .onNull = onIgnoredEvent,
+    .onString = onIgnoredString,
+    .onBeginObject = onIgnoredEvent,
+    .onBeginArray = onIgnoredEvent,
+    .onEndContainer = onIgnoredEvent,
+    .onEndData = onIgnoredEvent,
+};
+
+/**
+ * Check that a BONJSON document is well-formed.
+ *
+ * @return true if it is. If not, errorMessage describes what went wrong.
+ */
+static bool validateBonjson(const uint8_t* const document, const size_t documentSize, char* const errorMessage)
+{
+    size_t decodedOffset = 0;
+    ksbonjson_decodeStatus status = ksbonjson_decode(document, documentSize, &g_validationCallbacks, NULL, &decodedOffset);
+    if(status != KSBONJSON_DECODE_OK)
+    {
+        snprintf(errorMessage, ERROR_MESSAGE_SIZE, "Invalid BONJSON at offset %zu: status %d (%s)",
+                 decodedOffset,
+                 status,
+                 ksbonjson_decodeStatusDescription(status));
+        return false;
+    }
+    return true;
+}
 
-int main(const int argc, char** const argv)
+static void validate(const char* const src_path)
 {
-    bool toJson = false;
-    bool prettyPrint = false;
+    FILE* file = openFileForReading(src_path);
+    size_t documentSize = 0;
+    uint8_t* document = readEntireFile(file, &documentSize);
+    closeFile(file);
+
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    if(!validateBonjson(document, documentSize, errorMessage))
+    {
+        printError_exit("%s: %s", src_path, errorMessage);
+    }
+    free(document);
+}
+
+
+// ============================================================================
+// Aggregation
+// ============================================================================
+
+/**
+ * Parse a comma-separated list of histogram bucket bounds.
+ *
+ * @return The bounds (which the caller must free).
+ */
+static double* parseBucketBounds(const char* const list, size_t* const boundCount)
+{
+    size_t count = 1;
+    for(const char* ch = list; *ch != 0; ch++)
+    {
+        count += *ch == ',';
+    }
+    double* bounds = malloc(count * sizeof(*bounds));
+    if(bounds == NULL)
+    {
+        printError_exit("Could not allocate memory for %zu bucket bounds", count);
+    }
+
+    const char* pos = list;
+    for(size_t i = 0; i < count; i++)
+    {
+        char* end = NULL;
+        bounds[i] = strtod(pos, &end);
+        if(end == pos || (*end != ',' && *end != 0) || (i > 0 && bounds[i] <= bounds[i - 1]))
+        {
+            printError_exit("Bucket bounds must be ascending numbers separated by commas: %s", list);
+        }
+        pos = end + 1;
+    }
+    *boundCount = count;
+    return bounds;
+}
+
+/**
+ * Print the count, sum, minimum, maximum (and histogram) of the numbers at
+ * each path, as one line of JSON per path.
+ */
+static void aggregate(const char* const src_path,
+                      const char* const dst_path,
+                      const char** const paths,
+                      const size_t pathCount,
+                      const double* const bucketBounds,
+                      const size_t bucketBoundCount)
+{
+    FILE* file = openFileForReading(src_path);
+    size_t documentSize = 0;
+    uint8_t* document = readEntireFile(file, &documentSize);
+    closeFile(file);
+
+    KSBONJSONAggregate aggregates[KSBONJSON_MAX_AGGREGATES];
+    uint64_t* bucketCounts = calloc(pathCount * (bucketBoundCount + 1), sizeof(*bucketCounts));
+    if(bucketCounts == NULL)
+    {
+        printError_exit("Could not allocate memory for the histograms");
+    }
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        aggregates[i] = (KSBONJSONAggregate)
+        {
+            .path = paths[i],
+            .pathLength = strlen(paths[i]),
+            .bucketBounds = bucketBounds,
+            .bucketBoundCount = bucketBoundCount,
+            .bucketCounts = bucketBounds == NULL ? NULL : bucketCounts + i * (bucketBoundCount + 1),
+        };
+    }
+
+    ksbonjson_documentStatus status = ksbonjson_aggregate(document, documentSize, aggregates, pathCount);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to aggregate: status %d (%s)",
+                        src_path,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+    free(document);
+
+    file = openFileForWriting(dst_path);
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        const KSBONJSONAggregate* const result = &aggregates[i];
+        json_object* obj = json_object_new_object();
+        json_object_object_add(obj, "path", json_object_new_string(result->path));
+        json_object_object_add(obj, "count", json_object_new_uint64(result->count));
+        json_object_object_add(obj, "other", json_object_new_uint64(result->otherCount));
+        json_object_object_add(obj, "sum", result->isIntegerSum
+                               ? json_object_new_int64(result->integerSum)
+                               : json_object_new_double(result->sum));
+        if(result->count > 0)
+        {
+            json_object_object_add(obj, "min", json_object_new_double(result->min));
+            json_object_object_add(obj, "max", json_object_new_double(result->max));
+        }
+        if(result->bucketCounts != NULL)
+        {
+            json_object* histogram = json_object_new_array();
+            for(size_t j = 0; j <= bucketBoundCount; j++)
+            {
+                json_object_array_add(histogram, json_object_new_uint64(result->bucketCounts[j]));
+            }
+            json_object_object_add(obj, "histogram", histogram);
+        }
+
+        size_t jsonLength = 0;
+        const char* json = json_object_to_json_string_length(obj, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &jsonLength);
+        writeToFile(file, (const uint8_t*)json, jsonLength);
+        writeToFile(file, (const uint8_t*)"\n", 1);
+        json_object_put(obj);
+    }
+    closeFile(file);
+    free(bucketCounts);
+}
+
+
+// ============================================================================
+// Record Logs
+// ============================================================================
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t length;
+} MappedFile;
+
+static MappedFile mapFile(const int fd, const char* const path)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        printPError_exit("Could not stat %s", path);
+    }
+    MappedFile mapped = {.data = NULL, .length = (size_t)st.st_size};
+    if(mapped.length > 0)
+    {
+        mapped.data = mmap(NULL, mapped.length, PROT_READ, MAP_SHARED, fd, 0);
+        if(mapped.data == MAP_FAILED)
+        {
+            printPError_exit("Could not map %s", path);
+        }
+        madvise((void*)mapped.data, mapped.length, MADV_SEQUENTIAL);
+    }
+    return mapped;
+}
+
+static void unmapFile(MappedFile* const mapped)
+{
+    if(mapped->data != NULL)
+    {
+        munmap((void*)mapped->data, mapped->length);
+        mapped->data = NULL;
+    }
+}
+
+static ksbonjson_recordStatus writeToLog(const uint8_t* KSBONJSON_RESTRICT data,
+                                         size_t dataLength,
+                                         void* KSBONJSON_RESTRICT userData)
+{
+    const int fd = *(int*)userData;
+    while(dataLength > 0)
+    {
+        const ssize_t written = write(fd, data, dataLength);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return KSBONJSON_RECORD_COULD_NOT_WRITE;
+        }
+        data += written;
+        dataLength -= (size_t)written;
+    }
+    return KSBONJSON_RECORD_OK;
+}
+
+static ksbonjson_recordStatus syncLog(void* userData)
+{
+    return fsync(*(int*)userData) == 0 ? KSBONJSON_RECORD_OK : KSBONJSON_RECORD_COULD_NOT_WRITE;
+}
+
+static void checkRecordStatus(const ksbonjson_recordStatus status, const char* const logPath)
+{
+    if(status != KSBONJSON_RECORD_OK)
+    {
+        printPError_exit("%s: Failed to append to log: status %d (%s)",
+                         logPath,
+                         status,
+                         ksbonjson_recordStatusDescription(status));
+    }
+}
+
+static void appendJsonValueToLog(json_object* const root,
+                                 bonjson_encode_context* const encoded,
+                                 KSBONJSONRecordWriter* const writer,
+                                 const char* const logPath)
+{
+    encoded->pos = 0;
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, encoded);
+    ksbonjson_encodeStatus status = parseJsonElement(root, &eContext);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&eContext);
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        printError_exit("Failed to convert JSON to BONJSON: status %d (%s)",
+                        status,
+                        ksbonjson_encodeStatusDescription(status));
+    }
+    json_object_put(root);
+    checkRecordStatus(ksbonjson_appendRecord(writer, encoded->buffer, encoded->pos,
+                                             (uint64_t)currentTimeMilliseconds()),
+                      logPath);
+}
+
+/**
+ * Append each JSON value in the input to a record log as its own BONJSON
+ * document. A damaged tail (from a crash during an earlier append) is cut off
+ * first. Records are synced together every flushIntervalMs, and when the input
+ * stalls, so that a slow producer's records don't sit in the buffer.
+ */
+static void appendJsonToLog(const char* const src_path, const char* const logPath, const StreamOptions* const options)
+{
+    const int fd = open(logPath, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+        printPError_exit("Could not open %s", logPath);
+    }
+
+    MappedFile mapped = mapFile(fd, logPath);
+    size_t validLength = 0;
+    const ksbonjson_recordStatus recoverStatus = ksbonjson_recoverRecordLog(mapped.data, mapped.length, &validLength, NULL);
+    if(recoverStatus != KSBONJSON_RECORD_END)
+    {
+        printError("%s: Discarding %zu damaged bytes at offset %zu (%s)\n",
+                   logPath,
+                   mapped.length - validLength,
+                   validLength,
+                   ksbonjson_recordStatusDescription(recoverStatus));
+        if(ftruncate(fd, (off_t)validLength) != 0)
+        {
+            printPError_exit("Could not truncate %s", logPath);
+        }
+    }
+    unmapFile(&mapped);
+    if(lseek(fd, (off_t)validLength, SEEK_SET) < 0)
+    {
+        printPError_exit("Could not seek in %s", logPath);
+    }
+
+    int userData = fd;
+    const size_t bufferSize = options->flushSize > 0 ? options->flushSize : 1;
+    uint8_t* recordBuffer = malloc(bufferSize);
+    KSBONJSONRecordWriter writer;
+    ksbonjson_beginRecordWriting(&writer, writeToLog, syncLog, &userData,
+                                 recordBuffer, bufferSize,
+                                 (uint64_t)options->flushIntervalMs,
+                                 (uint64_t)currentTimeMilliseconds());
+
+    FILE* src = openFileForReading(src_path);
+    json_tokener* tokener = json_tokener_new_ex(JSON_TOKENER_DEFAULT_DEPTH);
+    if(tokener == NULL)
+    {
+        printError_exit("Failed to build tokener");
+    }
+    bonjson_encode_context* encoded = new_bonjson_encode_context(STREAM_READ_SIZE);
+    uint8_t* buffer = malloc(STREAM_READ_SIZE);
+    bool isCommitPending = false;
+    for(;;)
+    {
+        if(isCommitPending && g_inputPrefix.pos == g_inputPrefix.length)
+        {
+            struct pollfd pfd = {.fd = fileno(src), .events = POLLIN};
+            int64_t waitMs = options->flushIntervalMs - (currentTimeMilliseconds() - (int64_t)writer.lastCommitTime);
+            if(waitMs < 0)
+            {
+                waitMs = 0;
+            }
+            if(poll(&pfd, 1, (int)waitMs) == 0)
+            {
+                checkRecordStatus(ksbonjson_commitRecords(&writer, (uint64_t)currentTimeMilliseconds()), logPath);
+                isCommitPending = false;
+            }
+        }
+
+        const size_t bytesRead = readInput(src, buffer, STREAM_READ_SIZE);
+        if(bytesRead == 0)
+        {
+            break;
+        }
+        const char* pos = (const char*)buffer;
+        size_t remaining = bytesRead;
+        while(remaining > 0)
+        {
+            json_object* root = json_tokener_parse_ex(tokener, pos, (int)remaining);
+            if(root == NULL)
+            {
+                enum json_tokener_error error = json_tokener_get_error(tokener);
+                if(error != json_tokener_continue)
+                {
+                    printError_exit("Failed to parse JSON: %s", json_tokener_error_desc(error));
+                }
+                break;
+            }
+            const size_t parsedLength = json_tokener_get_parse_end(tokener);
+            pos += parsedLength;
+            remaining -= parsedLength;
+            appendJsonValueToLog(root, encoded, &writer, logPath);
+            isCommitPending = true;
+        }
+    }
+
+    // A top-level number is only complete once json-c sees a delimiter.
+    json_object* root = json_tokener_parse_ex(tokener, "", 1);
+    if(root != NULL)
+    {
+        appendJsonValueToLog(root, encoded, &writer, logPath);
+    }
+    checkRecordStatus(ksbonjson_commitRecords(&writer, (uint64_t)currentTimeMilliseconds()), logPath);
+
+    json_tokener_free(tokener);
+    free_bonjson_encode_context(encoded);
+    free(buffer);
+    free(recordBuffer);
+    closeFile(src);
+    if(close(fd) != 0)
+    {
+        printPError_exit("Could not close %s", logPath);
+    }
+}
+
+/**
+ * Print each record in a log as a line of JSON. Records are verified and
+ * decoded straight from the mapped file. A damaged tail is reported and
+ * skipped.
+ */
+static void logToJson(const char* const logPath, const char* const dst_path, const bool prettyPrint)
+{
+    const int fd = open(logPath, O_RDONLY);
+    if(fd < 0)
+    {
+        printPError_exit("Could not open %s", logPath);
+    }
+    MappedFile mapped = mapFile(fd, logPath);
+    close(fd);
+
+    DecoderContext ctx;
+    init_decoder_context(&ctx);
+    bonjson_encode_context* out = new_bonjson_encode_context(STREAM_READ_SIZE);
+    FILE* file = openFileForWriting(dst_path);
+    char errorMessage[ERROR_MESSAGE_SIZE];
+
+    KSBONJSONRecordReader reader;
+    ksbonjson_beginRecordReading(&reader, mapped.data, mapped.length);
+    const uint8_t* record;
+    size_t recordLength;
+    ksbonjson_recordStatus status;
+    while((status = ksbonjson_readRecord(&reader, &record, &recordLength)) == KSBONJSON_RECORD_OK)
+    {
+        out->pos = 0;
+        if(!convertBonjsonToJson(&ctx, record, recordLength, prettyPrint, out, errorMessage))
+        {
+            printError_exit("%s: Record at offset %zu: %s",
+                            logPath,
+                            (size_t)(record - mapped.data) - KSBONJSON_RECORD_HEADER_SIZE,
+                            errorMessage);
+        }
+        appendToBuffer(out, "\n", 1);
+        writeToFile(file, out->buffer, out->pos);
+    }
+    if(status != KSBONJSON_RECORD_END)
+    {
+        printError("%s: Ignoring %zu damaged bytes at offset %zu (%s)\n",
+                   logPath,
+                   mapped.length - ksbonjson_getValidRecordLogLength(&reader),
+                   ksbonjson_getValidRecordLogLength(&reader),
+                   ksbonjson_recordStatusDescription(status));
+    }
+
+    closeFile(file);
+    reset_decoder_context(&ctx);
+    free_bonjson_encode_context(out);
+    unmapFile(&mapped);
+}
+
+
+// ============================================================================
+// Appending
+// ============================================================================
+
+static void writeAppendedData(const int fd, bonjson_encode_context* const encoded, const char* const path)
+{
+    int userData = fd;
+    if(writeToLog(encoded->buffer, encoded->pos, &userData) != KSBONJSON_RECORD_OK)
+    {
+        printPError_exit("Could not write to %s", path);
+    }
+    encoded->pos = 0;
+}
+
+/**
+ * Write a chunk of appended elements followed by the array's closing byte,
+ * so that the file is a complete array after every write even if a later
+ * element fails. The next chunk is written over the closing byte.
+ */
+static void writeAppendedElements(const int fd,
+                                  bonjson_encode_context* const encoded,
+                                  const uint8_t closingByte,
+                                  const char* const path)
+{
+    writeAppendedData(fd, encoded, path);
+    int userData = fd;
+    if(writeToLog(&closingByte, 1, &userData) != KSBONJSON_RECORD_OK)
+    {
+        printPError_exit("Could not write to %s", path);
+    }
+    if(lseek(fd, -1, SEEK_CUR) < 0)
+    {
+        printPError_exit("Could not seek in %s", path);
+    }
+}
+
+static void appendJsonValueToArray(json_object* const root, KSBONJSONEncodeContext* const eContext)
+{
+    const ksbonjson_encodeStatus status = parseJsonElement(root, eContext);
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        printError_exit("Failed to convert JSON to BONJSON: status %d (%s)",
+                        status,
+                        ksbonjson_encodeStatusDescription(status));
+    }
+    json_object_put(root);
+}
+
+/**
+ * Append each JSON value in the input to the top-level array of a BONJSON
+ * file. The new elements are written over the array's closing byte, followed
+ * by a new one, so the existing elements are never read or rewritten.
+ */
+static void appendJsonToArray(const char* const src_path, const char* const arrayPath)
+{
+    const int fd = open(arrayPath, O_RDWR);
+    if(fd < 0)
+    {
+        printPError_exit("Could not open %s", arrayPath);
+    }
+
+    MappedFile mapped = mapFile(fd, arrayPath);
+    bonjson_encode_context* encoded = new_bonjson_encode_context(STREAM_READ_SIZE);
+    KSBONJSONEncodeContext eContext;
+    size_t appendOffset = 0;
+    ksbonjson_encodeStatus status = ksbonjson_beginAppendingToArray(&eContext, addEncodedDataCallback, encoded,
+                                                                    mapped.data, mapped.length, &appendOffset);
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        printError_exit("%s: Can't append: status %d (%s)",
+                        arrayPath,
+                        status,
+                        ksbonjson_encodeStatusDescription(status));
+    }
+    const uint8_t closingByte = mapped.data[appendOffset];
+    unmapFile(&mapped);
+    if(lseek(fd, (off_t)appendOffset, SEEK_SET) < 0)
+    {
+        printPError_exit("Could not seek in %s", arrayPath);
+    }
+
+    FILE* src = openFileForReading(src_path);
+    json_tokener* tokener = json_tokener_new_ex(JSON_TOKENER_DEFAULT_DEPTH);
+    if(tokener == NULL)
+    {
+        printError_exit("Failed to build tokener");
+    }
+    uint8_t* buffer = malloc(STREAM_READ_SIZE);
+    size_t bytesRead;
+    while((bytesRead = readInput(src, buffer, STREAM_READ_SIZE)) > 0)
+    {
+        const char* pos = (const char*)buffer;
+        size_t remaining = bytesRead;
+        while(remaining > 0)
+        {
+            json_object* root = json_tokener_parse_ex(tokener, pos, (int)remaining);
+            if(root == NULL)
+            {
+                enum json_tokener_error error = json_tokener_get_error(tokener);
+                if(error != json_tokener_continue)
+                {
+                    printError_exit("Failed to parse JSON: %s", json_tokener_error_desc(error));
+                }
+                break;
+            }
+            const size_t parsedLength = json_tokener_get_parse_end(tokener);
+            pos += parsedLength;
+            remaining -= parsedLength;
+            appendJsonValueToArray(root, &eContext);
+        }
+        if(encoded->pos >= STREAM_READ_SIZE)
+        {
+            writeAppendedElements(fd, encoded, closingByte, arrayPath);
+        }
+    }
+
+    // A top-level number is only complete once json-c sees a delimiter.
+    json_object* root = json_tokener_parse_ex(tokener, "", 1);
+    if(root != NULL)
+    {
+        appendJsonValueToArray(root, &eContext);
+    }
+    status = ksbonjson_terminateDocument(&eContext);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&eContext);
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        printError_exit("%s: Failed to close the array: status %d (%s)",
+                        arrayPath,
+                        status,
+                        ksbonjson_encodeStatusDescription(status));
+    }
+    writeAppendedData(fd, encoded, arrayPath);
+
+    json_tokener_free(tokener);
+    free_bonjson_encode_context(encoded);
+    free(buffer);
+    closeFile(src);
+    if(fsync(fd) != 0 || close(fd) != 0)
+    {
+        printPError_exit("Could not close %s", arrayPath);
+    }
+}
+
+
+// ============================================================================
+// Indexes
+// ============================================================================
+
+static MappedFile mapFileAtPath(const char* const path)
+{
+    if(strcmp(path, "-") == 0)
+    {
+        printError_exit("Indexes need a file to read (use -i)");
+    }
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        printPError_exit("Could not open %s", path);
+    }
+    MappedFile mapped = mapFile(fd, path);
+    close(fd);
+    return mapped;
+}
+
+static ksbonjson_indexKind parseIndexKind(const char* const name)
+{
+    if(strcmp(name, "array") == 0)
+    {
+        return KSBONJSON_INDEX_ARRAY;
+    }
+    if(strcmp(name, "sequence") == 0)
+    {
+        return KSBONJSON_INDEX_SEQUENCE;
+    }
+    if(strcmp(name, "log") == 0)
+    {
+        return KSBONJSON_INDEX_RECORD_LOG;
+    }
+    printError_exit("Unknown index kind: %s (expected array, sequence or log)", name);
+    return KSBONJSON_INDEX_ARRAY;
+}
+
+static void buildIndex(const char* const src_path, const char* const indexPath, const KSBONJSONIndexOptions* const options)
+{
+    MappedFile mapped = mapFileAtPath(src_path);
+
+    // Usually enough on the first try, and otherwise we're told the exact size.
+    size_t indexSize = mapped.length / 64 + KSBONJSON_INDEX_HEADER_SIZE + options->keyPathLength;
+    uint8_t* index = malloc(indexSize);
+    size_t indexLength = 0;
+    ksbonjson_documentStatus status = ksbonjson_buildIndex(mapped.data, mapped.length, options, index, indexSize, &indexLength);
+    if(status == KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL)
+    {
+        free(index);
+        indexSize = indexLength;
+        index = malloc(indexSize);
+        status = ksbonjson_buildIndex(mapped.data, mapped.length, options, index, indexSize, &indexLength);
+    }
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to build index: status %d (%s)",
+                        src_path,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+    unmapFile(&mapped);
+
+    FILE* const file = fopen(indexPath, "wb");
+    if(file == NULL)
+    {
+        printPError_exit("Could not open %s", indexPath);
+    }
+    writeToFile(file, index, indexLength);
+    closeFile(file);
+    free(index);
+}
+
+/**
+ * Map a document and its sidecar index, and open the index.
+ */
+static void openIndexAtPath(const char* const src_path,
+                            const char* const indexPath,
+                            MappedFile* const document,
+                            MappedFile* const indexData,
+                            KSBONJSONIndex* const index)
+{
+    *document = mapFileAtPath(src_path);
+    *indexData = mapFileAtPath(indexPath);
+    const ksbonjson_documentStatus status = ksbonjson_openIndex(index, indexData->data, indexData->length,
+                                                                document->data, document->length);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to open index: status %d (%s)",
+                        indexPath,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+}
+
+/**
+ * Print one element of a document as JSON, found with its sidecar index.
+ */
+static void lookUpIndexedElement(const char* const src_path,
+                                 const char* const dst_path,
+                                 const char* const indexPath,
+                                 const char* const elementIndex,
+                                 const char* const key,
+                                 const bool prettyPrint)
+{
+    MappedFile document;
+    MappedFile indexData;
+    KSBONJSONIndex index;
+    openIndexAtPath(src_path, indexPath, &document, &indexData, &index);
+
+    ksbonjson_documentStatus status;
+    const uint8_t* value = NULL;
+    size_t valueLength = 0;
+    char* numberEnd = NULL;
+    if(elementIndex != NULL)
+    {
+        const uint64_t position = strtoull(elementIndex, &numberEnd, 10);
+        if(*elementIndex == '\0' || *numberEnd != '\0')
+        {
+            printError_exit("Not an element index: %s", elementIndex);
+        }
+        status = ksbonjson_findIndexedElement(&index, position, &value, &valueLength);
+    }
+    else
+    {
+        // A key that looks like an integer could be either.
+        errno = 0;
+        const int64_t integerKey = strtoll(key, &numberEnd, 10);
+        status = KSBONJSON_DOCUMENT_NOT_FOUND;
+        if(*key != '\0' && *numberEnd == '\0' && errno == 0)
+        {
+            status = ksbonjson_findIndexedInteger(&index, integerKey, &value, &valueLength);
+        }
+        if(status == KSBONJSON_DOCUMENT_NOT_FOUND)
+        {
+            status = ksbonjson_findIndexedString(&index, key, strlen(key), &value, &valueLength);
+        }
+    }
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to find %s: status %d (%s)",
+                        src_path,
+                        elementIndex != NULL ? elementIndex : key,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+
+    DecoderContext ctx;
+    init_decoder_context(&ctx);
+    bonjson_encode_context* out = new_bonjson_encode_context(valueLength * 2 + 1);
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    if(!convertBonjsonToJson(&ctx, value, valueLength, prettyPrint, out, errorMessage))
+    {
+        printError_exit("%s: %s", src_path, errorMessage);
+    }
+    appendToBuffer(out, "\n", 1);
+    FILE* const file = openFileForWriting(dst_path);
+    writeToFile(file, out->buffer, out->pos);
+    closeFile(file);
+
+    reset_decoder_context(&ctx);
+    free_bonjson_encode_context(out);
+    unmapFile(&indexData);
+    unmapFile(&document);
+}
+
+
+// ============================================================================
+// Zone Maps
+// ============================================================================
+
+/**
+ * A --range or --equals condition, as given on the command line.
+ */
+typedef struct
+{
+    const char* spec;
+    bool isRange;
+} PredicateSpec;
+
+typedef struct
+{
+    const char* src_path;
+    DecoderContext ctx;
+    bonjson_encode_context* out;
+    FILE* file;
+    bool prettyPrint;
+} ZoneMapScan;
+
+static void buildZoneMap(const char* const src_path,
+                         const char* const indexPath,
+                         const char* const zoneMapPath,
+                         const char* const* const paths,
+                         const size_t pathCount)
+{
+    MappedFile document;
+    MappedFile indexData;
+    KSBONJSONIndex index;
+    openIndexAtPath(src_path, indexPath, &document, &indexData, &index);
+
+    size_t pathLengths[KSBONJSON_MAX_ZONE_PATHS];
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        pathLengths[i] = strlen(paths[i]);
+    }
+    // A byte per element in a block keeps false positives to about 2%.
+    const KSBONJSONZoneMapOptions options = {paths, pathLengths, pathCount, (size_t)index.stride};
+    const size_t zoneMapSize = ksbonjson_zoneMapSize(&index, &options);
+    uint8_t* const zoneMap = malloc(zoneMapSize);
+    const ksbonjson_documentStatus status = ksbonjson_buildZoneMap(&index, &options, zoneMap, zoneMapSize);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to build zone map: status %d (%s)",
+                        src_path,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+    unmapFile(&indexData);
+    unmapFile(&document);
+
+    FILE* const file = fopen(zoneMapPath, "wb");
+    if(file == NULL)
+    {
+        printPError_exit("Could not open %s", zoneMapPath);
+    }
+    writeToFile(file, zoneMap, zoneMapSize);
+    closeFile(file);
+    free(zoneMap);
+}
+
+/**
+ * Parse "<path>=<min>,<max>" or "<path>=<string>" into a predicate on one of
+ * the zone map's paths.
+ */
+static KSBONJSONPredicate parsePredicate(const KSBONJSONZoneMap* const zoneMap, const PredicateSpec* const spec)
+{
+    const char* const separator = strchr(spec->spec, '=');
+    if(separator == NULL)
+    {
+        printError_exit("Expected <path>=<value>: %s", spec->spec);
+    }
+    const size_t pathLength = (size_t)(separator - spec->spec);
+    KSBONJSONPredicate predicate = {.pathIndex = zoneMap->pathCount};
+    for(size_t i = 0; i < zoneMap->pathCount; i++)
+    {
+        if(zoneMap->pathLengths[i] == pathLength && memcmp(zoneMap->paths[i], spec->spec, pathLength) == 0)
+        {
+            predicate.pathIndex = i;
+        }
+    }
+    if(predicate.pathIndex == zoneMap->pathCount)
+    {
+        printError_exit("The zone map doesn't have the path %.*s", (int)pathLength, spec->spec);
+    }
+
+    const char* const value = separator + 1;
+    if(!spec->isRange)
+    {
+        predicate.string = value;
+        predicate.stringLength = strlen(value);
+        return predicate;
+    }
+    char* end = NULL;
+    predicate.min = strtod(value, &end);
+    if(end == value || *end != ',')
+    {
+        printError_exit("Expected <path>=<min>,<max>: %s", spec->spec);
+    }
+    const char* const maxStart = end + 1;
+    predicate.max = strtod(maxStart, &end);
+    if(end == maxStart || *end != '\0')
+    {
+        printError_exit("Expected <path>=<min>,<max>: %s", spec->spec);
+    }
+    return predicate;
+}
+
+static ksbonjson_documentStatus onZoneMapMatch(const uint8_t* const value,
+                                               const size_t valueLength,
+                                               const uint64_t elementIndex,
+                                               void* const userData)
+{
+    ZoneMapScan* const scan = (ZoneMapScan*)userData;
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    scan->out->pos = 0;
+    if(!convertBonjsonToJson(&scan->ctx, value, valueLength, scan->prettyPrint, scan->out, errorMessage))
+    {
+        printError_exit("%s: Element %" PRIu64 ": %s", scan->src_path, elementIndex, errorMessage);
+    }
+    appendToBuffer(scan->out, "\n", 1);
+    writeToFile(scan->file, scan->out->buffer, scan->out->pos);
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Print each element that matches all of the predicates as a line of JSON,
+ * skipping the blocks of elements that the zone map rules out.
+ */
+static void scanZoneMap(const char* const src_path,
+                        const char* const dst_path,
+                        const char* const indexPath,
+                        const char* const zoneMapPath,
+                        const PredicateSpec* const specs,
+                        const size_t specCount,
+                        const bool prettyPrint)
+{
+    MappedFile document;
+    MappedFile indexData;
+    KSBONJSONIndex index;
+    openIndexAtPath(src_path, indexPath, &document, &indexData, &index);
+    MappedFile zoneMapData = mapFileAtPath(zoneMapPath);
+    KSBONJSONZoneMap zoneMap;
+    ksbonjson_documentStatus status = ksbonjson_openZoneMap(&zoneMap, zoneMapData.data, zoneMapData.length, &index);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to open zone map: status %d (%s)",
+                        zoneMapPath,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+
+    KSBONJSONPredicate predicates[KSBONJSON_MAX_ZONE_PATHS * 2];
+    for(size_t i = 0; i < specCount; i++)
+    {
+        predicates[i] = parsePredicate(&zoneMap, &specs[i]);
+    }
+
+    ZoneMapScan scan =
+    {
+        .src_path = src_path,
+        .out = new_bonjson_encode_context(STREAM_READ_SIZE),
+        .file = openFileForWriting(dst_path),
+        .prettyPrint = prettyPrint,
+    };
+    init_decoder_context(&scan.ctx);
+    status = ksbonjson_scanZoneMap(&zoneMap, predicates, specCount, onZoneMapMatch, &scan, NULL);
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to scan: status %d (%s)",
+                        src_path,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+
+    closeFile(scan.file);
+    reset_decoder_context(&scan.ctx);
+    free_bonjson_encode_context(scan.out);
+    unmapFile(&zoneMapData);
+    unmapFile(&indexData);
+    unmapFile(&document);
+}
+
+
+// ============================================================================
+// Shards
+// ============================================================================
+
+// Shards are copied in pieces of this size, so that a few big shards still
+// keep every thread busy.
+#define SHARD_COPY_SIZE (16 * 1024 * 1024)
+
+/**
+ * Bytes to copy from a mapped file to an offset in an output file.
+ */
+typedef struct
+{
+    int fd;
+    off_t offset;
+    const uint8_t* data;
+    size_t length;
+    const char* path;
+} ShardCopy;
+
+typedef struct
+{
+    ShardCopy* copies;
+    size_t copyCount;
+    size_t nextCopy;
+    pthread_mutex_t mutex;
+} ShardCopier;
+
+static void writeAtOffset(const int fd, const uint8_t* data, size_t length, off_t offset, const char* const path)
+{
+    while(length > 0)
+    {
+        const ssize_t written = pwrite(fd, data, length, offset);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            printPError_exit("Could not write to %s", path);
+        }
+        data += written;
+        length -= (size_t)written;
+        offset += written;
+    }
+}
+
+static void addShardCopies(ShardCopier* const copier, const int fd, off_t offset,
+                           const uint8_t* data, size_t length, const char* const path)
+{
+    while(length > 0)
+    {
+        const size_t pieceLength = length < SHARD_COPY_SIZE ? length : SHARD_COPY_SIZE;
+        copier->copies = realloc(copier->copies, (copier->copyCount + 1) * sizeof(*copier->copies));
+        copier->copies[copier->copyCount++] = (ShardCopy){fd, offset, data, pieceLength, path};
+        offset += (off_t)pieceLength;
+        data += pieceLength;
+        length -= pieceLength;
+    }
+}
+
+static void* shardCopyThread(void* const userData)
+{
+    ShardCopier* const copier = (ShardCopier*)userData;
+    for(;;)
+    {
+        pthread_mutex_lock(&copier->mutex);
+        const size_t index = copier->nextCopy++;
+        pthread_mutex_unlock(&copier->mutex);
+        if(index >= copier->copyCount)
+        {
+            return NULL;
+        }
+        const ShardCopy* const copy = &copier->copies[index];
+        writeAtOffset(copy->fd, copy->data, copy->length, copy->offset, copy->path);
+    }
+}
+
+/**
+ * Do all of the copies, with a thread per CPU.
+ */
+static void runShardCopies(ShardCopier* const copier)
+{
+    long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if(threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    if((size_t)threadCount > copier->copyCount)
+    {
+        threadCount = (long)copier->copyCount;
+    }
+
+    pthread_mutex_init(&copier->mutex, NULL);
+    pthread_t* const threads = malloc((size_t)threadCount * sizeof(*threads));
+    for(long i = 0; i < threadCount; i++)
+    {
+        const int result = pthread_create(&threads[i], NULL, shardCopyThread, copier);
+        if(result != 0)
+        {
+            printError_exit("Could not start copying thread: %s", strerror(result));
+        }
+    }
+    for(long i = 0; i < threadCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&copier->mutex);
+    free(threads);
+    free(copier->copies);
+}
+
+static int createShardFile(const char* const path)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        printPError_exit("Could not open %s", path);
+    }
+    return fd;
+}
+
+/**
+ * Split the input's top-level array into files named <prefix>.0 to
+ * <prefix>.<n-1>, each an array holding a run of the elements. The elements
+ * are copied as they are, without being decoded.
+ */
+static void splitArray(const char* const src_path,
+                       const char* const dst_prefix,
+                       const char* const indexPath,
+                       const size_t shardCount)
+{
+    if(strcmp(dst_prefix, "-") == 0)
+    {
+        printError_exit("--split needs a prefix for the files to write (use -o)");
+    }
+
+    MappedFile document;
+    MappedFile indexData = {NULL, 0};
+    KSBONJSONShard* const shards = malloc(shardCount * sizeof(*shards));
+    ksbonjson_documentStatus status;
+    if(indexPath != NULL)
+    {
+        KSBONJSONIndex index;
+        openIndexAtPath(src_path, indexPath, &document, &indexData, &index);
+        status = ksbonjson_splitIndexedArray(&index, shardCount, shards);
+    }
+    else
+    {
+        document = mapFileAtPath(src_path);
+        status = ksbonjson_splitArray(document.data, document.length, shardCount, shards);
+    }
+    if(status != KSBONJSON_DOCUMENT_OK)
+    {
+        printError_exit("%s: Failed to split: status %d (%s)",
+                        src_path,
+                        status,
+                        ksbonjson_documentStatusDescription(status));
+    }
+
+    // Each shard keeps the document's own opening and closing bytes.
+    ShardCopier copier = {0};
+    int* const fds = malloc(shardCount * sizeof(*fds));
+    char** const paths = malloc(shardCount * sizeof(*paths));
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        const size_t pathSize = strlen(dst_prefix) + 24;
+        paths[i] = malloc(pathSize);
+        snprintf(paths[i], pathSize, "%s.%zu", dst_prefix, i);
+        fds[i] = createShardFile(paths[i]);
+        writeAtOffset(fds[i], document.data, 1, 0, paths[i]);
+        writeAtOffset(fds[i], document.data + document.length - 1, 1, (off_t)shards[i].length + 1, paths[i]);
+        addShardCopies(&copier, fds[i], 1, document.data + shards[i].offset, shards[i].length, paths[i]);
+    }
+    runShardCopies(&copier);
+
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        if(close(fds[i]) != 0)
+        {
+            printPError_exit("Could not close %s", paths[i]);
+        }
+        free(paths[i]);
+    }
+    free(paths);
+    free(fds);
+    free(shards);
+    unmapFile(&indexData);
+    unmapFile(&document);
+}
+
+/**
+ * Merge arrays (such as the files written by --split) into one array, by
+ * concatenating their elements without decoding them.
+ */
+static void mergeArrays(char* const* const shardPaths, const size_t shardCount, const char* const dst_path)
+{
+    if(shardCount == 0)
+    {
+        printError_exit("--merge needs the files to merge");
+    }
+    if(strcmp(dst_path, "-") == 0)
+    {
+        printError_exit("--merge needs a file to write (use -o)");
+    }
+
+    MappedFile* const mapped = malloc(shardCount * sizeof(*mapped));
+    KSBONJSONShard* const shards = malloc(shardCount * sizeof(*shards));
+    size_t mergedLength = 2;
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        mapped[i] = mapFileAtPath(shardPaths[i]);
+        const ksbonjson_documentStatus status = ksbonjson_getArrayElements(mapped[i].data, mapped[i].length, &shards[i]);
+        if(status != KSBONJSON_DOCUMENT_OK)
+        {
+            printError_exit("%s: Can't merge: status %d (%s)",
+                            shardPaths[i],
+                            status,
+                            ksbonjson_documentStatusDescription(status));
+        }
+        mergedLength += shards[i].length;
+    }
+
+    const int fd = createShardFile(dst_path);
+    if(ftruncate(fd, (off_t)mergedLength) != 0)
+    {
+        printPError_exit("Could not resize %s", dst_path);
+    }
+    writeAtOffset(fd, mapped[0].data, 1, 0, dst_path);
+    writeAtOffset(fd, mapped[0].data + mapped[0].length - 1, 1, (off_t)mergedLength - 1, dst_path);
+    ShardCopier copier = {0};
+    off_t offset = 1;
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        addShardCopies(&copier, fd, offset, mapped[i].data + shards[i].offset, shards[i].length, dst_path);
+        offset += (off_t)shards[i].length;
+    }
+    runShardCopies(&copier);
+
+    if(close(fd) != 0)
+    {
+        printPError_exit("Could not close %s", dst_path);
+    }
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        unmapFile(&mapped[i]);
+    }
+    free(shards);
+    free(mapped);
+}
+
+
+// Streams JSON text directly from decoder callbacks, formatted the same way json-c would.
+
+typedef struct
+{
+    bool isObject;
+    bool isExpectingName;
+    bool hasChildren;
+} JsonWriterFrame;
+
+typedef struct
+{
+    KSBONJSONDecodeCallbacks callbacks;
+    OutputStream* out;
+    bool prettyPrint;
+    int depth;
+    JsonWriterFrame frames[KSBONJSON_MAX_CONTAINER_DEPTH + 1];
+} JsonWriterContext;
+
+static void writeJsonIndent(JsonWriterContext* const ctx, const int level)
+{
+    static const char spaces[] = "                                ";
+    writeToOutputStream(ctx->out, "\n", 1);
+    for(int remaining = level * 2; remaining > 0; remaining -= sizeof(spaces) - 1)
+    {
+        writeToOutputStream(ctx->out, spaces, remaining < (int)sizeof(spaces) - 1 ? (size_t)remaining : sizeof(spaces) - 1);
+    }
+}
+
+/**
+ * Write whatever must come before the next value (or object member name).
+ *
+ * @return true if the next string is an object member name.
+ */
+static bool beginJsonValue(JsonWriterContext* const ctx)
+{
+    JsonWriterFrame* const frame = &ctx->frames[ctx->depth];
+    if(ctx->depth == 0 || (frame->isObject && !frame->isExpectingName))
+    {
+        frame->isExpectingName = frame->isObject;
+        return false;
+    }
+    if(frame->hasChildren)
+    {
+        writeToOutputStream(ctx->out, ",", 1);
+    }
+    if(ctx->prettyPrint)
+    {
+        writeJsonIndent(ctx, ctx->depth);
+    }
+    frame->hasChildren = true;
+    if(frame->isObject)
+    {
+        frame->isExpectingName = false;
+        return true;
+    }
+    return false;
+}
+
+static void endJsonValue(JsonWriterContext* const ctx)
+{
+    if(ctx->depth == 0)
+    {
+        // Top-level values are newline-separated
+        writeToOutputStream(ctx->out, "\n", 1);
+    }
+}
+
+static void writeJsonScalar(JsonWriterContext* const ctx, const char* const text, const size_t length)
+{
+    beginJsonValue(ctx);
+    writeToOutputStream(ctx->out, text, length);
+    endJsonValue(ctx);
+}
+
+static void writeJsonString(JsonWriterContext* const ctx, const char* const value, const size_t length)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    OutputStream* const out = ctx->out;
+    size_t runStart = 0;
+
+    writeToOutputStream(out, "\"", 1);
+    for(size_t i = 0; i < length; i++)
+    {
+        const uint8_t ch = (uint8_t)value[i];
+        char escaped[6] = {'\\', 0};
+        size_t escapedLength = 2;
+        switch(ch)
+        {
+            case '"': escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '/': escaped[1] = '/'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                if(ch >= ' ')
+                {
+                    continue;
+                }
+                memcpy(escaped, "\\u00", 4);
+                escaped[4] = hexDigits[ch >> 4];
+                escaped[5] = hexDigits[ch & 15];
+                escapedLength = 6;
+                break;
+        }
+        writeToOutputStream(out, value + runStart, i - runStart);
+        writeToOutputStream(out, escaped, escapedLength);
+        runStart = i + 1;
+    }
+    writeToOutputStream(out, value + runStart, length - runStart);
+    writeToOutputStream(out, "\"", 1);
+}
+
+static ksbonjson_decodeStatus onStreamBoolean(bool value, void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    if(value)
+    {
+        writeJsonScalar(ctx, "true", 4);
+    }
+    else
+    {
+        writeJsonScalar(ctx, "false", 5);
+    }
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamInteger(int64_t value, void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+    writeJsonScalar(ctx, buffer, length);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamUInteger(uint64_t value, void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+    writeJsonScalar(ctx, buffer, length);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamFloat(double value, void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    char buffer[40];
+    int length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    if(strpbrk(buffer, ".e") == NULL)
+    {
+        // Keep it a float, like json-c does
+        memcpy(buffer + length, ".0", 3);
+        length += 2;
+    }
+    writeJsonScalar(ctx, buffer, length);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamNull(void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    writeJsonScalar(ctx, "null", 4);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamString(const char* KSBONJSON_RESTRICT value,
+                                             size_t length,
+                                             void* KSBONJSON_RESTRICT userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    const bool isName = beginJsonValue(ctx);
+    writeJsonString(ctx, value, length);
+    if(isName)
+    {
+        writeToOutputStream(ctx->out, ":", 1);
+    }
+    else
+    {
+        endJsonValue(ctx);
+    }
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus beginStreamContainer(JsonWriterContext* ctx, bool isObject)
+{
+    beginJsonValue(ctx);
+    writeToOutputStream(ctx->out, isObject ? "{" : "[", 1);
+    ctx->depth++;
+    ctx->frames[ctx->depth] = (JsonWriterFrame)
+    {
+        .isObject = isObject,
+        .isExpectingName = isObject,
+    };
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onStreamBeginObject(void* userData)
+{
+    return beginStreamContainer((JsonWriterContext*)userData, true);
+}
+
+static ksbonjson_decodeStatus onStreamBeginArray(void* userData)
+{
+    return beginStreamContainer((JsonWriterContext*)userData, false);
+}
+
+static ksbonjson_decodeStatus onStreamEndContainer(void* userData)
+{
+    JsonWriterContext* ctx = (JsonWriterContext*)userData;
+    const bool isObject = ctx->frames[ctx->depth].isObject;
+    ctx->depth--;
+    if(ctx->prettyPrint)
+    {
+        writeJsonIndent(ctx, ctx->depth);
+    }
+    writeToOutputStream(ctx->out, isObject ? "}" : "]", 1);
+    endJsonValue(ctx);
+    return KSBONJSON_DECODE_OK;
+}
+
+static void init_json_writer_context(JsonWriterContext* ctx, OutputStream* out, bool prettyPrint)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->out = out;
+    ctx->prettyPrint = prettyPrint;
+    ctx->callbacks.onBeginArray = onStreamBeginArray;
+    ctx->callbacks.onBeginObject = onStreamBeginObject;
+    ctx->callbacks.onBoolean = onStreamBoolean;
+    ctx->callbacks.onEndContainer = onStreamEndContainer;
+    ctx->callbacks.onEndData = onEndData;
+    ctx->callbacks.onFloat = onStreamFloat;
+    ctx->callbacks.onInteger = onStreamInteger;
+    ctx->callbacks.onNull = onStreamNull;
+    ctx->callbacks.onString = onStreamString;
+    ctx->callbacks.onUInteger = onStreamUInteger;
+}
+
+/**
+ * Convert BONJSON to JSON as the data arrives. Each top-level value becomes one line
+ * of JSON. Memory use is bounded by the size of the largest scalar value.
+ */
+static void bonjsonToJsonStream(const char* const src_path,
+                                const char* const dst_path,
+                                const bool prettyPrint,
+                                const StreamOptions* const options)
+{
+    FILE* src = openFileForReading(src_path);
+    OutputStream out;
+    initOutputStream(&out, openFileForWriting(dst_path), options);
+
+    JsonWriterContext ctx;
+    init_json_writer_context(&ctx, &out, prettyPrint);
+    KSBONJSONDecodeContext dContext;
+    ksbonjson_beginDecode(&dContext, &ctx.callbacks, &ctx);
+
+    size_t bufferSize = STREAM_READ_SIZE * 2;
+    uint8_t* buffer = malloc(bufferSize);
+    size_t pendingLength = 0;
+    size_t totalConsumed = 0;
+    for(;;)
+    {
+        if(bufferSize - pendingLength < STREAM_READ_SIZE)
+        {
+            // The current value is bigger than our buffer
+            if(bufferSize >= MAX_STREAM_VALUE_SIZE)
+            {
+                printError_exit("BONJSON value at offset %zu exceeds max streaming value size of %d",
+                                totalConsumed, MAX_STREAM_VALUE_SIZE);
+            }
+            bufferSize *= 2;
+            buffer = realloc(buffer, bufferSize);
+        }
+
+        const size_t bytesRead = readFromInputStream(src, buffer + pendingLength, bufferSize - pendingLength, &out);
+        if(bytesRead == 0)
+        {
+            break;
+        }
+        pendingLength += bytesRead;
+
+        size_t consumed = 0;
+        ksbonjson_decodeStatus status = ksbonjson_decodeChunk(&dContext, buffer, pendingLength, &consumed);
+        if(status != KSBONJSON_DECODE_OK)
+        {
+            printError_exit("Failed to decode BONJSON stream %s at offset %zu: status %d (%s)",
+                            src_path,
+                            totalConsumed + consumed,
+                            status,
+                            ksbonjson_decodeStatusDescription(status));
+        }
+        memmove(buffer, buffer + consumed, pendingLength - consumed);
+        pendingLength -= consumed;
+        totalConsumed += consumed;
+    }
+
+    ksbonjson_decodeStatus status = pendingLength > 0 ? KSBONJSON_DECODE_INCOMPLETE : ksbonjson_endDecode(&dContext);
+    if(status != KSBONJSON_DECODE_OK)
+    {
+        printError_exit("Failed to decode BONJSON stream %s at offset %zu: status %d (%s)",
+                        src_path,
+                        totalConsumed,
+                        status,
+                        ksbonjson_decodeStatusDescription(status));
+    }
+
+    free(buffer);
+    closeFile(src);
+    closeOutputStream(&out);
+    closeFile(out.file);
+}
+
+
+// ============================================================================
+// Conversion Server
+// ============================================================================
+
+// A long-running process that converts documents sent to it over a Unix socket,
+// which avoids paying process startup costs for every conversion.
+//
+// Wire protocol (integers are little endian):
+//   Request:  [u8 command] [u8 flags] [u64 length] [document]
+//   Response: [u8 status]             [u64 length] [converted document or error message]
+//
+// A connection may carry any number of requests, but it's closed if it goes
+// SERVER_TIMEOUT_SEC without any data arriving. A request that's too large gets
+// an error response, and then the connection is closed.
+
+enum
+{
+    SERVER_COMMAND_TO_BONJSON = 'b',
+    SERVER_COMMAND_TO_JSON = 'j',
+    SERVER_COMMAND_VALIDATE = 'v',
+};
+
+enum
+{
+    SERVER_FLAG_PRETTY_PRINT = 1,
+};
+
+enum
+{
+    SERVER_STATUS_OK = 0,
+    SERVER_STATUS_ERROR = 1,
+};
+
+#define SERVER_REQUEST_HEADER_SIZE 10
+#define SERVER_RESPONSE_HEADER_SIZE 9
+
+typedef struct
+{
+    json_tokener* tokener;
+    DecoderContext decoder;
+    bonjson_encode_context* request;
+    bonjson_encode_context* response;
+} ConversionServer;
+
+static void encodeUInt64LE(uint8_t* const dst, uint64_t value)
+{
+    for(int i = 0; i < 8; i++)
+    {
+        dst[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static uint64_t decodeUInt64LE(const uint8_t* const src)
+{
+    uint64_t value = 0;
+    for(int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+/**
+ * Read exactly length bytes from a socket.
+ *
+ * @return false if the peer closed the connection or an error occurred.
+ */
+static bool readFromSocket(const int fd, uint8_t* buffer, size_t length)
+{
+    while(length > 0)
+    {
+        const ssize_t bytesRead = read(fd, buffer, length);
+        if(bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytesRead <= 0)
+        {
+            return false;
+        }
+        buffer += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+/**
+ * Write exactly length bytes to a socket.
+ *
+ * @return false if the peer closed the connection or an error occurred.
+ */
+static bool writeToSocket(const int fd, const uint8_t* data, size_t length)
+{
+    while(length > 0)
+    {
+        const ssize_t bytesWritten = write(fd, data, length);
+        if(bytesWritten < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytesWritten <= 0)
+        {
+            return false;
+        }
+        data += bytesWritten;
+        length -= bytesWritten;
+    }
+    return true;
+}
+
+static struct sockaddr_un makeSocketAddress(const char* const socketPath)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if(strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        printError_exit("Socket path is too long: %s", socketPath);
+    }
+    strcpy(address.sun_path, socketPath);
+    return address;
+}
+
+static uint8_t handleServerRequest(ConversionServer* const server,
+                                   const uint8_t command,
+                                   const uint8_t flags,
+                                   const uint8_t* const document,
+                                   const size_t documentSize)
+{
+    bonjson_encode_context* const response = server->response;
+    char errorMessage[ERROR_MESSAGE_SIZE];
+    bool success;
+    response->pos = 0;
+
+    switch(command)
+    {
+        case SERVER_COMMAND_TO_BONJSON:
+            success = convertJsonToBonjson(server->tokener, document, documentSize, response, errorMessage);
+            break;
+        case SERVER_COMMAND_TO_JSON:
+            success = convertBonjsonToJson(&server->decoder,
+                                           document,
+                                           documentSize,
+                                           (flags & SERVER_FLAG_PRETTY_PRINT) != 0,
+                                           response,
+                                           errorMessage);
+            break;
+        case SERVER_COMMAND_VALIDATE:
+            success = validateBonjson(document, documentSize, errorMessage);
+            break;
+        default:
+            snprintf(errorMessage, ERROR_MESSAGE_SIZE, "Unknown command 0x%02x", command);
+            success = false;
+            break;
+    }
+
+    if(!success)
+    {
+        response->pos = 0;
+        appendToBuffer(response, errorMessage, strlen(errorMessage));
+        return SERVER_STATUS_ERROR;
+    }
+    return SERVER_STATUS_OK;
+}
+
+/**
+ * Send the server's response buffer to a client.
+ *
+ * @return false if the peer closed the connection or an error occurred.
+ */
+static bool sendServerResponse(ConversionServer* const server, const int fd, const uint8_t status)
+{
+    uint8_t responseHeader[SERVER_RESPONSE_HEADER_SIZE];
+    responseHeader[0] = status;
+    encodeUInt64LE(responseHeader + 1, server->response->pos);
+    return writeToSocket(fd, responseHeader, sizeof(responseHeader)) &&
+           writeToSocket(fd, server->response->buffer, server->response->pos);
+}
+
+static void serveConnection(ConversionServer* const server, const int fd)
+{
+    const struct timeval timeout = {.tv_sec = SERVER_TIMEOUT_SEC};
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+       setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        printError("Could not set connection timeout: %s\n", strerror(errno));
+        return;
+    }
+
+    uint8_t header[SERVER_REQUEST_HEADER_SIZE];
+    while(readFromSocket(fd, header, sizeof(header)))
+    {
+        const uint64_t documentSize = decodeUInt64LE(header + 2);
+        if(documentSize > MAX_FILE_SIZE)
+        {
+            printError("Rejected request of %" PRIu64 " bytes\n", documentSize);
+            // The document isn't read, so the connection can't carry on after this.
+            char errorMessage[ERROR_MESSAGE_SIZE];
+            snprintf(errorMessage, sizeof(errorMessage),
+                     "Request of %" PRIu64 " bytes is larger than the limit of %" PRIu64 " bytes",
+                     documentSize, (uint64_t)MAX_FILE_SIZE);
+            server->response->pos = 0;
+            appendToBuffer(server->response, errorMessage, strlen(errorMessage));
+            sendServerResponse(server, fd, SERVER_STATUS_ERROR);
+            return;
+        }
+
+        bonjson_encode_context* const request = server->request;
+        if(documentSize > request->size)
+        {
+            request->buffer = realloc(request->buffer, documentSize);
+            if(request->buffer == NULL)
+            {
+                printError_exit("Could not grow buffer to %" PRIu64 " bytes", documentSize);
+            }
+            request->size = documentSize;
+        }
+        if(!readFromSocket(fd, request->buffer, documentSize))
+        {
+            return;
+        }
+
+        const uint8_t status = handleServerRequest(server, header[0], header[1], request->buffer, documentSize);
+        if(!sendServerResponse(server, fd, status))
+        {
+            return;
+        }
+    }
+}
+
+static void runServer(const char* const socketPath)
+{
+    // A client hanging up on us shouldn't take the server down.
+    signal(SIGPIPE, SIG_IGN);
+
+    ConversionServer server;
+    server.tokener = json_tokener_new_ex(JSON_TOKENER_DEFAULT_DEPTH);
+    if(server.tokener == NULL)
+    {
+        printError_exit("Failed to build tokener");
+    }
+    init_decoder_context(&server.decoder);
+    server.request = new_bonjson_encode_context(STREAM_READ_SIZE);
+    server.response = new_bonjson_encode_context(STREAM_READ_SIZE);
+
+    const struct sockaddr_un address = makeSocketAddress(socketPath);
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd < 0)
+    {
+        printPError_exit("Could not create socket");
+    }
+    unlink(socketPath);
+    if(bind(listenFd, (const struct sockaddr*)&address, sizeof(address)) < 0)
+    {
+        printPError_exit("Could not bind to %s", socketPath);
+    }
+    if(listen(listenFd, SOMAXCONN) < 0)
+    {
+        printPError_exit("Could not listen on %s", socketPath);
+    }
+
+    for(;;)
+    {
+        const int fd = accept(listenFd, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            printPError_exit("Could not accept connection on %s", socketPath);
+        }
+        serveConnection(&server, fd);
+        close(fd);
+    }
+}
+
+/**
+ * Send a single conversion request to a server started with --serve.
+ */
+static void runClient(const char* const socketPath,
+                      const uint8_t command,
+                      const uint8_t flags,
+                      const char* const src_path,
+                      const char* const dst_path)
+{
+    FILE* file = openFileForReading(src_path);
+    size_t documentSize = 0;
+    uint8_t* document = readEntireFile(file, &documentSize);
+    closeFile(file);
+
+    const struct sockaddr_un address = makeSocketAddress(socketPath);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        printPError_exit("Could not create socket");
+    }
+    if(connect(fd, (const struct sockaddr*)&address, sizeof(address)) < 0)
+    {
+        printPError_exit("Could not connect to %s", socketPath);
+    }
+
+    // The server may reject a request without reading all of it, so a failed
+    // send still leaves an error response to read.
+    signal(SIGPIPE, SIG_IGN);
+    uint8_t header[SERVER_REQUEST_HEADER_SIZE] = {command, flags};
+    encodeUInt64LE(header + 2, documentSize);
+    const bool wasSent = writeToSocket(fd, header, sizeof(header)) && writeToSocket(fd, document, documentSize);
+    const int sendError = errno;
+    free(document);
+
+    uint8_t responseHeader[SERVER_RESPONSE_HEADER_SIZE];
+    if(!readFromSocket(fd, responseHeader, sizeof(responseHeader)))
+    {
+        if(!wasSent)
+        {
+            errno = sendError;
+            printPError_exit("Could not send request to %s", socketPath);
+        }
+        printError_exit("Server at %s closed the connection", socketPath);
+    }
+    const uint64_t responseSize = decodeUInt64LE(responseHeader + 1);
+    uint8_t* response = malloc(responseSize + 1);
+    if(!readFromSocket(fd, response, responseSize))
+    {
+        printError_exit("Server at %s closed the connection", socketPath);
+    }
+    close(fd);
+
+    if(responseHeader[0] != SERVER_STATUS_OK)
+    {
+        response[responseSize] = 0;
+        printError_exit("%s: %s", src_path, (const char*)response);
+    }
+
+    if(command != SERVER_COMMAND_VALIDATE)
+    {
+        file = openFileForWriting(dst_path);
+        writeToFile(file, response, responseSize);
+        closeFile(file);
+    }
+    free(response);
+}
+
+
+// ============================================================================
+// Startup & command line args
+// ============================================================================
+
+#define QUOTE(str) #str
+#define EXPAND_AND_QUOTE(str) QUOTE(str)
+
+static char* g_argv_0;
+
+static void print_usage(void)
+{
+    printError("\
+Purpose:   Convert JSON <-> BONJSON.\n\
+Version:   %s\n\
+Copyright: (c) 2024 Karl Stenerud\n\
+License:   MIT, NO WARRANTIES IMPLIED\n\
+\n\
+Usage: %s [options] [files to --merge]\n\
+Where the default behavior is to convert from stdin to stdout.\n\
+\n\
+Options:\n\
+  -h: Print help and exit\n\
+  -v: Print version and exit\n\
+  -i <path>: Input file (use - to specify stdin) (default stdin)\n\
+  -o <path>: Output file (use - to specify stdout) (default stdout)\n\
+  -b: Convert JSON to BONJSON (default)\n\
+  -j: Convert BONJSON to JSON\n\
+  -p: Pretty-print (if converting to JSON)\n\
+  -s: Stream mode: convert as data arrives, using bounded memory\n\
+      (each top-level value is converted separately)\n\
+  -f <bytes>: Stream mode: flush output after this many bytes (default %d)\n\
+  -t <ms>: Stream mode: flush output if the input stalls for this long (default %d)\n\
+  --validate: Only check that the BONJSON input is valid\n\
+  --canonical: Sort object members by name when converting to BONJSON, so that\n\
+               equal documents convert to identical bytes (not in stream mode)\n\
+  --aggregate <path>: Print the count, sum, min and max of the numbers at a JSON\n\
+                      Pointer path in the BONJSON input, where a * segment\n\
+                      matches every member or element (can be repeated)\n\
+  --buckets <b1,b2,...>: Also print a histogram of the aggregated numbers, with\n\
+                         these ascending bucket upper bounds\n\
+  --log <path>: Append each JSON value in the input to a record log (with -b),\n\
+               or print each record in a log as a line of JSON (with -j).\n\
+               Records are synced every -t ms (default %d) and buffered up to\n\
+               -f bytes (default %d)\n\
+  --append <path>: Append each JSON value in the input to the top-level array\n\
+                  of a BONJSON file, without rewriting what's already there\n\
+  --build-index <path>: Write a sidecar index of the BONJSON input file's elements\n\
+  --index-kind <kind>: What the elements are: array (the top-level array's,\n\
+                       the default), sequence (top-level values) or log (records)\n\
+  --stride <n>: Record the offset of every nth element (default %d)\n\
+  --key-path <path>: Also index the elements by the string or integer at this\n\
+                     JSON Pointer path within them\n\
+  --index <path>: Print one element of the BONJSON input file as JSON, found\n\
+                  with this index (use with --element or --key)\n\
+  --element <n>: The position of the element to print\n\
+  --key <key>: The key of the element to print\n\
+  --build-zone-map <path>: Write a zone map of the BONJSON input file (with\n\
+                           --index), summarizing the numbers and strings at\n\
+                           each --zone-path in every block of elements\n\
+  --zone-path <path>: A JSON Pointer path to summarize (can be repeated)\n\
+  --zone-map <path>: Print each element of the BONJSON input file that matches\n\
+                     every --range and --equals as a line of JSON (with --index)\n\
+  --range <path>=<min>,<max>: Match numbers from min to max at a zone path\n\
+  --equals <path>=<string>: Match a string at a zone path\n\
+  --split <n>: Split the top-level array of the BONJSON input file into n\n\
+               arrays of about the same size, written to <-o path>.0 to\n\
+               <-o path>.<n-1> (uses --index to find the boundaries, if given)\n\
+  --merge <files...>: Write one array holding the elements of the arrays in\n\
+                      these BONJSON files, in order, to the -o file\n\
+  --serve <socket>: Run as a conversion server listening on a Unix socket\n\
+  --connect <socket>: Send the conversion to a server instead of doing it locally\n\
+  -z <type[:level]>: Compress the output (gzip or zstd)\n\
+  --no-decompress: Don't check whether the input is compressed\n\
+\n\
+Compressed (gzip or zstd) input is detected and decompressed automatically,\n\
+unless --no-decompress is given.\n\
+\n\
+", EXPAND_AND_QUOTE(PROJECT_VERSION), basename(g_argv_0), DEFAULT_FLUSH_SIZE, DEFAULT_FLUSH_INTERVAL_MS,
+    DEFAULT_FLUSH_INTERVAL_MS, DEFAULT_FLUSH_SIZE, DEFAULT_INDEX_STRIDE);
+}
+
+static void print_usage_printError_exit(void)
+{
+    print_usage();
+    exit(1);
+}
+
+static void print_version(void)
+{
+    printf("%s\n", EXPAND_AND_QUOTE(PROJECT_VERSION));
+}
+
+/**
+ * Parse an option's value as a whole number no greater than max, or exit.
+ */
+static uint64_t parseNumberOption(const char* const option, const char* const value, const uint64_t max)
+{
+    char* end = NULL;
+    errno = 0;
+    const uint64_t number = strtoull(value, &end, 10);
+    // strtoull() would also take leading spaces and signs
+    if(*value < '0' || *value > '9' || *end != '\0')
+    {
+        printError_exit("%s needs a whole number: %s", option, value);
+    }
+    if(errno != 0 || number > max)
+    {
+        printError_exit("%s is too large: %s", option, value);
+    }
+    return number;
+}
+
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(const int argc, char** const argv)
+{
+    bool toJson = false;
+    bool prettyPrint = false;
+    bool stream = false;
+    bool validateOnly = false;
+    bool canonical = false;
+    const char* aggregatePaths[KSBONJSON_MAX_AGGREGATES];
+    size_t aggregatePathCount = 0;
+    double* bucketBounds = NULL;
+    size_t bucketBoundCount = 0;
+    const char* serve_path = NULL;
+    const char* connect_path = NULL;
+    const char* log_path = NULL;
+    const char* append_path = NULL;
+    const char* build_index_path = NULL;
+    const char* index_path = NULL;
+    const char* lookupElement = NULL;
+    const char* lookupKey = NULL;
+    const char* build_zone_map_path = NULL;
+    const char* zone_map_path = NULL;
+    const char* zonePaths[KSBONJSON_MAX_ZONE_PATHS];
+    size_t zonePathCount = 0;
+    PredicateSpec predicateSpecs[KSBONJSON_MAX_ZONE_PATHS * 2];
+    size_t predicateSpecCount = 0;
+    size_t splitCount = 0;
+    bool merge = false;
+    KSBONJSONIndexOptions indexOptions =
+    {
+        .kind = KSBONJSON_INDEX_ARRAY,
+        .stride = DEFAULT_INDEX_STRIDE,
+    };
+    StreamOptions streamOptions =
+    {
+        .flushSize = DEFAULT_FLUSH_SIZE,
+        .flushIntervalMs = DEFAULT_FLUSH_INTERVAL_MS,
+    };
     const char* src_path = "-";
     const char* dst_path = "-";
 
     g_argv_0 = argv[0];
 
+    static const struct option longOptions[] =
+    {
+        {"serve", required_argument, NULL, 'S'},
+        {"connect", required_argument, NULL, 'C'},
+        {"validate", no_argument, NULL, 'V'},
+        {"canonical", no_argument, NULL, 'K'},
+        {"aggregate", required_argument, NULL, 'A'},
+        {"buckets", required_argument, NULL, 'B'},
+        {"log", required_argument, NULL, 'L'},
+        {"append", required_argument, NULL, 'G'},
+        {"build-index", required_argument, NULL, 'I'},
+        {"index-kind", required_argument, NULL, 'N'},
+        {"stride", required_argument, NULL, 'D'},
+        {"key-path", required_argument, NULL, 'P'},
+        {"index", required_argument, NULL, 'X'},
+        {"element", required_argument, NULL, 'E'},
+        {"key", required_argument, NULL, 'k'},
+        {"build-zone-map", required_argument, NULL, 'Z'},
+        {"zone-path", required_argument, NULL, 'Y'},
+        {"zone-map", required_argument, NULL, 'M'},
+        {"range", required_argument, NULL, 'R'},
+        {"equals", required_argument, NULL, 'Q'},
+        {"split", required_argument, NULL, 'W'},
+        {"merge", no_argument, NULL, 'U'},
+        {"no-decompress", no_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0},
+    };
+
     int ch;
-    while((ch = getopt(argc, argv, "?hvbjpi:o:")) >= 0)
+    while((ch = getopt_long(argc, argv, "?hvbjpsf:t:i:o:z:", longOptions, NULL)) >= 0)
     {
         switch(ch)
         {
+            case 'S':
+                serve_path = strdup(optarg);
+                break;
+            case 'C':
+                connect_path = strdup(optarg);
+                break;
+            case 'V':
+                validateOnly = true;
+                break;
+            case 'K':
+                canonical = true;
+                break;
+            case 'A':
+                if(aggregatePathCount >= KSBONJSON_MAX_AGGREGATES)
+                {
+                    printError_exit("No more than %d --aggregate paths are allowed", KSBONJSON_MAX_AGGREGATES);
+                }
+                aggregatePaths[aggregatePathCount++] = strdup(optarg);
+                break;
+            case 'B':
+                free(bucketBounds);
+                bucketBounds = parseBucketBounds(optarg, &bucketBoundCount);
+                break;
+            case 'L':
+                log_path = strdup(optarg);
+                break;
+            case 'G':
+                append_path = strdup(optarg);
+                break;
+            case 'I':
+                build_index_path = strdup(optarg);
+                break;
+            case 'N':
+                indexOptions.kind = parseIndexKind(optarg);
+                break;
+            case 'D':
+                indexOptions.stride = parseNumberOption("--stride", optarg, SIZE_MAX);
+                break;
+            case 'P':
+                indexOptions.keyPath = strdup(optarg);
+                indexOptions.keyPathLength = strlen(optarg);
+                break;
+            case 'X':
+                index_path = strdup(optarg);
+                break;
+            case 'E':
+                lookupElement = strdup(optarg);
+                break;
+            case 'k':
+                lookupKey = strdup(optarg);
+                break;
+            case 'Z':
+                build_zone_map_path = strdup(optarg);
+                break;
+            case 'Y':
+                if(zonePathCount >= KSBONJSON_MAX_ZONE_PATHS)
+                {
+                    printError_exit("No more than %d --zone-path paths are allowed", KSBONJSON_MAX_ZONE_PATHS);
+                }
+                zonePaths[zonePathCount++] = strdup(optarg);
+                break;
+            case 'M':
+                zone_map_path = strdup(optarg);
+                break;
+            case 'R':
+            case 'Q':
+                if(predicateSpecCount >= KSBONJSON_MAX_ZONE_PATHS * 2)
+                {
+                    printError_exit("No more than %d --range and --equals conditions are allowed", KSBONJSON_MAX_ZONE_PATHS * 2);
+                }
+                predicateSpecs[predicateSpecCount++] = (PredicateSpec){strdup(optarg), ch == 'R'};
+                break;
+            case 'W':
+                splitCount = strtoull(optarg, NULL, 10);
+                if(splitCount == 0)
+                {
+                    printError_exit("--split needs a number of files greater than 0: %s", optarg);
+                }
+                break;
+            case 'U':
+                merge = true;
+                break;
+            case 'n':
+                g_detectInputCompression = false;
+                break;
             case '?':
             case 'h':
                 print_usage();
@@ -606,6 +3166,22 @@ int main(const int argc, char** const argv)
             case 'p':
                 prettyPrint = true;
                 break;
+            case 's':
+                stream = true;
+                break;
+            case 'f':
+                streamOptions.flushSize = parseNumberOption("-f", optarg, SIZE_MAX);
+                break;
+            case 't':
+                streamOptions.flushIntervalMs = (int)parseNumberOption("-t", optarg, INT_MAX);
+                break;
+            case 'z':
+                g_outputCompression = parseCompressionSpec(optarg, &g_outputCompressionLevel);
+                if(g_outputCompression == COMPRESSION_NONE)
+                {
+                    printError_exit("Unknown compression type: %s", optarg);
+                }
+                break;
             case 'i':
                 src_path = strdup(optarg);
                 break;
@@ -618,13 +3194,142 @@ int main(const int argc, char** const argv)
         }
     }
 
-    if(toJson)
+    if(optind < argc && !merge)
+    {
+        printError_exit("Unexpected argument: %s", argv[optind]);
+    }
+    if(canonical && (stream || toJson || serve_path != NULL || connect_path != NULL))
+    {
+        printError_exit("--canonical only works when converting a whole file to BONJSON");
+    }
+    if(aggregatePathCount > 0 && (stream || validateOnly || canonical || serve_path != NULL || connect_path != NULL))
+    {
+        printError_exit("--aggregate can't be combined with other modes");
+    }
+    if(bucketBounds != NULL && aggregatePathCount == 0)
+    {
+        printError_exit("--buckets requires --aggregate");
+    }
+    if(log_path != NULL && (stream || validateOnly || canonical || aggregatePathCount > 0 ||
+                            serve_path != NULL || connect_path != NULL))
+    {
+        printError_exit("--log can't be combined with other modes");
+    }
+    if(append_path != NULL && (stream || toJson || validateOnly || canonical || aggregatePathCount > 0 ||
+                               log_path != NULL || serve_path != NULL || connect_path != NULL))
+    {
+        printError_exit("--append can't be combined with other modes");
+    }
+    if((build_index_path != NULL || index_path != NULL) &&
+       (stream || validateOnly || canonical || aggregatePathCount > 0 || log_path != NULL || append_path != NULL ||
+        serve_path != NULL || connect_path != NULL || (build_index_path != NULL && index_path != NULL)))
+    {
+        printError_exit("--build-index and --index can't be combined with other modes");
+    }
+    if((splitCount > 0 || merge) &&
+       (stream || toJson || validateOnly || canonical || aggregatePathCount > 0 || log_path != NULL ||
+        append_path != NULL || build_index_path != NULL || lookupElement != NULL || lookupKey != NULL ||
+        build_zone_map_path != NULL || zone_map_path != NULL || serve_path != NULL || connect_path != NULL ||
+        (splitCount > 0 && merge) || (merge && index_path != NULL)))
+    {
+        printError_exit("--split and --merge can't be combined with other modes");
+    }
+    if((build_zone_map_path != NULL || zone_map_path != NULL) &&
+       (index_path == NULL || lookupElement != NULL || lookupKey != NULL ||
+        (build_zone_map_path != NULL && zone_map_path != NULL)))
+    {
+        printError_exit("--build-zone-map and --zone-map need --index, and can't be combined with other modes");
+    }
+    if(build_zone_map_path != NULL && zonePathCount == 0)
+    {
+        printError_exit("--build-zone-map needs at least one --zone-path");
+    }
+    if(predicateSpecCount > 0 && zone_map_path == NULL)
+    {
+        printError_exit("--range and --equals require --zone-map");
+    }
+    if(index_path != NULL && build_zone_map_path == NULL && zone_map_path == NULL && splitCount == 0 &&
+       (lookupElement == NULL) == (lookupKey == NULL))
+    {
+        printError_exit("--index needs either --element or --key");
+    }
+
+    if(serve_path != NULL)
+    {
+        runServer(serve_path);
+    }
+    else if(connect_path != NULL)
+    {
+        const uint8_t command = validateOnly ? SERVER_COMMAND_VALIDATE
+                              : toJson ? SERVER_COMMAND_TO_JSON
+                              : SERVER_COMMAND_TO_BONJSON;
+        runClient(connect_path, command, prettyPrint ? SERVER_FLAG_PRETTY_PRINT : 0, src_path, dst_path);
+    }
+    else if(validateOnly)
+    {
+        validate(src_path);
+    }
+    else if(aggregatePathCount > 0)
+    {
+        aggregate(src_path, dst_path, aggregatePaths, aggregatePathCount, bucketBounds, bucketBoundCount);
+    }
+    else if(append_path != NULL)
+    {
+        appendJsonToArray(src_path, append_path);
+    }
+    else if(splitCount > 0)
+    {
+        splitArray(src_path, dst_path, index_path, splitCount);
+    }
+    else if(merge)
+    {
+        mergeArrays(argv + optind, (size_t)(argc - optind), dst_path);
+    }
+    else if(build_index_path != NULL)
+    {
+        buildIndex(src_path, build_index_path, &indexOptions);
+    }
+    else if(build_zone_map_path != NULL)
+    {
+        buildZoneMap(src_path, index_path, build_zone_map_path, zonePaths, zonePathCount);
+    }
+    else if(zone_map_path != NULL)
+    {
+        scanZoneMap(src_path, dst_path, index_path, zone_map_path, predicateSpecs, predicateSpecCount, prettyPrint);
+    }
+    else if(index_path != NULL)
+    {
+        lookUpIndexedElement(src_path, dst_path, index_path, lookupElement, lookupKey, prettyPrint);
+    }
+    else if(log_path != NULL)
+    {
+        if(toJson)
+        {
+            logToJson(log_path, dst_path, prettyPrint);
+        }
+        else
+        {
+            appendJsonToLog(src_path, log_path, &streamOptions);
+        }
+    }
+    else if(stream)
+    {
+        if(toJson)
+        {
+            bonjsonToJsonStream(src_path, dst_path, prettyPrint, &streamOptions);
+        }
+        else
+        {
+            jsonToBonjsonStream(src_path, dst_path, &streamOptions);
+        }
+    }
+    else if(toJson)
     {
         bonjsonToJson(src_path, dst_path, prettyPrint);
     }
     else
     {
-        jsonToBonjson(src_path, dst_path);
+        jsonToBonjson(src_path, dst_path, canonical);
     }
 
     return 0;
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#
+#  make_training_corpus.py
+#
+#  Created by Karl Stenerud on 2024-07-07.
+#
+#  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall remain in place
+# in this source code.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+
+"""
+Regenerates the PGO training corpus in pgo/ (see tools/pgo_build.sh).
+
+    make_training_corpus.py <output dir>
+
+The corpus is committed so that profiles are reproducible. Each file leans
+on a different part of the codec, and mixed.json covers them all together.
+"""
+
+import json
+import os
+import random
+import sys
+
+WORDS = ["alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+         "hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+         "oscar", "papa", "quebec", "romeo", "sierra", "tango", "über",
+         "café", "日本", "Жук"]
+
+def random_string(rng):
+    length = rng.choice([0, 1, 3, 8, 20, 60, 200])
+    text = " ".join(rng.choice(WORDS) for _ in range(length // 5 + 1))
+    return text[:length]
+
+def random_integer(rng):
+    # Every encoded width, both signs
+    bits = rng.choice([3, 6, 7, 8, 12, 16, 20, 24, 32, 40, 48, 56, 63])
+    value = rng.getrandbits(bits)
+    return -value if rng.random() < 0.4 else value
+
+def random_float(rng):
+    kind = rng.randrange(3)
+    if kind == 0:
+        return rng.randrange(-512, 512) + 0.5        # float16
+    if kind == 1:
+        return rng.randrange(-1 << 20, 1 << 20) / 1024.0 + 1 / 3.0
+    return rng.uniform(-1e6, 1e6)
+
+def random_scalar(rng, weights):
+    kind = rng.choices(["null", "bool", "int", "float", "string"], weights)[0]
+    if kind == "null":
+        return None
+    if kind == "bool":
+        return rng.random() < 0.5
+    if kind == "int":
+        return random_integer(rng)
+    if kind == "float":
+        return random_float(rng)
+    return random_string(rng)
+
+def random_value(rng, shape, depth):
+    weights, max_depth, container_chance, max_width = shape
+    if depth < max_depth and rng.random() < container_chance:
+        width = rng.randrange(max_width + 1)
+        if rng.random() < 0.5:
+            return [random_value(rng, shape, depth + 1) for _ in range(width)]
+        return {"%s_%d" % (rng.choice(WORDS), i): random_value(rng, shape, depth + 1)
+                for i in range(width)}
+    return random_scalar(rng, weights)
+
+def records(seed, count, shape):
+    rng = random.Random(seed)
+    return [random_value(rng, shape, 0) for _ in range(count)]
+
+# json-c refuses to parse anything nested deeper than 32 levels
+CORPUS = {
+    #                 seed  count  null,bool,int,float,string  depth  container chance  width
+    "strings.json":  (1,    1000,  ([0, 0, 0, 0, 1],           0,     0.0,              0)),
+    "integers.json": (2,    3000,  ([0, 0, 1, 0, 0],           0,     0.0,              0)),
+    "floats.json":   (3,    3000,  ([0, 0, 0, 1, 0],           0,     0.0,              0)),
+    "nested.json":   (4,    40,    ([1, 1, 1, 1, 1],           28,    0.7,              3)),
+    "mixed.json":    (5,    200,   ([1, 2, 4, 3, 4],           6,     0.5,              6)),
+}
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: %s <output dir>" % sys.argv[0], file=sys.stderr)
+        return 1
+    for name, (seed, count, shape) in CORPUS.items():
+        with open(os.path.join(sys.argv[1], name), "w") as f:
+            json.dump(records(seed, count, shape), f, ensure_ascii=False)
+            f.write("\n")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
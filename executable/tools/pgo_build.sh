@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Builds the executable (and the library, statically) with profile-guided
+# optimization:
+#   1. Configure and build with instrumentation (-Db_pgo=generate)
+#   2. Run the instrumented binary over the training corpus in pgo/
+#   3. Reconfigure the same build dir with -Db_pgo=use and rebuild
+#
+#   pgo_build.sh [build dir] [extra meson options...]
+#
+# The result is build/bonjson (or whichever build dir you chose).
+
+set -e
+
+source_dir=$(cd "$(dirname "$0")/.." && pwd)
+build_dir=${1:-build}
+[ $# -gt 0 ] && shift
+
+meson setup "$build_dir" "$source_dir" \
+    -Dbuildtype=release \
+    -Ddefault_library=static \
+    -Db_pgo=generate \
+    "$@"
+ninja -C "$build_dir"
+
+# Clang writes its raw profiles to the working directory, and expects them
+# merged into default.profdata in the build dir. GCC writes .gcda files next
+# to the object files, where the second build will find them.
+rm -f "$build_dir"/*.profraw
+(cd "$build_dir" && "$source_dir/tools/pgo_train.sh" ./bonjson "$source_dir/pgo")
+if ls "$build_dir"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -output="$build_dir/default.profdata" "$build_dir"/*.profraw
+fi
+
+meson configure "$build_dir" -Db_pgo=use
+ninja -C "$build_dir"
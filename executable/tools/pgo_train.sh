@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Runs an instrumented bonjson executable over the training corpus.
+# Called by pgo_build.sh, or with "ninja pgo-train".
+#
+#   pgo_train.sh <bonjson executable> <corpus dir>
+#
+# Every conversion mode is exercised in roughly the proportion we expect in
+# production: mostly one-shot conversions in both directions.
+
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <bonjson executable> <corpus dir>" >&2
+    exit 1
+fi
+exe="$1"
+corpus="$2"
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+for round in 1 2 3; do
+    for json in "$corpus"/*.json; do
+        bonjson="$scratch/$(basename "$json" .json).bonjson"
+        "$exe" -b -i "$json" -o "$bonjson"
+        "$exe" -j -i "$bonjson" -o /dev/null
+        "$exe" -j -p -i "$bonjson" -o /dev/null
+        "$exe" --validate -i "$bonjson"
+        if [ "$round" -eq 1 ]; then
+            "$exe" -s -b -i "$json" -o /dev/null
+            "$exe" -s -j -i "$bonjson" -o /dev/null
+        fi
+    done
+done
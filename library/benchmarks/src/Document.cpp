@@ -0,0 +1,175 @@
+//
+//  Document.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Document.h"
+
+#include <stdexcept>
+
+
+bool Value::operator==(const Value& other) const
+{
+    if(type != other.type)
+    {
+        return false;
+    }
+    switch(type)
+    {
+        case Null:
+            return true;
+        case Boolean:
+            return boolean == other.boolean;
+        case Integer:
+            return integer == other.integer;
+        case UInteger:
+            return uinteger == other.uinteger;
+        case Float:
+            return floatValue == other.floatValue;
+        case String:
+            return string == other.string;
+        case Array:
+            return elements == other.elements;
+        case Object:
+            return members == other.members;
+    }
+    return false;
+}
+
+DocumentBuilder::DocumentBuilder()
+: hasRoot(false)
+, hasPendingName(false)
+{}
+
+Value* DocumentBuilder::addValue(Value&& value)
+{
+    if(containers.empty())
+    {
+        if(hasRoot)
+        {
+            throw std::runtime_error("Document has more than one top-level value");
+        }
+        root = std::move(value);
+        hasRoot = true;
+        return &root;
+    }
+
+    Value* container = containers.back();
+    if(container->type == Value::Array)
+    {
+        container->elements.push_back(std::move(value));
+        return &container->elements.back();
+    }
+    if(!hasPendingName)
+    {
+        throw std::runtime_error("Expected an object member name");
+    }
+    container->members.emplace_back(std::move(pendingName), std::move(value));
+    hasPendingName = false;
+    return &container->members.back().second;
+}
+
+void DocumentBuilder::addNull()
+{
+    addValue(Value());
+}
+
+void DocumentBuilder::addBoolean(bool value)
+{
+    Value v;
+    v.type = Value::Boolean;
+    v.boolean = value;
+    addValue(std::move(v));
+}
+
+void DocumentBuilder::addInteger(int64_t value)
+{
+    Value v;
+    v.type = Value::Integer;
+    v.integer = value;
+    addValue(std::move(v));
+}
+
+void DocumentBuilder::addUInteger(uint64_t value)
+{
+    Value v;
+    v.type = Value::UInteger;
+    v.uinteger = value;
+    addValue(std::move(v));
+}
+
+void DocumentBuilder::addFloat(double value)
+{
+    Value v;
+    v.type = Value::Float;
+    v.floatValue = value;
+    addValue(std::move(v));
+}
+
+void DocumentBuilder::addString(const char* value, size_t length)
+{
+    if(!containers.empty() && containers.back()->type == Value::Object && !hasPendingName)
+    {
+        pendingName.assign(value, length);
+        hasPendingName = true;
+        return;
+    }
+    Value v;
+    v.type = Value::String;
+    v.string.assign(value, length);
+    addValue(std::move(v));
+}
+
+void DocumentBuilder::beginArray()
+{
+    Value v;
+    v.type = Value::Array;
+    containers.push_back(addValue(std::move(v)));
+}
+
+void DocumentBuilder::beginObject()
+{
+    Value v;
+    v.type = Value::Object;
+    containers.push_back(addValue(std::move(v)));
+}
+
+void DocumentBuilder::endContainer()
+{
+    if(containers.empty())
+    {
+        throw std::runtime_error("Unbalanced end of container");
+    }
+    containers.pop_back();
+}
+
+Value DocumentBuilder::takeDocument()
+{
+    if(!hasRoot || !containers.empty())
+    {
+        throw std::runtime_error("Document is incomplete");
+    }
+    hasRoot = false;
+    return std::move(root);
+}
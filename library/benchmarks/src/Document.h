@@ -0,0 +1,102 @@
+//
+//  Document.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef Document_h
+#define Document_h
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// A format-neutral in-memory document, used to encode and decode the same
+// data in several formats when comparing them.
+
+struct Value
+{
+    enum Type
+    {
+        Null,
+        Boolean,
+        Integer,
+        UInteger,
+        Float,
+        String,
+        Array,
+        Object,
+    };
+
+    Type type = Null;
+    bool boolean = false;
+    int64_t integer = 0;
+    uint64_t uinteger = 0;
+    double floatValue = 0;
+    std::string string;
+    std::vector<Value> elements;
+    std::vector<std::pair<std::string, Value>> members;
+
+    bool operator==(const Value& other) const;
+    bool operator!=(const Value& other) const { return !(*this == other); }
+};
+
+/**
+ * Builds a Value from a stream of decode events.
+ *
+ * Inside an object, strings alternate between member names and values, the
+ * same as in the BONJSON decoder callbacks.
+ */
+class DocumentBuilder
+{
+public:
+    DocumentBuilder();
+
+    void addNull();
+    void addBoolean(bool value);
+    void addInteger(int64_t value);
+    void addUInteger(uint64_t value);
+    void addFloat(double value);
+    void addString(const char* value, size_t length);
+    void beginArray();
+    void beginObject();
+    void endContainer();
+
+    /**
+     * Take the finished document, leaving the builder ready to build another.
+     */
+    Value takeDocument();
+
+private:
+    Value* addValue(Value&& value);
+
+    Value root;
+    bool hasRoot;
+    std::vector<Value*> containers;
+    std::string pendingName;
+    bool hasPendingName;
+};
+
+#endif // Document_h
@@ -0,0 +1,103 @@
+//
+//  InliningKernels.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "InliningKernels.h"
+
+// Built twice, see meson.build
+#if BONJSON_KERNELS_INLINED
+#   define KSBONJSON_STATIC
+#   include "ksbonjson.h"
+#   define KERNEL(NAME) inliningKernel_ ## NAME ## _inlined
+#else
+#   include <ksbonjson/KSBONJSONEncoder.h>
+#   define KERNEL(NAME) inliningKernel_ ## NAME ## _linked
+#endif
+
+
+typedef struct
+{
+    uint8_t* buffer;
+    size_t bufferSize;
+    size_t length;
+} Output;
+
+static ksbonjson_encodeStatus addEncodedData(const uint8_t* KSBONJSON_RESTRICT data,
+                                             size_t dataLength,
+                                             void* KSBONJSON_RESTRICT userData)
+{
+    Output* output = (Output*)userData;
+    if(output->length + dataLength > output->bufferSize)
+    {
+        return KSBONJSON_ENCODE_COULD_NOT_ADD_DATA;
+    }
+    for(size_t i = 0; i < dataLength; i++)
+    {
+        output->buffer[output->length + i] = data[i];
+    }
+    output->length += dataLength;
+    return KSBONJSON_ENCODE_OK;
+}
+
+#define ENCODE_ARRAY(ADD_VALUE) \
+    do \
+    { \
+        Output output = {buffer, bufferSize, 0}; \
+        KSBONJSONEncodeContext ctx; \
+        ksbonjson_beginEncode(&ctx, addEncodedData, &output); \
+        if(ksbonjson_beginArray(&ctx) != KSBONJSON_ENCODE_OK) \
+        { \
+            return 0; \
+        } \
+        for(size_t i = 0; i < count; i++) \
+        { \
+            if(ADD_VALUE != KSBONJSON_ENCODE_OK) \
+            { \
+                return 0; \
+            } \
+        } \
+        if(ksbonjson_endContainer(&ctx) != KSBONJSON_ENCODE_OK || \
+           ksbonjson_endEncode(&ctx) != KSBONJSON_ENCODE_OK) \
+        { \
+            return 0; \
+        } \
+        return output.length; \
+    } \
+    while(0)
+
+size_t KERNEL(encodeIntegers)(const int64_t* values, size_t count, uint8_t* buffer, size_t bufferSize)
+{
+    ENCODE_ARRAY(ksbonjson_addInteger(&ctx, values[i]));
+}
+
+size_t KERNEL(encodeFloats)(const double* values, size_t count, uint8_t* buffer, size_t bufferSize)
+{
+    ENCODE_ARRAY(ksbonjson_addFloat(&ctx, values[i]));
+}
+
+size_t KERNEL(encodeBooleans)(const uint8_t* values, size_t count, uint8_t* buffer, size_t bufferSize)
+{
+    ENCODE_ARRAY(ksbonjson_addBoolean(&ctx, values[i] != 0));
+}
@@ -0,0 +1,60 @@
+//
+//  InliningKernels.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef InliningKernels_h
+#define InliningKernels_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// The same encoding loops built twice: once calling the library through its
+// public interface (a shared library, or a static one with LTO), and once
+// with the single-header amalgamation compiled into the same file so that
+// the compiler can inline the API into the loop.
+//
+// Each kernel encodes an array of the given values into buffer, and returns
+// the encoded length (or 0 on failure).
+
+size_t inliningKernel_encodeIntegers_linked(const int64_t* values, size_t count, uint8_t* buffer, size_t bufferSize);
+size_t inliningKernel_encodeIntegers_inlined(const int64_t* values, size_t count, uint8_t* buffer, size_t bufferSize);
+
+size_t inliningKernel_encodeFloats_linked(const double* values, size_t count, uint8_t* buffer, size_t bufferSize);
+size_t inliningKernel_encodeFloats_inlined(const double* values, size_t count, uint8_t* buffer, size_t bufferSize);
+
+size_t inliningKernel_encodeBooleans_linked(const uint8_t* values, size_t count, uint8_t* buffer, size_t bufferSize);
+size_t inliningKernel_encodeBooleans_inlined(const uint8_t* values, size_t count, uint8_t* buffer, size_t bufferSize);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // InliningKernels_h
@@ -0,0 +1,517 @@
+//
+//  KSBONJSONCorpusGenerator.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "KSBONJSONCorpusGenerator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+#define MAX_LIST_ENTRIES 16
+
+// Strings are generated and added in chunks of this size
+#define STRING_CHUNK_SIZE 256
+
+static const char g_alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+#define ALPHABET_SIZE (sizeof(g_alphabet) - 1)
+
+union float32_u
+{
+    float f32;
+    uint32_t u32;
+};
+
+union float64_u
+{
+    double f64;
+    uint64_t u64;
+};
+
+
+// ============================================================================
+// Random Numbers
+// ============================================================================
+
+// SplitMix64: small, fast, and gives the same sequence on every platform
+// (unlike rand() or the C++ distributions).
+static uint64_t nextRandom(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t randomInRange(uint64_t* state, uint64_t min, uint64_t max)
+{
+    const uint64_t span = max - min + 1;
+    if(span == 0)
+    {
+        // The full 64-bit range
+        return nextRandom(state);
+    }
+    return min + nextRandom(state) % span;
+}
+
+static size_t randomInCorpusRange(uint64_t* state, KSBONJSONCorpusRange range)
+{
+    if(range.max <= range.min)
+    {
+        return range.min;
+    }
+    return (size_t)randomInRange(state, range.min, range.max);
+}
+
+// Pick an index from a list of relative weights. Returns -1 if all weights are 0.
+static int randomWeightedChoice(uint64_t* state, const unsigned* weights, int count)
+{
+    uint64_t total = 0;
+    for(int i = 0; i < count; i++)
+    {
+        total += weights[i];
+    }
+    if(total == 0)
+    {
+        return -1;
+    }
+
+    uint64_t choice = nextRandom(state) % total;
+    for(int i = 0; i < count; i++)
+    {
+        if(choice < weights[i])
+        {
+            return i;
+        }
+        choice -= weights[i];
+    }
+    return count - 1;
+}
+
+
+// ============================================================================
+// Value Generation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_encodeStatus propagatedResult = CALL; \
+        if(propagatedResult != KSBONJSON_ENCODE_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+static ksbonjson_encodeStatus addRandomString(KSBONJSONEncodeContext* ctx, uint64_t* state, size_t length)
+{
+    char chunk[STRING_CHUNK_SIZE];
+    if(length == 0)
+    {
+        return ksbonjson_addString(ctx, "", 0);
+    }
+    while(length > 0)
+    {
+        const size_t chunkLength = length < sizeof(chunk) ? length : sizeof(chunk);
+        for(size_t i = 0; i < chunkLength; i++)
+        {
+            chunk[i] = g_alphabet[nextRandom(state) % ALPHABET_SIZE];
+        }
+        length -= chunkLength;
+        PROPAGATE_ERROR(ksbonjson_chunkString(ctx, chunk, chunkLength, length == 0));
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+// Names are derived from their index alone, so each name is the same every
+// time it's used. The index is spelled out at the start of the name to keep
+// the names distinct even when they're short.
+static ksbonjson_encodeStatus addObjectName(KSBONJSONCorpusGenerator* gen,
+                                            KSBONJSONEncodeContext* ctx,
+                                            size_t index)
+{
+    char prefix[32];
+    size_t prefixLength = 0;
+    size_t remaining = index;
+    do
+    {
+        prefix[prefixLength++] = g_alphabet[remaining % ALPHABET_SIZE];
+        remaining /= ALPHABET_SIZE;
+    }
+    while(remaining > 0);
+
+    uint64_t nameState = gen->spec.seed ^ ((uint64_t)index * 0xd1b54a32d192ed03ULL);
+    size_t length = randomInCorpusRange(&nameState, gen->spec.keyLength);
+    if(length <= prefixLength)
+    {
+        return ksbonjson_addString(ctx, prefix, prefixLength);
+    }
+
+    PROPAGATE_ERROR(ksbonjson_chunkString(ctx, prefix, prefixLength, false));
+    length -= prefixLength;
+    char chunk[STRING_CHUNK_SIZE];
+    while(length > 0)
+    {
+        const size_t chunkLength = length < sizeof(chunk) ? length : sizeof(chunk);
+        for(size_t i = 0; i < chunkLength; i++)
+        {
+            chunk[i] = g_alphabet[nextRandom(&nameState) % ALPHABET_SIZE];
+        }
+        length -= chunkLength;
+        PROPAGATE_ERROR(ksbonjson_chunkString(ctx, chunk, chunkLength, length == 0));
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+static ksbonjson_encodeStatus addRandomInteger(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    uint64_t* state = &gen->rngState;
+    const int width = randomWeightedChoice(state, gen->spec.intWidthWeights, KSBONJSON_CORPUS_INT_WIDTH_COUNT);
+    const bool isNegative = nextRandom(state) & 1;
+
+    // The ranges below match the encoder's choice of width.
+    uint64_t magnitude;
+    switch(width)
+    {
+        case KSBONJSON_CORPUS_INT_SMALL:
+            magnitude = randomInRange(state, 0, 117);
+            break;
+        case KSBONJSON_CORPUS_INT_8:
+            magnitude = randomInRange(state, 118, 245);
+            break;
+        case KSBONJSON_CORPUS_INT_16:
+            magnitude = randomInRange(state, 246, 0x7fff);
+            break;
+        case KSBONJSON_CORPUS_UINT_64:
+            return ksbonjson_addUInteger(ctx, randomInRange(state, 0x8000000000000000ULL, 0xffffffffffffffffULL));
+        case -1:
+            return ksbonjson_addInteger(ctx, 0);
+        default:
+        {
+            const int bits = (width - KSBONJSON_CORPUS_INT_8 + 1) * 8;
+            magnitude = randomInRange(state, 1ULL << (bits - 9), (1ULL << (bits - 1)) - 1);
+            break;
+        }
+    }
+    return ksbonjson_addInteger(ctx, isNegative ? -(int64_t)magnitude : (int64_t)magnitude);
+}
+
+// Each precision sets the lowest significand bit that its type can hold, which
+// guarantees that the value neither fits a smaller type nor is a whole number.
+static ksbonjson_encodeStatus addRandomFloat(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    uint64_t* state = &gen->rngState;
+    const int precision = randomWeightedChoice(state, gen->spec.floatPrecisionWeights, KSBONJSON_CORPUS_FLOAT_PRECISION_COUNT);
+    const uint64_t sign = nextRandom(state) & 1;
+
+    switch(precision)
+    {
+        case KSBONJSON_CORPUS_FLOAT_16:
+        {
+            // float16 is the upper half of a float32 (7 significand bits)
+            union float32_u f;
+            const uint32_t exponent = (uint32_t)randomInRange(state, 127 - 8, 127 + 6);
+            const uint32_t significand = ((uint32_t)nextRandom(state) & 0x7f) | 1;
+            f.u32 = ((uint32_t)sign << 31) | (exponent << 23) | (significand << 16);
+            return ksbonjson_addFloat(ctx, f.f32);
+        }
+        case KSBONJSON_CORPUS_FLOAT_32:
+        {
+            union float32_u f;
+            const uint32_t exponent = (uint32_t)randomInRange(state, 127 - 20, 127 + 20);
+            const uint32_t significand = ((uint32_t)nextRandom(state) & 0x7fffff) | 1;
+            f.u32 = ((uint32_t)sign << 31) | (exponent << 23) | significand;
+            return ksbonjson_addFloat(ctx, f.f32);
+        }
+        case KSBONJSON_CORPUS_FLOAT_64:
+        {
+            union float64_u f;
+            const uint64_t exponent = randomInRange(state, 1023 - 30, 1023 + 30);
+            const uint64_t significand = (nextRandom(state) & 0xfffffffffffffULL) | 1;
+            f.u64 = (sign << 63) | (exponent << 52) | significand;
+            return ksbonjson_addFloat(ctx, f.f64);
+        }
+        default:
+            return ksbonjson_addFloat(ctx, 0.5);
+    }
+}
+
+static ksbonjson_encodeStatus addRandomValue(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx);
+
+static ksbonjson_encodeStatus addRandomArray(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    const size_t length = randomInCorpusRange(&gen->rngState, gen->spec.arrayLength);
+    gen->depth++;
+    PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+    for(size_t i = 0; i < length; i++)
+    {
+        PROPAGATE_ERROR(addRandomValue(gen, ctx));
+    }
+    gen->depth--;
+    return ksbonjson_endContainer(ctx);
+}
+
+static ksbonjson_encodeStatus addRandomObject(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    const size_t keyCount = gen->spec.keyCount > 0 ? gen->spec.keyCount : 1;
+    size_t width = randomInCorpusRange(&gen->rngState, gen->spec.objectWidth);
+    if(width > keyCount)
+    {
+        // Names must be unique within an object
+        width = keyCount;
+    }
+
+    // Consecutive names from a random starting point are guaranteed to be distinct.
+    const size_t firstKey = (size_t)(nextRandom(&gen->rngState) % keyCount);
+    gen->depth++;
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    for(size_t i = 0; i < width; i++)
+    {
+        PROPAGATE_ERROR(addObjectName(gen, ctx, (firstKey + i) % keyCount));
+        PROPAGATE_ERROR(addRandomValue(gen, ctx));
+    }
+    gen->depth--;
+    return ksbonjson_endContainer(ctx);
+}
+
+static ksbonjson_encodeStatus addRandomValue(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    unsigned weights[KSBONJSON_CORPUS_VALUE_TYPE_COUNT];
+    memcpy(weights, gen->spec.typeWeights, sizeof(weights));
+    if(gen->depth >= gen->spec.maxDepth)
+    {
+        weights[KSBONJSON_CORPUS_ARRAY] = 0;
+        weights[KSBONJSON_CORPUS_OBJECT] = 0;
+    }
+
+    uint64_t* state = &gen->rngState;
+    switch(randomWeightedChoice(state, weights, KSBONJSON_CORPUS_VALUE_TYPE_COUNT))
+    {
+        case KSBONJSON_CORPUS_BOOLEAN:
+            return ksbonjson_addBoolean(ctx, nextRandom(state) & 1);
+        case KSBONJSON_CORPUS_INTEGER:
+            return addRandomInteger(gen, ctx);
+        case KSBONJSON_CORPUS_FLOAT:
+            return addRandomFloat(gen, ctx);
+        case KSBONJSON_CORPUS_STRING:
+            return addRandomString(ctx, state, randomInCorpusRange(state, gen->spec.stringLength));
+        case KSBONJSON_CORPUS_ARRAY:
+            return addRandomArray(gen, ctx);
+        case KSBONJSON_CORPUS_OBJECT:
+            return addRandomObject(gen, ctx);
+        default:
+            return ksbonjson_addNull(ctx);
+    }
+}
+
+
+// ============================================================================
+// Spec Parsing
+// ============================================================================
+
+static bool parseNumber(const char* str, const char** end, uint64_t* result)
+{
+    char* numberEnd;
+    if(*str < '0' || *str > '9')
+    {
+        return false;
+    }
+    *result = strtoull(str, &numberEnd, 0);
+    *end = numberEnd;
+    return true;
+}
+
+static bool parseSingleNumber(const char* str, uint64_t* result)
+{
+    const char* end;
+    return parseNumber(str, &end, result) && *end == 0;
+}
+
+// "n" or "min-max"
+static bool parseRange(const char* str, KSBONJSONCorpusRange* range)
+{
+    const char* end;
+    uint64_t min;
+    uint64_t max;
+    if(!parseNumber(str, &end, &min))
+    {
+        return false;
+    }
+    max = min;
+    if(*end == '-' && !parseNumber(end + 1, &end, &max))
+    {
+        return false;
+    }
+    if(*end != 0 || max < min)
+    {
+        return false;
+    }
+    range->min = (size_t)min;
+    range->max = (size_t)max;
+    return true;
+}
+
+// Exactly "count" comma-separated numbers
+static bool parseWeights(const char* str, unsigned* weights, int count)
+{
+    unsigned parsed[MAX_LIST_ENTRIES];
+    for(int i = 0; i < count; i++)
+    {
+        uint64_t value;
+        if(!parseNumber(str, &str, &value))
+        {
+            return false;
+        }
+        parsed[i] = (unsigned)value;
+        if(*str != (i == count - 1 ? 0 : ','))
+        {
+            return false;
+        }
+        str++;
+    }
+    memcpy(weights, parsed, sizeof(*weights) * (size_t)count);
+    return true;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+void ksbonjson_corpusDefaultSpec(KSBONJSONCorpusSpec* spec)
+{
+    *spec = (KSBONJSONCorpusSpec)
+    {
+        .seed = 1,
+        .recordCount = 1000,
+        .typeWeights = {1, 2, 6, 3, 6, 1, 1},
+        .intWidthWeights = {8, 4, 4, 2, 2, 1, 1, 1, 1, 1},
+        .floatPrecisionWeights = {1, 1, 4},
+        .stringLength = {0, 32},
+        .objectWidth = {1, 12},
+        .arrayLength = {0, 10},
+        .maxDepth = 4,
+        .keyCount = 50,
+        .keyLength = {3, 16},
+    };
+}
+
+bool ksbonjson_corpusSetSpecField(KSBONJSONCorpusSpec* spec, const char* name, const char* value)
+{
+    uint64_t number;
+    if(strcmp(name, "seed") == 0)
+    {
+        return parseSingleNumber(value, &spec->seed);
+    }
+    if(strcmp(name, "records") == 0)
+    {
+        if(!parseSingleNumber(value, &number))
+        {
+            return false;
+        }
+        spec->recordCount = (size_t)number;
+        return true;
+    }
+    if(strcmp(name, "types") == 0)
+    {
+        return parseWeights(value, spec->typeWeights, KSBONJSON_CORPUS_VALUE_TYPE_COUNT);
+    }
+    if(strcmp(name, "int-widths") == 0)
+    {
+        return parseWeights(value, spec->intWidthWeights, KSBONJSON_CORPUS_INT_WIDTH_COUNT);
+    }
+    if(strcmp(name, "float-precisions") == 0)
+    {
+        return parseWeights(value, spec->floatPrecisionWeights, KSBONJSON_CORPUS_FLOAT_PRECISION_COUNT);
+    }
+    if(strcmp(name, "string-length") == 0)
+    {
+        return parseRange(value, &spec->stringLength);
+    }
+    if(strcmp(name, "object-width") == 0)
+    {
+        return parseRange(value, &spec->objectWidth);
+    }
+    if(strcmp(name, "array-length") == 0)
+    {
+        return parseRange(value, &spec->arrayLength);
+    }
+    if(strcmp(name, "depth") == 0)
+    {
+        // The record itself is one level, and the encoder's top-level array is another.
+        if(!parseSingleNumber(value, &number) || number < 1 || number > KSBONJSON_MAX_CONTAINER_DEPTH - 2)
+        {
+            return false;
+        }
+        spec->maxDepth = (int)number;
+        return true;
+    }
+    if(strcmp(name, "keys") == 0)
+    {
+        if(!parseSingleNumber(value, &number) || number < 1)
+        {
+            return false;
+        }
+        spec->keyCount = (size_t)number;
+        return true;
+    }
+    if(strcmp(name, "key-length") == 0)
+    {
+        return parseRange(value, &spec->keyLength);
+    }
+    return false;
+}
+
+void ksbonjson_corpusBeginGenerate(KSBONJSONCorpusGenerator* gen, const KSBONJSONCorpusSpec* spec)
+{
+    gen->spec = *spec;
+    gen->rngState = spec->seed;
+    gen->depth = 0;
+}
+
+ksbonjson_encodeStatus ksbonjson_corpusAddRecord(KSBONJSONCorpusGenerator* gen, KSBONJSONEncodeContext* ctx)
+{
+    // Records are always objects, like rows in a table or events in a log.
+    return addRandomObject(gen, ctx);
+}
+
+ksbonjson_encodeStatus ksbonjson_corpusGenerate(const KSBONJSONCorpusSpec* spec, KSBONJSONEncodeContext* ctx)
+{
+    KSBONJSONCorpusGenerator gen;
+    ksbonjson_corpusBeginGenerate(&gen, spec);
+
+    PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+    for(size_t i = 0; i < spec->recordCount; i++)
+    {
+        PROPAGATE_ERROR(ksbonjson_corpusAddRecord(&gen, ctx));
+    }
+    PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+    return ksbonjson_endEncode(ctx);
+}
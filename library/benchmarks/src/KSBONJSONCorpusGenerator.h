@@ -0,0 +1,205 @@
+//
+//  KSBONJSONCorpusGenerator.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONCorpusGenerator_h
+#define KSBONJSONCorpusGenerator_h
+
+#include <ksbonjson/KSBONJSONEncoder.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Generates synthetic BONJSON documents with a controlled shape, for
+// benchmarking and regression testing. The same spec always generates
+// exactly the same document, on every platform.
+
+
+// ============================================================================
+// Types
+// ============================================================================
+
+/**
+ * The kinds of value that the generator can produce.
+ */
+typedef enum
+{
+    KSBONJSON_CORPUS_NULL,
+    KSBONJSON_CORPUS_BOOLEAN,
+    KSBONJSON_CORPUS_INTEGER,
+    KSBONJSON_CORPUS_FLOAT,
+    KSBONJSON_CORPUS_STRING,
+    KSBONJSON_CORPUS_ARRAY,
+    KSBONJSON_CORPUS_OBJECT,
+    KSBONJSON_CORPUS_VALUE_TYPE_COUNT,
+} ksbonjson_corpusValueType;
+
+/**
+ * Integer widths, in terms of how many bytes the encoded value occupies
+ * after its type code.
+ */
+typedef enum
+{
+    KSBONJSON_CORPUS_INT_SMALL,
+    KSBONJSON_CORPUS_INT_8,
+    KSBONJSON_CORPUS_INT_16,
+    KSBONJSON_CORPUS_INT_24,
+    KSBONJSON_CORPUS_INT_32,
+    KSBONJSON_CORPUS_INT_40,
+    KSBONJSON_CORPUS_INT_48,
+    KSBONJSON_CORPUS_INT_56,
+    KSBONJSON_CORPUS_INT_64,
+    KSBONJSON_CORPUS_UINT_64,
+    KSBONJSON_CORPUS_INT_WIDTH_COUNT,
+} ksbonjson_corpusIntWidth;
+
+/**
+ * Float precisions, in terms of the smallest float type that can hold the value.
+ */
+typedef enum
+{
+    KSBONJSON_CORPUS_FLOAT_16,
+    KSBONJSON_CORPUS_FLOAT_32,
+    KSBONJSON_CORPUS_FLOAT_64,
+    KSBONJSON_CORPUS_FLOAT_PRECISION_COUNT,
+} ksbonjson_corpusFloatPrecision;
+
+typedef struct
+{
+    size_t min;
+    size_t max;
+} KSBONJSONCorpusRange;
+
+/**
+ * Describes the shape of the documents to generate.
+ *
+ * All weights are relative to the other weights in the same array.
+ * A weight of 0 disables that choice.
+ */
+typedef struct
+{
+    /** Seed for the random number generator. */
+    uint64_t seed;
+
+    /** Number of elements in the top-level array. */
+    size_t recordCount;
+
+    /** Relative frequency of each value type inside a record. */
+    unsigned typeWeights[KSBONJSON_CORPUS_VALUE_TYPE_COUNT];
+
+    /** Relative frequency of each integer width. */
+    unsigned intWidthWeights[KSBONJSON_CORPUS_INT_WIDTH_COUNT];
+
+    /** Relative frequency of each float precision. */
+    unsigned floatPrecisionWeights[KSBONJSON_CORPUS_FLOAT_PRECISION_COUNT];
+
+    /** Length of string values, in bytes. */
+    KSBONJSONCorpusRange stringLength;
+
+    /** Number of members in each object. */
+    KSBONJSONCorpusRange objectWidth;
+
+    /** Number of elements in each array. */
+    KSBONJSONCorpusRange arrayLength;
+
+    /** Maximum container depth of a record. Containers at this depth only hold scalars. */
+    int maxDepth;
+
+    /** Number of distinct object member names. Fewer names means more repetition. */
+    size_t keyCount;
+
+    /** Length of object member names, in bytes. */
+    KSBONJSONCorpusRange keyLength;
+} KSBONJSONCorpusSpec;
+
+typedef struct
+{
+    KSBONJSONCorpusSpec spec;
+    uint64_t rngState;
+    int depth;
+} KSBONJSONCorpusGenerator;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Fill a spec with defaults that produce a mix of every type.
+ *
+ * @param spec The spec to fill.
+ */
+void ksbonjson_corpusDefaultSpec(KSBONJSONCorpusSpec* spec);
+
+/**
+ * Set a spec field from a textual "name" and "value", such as
+ * ("string-length", "4-40") or ("int-widths", "1,1,0,0,0,0,0,0,0,0").
+ *
+ * Names: seed, records, types, int-widths, float-precisions, string-length,
+ * object-width, array-length, depth, keys, key-length.
+ *
+ * @param spec The spec to modify.
+ * @param name The field name.
+ * @param value The field value.
+ * @return true if the name was recognized and the value was valid.
+ */
+bool ksbonjson_corpusSetSpecField(KSBONJSONCorpusSpec* spec, const char* name, const char* value);
+
+/**
+ * Begin generating records.
+ *
+ * @param generator The generator to initialize.
+ * @param spec The shape of the records to generate.
+ */
+void ksbonjson_corpusBeginGenerate(KSBONJSONCorpusGenerator* generator, const KSBONJSONCorpusSpec* spec);
+
+/**
+ * Generate the next record (one top-level array element).
+ *
+ * @param generator The generator.
+ * @param context The encoding context to add the record to.
+ * @return KSBONJSON_ENCODE_OK on success.
+ */
+ksbonjson_encodeStatus ksbonjson_corpusAddRecord(KSBONJSONCorpusGenerator* generator,
+                                                 KSBONJSONEncodeContext* context);
+
+/**
+ * Generate a complete document: an array of spec->recordCount records.
+ *
+ * @param spec The shape of the document to generate.
+ * @param context A context that has just been passed to ksbonjson_beginEncode().
+ * @return KSBONJSON_ENCODE_OK on success.
+ */
+ksbonjson_encodeStatus ksbonjson_corpusGenerate(const KSBONJSONCorpusSpec* spec,
+                                                KSBONJSONEncodeContext* context);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONCorpusGenerator_h
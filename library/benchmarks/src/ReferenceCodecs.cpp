@@ -0,0 +1,682 @@
+//
+//  ReferenceCodecs.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "ReferenceCodecs.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+// Decoders refuse to nest deeper than this
+#define MAX_DEPTH 512
+
+
+// ============================================================================
+// Utility
+// ============================================================================
+
+static void appendBigEndian(std::vector<uint8_t>& output, uint64_t value, int byteCount)
+{
+    for(int i = byteCount - 1; i >= 0; i--)
+    {
+        output.push_back(uint8_t(value >> (i * 8)));
+    }
+}
+
+static void appendBytes(std::vector<uint8_t>& output, const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    output.insert(output.end(), bytes, bytes + length);
+}
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static uint64_t doubleBits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+class Reader
+{
+public:
+    Reader(const uint8_t* data, size_t length)
+    : pos(data)
+    , end(data + length)
+    {}
+
+    uint8_t readByte()
+    {
+        require(1);
+        return *pos++;
+    }
+
+    uint64_t readBigEndian(int byteCount)
+    {
+        require(size_t(byteCount));
+        uint64_t value = 0;
+        for(int i = 0; i < byteCount; i++)
+        {
+            value = (value << 8) | *pos++;
+        }
+        return value;
+    }
+
+    const char* readBytes(uint64_t length)
+    {
+        require(length);
+        const char* bytes = reinterpret_cast<const char*>(pos);
+        pos += length;
+        return bytes;
+    }
+
+    bool isAtEnd() const
+    {
+        return pos == end;
+    }
+
+private:
+    void require(uint64_t length)
+    {
+        if(uint64_t(end - pos) < length)
+        {
+            throw std::runtime_error("Unexpected end of data");
+        }
+    }
+
+    const uint8_t* pos;
+    const uint8_t* end;
+};
+
+static double floatFromBits(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double doubleFromBits(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// ============================================================================
+// CBOR
+// ============================================================================
+
+enum
+{
+    CBOR_UNSIGNED = 0,
+    CBOR_NEGATIVE = 1,
+    CBOR_TEXT = 3,
+    CBOR_ARRAY = 4,
+    CBOR_MAP = 5,
+    CBOR_SIMPLE = 7,
+};
+
+static void encodeCBORHead(std::vector<uint8_t>& output, int majorType, uint64_t argument)
+{
+    const uint8_t major = uint8_t(majorType << 5);
+    if(argument < 24)
+    {
+        output.push_back(uint8_t(major | argument));
+    }
+    else if(argument <= 0xff)
+    {
+        output.push_back(major | 24);
+        appendBigEndian(output, argument, 1);
+    }
+    else if(argument <= 0xffff)
+    {
+        output.push_back(major | 25);
+        appendBigEndian(output, argument, 2);
+    }
+    else if(argument <= 0xffffffff)
+    {
+        output.push_back(major | 26);
+        appendBigEndian(output, argument, 4);
+    }
+    else
+    {
+        output.push_back(major | 27);
+        appendBigEndian(output, argument, 8);
+    }
+}
+
+static void encodeCBORString(std::vector<uint8_t>& output, const std::string& value)
+{
+    encodeCBORHead(output, CBOR_TEXT, value.size());
+    appendBytes(output, value.data(), value.size());
+}
+
+// Half precision floats are only used when they hold the value exactly.
+static bool toCBORHalf(double value, uint16_t* result)
+{
+    const float asFloat = float(value);
+    if(double(asFloat) != value)
+    {
+        return false;
+    }
+    const uint32_t bits = floatBits(asFloat);
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const int exponent = int((bits >> 23) & 0xff) - 127;
+    const uint32_t significand = bits & 0x7fffff;
+    if(exponent < -14 || exponent > 15 || (significand & 0x1fff) != 0)
+    {
+        // Out of range, subnormal or too precise
+        return false;
+    }
+    *result = uint16_t(sign | uint32_t(exponent + 15) << 10 | significand >> 13);
+    return true;
+}
+
+static double fromCBORHalf(uint16_t half)
+{
+    const int exponent = (half >> 10) & 0x1f;
+    const int significand = half & 0x3ff;
+    double value;
+    if(exponent == 0)
+    {
+        value = std::ldexp(significand, -24);
+    }
+    else if(exponent != 31)
+    {
+        value = std::ldexp(significand + 1024, exponent - 25);
+    }
+    else
+    {
+        value = significand == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+void encodeCBOR(const Value& value, std::vector<uint8_t>& output)
+{
+    switch(value.type)
+    {
+        case Value::Null:
+            output.push_back(0xf6);
+            break;
+        case Value::Boolean:
+            output.push_back(value.boolean ? 0xf5 : 0xf4);
+            break;
+        case Value::Integer:
+            if(value.integer >= 0)
+            {
+                encodeCBORHead(output, CBOR_UNSIGNED, uint64_t(value.integer));
+            }
+            else
+            {
+                encodeCBORHead(output, CBOR_NEGATIVE, ~uint64_t(value.integer));
+            }
+            break;
+        case Value::UInteger:
+            encodeCBORHead(output, CBOR_UNSIGNED, value.uinteger);
+            break;
+        case Value::Float:
+        {
+            uint16_t half;
+            if(toCBORHalf(value.floatValue, &half))
+            {
+                output.push_back(0xf9);
+                appendBigEndian(output, half, 2);
+            }
+            else if(double(float(value.floatValue)) == value.floatValue)
+            {
+                output.push_back(0xfa);
+                appendBigEndian(output, floatBits(float(value.floatValue)), 4);
+            }
+            else
+            {
+                output.push_back(0xfb);
+                appendBigEndian(output, doubleBits(value.floatValue), 8);
+            }
+            break;
+        }
+        case Value::String:
+            encodeCBORString(output, value.string);
+            break;
+        case Value::Array:
+            encodeCBORHead(output, CBOR_ARRAY, value.elements.size());
+            for(const Value& element: value.elements)
+            {
+                encodeCBOR(element, output);
+            }
+            break;
+        case Value::Object:
+            encodeCBORHead(output, CBOR_MAP, value.members.size());
+            for(const auto& member: value.members)
+            {
+                encodeCBORString(output, member.first);
+                encodeCBOR(member.second, output);
+            }
+            break;
+    }
+}
+
+static uint64_t readCBORArgument(Reader& reader, uint8_t initialByte)
+{
+    const uint8_t info = initialByte & 0x1f;
+    if(info < 24)
+    {
+        return info;
+    }
+    switch(info)
+    {
+        case 24: return reader.readBigEndian(1);
+        case 25: return reader.readBigEndian(2);
+        case 26: return reader.readBigEndian(4);
+        case 27: return reader.readBigEndian(8);
+        default: throw std::runtime_error("Unsupported CBOR length encoding");
+    }
+}
+
+static void decodeCBORValue(Reader& reader, DocumentBuilder& builder, int depth)
+{
+    if(depth > MAX_DEPTH)
+    {
+        throw std::runtime_error("CBOR document is too deeply nested");
+    }
+
+    const uint8_t initialByte = reader.readByte();
+    switch(initialByte >> 5)
+    {
+        case CBOR_UNSIGNED:
+        {
+            const uint64_t value = readCBORArgument(reader, initialByte);
+            if(value <= INT64_MAX)
+            {
+                builder.addInteger(int64_t(value));
+            }
+            else
+            {
+                builder.addUInteger(value);
+            }
+            return;
+        }
+        case CBOR_NEGATIVE:
+        {
+            const uint64_t value = readCBORArgument(reader, initialByte);
+            if(value > INT64_MAX)
+            {
+                throw std::runtime_error("CBOR negative integer is out of range");
+            }
+            builder.addInteger(~int64_t(value));
+            return;
+        }
+        case CBOR_TEXT:
+        {
+            const uint64_t length = readCBORArgument(reader, initialByte);
+            builder.addString(reader.readBytes(length), size_t(length));
+            return;
+        }
+        case CBOR_ARRAY:
+        {
+            builder.beginArray();
+            for(uint64_t count = readCBORArgument(reader, initialByte); count > 0; count--)
+            {
+                decodeCBORValue(reader, builder, depth + 1);
+            }
+            builder.endContainer();
+            return;
+        }
+        case CBOR_MAP:
+        {
+            builder.beginObject();
+            for(uint64_t count = readCBORArgument(reader, initialByte); count > 0; count--)
+            {
+                const uint8_t nameByte = reader.readByte();
+                if(nameByte >> 5 != CBOR_TEXT)
+                {
+                    throw std::runtime_error("CBOR map key is not a text string");
+                }
+                const uint64_t length = readCBORArgument(reader, nameByte);
+                builder.addString(reader.readBytes(length), size_t(length));
+                decodeCBORValue(reader, builder, depth + 1);
+            }
+            builder.endContainer();
+            return;
+        }
+        case CBOR_SIMPLE:
+            switch(initialByte)
+            {
+                case 0xf4: builder.addBoolean(false); return;
+                case 0xf5: builder.addBoolean(true); return;
+                case 0xf6: builder.addNull(); return;
+                case 0xf9: builder.addFloat(fromCBORHalf(uint16_t(reader.readBigEndian(2)))); return;
+                case 0xfa: builder.addFloat(floatFromBits(uint32_t(reader.readBigEndian(4)))); return;
+                case 0xfb: builder.addFloat(doubleFromBits(reader.readBigEndian(8))); return;
+                default: break;
+            }
+            break;
+        default:
+            break;
+    }
+    throw std::runtime_error("Unsupported CBOR type");
+}
+
+void decodeCBOR(const uint8_t* data, size_t length, DocumentBuilder& builder)
+{
+    Reader reader(data, length);
+    decodeCBORValue(reader, builder, 0);
+    if(!reader.isAtEnd())
+    {
+        throw std::runtime_error("Unexpected data after the CBOR document");
+    }
+}
+
+
+// ============================================================================
+// MessagePack
+// ============================================================================
+
+static void encodeMessagePackLength(std::vector<uint8_t>& output,
+                                    uint64_t length,
+                                    uint8_t fixType,
+                                    uint64_t fixMax,
+                                    uint8_t type8,
+                                    uint8_t type16,
+                                    uint8_t type32)
+{
+    if(length <= fixMax)
+    {
+        output.push_back(uint8_t(fixType | length));
+    }
+    else if(type8 != 0 && length <= 0xff)
+    {
+        output.push_back(type8);
+        appendBigEndian(output, length, 1);
+    }
+    else if(length <= 0xffff)
+    {
+        output.push_back(type16);
+        appendBigEndian(output, length, 2);
+    }
+    else if(length <= 0xffffffff)
+    {
+        output.push_back(type32);
+        appendBigEndian(output, length, 4);
+    }
+    else
+    {
+        throw std::runtime_error("Too long for MessagePack");
+    }
+}
+
+static void encodeMessagePackString(std::vector<uint8_t>& output, const std::string& value)
+{
+    encodeMessagePackLength(output, value.size(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+    appendBytes(output, value.data(), value.size());
+}
+
+static void encodeMessagePackInteger(std::vector<uint8_t>& output, int64_t value)
+{
+    if(value >= 0)
+    {
+        if(value <= 0x7f)
+        {
+            output.push_back(uint8_t(value));
+        }
+        else if(value <= 0xff)
+        {
+            output.push_back(0xcc);
+            appendBigEndian(output, uint64_t(value), 1);
+        }
+        else if(value <= 0xffff)
+        {
+            output.push_back(0xcd);
+            appendBigEndian(output, uint64_t(value), 2);
+        }
+        else if(value <= 0xffffffff)
+        {
+            output.push_back(0xce);
+            appendBigEndian(output, uint64_t(value), 4);
+        }
+        else
+        {
+            output.push_back(0xcf);
+            appendBigEndian(output, uint64_t(value), 8);
+        }
+    }
+    else if(value >= -32)
+    {
+        output.push_back(uint8_t(value));
+    }
+    else if(value >= INT8_MIN)
+    {
+        output.push_back(0xd0);
+        appendBigEndian(output, uint64_t(value), 1);
+    }
+    else if(value >= INT16_MIN)
+    {
+        output.push_back(0xd1);
+        appendBigEndian(output, uint64_t(value), 2);
+    }
+    else if(value >= INT32_MIN)
+    {
+        output.push_back(0xd2);
+        appendBigEndian(output, uint64_t(value), 4);
+    }
+    else
+    {
+        output.push_back(0xd3);
+        appendBigEndian(output, uint64_t(value), 8);
+    }
+}
+
+void encodeMessagePack(const Value& value, std::vector<uint8_t>& output)
+{
+    switch(value.type)
+    {
+        case Value::Null:
+            output.push_back(0xc0);
+            break;
+        case Value::Boolean:
+            output.push_back(value.boolean ? 0xc3 : 0xc2);
+            break;
+        case Value::Integer:
+            encodeMessagePackInteger(output, value.integer);
+            break;
+        case Value::UInteger:
+            output.push_back(0xcf);
+            appendBigEndian(output, value.uinteger, 8);
+            break;
+        case Value::Float:
+            if(double(float(value.floatValue)) == value.floatValue)
+            {
+                output.push_back(0xca);
+                appendBigEndian(output, floatBits(float(value.floatValue)), 4);
+            }
+            else
+            {
+                output.push_back(0xcb);
+                appendBigEndian(output, doubleBits(value.floatValue), 8);
+            }
+            break;
+        case Value::String:
+            encodeMessagePackString(output, value.string);
+            break;
+        case Value::Array:
+            encodeMessagePackLength(output, value.elements.size(), 0x90, 15, 0, 0xdc, 0xdd);
+            for(const Value& element: value.elements)
+            {
+                encodeMessagePack(element, output);
+            }
+            break;
+        case Value::Object:
+            encodeMessagePackLength(output, value.members.size(), 0x80, 15, 0, 0xde, 0xdf);
+            for(const auto& member: value.members)
+            {
+                encodeMessagePackString(output, member.first);
+                encodeMessagePack(member.second, output);
+            }
+            break;
+    }
+}
+
+static int64_t signExtend(uint64_t value, int byteCount)
+{
+    const int shift = 64 - byteCount * 8;
+    return int64_t(value << shift) >> shift;
+}
+
+static void decodeMessagePackValue(Reader& reader, DocumentBuilder& builder, int depth);
+
+static void decodeMessagePackArray(Reader& reader, DocumentBuilder& builder, int depth, uint64_t count)
+{
+    builder.beginArray();
+    for(; count > 0; count--)
+    {
+        decodeMessagePackValue(reader, builder, depth + 1);
+    }
+    builder.endContainer();
+}
+
+static void decodeMessagePackMap(Reader& reader, DocumentBuilder& builder, int depth, uint64_t count)
+{
+    builder.beginObject();
+    for(; count > 0; count--)
+    {
+        const uint8_t nameByte = reader.readByte();
+        uint64_t length;
+        if((nameByte & 0xe0) == 0xa0)
+        {
+            length = nameByte & 0x1f;
+        }
+        else if(nameByte >= 0xd9 && nameByte <= 0xdb)
+        {
+            length = reader.readBigEndian(1 << (nameByte - 0xd9));
+        }
+        else
+        {
+            throw std::runtime_error("MessagePack map key is not a string");
+        }
+        builder.addString(reader.readBytes(length), size_t(length));
+        decodeMessagePackValue(reader, builder, depth + 1);
+    }
+    builder.endContainer();
+}
+
+static void decodeMessagePackValue(Reader& reader, DocumentBuilder& builder, int depth)
+{
+    if(depth > MAX_DEPTH)
+    {
+        throw std::runtime_error("MessagePack document is too deeply nested");
+    }
+
+    const uint8_t type = reader.readByte();
+    if(type <= 0x7f)
+    {
+        builder.addInteger(type);
+        return;
+    }
+    if(type >= 0xe0)
+    {
+        builder.addInteger(int8_t(type));
+        return;
+    }
+    switch(type & 0xf0)
+    {
+        case 0x80:
+            decodeMessagePackMap(reader, builder, depth, type & 0x0f);
+            return;
+        case 0x90:
+            decodeMessagePackArray(reader, builder, depth, type & 0x0f);
+            return;
+        case 0xa0:
+        case 0xb0:
+        {
+            const uint64_t length = type & 0x1f;
+            builder.addString(reader.readBytes(length), size_t(length));
+            return;
+        }
+        default:
+            break;
+    }
+
+    switch(type)
+    {
+        case 0xc0: builder.addNull(); return;
+        case 0xc2: builder.addBoolean(false); return;
+        case 0xc3: builder.addBoolean(true); return;
+        case 0xca: builder.addFloat(floatFromBits(uint32_t(reader.readBigEndian(4)))); return;
+        case 0xcb: builder.addFloat(doubleFromBits(reader.readBigEndian(8))); return;
+        case 0xcc: builder.addInteger(int64_t(reader.readBigEndian(1))); return;
+        case 0xcd: builder.addInteger(int64_t(reader.readBigEndian(2))); return;
+        case 0xce: builder.addInteger(int64_t(reader.readBigEndian(4))); return;
+        case 0xcf:
+        {
+            const uint64_t value = reader.readBigEndian(8);
+            if(value <= INT64_MAX)
+            {
+                builder.addInteger(int64_t(value));
+            }
+            else
+            {
+                builder.addUInteger(value);
+            }
+            return;
+        }
+        case 0xd0: builder.addInteger(signExtend(reader.readBigEndian(1), 1)); return;
+        case 0xd1: builder.addInteger(signExtend(reader.readBigEndian(2), 2)); return;
+        case 0xd2: builder.addInteger(signExtend(reader.readBigEndian(4), 4)); return;
+        case 0xd3: builder.addInteger(int64_t(reader.readBigEndian(8))); return;
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+        {
+            const uint64_t length = reader.readBigEndian(1 << (type - 0xd9));
+            builder.addString(reader.readBytes(length), size_t(length));
+            return;
+        }
+        case 0xdc: decodeMessagePackArray(reader, builder, depth, reader.readBigEndian(2)); return;
+        case 0xdd: decodeMessagePackArray(reader, builder, depth, reader.readBigEndian(4)); return;
+        case 0xde: decodeMessagePackMap(reader, builder, depth, reader.readBigEndian(2)); return;
+        case 0xdf: decodeMessagePackMap(reader, builder, depth, reader.readBigEndian(4)); return;
+        default: break;
+    }
+    throw std::runtime_error("Unsupported MessagePack type");
+}
+
+void decodeMessagePack(const uint8_t* data, size_t length, DocumentBuilder& builder)
+{
+    Reader reader(data, length);
+    decodeMessagePackValue(reader, builder, 0);
+    if(!reader.isAtEnd())
+    {
+        throw std::runtime_error("Unexpected data after the MessagePack document");
+    }
+}
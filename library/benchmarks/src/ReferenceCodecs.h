@@ -0,0 +1,49 @@
+//
+//  ReferenceCodecs.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef ReferenceCodecs_h
+#define ReferenceCodecs_h
+
+#include "Document.h"
+
+
+// Small, self-contained CBOR (RFC 8949) and MessagePack codecs, so that the
+// format comparison doesn't depend on third-party libraries.
+//
+// They implement the same subset that BONJSON covers (the JSON data model),
+// and like most general-purpose codecs they always use the smallest
+// encoding that represents a value exactly. Containers are written with
+// definite lengths, which both formats require to be known up front.
+//
+// The decoders throw std::runtime_error on malformed or unsupported input.
+
+void encodeCBOR(const Value& value, std::vector<uint8_t>& output);
+void decodeCBOR(const uint8_t* data, size_t length, DocumentBuilder& builder);
+
+void encodeMessagePack(const Value& value, std::vector<uint8_t>& output);
+void decodeMessagePack(const uint8_t* data, size_t length, DocumentBuilder& builder);
+
+#endif // ReferenceCodecs_h
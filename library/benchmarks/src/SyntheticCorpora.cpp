@@ -0,0 +1,198 @@
+//
+//  SyntheticCorpora.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "SyntheticCorpora.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+
+
+#define CORPUS_SEED 0x5eed
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        ksbonjson_encodeStatus propagatedResult = CALL; \
+        if(propagatedResult != KSBONJSON_ENCODE_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+static std::string randomString(std::mt19937_64& rng, size_t minLength, size_t maxLength)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::uniform_int_distribution<size_t> lengthDist(minLength, maxLength);
+    std::uniform_int_distribution<size_t> charDist(0, sizeof(alphabet) - 2);
+    std::string str(lengthDist(rng), ' ');
+    for(char& ch: str)
+    {
+        ch = alphabet[charDist(rng)];
+    }
+    return str;
+}
+
+static ksbonjson_encodeStatus addString(KSBONJSONEncodeContext* ctx, const char* value)
+{
+    return ksbonjson_addString(ctx, value, strlen(value));
+}
+
+static ksbonjson_encodeStatus addString(KSBONJSONEncodeContext* ctx, const std::string& value)
+{
+    return ksbonjson_addString(ctx, value.data(), value.size());
+}
+
+ksbonjson_encodeStatus encodeTwitterCorpus(KSBONJSONEncodeContext* ctx)
+{
+    std::mt19937_64 rng(CORPUS_SEED);
+    std::uniform_int_distribution<uint64_t> idDist(500000000000000000ULL, 510000000000000000ULL);
+    std::uniform_int_distribution<int> countDist(0, 5000);
+    std::bernoulli_distribution coinDist(0.5);
+
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    PROPAGATE_ERROR(addString(ctx, "statuses"));
+    PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+    for(int i = 0; i < 100; i++)
+    {
+        const uint64_t id = idDist(rng);
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(addString(ctx, "created_at"));
+        PROPAGATE_ERROR(addString(ctx, "Sun Aug 31 00:29:15 +0000 2014"));
+        PROPAGATE_ERROR(addString(ctx, "id"));
+        PROPAGATE_ERROR(ksbonjson_addUInteger(ctx, id));
+        PROPAGATE_ERROR(addString(ctx, "id_str"));
+        PROPAGATE_ERROR(addString(ctx, std::to_string(id)));
+        PROPAGATE_ERROR(addString(ctx, "text"));
+        PROPAGATE_ERROR(addString(ctx, randomString(rng, 20, 140)));
+        PROPAGATE_ERROR(addString(ctx, "truncated"));
+        PROPAGATE_ERROR(ksbonjson_addBoolean(ctx, false));
+        PROPAGATE_ERROR(addString(ctx, "in_reply_to_status_id"));
+        PROPAGATE_ERROR(ksbonjson_addNull(ctx));
+        PROPAGATE_ERROR(addString(ctx, "user"));
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(addString(ctx, "id"));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, int64_t(idDist(rng) % 3000000000ULL)));
+        PROPAGATE_ERROR(addString(ctx, "name"));
+        PROPAGATE_ERROR(addString(ctx, randomString(rng, 4, 20)));
+        PROPAGATE_ERROR(addString(ctx, "screen_name"));
+        PROPAGATE_ERROR(addString(ctx, randomString(rng, 4, 15)));
+        PROPAGATE_ERROR(addString(ctx, "description"));
+        PROPAGATE_ERROR(addString(ctx, randomString(rng, 0, 160)));
+        PROPAGATE_ERROR(addString(ctx, "followers_count"));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, countDist(rng)));
+        PROPAGATE_ERROR(addString(ctx, "friends_count"));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, countDist(rng)));
+        PROPAGATE_ERROR(addString(ctx, "verified"));
+        PROPAGATE_ERROR(ksbonjson_addBoolean(ctx, coinDist(rng)));
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        PROPAGATE_ERROR(addString(ctx, "retweet_count"));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, countDist(rng)));
+        PROPAGATE_ERROR(addString(ctx, "favorited"));
+        PROPAGATE_ERROR(ksbonjson_addBoolean(ctx, coinDist(rng)));
+        PROPAGATE_ERROR(addString(ctx, "lang"));
+        PROPAGATE_ERROR(addString(ctx, "ja"));
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+    }
+    return ksbonjson_terminateDocument(ctx);
+}
+
+ksbonjson_encodeStatus encodeCitmCorpus(KSBONJSONEncodeContext* ctx)
+{
+    std::mt19937_64 rng(CORPUS_SEED);
+    std::uniform_int_distribution<int64_t> idDist(100000000, 400000000);
+    std::uniform_int_distribution<int> lengthDist(0, 8);
+
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    PROPAGATE_ERROR(addString(ctx, "events"));
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    for(int i = 0; i < 200; i++)
+    {
+        const int64_t id = idDist(rng);
+        PROPAGATE_ERROR(addString(ctx, std::to_string(id)));
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(addString(ctx, "description"));
+        PROPAGATE_ERROR(ksbonjson_addNull(ctx));
+        PROPAGATE_ERROR(addString(ctx, "id"));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, id));
+        PROPAGATE_ERROR(addString(ctx, "logo"));
+        PROPAGATE_ERROR(addString(ctx, "/images/UE0AAAAACEKo6QAAAAZDSVRN"));
+        PROPAGATE_ERROR(addString(ctx, "name"));
+        PROPAGATE_ERROR(addString(ctx, randomString(rng, 10, 40)));
+        PROPAGATE_ERROR(addString(ctx, "subTopicIds"));
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int j = lengthDist(rng); j > 0; j--)
+        {
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, idDist(rng)));
+        }
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        PROPAGATE_ERROR(addString(ctx, "topicIds"));
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int j = lengthDist(rng); j > 0; j--)
+        {
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, idDist(rng)));
+        }
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+    }
+    return ksbonjson_terminateDocument(ctx);
+}
+
+ksbonjson_encodeStatus encodeCanadaCorpus(KSBONJSONEncodeContext* ctx)
+{
+    std::mt19937_64 rng(CORPUS_SEED);
+    std::uniform_real_distribution<double> longitudeDist(-141.0, -52.0);
+    std::uniform_real_distribution<double> latitudeDist(41.0, 83.0);
+
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    PROPAGATE_ERROR(addString(ctx, "type"));
+    PROPAGATE_ERROR(addString(ctx, "FeatureCollection"));
+    PROPAGATE_ERROR(addString(ctx, "features"));
+    PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    PROPAGATE_ERROR(addString(ctx, "type"));
+    PROPAGATE_ERROR(addString(ctx, "Feature"));
+    PROPAGATE_ERROR(addString(ctx, "geometry"));
+    PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+    PROPAGATE_ERROR(addString(ctx, "type"));
+    PROPAGATE_ERROR(addString(ctx, "Polygon"));
+    PROPAGATE_ERROR(addString(ctx, "coordinates"));
+    PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+    for(int ring = 0; ring < 50; ring++)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int point = 0; point < 200; point++)
+        {
+            PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+            PROPAGATE_ERROR(ksbonjson_addFloat(ctx, longitudeDist(rng)));
+            PROPAGATE_ERROR(ksbonjson_addFloat(ctx, latitudeDist(rng)));
+            PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        }
+        PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+    }
+    return ksbonjson_terminateDocument(ctx);
+}
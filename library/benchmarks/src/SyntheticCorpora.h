@@ -0,0 +1,54 @@
+//
+//  SyntheticCorpora.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef SyntheticCorpora_h
+#define SyntheticCorpora_h
+
+#include <ksbonjson/KSBONJSONEncoder.h>
+
+
+// Synthetic stand-ins for the well-known JSON benchmark corpora, generated
+// with a fixed seed so that every run encodes exactly the same document.
+// Each function encodes one complete document into a freshly begun context.
+
+/**
+ * twitter.json: an array of status objects with a nested user object, lots of
+ * short strings, large IDs, booleans and nulls.
+ */
+ksbonjson_encodeStatus encodeTwitterCorpus(KSBONJSONEncodeContext* ctx);
+
+/**
+ * citm_catalog.json: wide objects keyed by numeric strings, mostly holding
+ * integers and small arrays of integers.
+ */
+ksbonjson_encodeStatus encodeCitmCorpus(KSBONJSONEncodeContext* ctx);
+
+/**
+ * canada.json: a GeoJSON polygon made up almost entirely of float64 coordinate pairs.
+ */
+ksbonjson_encodeStatus encodeCanadaCorpus(KSBONJSONEncodeContext* ctx);
+
+#endif // SyntheticCorpora_h
@@ -0,0 +1,402 @@
+//
+//  adversarial.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Worst-case inputs for the decoder, as could be sent by a hostile client.
+//
+// Every case reports time per input byte (so that the CPU cost of a request
+// can be bounded from its size) and, for the incremental decoder, how many
+// bytes the caller had to buffer per input byte.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <ksbonjson/KSBONJSONDecoder.h>
+
+
+#define MARK_UNUSED(x) (void)(x)
+
+#define SEED 0xbad5eed
+
+// Size of each piece of data fed to the incremental decoder
+#define CHUNK_SIZE 65536
+
+enum
+{
+    TYPE_ARRAY = 0xeb,
+    TYPE_OBJECT = 0xec,
+    TYPE_END = 0xed,
+    TYPE_FALSE = 0xee,
+    TYPE_TRUE = 0xef,
+    TYPE_NULL = 0xf0,
+    TYPE_INT16 = 0xf2,
+    TYPE_INT32 = 0xf4,
+    TYPE_BIGPOSITIVE = 0xfa,
+    TYPE_FLOAT64 = 0xfe,
+    TYPE_STRING = 0xff,
+};
+
+#define SMALL(VALUE) uint8_t((VALUE) + 117)
+
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+static ksbonjson_decodeStatus onBoolean(bool value, void* userData)
+{
+    MARK_UNUSED(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onInteger(int64_t value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onUInteger(uint64_t value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onFloat(double value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onNull(void* userData)
+{
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onString(const char* KSBONJSON_RESTRICT value,
+                                       size_t length,
+                                       void* KSBONJSON_RESTRICT userData)
+{
+    benchmark::DoNotOptimize(value);
+    benchmark::DoNotOptimize(length);
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onContainerEvent(void* userData)
+{
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static const KSBONJSONDecodeCallbacks g_callbacks =
+{
+    .onBoolean = onBoolean,
+    .onInteger = onInteger,
+    .onUInteger = onUInteger,
+    .onFloat = onFloat,
+    .onNull = onNull,
+    .onString = onString,
+    .onBeginObject = onContainerEvent,
+    .onBeginArray = onContainerEvent,
+    .onEndContainer = onContainerEvent,
+    .onEndData = onContainerEvent,
+};
+
+static ksbonjson_decodeStatus decodeWhole(const std::vector<uint8_t>& document)
+{
+    size_t decodedOffset = 0;
+    return ksbonjson_decode(document.data(), document.size(), &g_callbacks, NULL, &decodedOffset);
+}
+
+// Feed the document to the incremental decoder CHUNK_SIZE bytes at a time,
+// keeping unconsumed bytes the way a network reader would.
+static ksbonjson_decodeStatus decodeChunked(const std::vector<uint8_t>& document,
+                                            std::vector<uint8_t>& pending,
+                                            size_t* maxPending)
+{
+    KSBONJSONDecodeContext ctx;
+    ksbonjson_beginDecode(&ctx, &g_callbacks, NULL);
+    pending.clear();
+    for(size_t offset = 0; offset < document.size(); offset += CHUNK_SIZE)
+    {
+        const size_t end = std::min(offset + CHUNK_SIZE, document.size());
+        pending.insert(pending.end(), document.begin() + offset, document.begin() + end);
+        *maxPending = std::max(*maxPending, pending.size());
+        size_t consumed = 0;
+        const ksbonjson_decodeStatus status = ksbonjson_decodeChunk(&ctx, pending.data(), pending.size(), &consumed);
+        if(status != KSBONJSON_DECODE_OK)
+        {
+            return status;
+        }
+        pending.erase(pending.begin(), pending.begin() + consumed);
+    }
+    return pending.empty() ? ksbonjson_endDecode(&ctx) : KSBONJSON_DECODE_INCOMPLETE;
+}
+
+static void reportPerByte(benchmark::State& state, size_t documentSize)
+{
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(documentSize));
+    state.counters["document_bytes"] = double(documentSize);
+    state.counters["time_per_byte"] = benchmark::Counter(double(documentSize),
+                                                         benchmark::Counter::kIsIterationInvariantRate
+                                                         | benchmark::Counter::kInvert);
+}
+
+static void runDecode(benchmark::State& state,
+                      const std::vector<uint8_t>& document,
+                      ksbonjson_decodeStatus expectedStatus)
+{
+    if(decodeWhole(document) != expectedStatus)
+    {
+        state.SkipWithError("Unexpected decode status");
+        return;
+    }
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(decodeWhole(document));
+    }
+    reportPerByte(state, document.size());
+}
+
+static void runDecodeChunked(benchmark::State& state,
+                             const std::vector<uint8_t>& document,
+                             ksbonjson_decodeStatus expectedStatus)
+{
+    std::vector<uint8_t> pending;
+    size_t maxPending = 0;
+    if(decodeChunked(document, pending, &maxPending) != expectedStatus)
+    {
+        state.SkipWithError("Unexpected decode status");
+        return;
+    }
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(decodeChunked(document, pending, &maxPending));
+    }
+    reportPerByte(state, document.size());
+    state.counters["buffered_bytes_per_byte"] = double(maxPending) / double(document.size());
+}
+
+
+// ============================================================================
+// Documents
+// ============================================================================
+
+// SplitMix64, so that the "random" documents are the same on every platform
+static uint64_t nextRandom(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// An array of chains that each nest right up to the maximum depth.
+static std::vector<uint8_t> maxDepthDocument(size_t approximateSize)
+{
+    // The outer array takes up one level.
+    const int chainDepth = KSBONJSON_MAX_CONTAINER_DEPTH - 2;
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    while(document.size() < approximateSize)
+    {
+        document.insert(document.end(), chainDepth, TYPE_ARRAY);
+        document.push_back(SMALL(1));
+        document.insert(document.end(), chainDepth, TYPE_END);
+    }
+    document.push_back(TYPE_END);
+    return document;
+}
+
+// A string whose terminator is the very last byte.
+static std::vector<uint8_t> longStringDocument(size_t size)
+{
+    std::vector<uint8_t> document(size, 'x');
+    document.front() = TYPE_STRING;
+    document.back() = TYPE_STRING;
+    return document;
+}
+
+static std::vector<uint8_t> tinyIntsDocument(size_t size)
+{
+    std::vector<uint8_t> document(size, SMALL(1));
+    document.front() = TYPE_ARRAY;
+    document.back() = TYPE_END;
+    return document;
+}
+
+// Big numbers with the longest header that decodeUleb128() accepts: the
+// header value is padded out with redundant continuation bytes.
+static std::vector<uint8_t> bigNumberHeadersDocument(size_t approximateSize)
+{
+    // 8 significand bytes, no exponent
+    const uint8_t header[] = {0xa0, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00};
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    while(document.size() < approximateSize)
+    {
+        document.push_back(TYPE_BIGPOSITIVE);
+        document.insert(document.end(), header, header + sizeof(header));
+        document.insert(document.end(), {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x00});
+    }
+    document.push_back(TYPE_END);
+    return document;
+}
+
+static void addMixedValue(std::vector<uint8_t>& document, int kind)
+{
+    switch(kind)
+    {
+        case 0: document.push_back(SMALL(10)); break;
+        case 1: document.insert(document.end(), {TYPE_INT16, 0xe8, 0x03}); break;
+        case 2: document.insert(document.end(), {TYPE_INT32, 0x01, 0x02, 0x03, 0x04}); break;
+        case 3: document.insert(document.end(), {TYPE_FLOAT64, 0x58, 0x39, 0xb4, 0xc8, 0x76, 0xbe, 0xf3, 0x3f}); break;
+        case 4: document.insert(document.end(), {TYPE_STRING, 'a', 'b', 'c', TYPE_STRING}); break;
+        case 5: document.push_back(TYPE_NULL); break;
+        case 6: document.push_back(TYPE_TRUE); break;
+        default: document.insert(document.end(), {TYPE_ARRAY, TYPE_FALSE, TYPE_END}); break;
+    }
+}
+
+// The same values in either random order (defeating branch prediction) or
+// grouped by type (the best case), for comparison.
+static std::vector<uint8_t> mixedTypesDocument(size_t valueCount, bool shuffled)
+{
+    std::vector<int> kinds(valueCount);
+    for(size_t i = 0; i < valueCount; i++)
+    {
+        kinds[i] = int(i % 8);
+    }
+    if(shuffled)
+    {
+        uint64_t rng = SEED;
+        for(size_t i = valueCount - 1; i > 0; i--)
+        {
+            std::swap(kinds[i], kinds[nextRandom(&rng) % (i + 1)]);
+        }
+    }
+    else
+    {
+        std::sort(kinds.begin(), kinds.end());
+    }
+
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    for(int kind: kinds)
+    {
+        addMixedValue(document, kind);
+    }
+    document.push_back(TYPE_END);
+    return document;
+}
+
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+
+#define SIZES ->RangeMultiplier(16)->Range(1 << 16, 1 << 26)
+
+static void BM_max_depth(benchmark::State& state)
+{
+    runDecode(state, maxDepthDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_max_depth) SIZES;
+
+// Opening containers forever must be rejected as soon as the limit is reached.
+static void BM_depth_exceeded(benchmark::State& state)
+{
+    runDecode(state, std::vector<uint8_t>(size_t(state.range(0)), TYPE_ARRAY), KSBONJSON_DECODE_CONTAINER_DEPTH_EXCEEDED);
+}
+BENCHMARK(BM_depth_exceeded) SIZES;
+
+static void BM_long_string(benchmark::State& state)
+{
+    runDecode(state, longStringDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_long_string) SIZES;
+
+// The incremental decoder can't report the string until its terminator
+// arrives, so the caller has to buffer all of it.
+static void BM_long_string_chunked(benchmark::State& state)
+{
+    runDecodeChunked(state, longStringDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_long_string_chunked) SIZES;
+
+static void BM_unterminated_string(benchmark::State& state)
+{
+    std::vector<uint8_t> document = longStringDocument(size_t(state.range(0)));
+    document.back() = 'x';
+    runDecode(state, document, KSBONJSON_DECODE_INCOMPLETE);
+}
+BENCHMARK(BM_unterminated_string) SIZES;
+
+static void BM_tiny_ints(benchmark::State& state)
+{
+    runDecode(state, tinyIntsDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_tiny_ints) SIZES;
+
+static void BM_tiny_ints_chunked(benchmark::State& state)
+{
+    runDecodeChunked(state, tinyIntsDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_tiny_ints_chunked) SIZES;
+
+static void BM_big_number_headers(benchmark::State& state)
+{
+    runDecode(state, bigNumberHeadersDocument(size_t(state.range(0))), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_big_number_headers) SIZES;
+
+// A header longer than 64 bits must be rejected without reading further.
+static void BM_oversized_big_number_header(benchmark::State& state)
+{
+    std::vector<uint8_t> document(size_t(state.range(0)), 0x80);
+    document[0] = TYPE_BIGPOSITIVE;
+    runDecode(state, document, KSBONJSON_DECODE_TOO_BIG);
+}
+BENCHMARK(BM_oversized_big_number_header) SIZES;
+
+static void BM_mixed_types_shuffled(benchmark::State& state)
+{
+    runDecode(state, mixedTypesDocument(size_t(state.range(0)), true), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_mixed_types_shuffled)->Arg(1 << 20);
+
+static void BM_mixed_types_grouped(benchmark::State& state)
+{
+    runDecode(state, mixedTypesDocument(size_t(state.range(0)), false), KSBONJSON_DECODE_OK);
+}
+BENCHMARK(BM_mixed_types_grouped)->Arg(1 << 20);
+
+
+BENCHMARK_MAIN();
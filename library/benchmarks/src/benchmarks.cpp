@@ -0,0 +1,1334 @@
+//
+//  benchmarks.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ksbonjson/KSBONJSONEncoder.h>
+#include <ksbonjson/KSBONJSONDecoder.h>
+#include <ksbonjson/KSBONJSONDocument.h>
+#include <ksbonjson/KSBONJSONPatch.h>
+#include <ksbonjson/KSBONJSONDiff.h>
+#include <ksbonjson/KSBONJSONHash.h>
+#include <ksbonjson/KSBONJSONCanonical.h>
+#include <ksbonjson/KSBONJSONColumns.h>
+#include <ksbonjson/KSBONJSONAggregate.h>
+#include <ksbonjson/KSBONJSONRecordLog.h>
+#include <ksbonjson/KSBONJSONIndex.h>
+#include <ksbonjson/KSBONJSONZoneMap.h>
+#include <ksbonjson/KSBONJSONShard.h>
+#include <ksbonjson/KSBONJSONKernels.h>
+#include "InliningKernels.h"
+#include "KSBONJSONCorpusGenerator.h"
+#include "SyntheticCorpora.h"
+
+
+#define MARK_UNUSED(x) (void)(x)
+
+// How many values each per-type benchmark encodes or decodes per iteration
+#define VALUES_PER_ITERATION 1000
+
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+typedef std::function<ksbonjson_encodeStatus(KSBONJSONEncodeContext*)> EncodeFunc;
+
+static ksbonjson_encodeStatus addEncodedDataCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                                     size_t length,
+                                                     void* KSBONJSON_RESTRICT userData)
+{
+    std::vector<uint8_t>* buffer = static_cast<std::vector<uint8_t>*>(userData);
+    buffer->insert(buffer->end(), data, data + length);
+    return KSBONJSON_ENCODE_OK;
+}
+
+static void encode(std::vector<uint8_t>& buffer, const EncodeFunc& encodeContents)
+{
+    KSBONJSONEncodeContext ctx;
+    buffer.clear();
+    ksbonjson_beginEncode(&ctx, addEncodedDataCallback, &buffer);
+    ksbonjson_encodeStatus status = encodeContents(&ctx);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&ctx);
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        throw std::runtime_error(ksbonjson_encodeStatusDescription(status));
+    }
+}
+
+static std::vector<uint8_t> encodeDocument(const EncodeFunc& encodeContents)
+{
+    std::vector<uint8_t> buffer;
+    encode(buffer, encodeContents);
+    return buffer;
+}
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        ksbonjson_encodeStatus propagatedResult = CALL; \
+        if(propagatedResult != KSBONJSON_ENCODE_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+// Encode an array containing the same value VALUES_PER_ITERATION times.
+static EncodeFunc repeatedValue(const EncodeFunc& encodeValue)
+{
+    return [encodeValue](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int i = 0; i < VALUES_PER_ITERATION; i++)
+        {
+            PROPAGATE_ERROR(encodeValue(ctx));
+        }
+        return ksbonjson_endContainer(ctx);
+    };
+}
+
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+static ksbonjson_decodeStatus onBoolean(bool value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onInteger(int64_t value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onUInteger(uint64_t value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onFloat(double value, void* userData)
+{
+    benchmark::DoNotOptimize(value);
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onNull(void* userData)
+{
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onString(const char* KSBONJSON_RESTRICT value,
+                                       size_t length,
+                                       void* KSBONJSON_RESTRICT userData)
+{
+    benchmark::DoNotOptimize(value);
+    benchmark::DoNotOptimize(length);
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onBeginObject(void* userData)
+{
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onBeginArray(void* userData)
+{
+    (*static_cast<size_t*>(userData))++;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onEndContainer(void* userData)
+{
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onEndData(void* userData)
+{
+    MARK_UNUSED(userData);
+    return KSBONJSON_DECODE_OK;
+}
+
+static const KSBONJSONDecodeCallbacks g_countingCallbacks =
+{
+    .onBoolean = onBoolean,
+    .onInteger = onInteger,
+    .onUInteger = onUInteger,
+    .onFloat = onFloat,
+    .onNull = onNull,
+    .onString = onString,
+    .onBeginObject = onBeginObject,
+    .onBeginArray = onBeginArray,
+    .onEndContainer = onEndContainer,
+    .onEndData = onEndData,
+};
+
+// Decode a document, returning the number of values it contains.
+static size_t decode(const std::vector<uint8_t>& document)
+{
+    size_t valueCount = 0;
+    size_t decodedOffset = 0;
+    ksbonjson_decodeStatus status = ksbonjson_decode(document.data(),
+                                                     document.size(),
+                                                     &g_countingCallbacks,
+                                                     &valueCount,
+                                                     &decodedOffset);
+    if(status != KSBONJSON_DECODE_OK)
+    {
+        throw std::runtime_error(ksbonjson_decodeStatusDescription(status));
+    }
+    return valueCount;
+}
+
+
+// ============================================================================
+// Runners
+// ============================================================================
+
+static void runEncode(benchmark::State& state, const EncodeFunc& encodeContents)
+{
+    std::vector<uint8_t> buffer;
+    encode(buffer, encodeContents);
+    const size_t documentSize = buffer.size();
+    const size_t valueCount = decode(buffer);
+
+    for(auto _ : state)
+    {
+        encode(buffer, encodeContents);
+        benchmark::DoNotOptimize(buffer.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(documentSize));
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(valueCount));
+    state.counters["document_bytes"] = double(documentSize);
+}
+
+static void runDecode(benchmark::State& state, const EncodeFunc& encodeContents)
+{
+    const std::vector<uint8_t> document = encodeDocument(encodeContents);
+    const size_t valueCount = decode(document);
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(decode(document));
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(valueCount));
+    state.counters["document_bytes"] = double(document.size());
+}
+
+#define BENCHMARK_ENCODE_DECODE(NAME, ENCODE_FUNC) \
+    static void BM_encode_##NAME(benchmark::State& state) { runEncode(state, ENCODE_FUNC); } \
+    static void BM_decode_##NAME(benchmark::State& state) { runDecode(state, ENCODE_FUNC); } \
+    BENCHMARK(BM_encode_##NAME); \
+    BENCHMARK(BM_decode_##NAME)
+
+#define BENCHMARK_INTEGER(NAME, VALUE) \
+    BENCHMARK_ENCODE_DECODE(NAME, repeatedValue([](KSBONJSONEncodeContext* ctx) \
+    { \
+        return ksbonjson_addInteger(ctx, VALUE); \
+    }))
+
+#define BENCHMARK_FLOAT(NAME, VALUE) \
+    BENCHMARK_ENCODE_DECODE(NAME, repeatedValue([](KSBONJSONEncodeContext* ctx) \
+    { \
+        return ksbonjson_addFloat(ctx, VALUE); \
+    }))
+
+
+// ============================================================================
+// Per-Type Benchmarks
+// ============================================================================
+
+BENCHMARK_ENCODE_DECODE(null, repeatedValue(ksbonjson_addNull));
+BENCHMARK_ENCODE_DECODE(boolean, repeatedValue([](KSBONJSONEncodeContext* ctx)
+{
+    return ksbonjson_addBoolean(ctx, true);
+}));
+
+// Each value is chosen to be the largest that still fits its encoded width.
+BENCHMARK_INTEGER(int_small, 100);
+BENCHMARK_INTEGER(int8, 200);
+BENCHMARK_INTEGER(int16, 0x7fff);
+BENCHMARK_INTEGER(int24, 0x7fffff);
+BENCHMARK_INTEGER(int32, 0x7fffffffLL);
+BENCHMARK_INTEGER(int40, 0x7fffffffffLL);
+BENCHMARK_INTEGER(int48, 0x7fffffffffffLL);
+BENCHMARK_INTEGER(int56, 0x7fffffffffffffLL);
+BENCHMARK_INTEGER(int64, 0x7fffffffffffffffLL);
+BENCHMARK_INTEGER(int64_negative, -0x7fffffffffffffffLL);
+BENCHMARK_ENCODE_DECODE(uint64, repeatedValue([](KSBONJSONEncodeContext* ctx)
+{
+    return ksbonjson_addUInteger(ctx, 0xffffffffffffffffULL);
+}));
+
+BENCHMARK_FLOAT(float16, 1.5);
+BENCHMARK_FLOAT(float32, 0.100000001490116119384765625);
+BENCHMARK_FLOAT(float64, 0.1);
+
+static void BM_encode_string(benchmark::State& state)
+{
+    const std::string value(size_t(state.range(0)), 'x');
+    runEncode(state, repeatedValue([&value](KSBONJSONEncodeContext* ctx)
+    {
+        return ksbonjson_addString(ctx, value.data(), value.size());
+    }));
+}
+BENCHMARK(BM_encode_string)->Arg(0)->Arg(8)->Arg(64)->Arg(1024)->Arg(65536);
+
+static void runDecodeString(benchmark::State& state, size_t length)
+{
+    const std::string value(length, 'x');
+    runDecode(state, repeatedValue([&value](KSBONJSONEncodeContext* ctx)
+    {
+        return ksbonjson_addString(ctx, value.data(), value.size());
+    }));
+}
+
+static void BM_decode_string(benchmark::State& state)
+{
+    runDecodeString(state, size_t(state.range(0)));
+}
+BENCHMARK(BM_decode_string)->Arg(0)->Arg(8)->Arg(64)->Arg(1024)->Arg(65536);
+
+// String decoding with each kernel set that this CPU supports
+static void BM_decode_string_kernels(benchmark::State& state)
+{
+    const ksbonjson_kernelSet originalKernelSet = ksbonjson_getKernelSet();
+    const ksbonjson_kernelSet kernelSet = ksbonjson_kernelSet(state.range(0));
+    if(!ksbonjson_setKernelSet(kernelSet))
+    {
+        state.SkipWithError("Not supported on this CPU");
+        return;
+    }
+    state.SetLabel(ksbonjson_kernelSetName(kernelSet));
+    runDecodeString(state, size_t(state.range(1)));
+    ksbonjson_setKernelSet(originalKernelSet);
+}
+static void kernelSetArgs(benchmark::internal::Benchmark* benchmark)
+{
+    for(int kernelSet = 0; kernelSet < KSBONJSON_KERNELS_COUNT; kernelSet++)
+    {
+        for(int length: {8, 64, 1024})
+        {
+            benchmark->Args({kernelSet, length});
+        }
+    }
+}
+BENCHMARK(BM_decode_string_kernels)->Apply(kernelSetArgs);
+
+static EncodeFunc nestedArrays(int depth)
+{
+    return [depth](KSBONJSONEncodeContext* ctx)
+    {
+        for(int i = 0; i < depth; i++)
+        {
+            PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        }
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 1));
+        return ksbonjson_terminateDocument(ctx);
+    };
+}
+
+static void BM_encode_nesting(benchmark::State& state)
+{
+    runEncode(state, nestedArrays(int(state.range(0))));
+}
+BENCHMARK(BM_encode_nesting)->Arg(1)->Arg(10)->Arg(KSBONJSON_MAX_CONTAINER_DEPTH - 1);
+
+static void BM_decode_nesting(benchmark::State& state)
+{
+    runDecode(state, nestedArrays(int(state.range(0))));
+}
+BENCHMARK(BM_decode_nesting)->Arg(1)->Arg(10)->Arg(KSBONJSON_MAX_CONTAINER_DEPTH - 1);
+
+
+// ============================================================================
+// Corpus Benchmarks
+// ============================================================================
+
+BENCHMARK_ENCODE_DECODE(twitter, encodeTwitterCorpus);
+BENCHMARK_ENCODE_DECODE(citm_catalog, encodeCitmCorpus);
+BENCHMARK_ENCODE_DECODE(canada, encodeCanadaCorpus);
+
+
+// ============================================================================
+// Generated Corpus Benchmarks
+// ============================================================================
+
+// Payload mixes built with the corpus generator. Each is the default spec
+// with some fields overridden (see ksbonjson_corpusSetSpecField()).
+
+static EncodeFunc generatedCorpus(const std::vector<std::pair<const char*, const char*>>& fields)
+{
+    KSBONJSONCorpusSpec spec;
+    ksbonjson_corpusDefaultSpec(&spec);
+    for(const auto& field: fields)
+    {
+        if(!ksbonjson_corpusSetSpecField(&spec, field.first, field.second))
+        {
+            throw std::runtime_error(std::string("Invalid corpus spec field ") + field.first);
+        }
+    }
+    return [spec](KSBONJSONEncodeContext* ctx)
+    {
+        KSBONJSONCorpusGenerator generator;
+        ksbonjson_corpusBeginGenerate(&generator, &spec);
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(size_t i = 0; i < spec.recordCount; i++)
+        {
+            PROPAGATE_ERROR(ksbonjson_corpusAddRecord(&generator, ctx));
+        }
+        return ksbonjson_endContainer(ctx);
+    };
+}
+
+BENCHMARK_ENCODE_DECODE(generated_mixed, generatedCorpus({}));
+BENCHMARK_ENCODE_DECODE(generated_small_ints, generatedCorpus({
+    {"types", "0,0,1,0,0,0,0"},
+    {"int-widths", "3,1,0,0,0,0,0,0,0,0"},
+}));
+BENCHMARK_ENCODE_DECODE(generated_wide_ints, generatedCorpus({
+    {"types", "0,0,1,0,0,0,0"},
+    {"int-widths", "0,0,1,1,1,1,1,1,1,1"},
+}));
+BENCHMARK_ENCODE_DECODE(generated_floats, generatedCorpus({
+    {"types", "0,0,0,1,0,0,0"},
+}));
+BENCHMARK_ENCODE_DECODE(generated_long_strings, generatedCorpus({
+    {"types", "0,0,0,0,1,0,0"},
+    {"string-length", "100-2000"},
+}));
+BENCHMARK_ENCODE_DECODE(generated_deep, generatedCorpus({
+    {"records", "100"},
+    {"types", "1,0,1,0,1,2,2"},
+    {"object-width", "1-3"},
+    {"array-length", "1-3"},
+    {"depth", "40"},
+}));
+BENCHMARK_ENCODE_DECODE(generated_unique_keys, generatedCorpus({
+    {"keys", "100000"},
+}));
+
+
+// ============================================================================
+// Inlining
+// ============================================================================
+
+// The same loops calling into the library vs with the library compiled into
+// them (see InliningKernels.h). The difference is what an application gains
+// from using the single-header amalgamation (or LTO with a static library).
+
+typedef size_t (*IntegerKernel)(const int64_t*, size_t, uint8_t*, size_t);
+typedef size_t (*FloatKernel)(const double*, size_t, uint8_t*, size_t);
+typedef size_t (*BooleanKernel)(const uint8_t*, size_t, uint8_t*, size_t);
+
+template<typename T, typename KERNEL>
+static void runKernel(benchmark::State& state, KERNEL kernel, const std::vector<T>& values)
+{
+    // Big enough for the widest encoding of every value
+    std::vector<uint8_t> buffer(values.size() * 9 + 2);
+    size_t length = kernel(values.data(), values.size(), buffer.data(), buffer.size());
+    if(length == 0)
+    {
+        state.SkipWithError("Encoding failed");
+        return;
+    }
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(kernel(values.data(), values.size(), buffer.data(), buffer.size()));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(length));
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(values.size()));
+    state.counters["document_bytes"] = double(length);
+}
+
+// A spread of small, 8-bit, and wider integers, positive and negative.
+static std::vector<int64_t> mixedIntegers()
+{
+    std::vector<int64_t> values;
+    for(int i = 0; i < VALUES_PER_ITERATION; i++)
+    {
+        const int64_t magnitude = int64_t(1) << (i % 40);
+        values.push_back(i & 1 ? -magnitude - i : magnitude + i);
+    }
+    return values;
+}
+
+static std::vector<double> mixedFloats()
+{
+    std::vector<double> values;
+    for(int i = 0; i < VALUES_PER_ITERATION; i++)
+    {
+        values.push_back(i % 3 == 0 ? 1.5 + i : (i % 3 == 1 ? 0.1f * i : 0.1 * i));
+    }
+    return values;
+}
+
+static std::vector<uint8_t> alternatingBooleans()
+{
+    std::vector<uint8_t> values;
+    for(int i = 0; i < VALUES_PER_ITERATION; i++)
+    {
+        values.push_back(uint8_t(i & 1));
+    }
+    return values;
+}
+
+#define BENCHMARK_KERNEL(NAME, KERNEL_TYPE, VALUES) \
+    static void BM_inlining_##NAME##_linked(benchmark::State& state) \
+    { \
+        runKernel(state, KERNEL_TYPE(inliningKernel_##NAME##_linked), VALUES()); \
+    } \
+    static void BM_inlining_##NAME##_inlined(benchmark::State& state) \
+    { \
+        runKernel(state, KERNEL_TYPE(inliningKernel_##NAME##_inlined), VALUES()); \
+    } \
+    BENCHMARK(BM_inlining_##NAME##_linked); \
+    BENCHMARK(BM_inlining_##NAME##_inlined)
+
+BENCHMARK_KERNEL(encodeIntegers, IntegerKernel, mixedIntegers);
+BENCHMARK_KERNEL(encodeFloats, FloatKernel, mixedFloats);
+BENCHMARK_KERNEL(encodeBooleans, BooleanKernel, alternatingBooleans);
+
+
+// ============================================================================
+// Editing
+// ============================================================================
+
+// Change one field of a large document and re-encode it. Only the changed
+// field is re-encoded: everything else is copied from the original bytes.
+static void BM_edit_document(benchmark::State& state)
+{
+    const EncodeFunc records = generatedCorpus({{"records", "40000"}});
+    const std::vector<uint8_t> document = encodeDocument([&records](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 1));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "records", 7));
+        PROPAGATE_ERROR(records(ctx));
+        return ksbonjson_endContainer(ctx);
+    });
+    std::vector<uint8_t> buffer;
+    buffer.reserve(document.size() + 16);
+    KSBONJSONNode nodes[10];
+    KSBONJSONDocument editable;
+    int64_t id = 0;
+
+    for(auto _ : state)
+    {
+        KSBONJSONNode* node = nullptr;
+        if(ksbonjson_loadDocument(&editable, document.data(), document.size(), nodes, 10) != KSBONJSON_DOCUMENT_OK ||
+           ksbonjson_getMember(&editable, editable.root, "id", 2, &node) != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not load the document");
+            return;
+        }
+        ksbonjson_setInteger(node, ++id);
+        encode(buffer, [&editable](KSBONJSONEncodeContext* ctx)
+        {
+            return ksbonjson_encodeDocument(&editable, ctx);
+        });
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_edit_document);
+
+// Apply a small merge patch to a large document and re-encode it.
+static void BM_merge_patch_document(benchmark::State& state)
+{
+    const EncodeFunc records = generatedCorpus({{"records", "40000"}});
+    const std::vector<uint8_t> document = encodeDocument([&records](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 1));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "records", 7));
+        PROPAGATE_ERROR(records(ctx));
+        return ksbonjson_endContainer(ctx);
+    });
+    const std::vector<uint8_t> patch = encodeDocument([](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+        PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 2));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "status", 6));
+        PROPAGATE_ERROR(ksbonjson_addString(ctx, "patched", 7));
+        return ksbonjson_endContainer(ctx);
+    });
+    std::vector<uint8_t> buffer;
+    buffer.reserve(document.size() + 32);
+    KSBONJSONNode nodes[10];
+    KSBONJSONNode patchNodes[10];
+    KSBONJSONDocument editable;
+    KSBONJSONDocument patchDocument;
+
+    for(auto _ : state)
+    {
+        if(ksbonjson_loadDocument(&editable, document.data(), document.size(), nodes, 10) != KSBONJSON_DOCUMENT_OK ||
+           ksbonjson_loadDocument(&patchDocument, patch.data(), patch.size(), patchNodes, 10) != KSBONJSON_DOCUMENT_OK ||
+           ksbonjson_applyMergePatch(&editable, &patchDocument) != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not patch the document");
+            return;
+        }
+        encode(buffer, [&editable](KSBONJSONEncodeContext* ctx)
+        {
+            return ksbonjson_encodeDocument(&editable, ctx);
+        });
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_merge_patch_document);
+
+// Diff two large documents that differ in one field.
+static void BM_diff_document(benchmark::State& state)
+{
+    const EncodeFunc records = generatedCorpus({{"records", "40000"}});
+    auto makeDocument = [&records](int64_t id)
+    {
+        return encodeDocument([&records, id](KSBONJSONEncodeContext* ctx)
+        {
+            PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "records", 7));
+            PROPAGATE_ERROR(records(ctx));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, id));
+            return ksbonjson_endContainer(ctx);
+        });
+    };
+    const std::vector<uint8_t> from = makeDocument(1);
+    const std::vector<uint8_t> to = makeDocument(2);
+    std::vector<uint8_t> buffer;
+    char pathBuffer[100];
+
+    for(auto _ : state)
+    {
+        size_t operationCount = 0;
+        ksbonjson_documentStatus status = KSBONJSON_DOCUMENT_OK;
+        encode(buffer, [&](KSBONJSONEncodeContext* ctx)
+        {
+            status = ksbonjson_diff(from.data(), from.size(), to.data(), to.size(),
+                                    pathBuffer, sizeof(pathBuffer), ctx, &operationCount);
+            return KSBONJSON_ENCODE_OK;
+        });
+        if(status != KSBONJSON_DOCUMENT_OK || operationCount != 1)
+        {
+            state.SkipWithError("Could not diff the documents");
+            return;
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(from.size() + to.size()));
+    state.counters["document_bytes"] = double(from.size());
+}
+BENCHMARK(BM_diff_document);
+
+
+// ============================================================================
+// Hashing
+// ============================================================================
+
+// Hash the mixed corpus (compare with BM_decode_generated_mixed, which only
+// counts the values).
+static void BM_hash_document(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeDocument(generatedCorpus({}));
+    const ksbonjson_hashAlgorithm algorithm = (ksbonjson_hashAlgorithm)state.range(0);
+    const int flags = (int)state.range(1);
+    uint8_t hash[KSBONJSON_HASH_MAX_LENGTH];
+
+    for(auto _ : state)
+    {
+        if(ksbonjson_hash(document.data(), document.size(), algorithm, flags, hash) != KSBONJSON_DECODE_OK)
+        {
+            state.SkipWithError("Could not hash the document");
+            return;
+        }
+        benchmark::DoNotOptimize(hash);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_hash_document)
+    ->ArgNames({"algorithm", "unordered"})
+    ->Args({KSBONJSON_HASH_FAST, 0})
+    ->Args({KSBONJSON_HASH_FAST, KSBONJSON_HASH_UNORDERED_MEMBERS})
+    ->Args({KSBONJSON_HASH_SHA256, 0})
+    ->Args({KSBONJSON_HASH_SHA256, KSBONJSON_HASH_UNORDERED_MEMBERS});
+
+
+// ============================================================================
+// Canonical Form
+// ============================================================================
+
+// Re-encode the mixed corpus (whose members are in random order) canonically.
+static void BM_canonicalize_document(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeDocument(generatedCorpus({}));
+    std::vector<KSBONJSONCanonicalMember> members(1000);
+    std::vector<uint8_t> buffer;
+    buffer.reserve(document.size());
+
+    for(auto _ : state)
+    {
+        ksbonjson_documentStatus status = KSBONJSON_DOCUMENT_OK;
+        encode(buffer, [&](KSBONJSONEncodeContext* ctx)
+        {
+            status = ksbonjson_canonicalize(document.data(), document.size(), members.data(), members.size(), ctx);
+            return KSBONJSON_ENCODE_OK;
+        });
+        if(status != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not canonicalize the document");
+            return;
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_canonicalize_document);
+
+// Check that a canonical document is canonical (it has to be checked to the end).
+static void BM_is_canonical(benchmark::State& state)
+{
+    const std::vector<uint8_t> original = encodeDocument(generatedCorpus({}));
+    std::vector<KSBONJSONCanonicalMember> members(1000);
+    const std::vector<uint8_t> document = encodeDocument([&](KSBONJSONEncodeContext* ctx)
+    {
+        return ksbonjson_canonicalize(original.data(), original.size(), members.data(), members.size(), ctx) == KSBONJSON_DOCUMENT_OK
+            ? KSBONJSON_ENCODE_OK : KSBONJSON_ENCODE_COULD_NOT_ADD_DATA;
+    });
+
+    for(auto _ : state)
+    {
+        bool isCanonical = false;
+        if(ksbonjson_isCanonical(document.data(), document.size(), &isCanonical) != KSBONJSON_DOCUMENT_OK || !isCanonical)
+        {
+            state.SkipWithError("The document is not canonical");
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_is_canonical);
+
+
+// ============================================================================
+// Column Extraction
+// ============================================================================
+
+#define RECORD_COUNT 100000
+#define ROWS_PER_BATCH 4096
+
+// An array of flat records: {"id":int,"user":string,"price":float,"quantity":int,"note":string,"active":bool}
+static std::vector<uint8_t> encodeRecords()
+{
+    return encodeDocument([](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int i = 0; i < RECORD_COUNT; i++)
+        {
+            const std::string user = "user" + std::to_string(i % 1000);
+            PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 1000000 + i));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "user", 4));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, user.data(), user.size()));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "price", 5));
+            PROPAGATE_ERROR(ksbonjson_addFloat(ctx, (i % 10000) * 0.01 + 0.005));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "quantity", 8));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, i % 50));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "note", 4));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "no particular remarks", 21));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "active", 6));
+            PROPAGATE_ERROR(ksbonjson_addBoolean(ctx, i % 3 == 0));
+            PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        }
+        return ksbonjson_endContainer(ctx);
+    });
+}
+
+// Extract 4 of the 6 fields into columns (compare with decode_records, which
+// only passes every value to a callback).
+static void BM_extract_columns(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    std::vector<int64_t> ids(ROWS_PER_BATCH);
+    std::vector<int64_t> quantities(ROWS_PER_BATCH);
+    std::vector<double> prices(ROWS_PER_BATCH);
+    std::vector<KSBONJSONStringSlice> users(ROWS_PER_BATCH);
+    std::vector<uint8_t> validity(ROWS_PER_BATCH / 8 * 4);
+    KSBONJSONColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_COLUMN_INT64, ids.data(), nullptr, nullptr, &validity[0]},
+        {"user", 4, KSBONJSON_COLUMN_STRING, nullptr, nullptr, users.data(), &validity[ROWS_PER_BATCH / 8]},
+        {"price", 5, KSBONJSON_COLUMN_FLOAT64, nullptr, prices.data(), nullptr, &validity[ROWS_PER_BATCH / 8 * 2]},
+        {"quantity", 8, KSBONJSON_COLUMN_INT64, quantities.data(), nullptr, nullptr, &validity[ROWS_PER_BATCH / 8 * 3]},
+    };
+    KSBONJSONColumnExtractor extractor;
+
+    for(auto _ : state)
+    {
+        size_t totalRows = 0;
+        size_t rowCount = 0;
+        ksbonjson_documentStatus status = ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 4);
+        while(status == KSBONJSON_DOCUMENT_OK)
+        {
+            status = ksbonjson_extractColumns(&extractor, ROWS_PER_BATCH, &rowCount);
+            if(rowCount == 0)
+            {
+                break;
+            }
+            totalRows += rowCount;
+            benchmark::DoNotOptimize(ids.data());
+            benchmark::DoNotOptimize(prices.data());
+        }
+        if(status != KSBONJSON_DOCUMENT_OK || totalRows != RECORD_COUNT)
+        {
+            state.SkipWithError("Could not extract the columns");
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_extract_columns);
+
+static void BM_decode_records(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(decode(document));
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_decode_records);
+
+// Sum one field of every record (compare with decode_records).
+static void BM_aggregate_path(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    KSBONJSONAggregate aggregate = {};
+    aggregate.path = "/*/price";
+    aggregate.pathLength = strlen(aggregate.path);
+
+    for(auto _ : state)
+    {
+        if(ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1) != KSBONJSON_DOCUMENT_OK ||
+           aggregate.count != RECORD_COUNT)
+        {
+            state.SkipWithError("Could not aggregate the prices");
+            return;
+        }
+        benchmark::DoNotOptimize(aggregate.sum);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["document_bytes"] = double(document.size());
+}
+BENCHMARK(BM_aggregate_path);
+
+// Encode 5 columns as records, one value at a time (table=0) or with
+// ksbonjson_addTableRows() (table=1).
+static void BM_encode_table_rows(benchmark::State& state)
+{
+    const bool isTable = state.range(0) != 0;
+    std::vector<int64_t> ids(RECORD_COUNT);
+    std::vector<int64_t> quantities(RECORD_COUNT);
+    std::vector<double> prices(RECORD_COUNT);
+    std::vector<std::string> userNames(1000);
+    std::vector<KSBONJSONStringView> users(RECORD_COUNT);
+    std::vector<KSBONJSONStringView> notes(RECORD_COUNT, KSBONJSONStringView{"no particular remarks", 21});
+    for(size_t i = 0; i < userNames.size(); i++)
+    {
+        userNames[i] = "user" + std::to_string(i);
+    }
+    for(int i = 0; i < RECORD_COUNT; i++)
+    {
+        ids[i] = 1000000 + i;
+        quantities[i] = i % 50;
+        prices[i] = (i % 10000) * 0.01 + 0.005;
+        users[i] = {userNames[i % 1000].data(), userNames[i % 1000].size()};
+    }
+    const KSBONJSONTableColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_TABLE_INT64, ids.data(), nullptr, nullptr, nullptr},
+        {"user", 4, KSBONJSON_TABLE_STRING, nullptr, nullptr, users.data(), nullptr},
+        {"price", 5, KSBONJSON_TABLE_FLOAT64, nullptr, prices.data(), nullptr, nullptr},
+        {"quantity", 8, KSBONJSON_TABLE_INT64, quantities.data(), nullptr, nullptr, nullptr},
+        {"note", 4, KSBONJSON_TABLE_STRING, nullptr, nullptr, notes.data(), nullptr},
+    };
+
+    const EncodeFunc encodeTable = [&](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        PROPAGATE_ERROR(ksbonjson_addTableRows(ctx, columns, 5, RECORD_COUNT));
+        return ksbonjson_endContainer(ctx);
+    };
+    const EncodeFunc encodeValues = [&](KSBONJSONEncodeContext* ctx)
+    {
+        PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+        for(int i = 0; i < RECORD_COUNT; i++)
+        {
+            PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, ids[i]));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "user", 4));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, users[i].data, users[i].length));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "price", 5));
+            PROPAGATE_ERROR(ksbonjson_addFloat(ctx, prices[i]));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "quantity", 8));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, quantities[i]));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "note", 4));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, notes[i].data, notes[i].length));
+            PROPAGATE_ERROR(ksbonjson_endContainer(ctx));
+        }
+        return ksbonjson_endContainer(ctx);
+    };
+
+    std::vector<uint8_t> buffer;
+    encode(buffer, encodeValues);
+    const size_t documentSize = buffer.size();
+    for(auto _ : state)
+    {
+        encode(buffer, isTable ? encodeTable : encodeValues);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(documentSize));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["document_bytes"] = double(documentSize);
+}
+BENCHMARK(BM_encode_table_rows)->ArgName("table")->Arg(0)->Arg(1);
+
+
+// ============================================================================
+// Record Logs
+// ============================================================================
+
+// Checksumming with each kernel set that this CPU supports
+static void BM_crc32c_kernels(benchmark::State& state)
+{
+    const ksbonjson_kernelSet originalKernelSet = ksbonjson_getKernelSet();
+    const ksbonjson_kernelSet kernelSet = ksbonjson_kernelSet(state.range(0));
+    if(!ksbonjson_setKernelSet(kernelSet))
+    {
+        state.SkipWithError("Not supported on this CPU");
+        return;
+    }
+    state.SetLabel(ksbonjson_kernelSetName(kernelSet));
+    const std::vector<uint8_t> data(size_t(state.range(1)), 0x5a);
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(ksbonjson_crc32c(0, data.data(), data.size()));
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+    ksbonjson_setKernelSet(originalKernelSet);
+}
+static void crc32cArgs(benchmark::internal::Benchmark* benchmark)
+{
+    for(int kernelSet = 0; kernelSet < KSBONJSON_KERNELS_COUNT; kernelSet++)
+    {
+        for(int length: {64, 65536})
+        {
+            benchmark->Args({kernelSet, length});
+        }
+    }
+}
+BENCHMARK(BM_crc32c_kernels)->Apply(crc32cArgs);
+
+// A log with one small document per record
+static std::vector<uint8_t> encodeRecordLog()
+{
+    std::vector<uint8_t> log;
+    std::vector<uint8_t> document;
+    for(int i = 0; i < RECORD_COUNT; i++)
+    {
+        encode(document, [i](KSBONJSONEncodeContext* ctx)
+        {
+            PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "id", 2));
+            PROPAGATE_ERROR(ksbonjson_addInteger(ctx, 1000000 + i));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "price", 5));
+            PROPAGATE_ERROR(ksbonjson_addFloat(ctx, (i % 10000) * 0.01 + 0.005));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "note", 4));
+            PROPAGATE_ERROR(ksbonjson_addString(ctx, "no particular remarks", 21));
+            return ksbonjson_endContainer(ctx);
+        });
+        uint8_t header[KSBONJSON_RECORD_HEADER_SIZE];
+        ksbonjson_frameRecord(header, document.data(), document.size());
+        log.insert(log.end(), header, header + sizeof(header));
+        log.insert(log.end(), document.begin(), document.end());
+    }
+    return log;
+}
+
+// Verify and iterate over every record in place.
+static void BM_read_record_log(benchmark::State& state)
+{
+    const std::vector<uint8_t> log = encodeRecordLog();
+
+    for(auto _ : state)
+    {
+        KSBONJSONRecordReader reader;
+        ksbonjson_beginRecordReading(&reader, log.data(), log.size());
+        const uint8_t* record;
+        size_t length;
+        size_t count = 0;
+        while(ksbonjson_readRecord(&reader, &record, &length) == KSBONJSON_RECORD_OK)
+        {
+            benchmark::DoNotOptimize(record);
+            count++;
+        }
+        if(count != RECORD_COUNT)
+        {
+            state.SkipWithError("Could not read the log");
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(log.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["log_bytes"] = double(log.size());
+}
+BENCHMARK(BM_read_record_log);
+
+// Append every record through a group-committing writer (into memory).
+static void BM_append_record_log(benchmark::State& state)
+{
+    const std::vector<uint8_t> log = encodeRecordLog();
+    std::vector<uint8_t> output;
+    output.reserve(log.size());
+    std::vector<uint8_t> buffer(65536);
+    const auto write = [](const uint8_t* data, size_t dataLength, void* userData)
+    {
+        std::vector<uint8_t>* output = (std::vector<uint8_t>*)userData;
+        output->insert(output->end(), data, data + dataLength);
+        return KSBONJSON_RECORD_OK;
+    };
+
+    for(auto _ : state)
+    {
+        output.clear();
+        KSBONJSONRecordWriter writer;
+        ksbonjson_beginRecordWriting(&writer, write, nullptr, &output, buffer.data(), buffer.size(), 1000, 0);
+        KSBONJSONRecordReader reader;
+        ksbonjson_beginRecordReading(&reader, log.data(), log.size());
+        const uint8_t* record;
+        size_t length;
+        uint64_t now = 0;
+        while(ksbonjson_readRecord(&reader, &record, &length) == KSBONJSON_RECORD_OK)
+        {
+            ksbonjson_appendRecord(&writer, record, length, now++);
+        }
+        ksbonjson_commitRecords(&writer, now);
+        if(output != log)
+        {
+            state.SkipWithError("Could not write the log");
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(log.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+}
+BENCHMARK(BM_append_record_log);
+
+// Append one record to the top-level array of a document of RECORD_COUNT
+// records, which only touches its closing byte.
+static void BM_append_to_array(benchmark::State& state)
+{
+    std::vector<uint8_t> document = encodeRecords();
+    const size_t documentLength = document.size();
+    const uint8_t closingByte = document.back();
+    const auto write = [](const uint8_t* data, size_t dataLength, void* userData)
+    {
+        std::vector<uint8_t>* output = (std::vector<uint8_t>*)userData;
+        output->insert(output->end(), data, data + dataLength);
+        return KSBONJSON_ENCODE_OK;
+    };
+
+    int64_t id = 0;
+    for(auto _ : state)
+    {
+        KSBONJSONEncodeContext ctx;
+        size_t appendOffset;
+        ksbonjson_encodeStatus status = ksbonjson_beginAppendingToArray(&ctx, write, &document, document.data(),
+                                                                        document.size(), &appendOffset);
+        document.resize(appendOffset);
+        if(status == KSBONJSON_ENCODE_OK)
+        {
+            status = [&ctx, &id]()
+            {
+                PROPAGATE_ERROR(ksbonjson_beginObject(&ctx));
+                PROPAGATE_ERROR(ksbonjson_addString(&ctx, "id", 2));
+                PROPAGATE_ERROR(ksbonjson_addInteger(&ctx, id++));
+                PROPAGATE_ERROR(ksbonjson_addString(&ctx, "user", 4));
+                PROPAGATE_ERROR(ksbonjson_addString(&ctx, "appender", 8));
+                PROPAGATE_ERROR(ksbonjson_endContainer(&ctx));
+                PROPAGATE_ERROR(ksbonjson_endContainer(&ctx));
+                return ksbonjson_endEncode(&ctx);
+            }();
+        }
+        if(status != KSBONJSON_ENCODE_OK)
+        {
+            state.SkipWithError("Could not append to the array");
+            return;
+        }
+
+        // Start over before the document gets too big
+        if(document.size() > documentLength * 2)
+        {
+            document.resize(documentLength);
+            document.back() = closingByte;
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.counters["document_bytes"] = double(documentLength);
+}
+BENCHMARK(BM_append_to_array);
+
+
+// ============================================================================
+// Indexes
+// ============================================================================
+
+static std::vector<uint8_t> buildRecordIndex(const std::vector<uint8_t>& document, size_t stride)
+{
+    const KSBONJSONIndexOptions options = {KSBONJSON_INDEX_ARRAY, stride, "/id", 3};
+    size_t length = 0;
+    ksbonjson_buildIndex(document.data(), document.size(), &options, nullptr, 0, &length);
+    std::vector<uint8_t> index(length);
+    if(ksbonjson_buildIndex(document.data(), document.size(), &options, index.data(), index.size(), &length) != KSBONJSON_DOCUMENT_OK)
+    {
+        throw std::runtime_error("Could not build the index");
+    }
+    return index;
+}
+
+// Find records by position, recording every Nth offset (a stride of
+// RECORD_COUNT is a linear scan from the start).
+static void BM_find_indexed_element(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    const std::vector<uint8_t> data = buildRecordIndex(document, size_t(state.range(0)));
+    KSBONJSONIndex index;
+    ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size());
+
+    uint64_t elementIndex = 0;
+    for(auto _ : state)
+    {
+        const uint8_t* value;
+        size_t valueLength;
+        elementIndex = (elementIndex + 7919) % RECORD_COUNT;
+        if(ksbonjson_findIndexedElement(&index, elementIndex, &value, &valueLength) != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not find the record");
+            return;
+        }
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.counters["index_bytes"] = double(data.size());
+}
+BENCHMARK(BM_find_indexed_element)->ArgName("stride")->Arg(1)->Arg(64)->Arg(RECORD_COUNT);
+
+// Find records by their "id" member.
+static void BM_find_indexed_key(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    const std::vector<uint8_t> data = buildRecordIndex(document, 64);
+    KSBONJSONIndex index;
+    ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size());
+
+    int64_t id = 0;
+    for(auto _ : state)
+    {
+        const uint8_t* value;
+        size_t valueLength;
+        id = (id + 7919) % RECORD_COUNT;
+        if(ksbonjson_findIndexedInteger(&index, 1000000 + id, &value, &valueLength) != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not find the record");
+            return;
+        }
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.counters["index_bytes"] = double(data.size());
+}
+BENCHMARK(BM_find_indexed_key);
+
+static void BM_build_index(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(buildRecordIndex(document, 64));
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+}
+BENCHMARK(BM_build_index);
+
+
+// ============================================================================
+// Zone Maps
+// ============================================================================
+
+static ksbonjson_documentStatus countZoneMapMatch(const uint8_t*, size_t, uint64_t, void* userData)
+{
+    (*static_cast<uint64_t*>(userData))++;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+// Find the records with 1% of the ids (query 0) or one of the 1000 users
+// (query 1), with blocks of 64 records or all records in one block (which
+// can't skip anything).
+static void BM_scan_zone_map(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    const std::vector<uint8_t> indexData = buildRecordIndex(document, size_t(state.range(1)));
+    KSBONJSONIndex index;
+    ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size());
+    const char* paths[] = {"/id", "/user"};
+    const size_t pathLengths[] = {3, 5};
+    const KSBONJSONZoneMapOptions options = {paths, pathLengths, 2, 64};
+    std::vector<uint8_t> data(ksbonjson_zoneMapSize(&index, &options));
+    ksbonjson_buildZoneMap(&index, &options, data.data(), data.size());
+    KSBONJSONZoneMap zoneMap;
+    ksbonjson_openZoneMap(&zoneMap, data.data(), data.size(), &index);
+
+    const KSBONJSONPredicate predicate = state.range(0) == 0 ?
+        KSBONJSONPredicate{0, nullptr, 0, 1050000, 1050000 + RECORD_COUNT / 100 - 1} :
+        KSBONJSONPredicate{1, "user7", 5, 0, 0};
+    const uint64_t expectedMatchCount = state.range(0) == 0 ? RECORD_COUNT / 100 : RECORD_COUNT / 1000;
+    uint64_t matchCount = 0;
+    uint64_t scannedBlockCount = 0;
+    for(auto _ : state)
+    {
+        matchCount = 0;
+        if(ksbonjson_scanZoneMap(&zoneMap, &predicate, 1, countZoneMapMatch, &matchCount, &scannedBlockCount) != KSBONJSON_DOCUMENT_OK ||
+           matchCount != expectedMatchCount)
+        {
+            state.SkipWithError("Could not scan the records");
+            return;
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * RECORD_COUNT);
+    state.counters["scanned_blocks"] = double(scannedBlockCount);
+    state.counters["zone_map_bytes"] = double(data.size());
+}
+BENCHMARK(BM_scan_zone_map)->ArgNames({"query", "stride"})->ArgsProduct({{0, 1}, {64, RECORD_COUNT}});
+
+
+// ============================================================================
+// Shards
+// ============================================================================
+
+// Find the boundaries of 16 shards by skipping over every record (stride 0)
+// or by looking up every Nth record in an index.
+static void BM_split_array(benchmark::State& state)
+{
+    const std::vector<uint8_t> document = encodeRecords();
+    const size_t stride = size_t(state.range(0));
+    const std::vector<uint8_t> indexData = buildRecordIndex(document, stride == 0 ? RECORD_COUNT : stride);
+    KSBONJSONIndex index;
+    ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size());
+    KSBONJSONShard shards[16];
+
+    for(auto _ : state)
+    {
+        const ksbonjson_documentStatus status = stride == 0 ?
+            ksbonjson_splitArray(document.data(), document.size(), 16, shards) :
+            ksbonjson_splitIndexedArray(&index, 16, shards);
+        if(status != KSBONJSON_DOCUMENT_OK)
+        {
+            state.SkipWithError("Could not split the records");
+            return;
+        }
+        benchmark::DoNotOptimize(shards);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(document.size()));
+}
+BENCHMARK(BM_split_array)->ArgName("stride")->Arg(0)->Arg(64);
+
+
+BENCHMARK_MAIN();
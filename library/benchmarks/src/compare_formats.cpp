@@ -0,0 +1,678 @@
+//
+//  compare_formats.cpp
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Encodes and decodes the same documents in BONJSON, JSON (json-c), CBOR and
+// MessagePack, and reports the size, speed and peak memory use of each.
+//
+// Every encoder works from the same in-memory document, and every decoder
+// builds a complete in-memory document (json-c builds its own object tree).
+// Each measurement runs in a child process so that its peak memory use can
+// be measured in isolation.
+
+#include "Document.h"
+#include "KSBONJSONCorpusGenerator.h"
+#include "ReferenceCodecs.h"
+#include "SyntheticCorpora.h"
+
+#include <ksbonjson/KSBONJSONEncoder.h>
+#include <ksbonjson/KSBONJSONDecoder.h>
+
+#if BONJSON_HAVE_JSONC
+#include <json.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define DEFAULT_MIN_SECONDS 0.5
+
+
+// ============================================================================
+// BONJSON
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        ksbonjson_encodeStatus propagatedResult = CALL; \
+        if(propagatedResult != KSBONJSON_ENCODE_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+static ksbonjson_encodeStatus addEncodedDataCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                                     size_t length,
+                                                     void* KSBONJSON_RESTRICT userData)
+{
+    std::vector<uint8_t>* buffer = static_cast<std::vector<uint8_t>*>(userData);
+    buffer->insert(buffer->end(), data, data + length);
+    return KSBONJSON_ENCODE_OK;
+}
+
+static ksbonjson_encodeStatus encodeBONJSONValue(KSBONJSONEncodeContext* ctx, const Value& value)
+{
+    switch(value.type)
+    {
+        case Value::Null:
+            return ksbonjson_addNull(ctx);
+        case Value::Boolean:
+            return ksbonjson_addBoolean(ctx, value.boolean);
+        case Value::Integer:
+            return ksbonjson_addInteger(ctx, value.integer);
+        case Value::UInteger:
+            return ksbonjson_addUInteger(ctx, value.uinteger);
+        case Value::Float:
+            return ksbonjson_addFloat(ctx, value.floatValue);
+        case Value::String:
+            return ksbonjson_addString(ctx, value.string.data(), value.string.size());
+        case Value::Array:
+            PROPAGATE_ERROR(ksbonjson_beginArray(ctx));
+            for(const Value& element: value.elements)
+            {
+                PROPAGATE_ERROR(encodeBONJSONValue(ctx, element));
+            }
+            return ksbonjson_endContainer(ctx);
+        case Value::Object:
+            PROPAGATE_ERROR(ksbonjson_beginObject(ctx));
+            for(const auto& member: value.members)
+            {
+                PROPAGATE_ERROR(ksbonjson_addString(ctx, member.first.data(), member.first.size()));
+                PROPAGATE_ERROR(encodeBONJSONValue(ctx, member.second));
+            }
+            return ksbonjson_endContainer(ctx);
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+static void encodeBONJSON(const Value& value, std::vector<uint8_t>& output)
+{
+    KSBONJSONEncodeContext ctx;
+    ksbonjson_beginEncode(&ctx, addEncodedDataCallback, &output);
+    ksbonjson_encodeStatus status = encodeBONJSONValue(&ctx, value);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&ctx);
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        throw std::runtime_error(ksbonjson_encodeStatusDescription(status));
+    }
+}
+
+#define BUILDER(USER_DATA) (*static_cast<DocumentBuilder*>(USER_DATA))
+
+static ksbonjson_decodeStatus onBoolean(bool value, void* userData)
+{
+    BUILDER(userData).addBoolean(value);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onInteger(int64_t value, void* userData)
+{
+    BUILDER(userData).addInteger(value);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onUInteger(uint64_t value, void* userData)
+{
+    BUILDER(userData).addUInteger(value);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onFloat(double value, void* userData)
+{
+    BUILDER(userData).addFloat(value);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onNull(void* userData)
+{
+    BUILDER(userData).addNull();
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onString(const char* KSBONJSON_RESTRICT value,
+                                       size_t length,
+                                       void* KSBONJSON_RESTRICT userData)
+{
+    BUILDER(userData).addString(value, length);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onBeginObject(void* userData)
+{
+    BUILDER(userData).beginObject();
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onBeginArray(void* userData)
+{
+    BUILDER(userData).beginArray();
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onEndContainer(void* userData)
+{
+    BUILDER(userData).endContainer();
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onEndData(void* userData)
+{
+    (void)userData;
+    return KSBONJSON_DECODE_OK;
+}
+
+static const KSBONJSONDecodeCallbacks g_builderCallbacks =
+{
+    .onBoolean = onBoolean,
+    .onInteger = onInteger,
+    .onUInteger = onUInteger,
+    .onFloat = onFloat,
+    .onNull = onNull,
+    .onString = onString,
+    .onBeginObject = onBeginObject,
+    .onBeginArray = onBeginArray,
+    .onEndContainer = onEndContainer,
+    .onEndData = onEndData,
+};
+
+static Value decodeBONJSON(const std::vector<uint8_t>& document)
+{
+    DocumentBuilder builder;
+    size_t decodedOffset = 0;
+    ksbonjson_decodeStatus status = ksbonjson_decode(document.data(),
+                                                     document.size(),
+                                                     &g_builderCallbacks,
+                                                     &builder,
+                                                     &decodedOffset);
+    if(status != KSBONJSON_DECODE_OK)
+    {
+        throw std::runtime_error(ksbonjson_decodeStatusDescription(status));
+    }
+    return builder.takeDocument();
+}
+
+
+// ============================================================================
+// JSON
+// ============================================================================
+
+#if BONJSON_HAVE_JSONC
+
+static json_object* toJsonObject(const Value& value)
+{
+    switch(value.type)
+    {
+        case Value::Null:
+            return NULL;
+        case Value::Boolean:
+            return json_object_new_boolean(value.boolean);
+        case Value::Integer:
+            return json_object_new_int64(value.integer);
+        case Value::UInteger:
+            return json_object_new_uint64(value.uinteger);
+        case Value::Float:
+            return json_object_new_double(value.floatValue);
+        case Value::String:
+            return json_object_new_string_len(value.string.data(), int(value.string.size()));
+        case Value::Array:
+        {
+            json_object* array = json_object_new_array_ext(int(value.elements.size()));
+            for(const Value& element: value.elements)
+            {
+                json_object_array_add(array, toJsonObject(element));
+            }
+            return array;
+        }
+        case Value::Object:
+        {
+            json_object* object = json_object_new_object();
+            for(const auto& member: value.members)
+            {
+                json_object_object_add(object, member.first.c_str(), toJsonObject(member.second));
+            }
+            return object;
+        }
+    }
+    return NULL;
+}
+
+// json-c can only serialize its own object tree, so building the tree is
+// part of the cost of encoding.
+static void encodeJSON(const Value& value, std::vector<uint8_t>& output)
+{
+    json_object* object = toJsonObject(value);
+    size_t length = 0;
+    const char* json = json_object_to_json_string_length(object, JSON_C_TO_STRING_PLAIN, &length);
+    output.insert(output.end(), json, json + length);
+    json_object_put(object);
+}
+
+static void decodeJSON(const std::vector<uint8_t>& document)
+{
+    json_tokener* tokener = json_tokener_new_ex(KSBONJSON_MAX_CONTAINER_DEPTH);
+    json_object* object = json_tokener_parse_ex(tokener,
+                                                reinterpret_cast<const char*>(document.data()),
+                                                int(document.size()));
+    const enum json_tokener_error error = json_tokener_get_error(tokener);
+    json_tokener_free(tokener);
+    if(error != json_tokener_success)
+    {
+        throw std::runtime_error(json_tokener_error_desc(error));
+    }
+    json_object_put(object);
+}
+
+#endif // BONJSON_HAVE_JSONC
+
+
+// ============================================================================
+// Formats
+// ============================================================================
+
+struct Format
+{
+    const char* name;
+    std::function<void(const Value&, std::vector<uint8_t>&)> encode;
+    std::function<void(const std::vector<uint8_t>&)> decode;
+    // Decode back into a Value to check that the format round-trips the data.
+    // Not every format can (JSON has no way to tell 1.0 from 1).
+    std::function<Value(const std::vector<uint8_t>&)> decodeToValue;
+};
+
+static Value decodeCBORToValue(const std::vector<uint8_t>& document)
+{
+    DocumentBuilder builder;
+    decodeCBOR(document.data(), document.size(), builder);
+    return builder.takeDocument();
+}
+
+static Value decodeMessagePackToValue(const std::vector<uint8_t>& document)
+{
+    DocumentBuilder builder;
+    decodeMessagePack(document.data(), document.size(), builder);
+    return builder.takeDocument();
+}
+
+static const std::vector<Format> g_formats =
+{
+    {"BONJSON", encodeBONJSON, [](const std::vector<uint8_t>& document) { decodeBONJSON(document); }, decodeBONJSON},
+#if BONJSON_HAVE_JSONC
+    {"JSON (json-c)", encodeJSON, decodeJSON, nullptr},
+#endif
+    {"CBOR", encodeCBOR, [](const std::vector<uint8_t>& document) { decodeCBORToValue(document); }, decodeCBORToValue},
+    {"MessagePack", encodeMessagePack, [](const std::vector<uint8_t>& document) { decodeMessagePackToValue(document); }, decodeMessagePackToValue},
+};
+
+
+// ============================================================================
+// Corpora
+// ============================================================================
+
+struct Corpus
+{
+    std::string name;
+    std::vector<uint8_t> bonjson;
+};
+
+static Corpus makeCorpus(const std::string& name, ksbonjson_encodeStatus (*encodeFunc)(KSBONJSONEncodeContext*))
+{
+    Corpus corpus = {name, {}};
+    KSBONJSONEncodeContext ctx;
+    ksbonjson_beginEncode(&ctx, addEncodedDataCallback, &corpus.bonjson);
+    ksbonjson_encodeStatus status = encodeFunc(&ctx);
+    if(status == KSBONJSON_ENCODE_OK)
+    {
+        status = ksbonjson_endEncode(&ctx);
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        throw std::runtime_error(ksbonjson_encodeStatusDescription(status));
+    }
+    return corpus;
+}
+
+static ksbonjson_encodeStatus encodeGeneratedCorpus(KSBONJSONEncodeContext* ctx)
+{
+    KSBONJSONCorpusSpec spec;
+    ksbonjson_corpusDefaultSpec(&spec);
+    spec.recordCount = 5000;
+    return ksbonjson_corpusGenerate(&spec, ctx);
+}
+
+static std::vector<Corpus> defaultCorpora()
+{
+    return
+    {
+        makeCorpus("twitter", encodeTwitterCorpus),
+        makeCorpus("citm_catalog", encodeCitmCorpus),
+        makeCorpus("canada", encodeCanadaCorpus),
+        makeCorpus("generated", encodeGeneratedCorpus),
+    };
+}
+
+static Corpus loadCorpus(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file)
+    {
+        throw std::runtime_error(std::string("Could not open ") + path);
+    }
+    Corpus corpus = {path, {}};
+    corpus.bonjson.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return corpus;
+}
+
+
+// ============================================================================
+// Measurement
+// ============================================================================
+
+struct Result
+{
+    size_t encodedSize;
+    double encodeSeconds;
+    double decodeSeconds;
+    long baselineKB;
+    bool roundTrips;
+    char error[200];
+};
+
+// Run a function repeatedly for at least minSeconds, returning the average time per call.
+static double timePerCall(double minSeconds, const std::function<void()>& func)
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    size_t iterations = 0;
+    double elapsed;
+    do
+    {
+        func();
+        iterations++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while(elapsed < minSeconds);
+    return elapsed / double(iterations);
+}
+
+static long maxRSSKilobytes(const struct rusage& usage)
+{
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void runMeasurement(const Format& format, const Value& document, double minSeconds, Result* result)
+{
+    // Everything touched so far (mostly the source document) counts towards the
+    // baseline rather than towards the format's own memory use.
+    std::vector<uint8_t> encoded;
+    format.encode(document, encoded);
+    encoded = std::vector<uint8_t>();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result->baselineKB = maxRSSKilobytes(usage);
+
+    result->encodeSeconds = timePerCall(minSeconds, [&]()
+    {
+        encoded.clear();
+        format.encode(document, encoded);
+    });
+    result->encodedSize = encoded.size();
+    result->decodeSeconds = timePerCall(minSeconds, [&]()
+    {
+        format.decode(encoded);
+    });
+    result->roundTrips = format.decodeToValue && format.decodeToValue(encoded) == document;
+}
+
+// Measure in a child process so that peak memory isn't polluted by earlier runs.
+static bool measure(const Format& format,
+                    const Value& document,
+                    double minSeconds,
+                    Result* result,
+                    long* peakKB)
+{
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+        throw std::runtime_error("Could not create pipe");
+    }
+
+    const pid_t pid = fork();
+    if(pid < 0)
+    {
+        throw std::runtime_error("Could not fork");
+    }
+    if(pid == 0)
+    {
+        close(fds[0]);
+        Result childResult = {};
+        try
+        {
+            runMeasurement(format, document, minSeconds, &childResult);
+        }
+        catch(const std::exception& e)
+        {
+            snprintf(childResult.error, sizeof(childResult.error), "%s", e.what());
+        }
+        const ssize_t written = write(fds[1], &childResult, sizeof(childResult));
+        _exit(written == ssize_t(sizeof(childResult)) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    *result = Result();
+    const ssize_t bytesRead = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0
+       || bytesRead != ssize_t(sizeof(*result)))
+    {
+        snprintf(result->error, sizeof(result->error), "Measurement process failed");
+        return false;
+    }
+    *peakKB = maxRSSKilobytes(usage) - result->baselineKB;
+    return result->error[0] == 0;
+}
+
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static void printUsage(const char* exeName)
+{
+    printf("Usage: %s [-t <seconds>] [-j] [file.bonjson ...]\n", exeName);
+    printf("\n");
+    printf("Compares BONJSON against other formats on the given BONJSON documents\n");
+    printf("(or on a set of built-in synthetic corpora if none are given).\n");
+    printf("\n");
+    printf("  -t <seconds>: Minimum time to spend on each measurement (default %g)\n", DEFAULT_MIN_SECONDS);
+    printf("  -j: Print the results as JSON\n");
+}
+
+static void printJSONString(const std::string& str)
+{
+    putchar('"');
+    for(unsigned char ch: str)
+    {
+        if(ch == '"' || ch == '\\')
+        {
+            printf("\\%c", ch);
+        }
+        else if(ch < 0x20)
+        {
+            printf("\\u%04x", ch);
+        }
+        else
+        {
+            putchar(ch);
+        }
+    }
+    putchar('"');
+}
+
+int main(int argc, char** argv)
+{
+    double minSeconds = DEFAULT_MIN_SECONDS;
+    bool printJSON = false;
+    int ch;
+    while((ch = getopt(argc, argv, "ht:j")) >= 0)
+    {
+        switch(ch)
+        {
+            case 't':
+                minSeconds = atof(optarg);
+                break;
+            case 'j':
+                printJSON = true;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    std::vector<Corpus> corpora;
+    try
+    {
+        if(optind < argc)
+        {
+            for(int i = optind; i < argc; i++)
+            {
+                corpora.push_back(loadCorpus(argv[i]));
+            }
+        }
+        else
+        {
+            corpora = defaultCorpora();
+        }
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    // Let the children's output stay separate from ours.
+    fflush(stdout);
+
+    bool success = true;
+    bool isFirstResult = true;
+    if(printJSON)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("%-16s %-14s %12s %10s %10s %10s %10s %10s %6s\n",
+               "Corpus", "Format", "Bytes", "Enc ms", "Enc MB/s", "Dec ms", "Dec MB/s", "Peak KB", "Exact");
+    }
+
+    for(const Corpus& corpus: corpora)
+    {
+        Value document;
+        try
+        {
+            document = decodeBONJSON(corpus.bonjson);
+        }
+        catch(const std::exception& e)
+        {
+            fprintf(stderr, "Error: %s: %s\n", corpus.name.c_str(), e.what());
+            success = false;
+            continue;
+        }
+
+        for(const Format& format: g_formats)
+        {
+            Result result;
+            long peakKB = 0;
+            fflush(stdout);
+            if(!measure(format, document, minSeconds, &result, &peakKB))
+            {
+                fprintf(stderr, "Error: %s / %s: %s\n", corpus.name.c_str(), format.name, result.error);
+                success = false;
+                continue;
+            }
+
+            const double encodeMBps = double(result.encodedSize) / result.encodeSeconds / 1e6;
+            const double decodeMBps = double(result.encodedSize) / result.decodeSeconds / 1e6;
+            const char* exact = format.decodeToValue ? (result.roundTrips ? "yes" : "NO") : "-";
+            if(printJSON)
+            {
+                printf("%s  {\"corpus\": ", isFirstResult ? "" : ",\n");
+                printJSONString(corpus.name);
+                printf(", \"format\": ");
+                printJSONString(format.name);
+                printf(", \"bytes\": %zu, \"encode_seconds\": %.9f, \"encode_mb_per_second\": %.3f"
+                       ", \"decode_seconds\": %.9f, \"decode_mb_per_second\": %.3f, \"peak_kb\": %ld",
+                       result.encodedSize, result.encodeSeconds, encodeMBps,
+                       result.decodeSeconds, decodeMBps, peakKB);
+                if(format.decodeToValue)
+                {
+                    printf(", \"round_trips\": %s", result.roundTrips ? "true" : "false");
+                }
+                printf("}");
+                isFirstResult = false;
+            }
+            else
+            {
+                printf("%-16s %-14s %12zu %10.3f %10.1f %10.3f %10.1f %10ld %6s\n",
+                       corpus.name.c_str(), format.name, result.encodedSize,
+                       result.encodeSeconds * 1000, encodeMBps,
+                       result.decodeSeconds * 1000, decodeMBps, peakKB, exact);
+            }
+        }
+    }
+
+    if(printJSON)
+    {
+        printf("\n]\n");
+    }
+    return success ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+//
+//  generate_corpus.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "KSBONJSONCorpusGenerator.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static ksbonjson_encodeStatus addEncodedDataCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                                     size_t dataLength,
+                                                     void* KSBONJSON_RESTRICT userData)
+{
+    FILE* file = (FILE*)userData;
+    if(fwrite(data, 1, dataLength, file) != dataLength)
+    {
+        return KSBONJSON_ENCODE_COULD_NOT_ADD_DATA;
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+static void printUsage(const char* exeName)
+{
+    printf("Usage: %s [-o <file>] [name=value ...]\n", exeName);
+    printf("\n");
+    printf("Generates a synthetic BONJSON document: an array of randomly generated\n");
+    printf("objects. The same spec always generates the same document.\n");
+    printf("\n");
+    printf("Spec fields (weights are relative, ranges are <n> or <min>-<max>):\n");
+    printf("  seed=<n>                Random seed\n");
+    printf("  records=<n>             Number of top-level records\n");
+    printf("  types=<7 weights>       null,boolean,integer,float,string,array,object\n");
+    printf("  int-widths=<10 weights> small,8,16,24,32,40,48,56,64-bit signed,64-bit unsigned\n");
+    printf("  float-precisions=<3 weights> float16,float32,float64\n");
+    printf("  string-length=<range>   Length of string values\n");
+    printf("  object-width=<range>    Members per object\n");
+    printf("  array-length=<range>    Elements per array\n");
+    printf("  depth=<n>               Maximum nesting depth of a record\n");
+    printf("  keys=<n>                Number of distinct member names\n");
+    printf("  key-length=<range>      Length of member names\n");
+    printf("\n");
+    printf("Example: %s records=10000 types=0,0,1,0,0,0,0 int-widths=1,1,0,0,0,0,0,0,0,0\n", exeName);
+}
+
+int main(int argc, char** argv)
+{
+    KSBONJSONCorpusSpec spec;
+    ksbonjson_corpusDefaultSpec(&spec);
+    const char* outputPath = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if(strcmp(arg, "-h") == 0)
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if(strcmp(arg, "-o") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+            continue;
+        }
+
+        const char* separator = strchr(arg, '=');
+        char name[64];
+        if(separator == NULL || (size_t)(separator - arg) >= sizeof(name))
+        {
+            fprintf(stderr, "Error: Invalid argument \"%s\"\n", arg);
+            return 1;
+        }
+        memcpy(name, arg, (size_t)(separator - arg));
+        name[separator - arg] = 0;
+        if(!ksbonjson_corpusSetSpecField(&spec, name, separator + 1))
+        {
+            fprintf(stderr, "Error: Invalid spec field \"%s\"\n", arg);
+            return 1;
+        }
+    }
+
+    FILE* file = stdout;
+    if(outputPath != NULL)
+    {
+        file = fopen(outputPath, "wb");
+        if(file == NULL)
+        {
+            fprintf(stderr, "Error: Could not open %s: %s\n", outputPath, strerror(errno));
+            return 1;
+        }
+    }
+
+    KSBONJSONEncodeContext ctx;
+    ksbonjson_beginEncode(&ctx, addEncodedDataCallback, file);
+    ksbonjson_encodeStatus status = ksbonjson_corpusGenerate(&spec, &ctx);
+    if(fclose(file) != 0 && status == KSBONJSON_ENCODE_OK)
+    {
+        status = KSBONJSON_ENCODE_COULD_NOT_ADD_DATA;
+    }
+    if(status != KSBONJSON_ENCODE_OK)
+    {
+        fprintf(stderr, "Error: %s\n", ksbonjson_encodeStatusDescription(status));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+//  KSBONJSONAggregate.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONAggregate_h
+#define KSBONJSONAggregate_h
+
+#include "KSBONJSONDocument.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The most aggregates that can be computed in one pass.
+ */
+#define KSBONJSON_MAX_AGGREGATES 64
+
+/**
+ * The most segments that an aggregate's path can have.
+ */
+#define KSBONJSON_MAX_PATH_SEGMENTS 32
+
+/**
+ * Statistics about the values at a path.
+ */
+typedef struct
+{
+    /**
+     * A JSON Pointer (RFC 6901), where a "*" segment matches every member of
+     * an object or every element of an array. For example, "/items/0/price"
+     * matches the price of the first item, and with the 0 replaced by a "*"
+     * it matches the price of every item.
+     */
+    const char* path;
+    size_t pathLength;
+
+    /**
+     * Optional histogram of the numbers: bucketCounts[i] counts the numbers
+     * that are <= bucketBounds[i] (and > bucketBounds[i - 1]), and
+     * bucketCounts[bucketBoundCount] counts the numbers above every bound.
+     * The bounds must be in ascending order, and bucketCounts must have room
+     * for bucketBoundCount + 1 counts.
+     */
+    const double* bucketBounds;
+    size_t bucketBoundCount;
+    uint64_t* bucketCounts;
+
+    // The results:
+
+    /** The number of numbers at the path. */
+    uint64_t count;
+
+    /** The number of other values (null, booleans, strings, containers) at the path. */
+    uint64_t otherCount;
+
+    /** The sum, minimum, and maximum of the numbers (0 if there are none). */
+    double sum;
+    double min;
+    double max;
+
+    /**
+     * The exact sum, as long as every number was an integer and the sum fits
+     * in an int64 (isIntegerSum is false otherwise).
+     */
+    int64_t integerSum;
+    bool isIntegerSum;
+
+    // Private: The compiled path
+    size_t segmentCount;
+    size_t segmentEnds[KSBONJSON_MAX_PATH_SEGMENTS];
+    int64_t segmentIndices[KSBONJSON_MAX_PATH_SEGMENTS];
+    uint32_t escapedSegments;
+} KSBONJSONAggregate;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Compute aggregates over the values at paths in a document, in a single
+ * pass over it.
+ *
+ * Values are never decoded unless they're at one of the paths (and then only
+ * numbers are decoded). Members and elements that aren't on any of the paths
+ * are skipped without being decoded.
+ *
+ * Any previous results in the aggregates are cleared.
+ *
+ * @param document The document.
+ * @param documentLength The length of the document.
+ * @param aggregates The aggregates to compute (no more than KSBONJSON_MAX_AGGREGATES).
+ * @param aggregateCount The number of aggregates.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_aggregate(const uint8_t* document,
+                                                              size_t documentLength,
+                                                              KSBONJSONAggregate* aggregates,
+                                                              size_t aggregateCount);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONAggregate_h
@@ -0,0 +1,101 @@
+//
+//  KSBONJSONCanonical.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONCanonical_h
+#define KSBONJSONCanonical_h
+
+#include "KSBONJSONDocument.h"
+#include "KSBONJSONEncoder.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Scratch space for sorting an object's members.
+ */
+typedef struct
+{
+    const uint8_t* name;
+    const uint8_t* value;
+    const uint8_t* valueEnd;
+} KSBONJSONCanonicalMember;
+
+/**
+ * Re-encode a document in canonical form, so that documents holding the same
+ * JSON value (as in ksbonjson_isEqualEncoded()) encode to the same bytes:
+ *
+ *   - Every number is encoded as the encoder would encode it: in the smallest
+ *     type that holds it exactly, and as an integer if it is one.
+ *   - Object members are sorted by name (comparing the UTF-8 bytes, which
+ *     sorts by code point).
+ *
+ * Objects must not have duplicate member names.
+ *
+ * Each object's members are sorted in the members buffer, so it needs one
+ * entry per member in the largest object, plus one per member of each object
+ * that it is nested in. Each object is scanned once more for each level of
+ * nesting that it is in.
+ *
+ * @param document The document to canonicalize.
+ * @param documentLength The length of the document.
+ * @param members Storage for sorting object members.
+ * @param memberCount The number of entries in the members buffer.
+ * @param encoder The encoder to encode the result into (after ksbonjson_beginEncode()).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_canonicalize(const uint8_t* document,
+                                                                 size_t documentLength,
+                                                                 KSBONJSONCanonicalMember* members,
+                                                                 size_t memberCount,
+                                                                 KSBONJSONEncodeContext* encoder);
+
+/**
+ * Check if a document is already in canonical form (see ksbonjson_canonicalize()).
+ *
+ * This needs no scratch space, and stops at the first value that isn't
+ * canonical.
+ *
+ * @param document The document to check.
+ * @param documentLength The length of the document.
+ * @param isCanonical Set to true if the document is canonical.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_isCanonical(const uint8_t* document,
+                                                                size_t documentLength,
+                                                                bool* isCanonical);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONCanonical_h
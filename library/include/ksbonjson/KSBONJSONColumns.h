@@ -0,0 +1,171 @@
+//
+//  KSBONJSONColumns.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONColumns_h
+#define KSBONJSONColumns_h
+
+#include "KSBONJSONDocument.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The most columns that can be extracted at once.
+ */
+#define KSBONJSON_MAX_COLUMNS 64
+
+typedef enum
+{
+    /**
+     * Integers (and floats that hold an integer). Stored in `integers`.
+     */
+    KSBONJSON_COLUMN_INT64 = 0,
+
+    /**
+     * Any number, converted to double. Stored in `floats`.
+     */
+    KSBONJSON_COLUMN_FLOAT64 = 1,
+
+    /**
+     * Strings, as slices of the source document. Stored in `strings`.
+     */
+    KSBONJSON_COLUMN_STRING = 2,
+} ksbonjson_columnType;
+
+/**
+ * Where a string is in the source document (its UTF-8 bytes, without the
+ * string delimiters).
+ */
+typedef struct
+{
+    size_t offset;
+    size_t length;
+} KSBONJSONStringSlice;
+
+/**
+ * A member to extract from every record, and where to store it.
+ *
+ * Only the buffer for the column's type is used, and it must have room for
+ * one value per row. Rows where the member is null or missing get a zero
+ * value (or an empty slice).
+ */
+typedef struct
+{
+    const char* name;
+    size_t nameLength;
+    ksbonjson_columnType type;
+
+    int64_t* integers;
+    double* floats;
+    KSBONJSONStringSlice* strings;
+
+    /**
+     * One bit per row (least significant bit first, as in Apache Arrow),
+     * set if the row has a value, and clear if it's null or missing. Can be
+     * NULL if you don't need it.
+     */
+    uint8_t* validity;
+} KSBONJSONColumn;
+
+/**
+ * Extraction state. The fields are private.
+ */
+typedef struct
+{
+    KSBONJSONColumn* columns;
+    size_t columnCount;
+    const uint8_t* document;
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    // Open addressing table of column index + 1 (0 is an empty slot),
+    // indexed by a hash of the member name.
+    uint8_t keyTable[KSBONJSON_MAX_COLUMNS * 2];
+} KSBONJSONColumnExtractor;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Begin extracting columns from a document that is an array of objects
+ * (records).
+ *
+ * The column list is compiled into a lookup table here, so member names are
+ * matched without comparing them to every column's name. Members that aren't
+ * in the list are skipped without being decoded.
+ *
+ * @param extractor The extraction state.
+ * @param document The document (must stay valid until extraction is done).
+ * @param documentLength The length of the document.
+ * @param columns The columns to extract (no more than KSBONJSON_MAX_COLUMNS,
+ *                and no two with the same name). They must stay valid
+ *                until extraction is done.
+ * @param columnCount The number of columns.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_beginColumnExtraction(KSBONJSONColumnExtractor* extractor,
+                                                                          const uint8_t* document,
+                                                                          size_t documentLength,
+                                                                          KSBONJSONColumn* columns,
+                                                                          size_t columnCount);
+
+/**
+ * Extract the next batch of records into the columns' buffers, starting at
+ * row 0 of each buffer.
+ *
+ * The document is read in a single pass, and the values are decoded directly
+ * into the buffers (there are no callbacks per value or per record).
+ *
+ * A record member whose value doesn't fit its column's type (for example a
+ * string in an INT64 column, or a float in an INT64 column) fails with
+ * KSBONJSON_DOCUMENT_WRONG_TYPE. After a failure, the extractor can't be used
+ * any further.
+ *
+ * @param extractor The extraction state.
+ * @param rowCapacity The most rows to extract (the size of the buffers).
+ * @param rowCount Set to the number of rows extracted (0 once the array
+ *                 has been read to the end). If this fails, it's the number
+ *                 of rows before the one that failed.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_extractColumns(KSBONJSONColumnExtractor* extractor,
+                                                                   size_t rowCapacity,
+                                                                   size_t* rowCount);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONColumns_h
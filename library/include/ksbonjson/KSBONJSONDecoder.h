@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include "KSBONJSONStats.h"
 
 
 // ============================================================================
@@ -274,6 +275,29 @@ typedef struct KSBONJSONDecodeCallbacks
 
 } KSBONJSONDecodeCallbacks;
 
+typedef struct
+{
+    uint8_t isObject: 1;
+    uint8_t isExpectingName: 1;
+} KSBONJSONDecodeContainerState;
+
+/**
+ * Decoder state that persists between calls to ksbonjson_decodeChunk().
+ */
+typedef struct
+{
+    const KSBONJSONDecodeCallbacks* callbacks;
+    void* userData;
+    int containerDepth;
+    KSBONJSONDecodeContainerState containers[KSBONJSON_MAX_CONTAINER_DEPTH];
+    // How much of a string cut off by the end of the last chunk has already
+    // been searched for its terminator.
+    size_t stringBytesScanned;
+#if KSBONJSON_STATS
+    KSBONJSONStats stats;
+#endif
+} KSBONJSONDecodeContext;
+
 
 // ============================================================================
 // API
@@ -295,6 +319,65 @@ KSBONJSON_PUBLIC ksbonjson_decodeStatus ksbonjson_decode(const uint8_t* KSBONJSO
                                                          void* KSBONJSON_RESTRICT userData,
                                                          size_t* KSBONJSON_RESTRICT decodedOffset);
 
+/**
+ * Begin a new incremental decoding process.
+ *
+ * Use this API instead of ksbonjson_decode() when the document arrives in pieces
+ * (for example from a pipe or socket) and you don't want to buffer all of it.
+ *
+ * @param context The decoding context.
+ * @param callbacks The callbacks to call with events as the document is decoded.
+ * @param userData Any user-defined data you want passed to the callbacks.
+ */
+KSBONJSON_PUBLIC void ksbonjson_beginDecode(KSBONJSONDecodeContext* context,
+                                            const KSBONJSONDecodeCallbacks* callbacks,
+                                            void* userData);
+
+/**
+ * Decode the next chunk of a BONJSON document.
+ *
+ * Decoding stops at the start of the first value that is not entirely contained
+ * in this chunk. The caller must keep the unconsumed bytes and pass them again
+ * (followed by more data) in the next call.
+ *
+ * Callbacks are only ever called for complete values, so a value is never
+ * reported twice.
+ *
+ * @param context The decoding context.
+ * @param data The next chunk of document data.
+ * @param dataLength The length of the chunk.
+ * @param consumedLength Pointer to a variable that will hold the number of bytes that were consumed.
+ * @return KSBONJSON_DECODE_OK on success.
+ */
+KSBONJSON_PUBLIC ksbonjson_decodeStatus ksbonjson_decodeChunk(KSBONJSONDecodeContext* KSBONJSON_RESTRICT context,
+                                                              const uint8_t* KSBONJSON_RESTRICT data,
+                                                              size_t dataLength,
+                                                              size_t* KSBONJSON_RESTRICT consumedLength);
+
+/**
+ * End the incremental decoding process.
+ *
+ * Note: If the last call to ksbonjson_decodeChunk() left unconsumed data,
+ *       the document was truncated.
+ *
+ * @param context The decoding context.
+ * @return KSBONJSON_DECODE_OK if the document was complete.
+ */
+KSBONJSON_PUBLIC ksbonjson_decodeStatus ksbonjson_endDecode(KSBONJSONDecodeContext* context);
+
+/**
+ * Get the statistics gathered so far by a decoding process.
+ *
+ * Stats are only gathered when the library is built with KSBONJSON_STATS set to 1.
+ *
+ * Note: ksbonjson_decode() doesn't expose its context, so use
+ *       ksbonjson_beginDecode() and ksbonjson_decodeChunk() to gather stats.
+ *
+ * @param context The decoding context.
+ * @return The stats, or NULL if the library was built without stats.
+ */
+KSBONJSON_PUBLIC const KSBONJSONStats* ksbonjson_getDecodeStats(const KSBONJSONDecodeContext* context);
+
 /**
  * Get a description for a decoding status code.
  *
@@ -0,0 +1,105 @@
+//
+//  KSBONJSONDiff.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONDiff_h
+#define KSBONJSONDiff_h
+
+#include "KSBONJSONDocument.h"
+#include "KSBONJSONEncoder.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Check if two encoded documents hold the same JSON value.
+ *
+ * Numbers are compared by value, so the same number encoded at different
+ * widths (for example a small int and an int16, or a float64 and a float32)
+ * is equal. Object members can be in any order.
+ *
+ * Both documents are walked in step without being decoded (only numbers that
+ * differ in their encoding get decoded), and values with identical encodings
+ * are compared with memcmp without being scanned or validated. This stops at
+ * the first difference.
+ *
+ * @param a The first document.
+ * @param aLength The length of the first document.
+ * @param b The second document.
+ * @param bLength The length of the second document.
+ * @param isEqual Set to true if the documents are equal.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_isEqualEncoded(const uint8_t* a,
+                                                                   size_t aLength,
+                                                                   const uint8_t* b,
+                                                                   size_t bLength,
+                                                                   bool* isEqual);
+
+/**
+ * Encode the differences between two documents as a JSON Patch (RFC 6902),
+ * which ksbonjson_applyJSONPatch() can apply to the first document to get the
+ * second. The patch is an array of "add", "remove", and "replace" operations,
+ * and is empty if the documents are equal (as in ksbonjson_isEqualEncoded()).
+ *
+ * The documents are compared in the same way as in ksbonjson_isEqualEncoded().
+ * Replacement values are copied from the second document as-is.
+ *
+ * Values that differ are compared down to the member or element that differs,
+ * so each level of nesting above a difference is scanned once more. Members
+ * are matched by name, quickly if both objects have them in the same order.
+ * Elements are matched by index.
+ *
+ * @param from The original document.
+ * @param fromLength The length of the original document.
+ * @param to The changed document.
+ * @param toLength The length of the changed document.
+ * @param pathBuffer Storage for the operations' paths.
+ * @param pathBufferLength The length of the path buffer.
+ * @param patch The encoder to encode the patch into (after ksbonjson_beginEncode()).
+ * @param operationCount Set to the number of operations in the patch.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_diff(const uint8_t* from,
+                                                         size_t fromLength,
+                                                         const uint8_t* to,
+                                                         size_t toLength,
+                                                         char* pathBuffer,
+                                                         size_t pathBufferLength,
+                                                         KSBONJSONEncodeContext* patch,
+                                                         size_t* operationCount);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONDiff_h
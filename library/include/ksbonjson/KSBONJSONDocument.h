@@ -0,0 +1,457 @@
+//
+//  KSBONJSONDocument.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONDocument_h
+#define KSBONJSONDocument_h
+
+#include "KSBONJSONEncoder.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    /**
+     * Everything completed without error
+     */
+    KSBONJSON_DOCUMENT_OK = 0,
+
+    /**
+     * The document (or the part of it that was being expanded) is not valid BONJSON.
+     */
+    KSBONJSON_DOCUMENT_INVALID_DATA = 1,
+
+    /**
+     * All of the nodes that were given to ksbonjson_loadDocument() are in use.
+     */
+    KSBONJSON_DOCUMENT_OUT_OF_NODES = 2,
+
+    /**
+     * The node is not of a type that supports this operation.
+     */
+    KSBONJSON_DOCUMENT_WRONG_TYPE = 3,
+
+    /**
+     * There is no such member or element.
+     */
+    KSBONJSON_DOCUMENT_NOT_FOUND = 4,
+
+    /**
+     * A patch is malformed (see KSBONJSONPatch.h).
+     */
+    KSBONJSON_DOCUMENT_INVALID_PATCH = 5,
+
+    /**
+     * A JSON Patch "test" operation failed.
+     */
+    KSBONJSON_DOCUMENT_TEST_FAILED = 6,
+
+    /**
+     * There wasn't enough room to store a member name.
+     */
+    KSBONJSON_DOCUMENT_NAME_BUFFER_FULL = 7,
+
+    /**
+     * There wasn't enough room to build a JSON Pointer path.
+     */
+    KSBONJSON_DOCUMENT_PATH_BUFFER_FULL = 8,
+
+    /**
+     * The encoder failed while encoding a result (see KSBONJSONDiff.h).
+     */
+    KSBONJSON_DOCUMENT_COULD_NOT_ENCODE = 9,
+
+    /**
+     * There wasn't enough room to sort an object's members (see KSBONJSONCanonical.h).
+     */
+    KSBONJSON_DOCUMENT_MEMBER_BUFFER_FULL = 10,
+
+    /**
+     * The list of columns to extract is invalid (see KSBONJSONColumns.h).
+     */
+    KSBONJSON_DOCUMENT_INVALID_COLUMNS = 11,
+
+    /**
+     * A path is malformed, or there are too many of them (see KSBONJSONAggregate.h).
+     */
+    KSBONJSON_DOCUMENT_INVALID_PATH = 12,
+
+    /**
+     * There was no room to build an index (see KSBONJSONIndex.h).
+     */
+    KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL = 13,
+
+    /**
+     * The data isn't an index of this document.
+     */
+    KSBONJSON_DOCUMENT_INVALID_INDEX = 14,
+} ksbonjson_documentStatus;
+
+typedef enum
+{
+    KSBONJSON_NODE_NULL = 0,
+    KSBONJSON_NODE_BOOLEAN = 1,
+    KSBONJSON_NODE_INTEGER = 2,
+    KSBONJSON_NODE_UINTEGER = 3,
+    KSBONJSON_NODE_FLOAT = 4,
+    KSBONJSON_NODE_STRING = 5,
+    KSBONJSON_NODE_ARRAY = 6,
+    KSBONJSON_NODE_OBJECT = 7,
+} ksbonjson_nodeType;
+
+/**
+ * A value in an editable document.
+ *
+ * Nodes that have not been modified remember where they are in the original
+ * document, and are copied from there verbatim when the document is encoded.
+ * Only modified nodes (and the containers that they are in) are re-encoded.
+ *
+ * The fields may be read directly, but must only be changed via the API.
+ */
+typedef struct KSBONJSONNode
+{
+    /** The node's encoded bytes in the original document (unless it was added). */
+    const uint8_t* encoded;
+    size_t encodedLength;
+
+    /** This node's member name, if its parent is an object. */
+    const char* name;
+    size_t nameLength;
+
+    struct KSBONJSONNode* parent;
+    struct KSBONJSONNode* nextSibling;
+
+    /** The children of a container that have been expanded so far. */
+    struct KSBONJSONNode* firstChild;
+    struct KSBONJSONNode* lastChild;
+    size_t childCount;
+
+    /** Where the rest of a container's children are, until it's fully expanded. */
+    const uint8_t* unexpanded;
+
+    union
+    {
+        bool boolean;
+        int64_t integer;
+        uint64_t uinteger;
+        double floatingPoint;
+        struct
+        {
+            const char* value;
+            size_t length;
+        } string;
+    } value;
+
+    uint8_t type;
+    uint8_t isExpanded: 1;
+    uint8_t isModified: 1;
+} KSBONJSONNode;
+
+/**
+ * An editable tree over an encoded BONJSON document.
+ *
+ * Containers are expanded (their children are given nodes) only as far as
+ * they're navigated into, so a small edit to a large document touches only
+ * the values that come before it in the containers along its path.
+ */
+typedef struct
+{
+    KSBONJSONNode* root;
+    KSBONJSONNode* nodes;
+    size_t nodeCount;
+    size_t nodesUsed;
+} KSBONJSONDocument;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Load an encoded document for editing. No data is copied: The document and
+ * any strings given to the API must remain valid while the document is in use.
+ *
+ * Nothing is decoded or checked here. Each container is checked as it gets
+ * expanded, and whatever never gets expanded is copied as-is when encoding.
+ * Use ksbonjson_decode() first if the whole document must be validated.
+ *
+ * @param document The document to initialize.
+ * @param bonjsonDocument The encoded BONJSON document.
+ * @param documentLength The length of the encoded document.
+ * @param nodes Storage for the document's nodes. Each value uses one node
+ *              once it has been expanded, and nodes are not reused when removed.
+ * @param nodeCount The number of nodes in the storage.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_loadDocument(KSBONJSONDocument* document,
+                                                                 const uint8_t* bonjsonDocument,
+                                                                 size_t documentLength,
+                                                                 KSBONJSONNode* nodes,
+                                                                 size_t nodeCount);
+
+/**
+ * Get the first child of a container, fully expanding it if necessary. The
+ * rest of the children can be reached via each child's nextSibling.
+ *
+ * @param document The document.
+ * @param container An array or object node.
+ * @param child Set to the first child (NULL if the container is empty).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_getFirstChild(KSBONJSONDocument* document,
+                                                                  KSBONJSONNode* container,
+                                                                  KSBONJSONNode** child);
+
+/**
+ * Get the next child of a container, expanding one more child if necessary.
+ * Unlike ksbonjson_getFirstChild(), this never expands more of the container
+ * than has been iterated over.
+ *
+ * @param document The document.
+ * @param container An array or object node.
+ * @param child The current child, or NULL to get the first child.
+ * @param next Set to the next child (NULL if there are no more).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_getNextChild(KSBONJSONDocument* document,
+                                                                 KSBONJSONNode* container,
+                                                                 KSBONJSONNode* child,
+                                                                 KSBONJSONNode** next);
+
+/**
+ * Get an object member by name, expanding the object up to that member if
+ * necessary. If there are duplicate names, the first one is returned.
+ *
+ * @param document The document.
+ * @param object An object node.
+ * @param name The member name.
+ * @param nameLength The length of the member name.
+ * @param member Set to the member's value node.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if there is no member with that name.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_getMember(KSBONJSONDocument* document,
+                                                              KSBONJSONNode* object,
+                                                              const char* name,
+                                                              size_t nameLength,
+                                                              KSBONJSONNode** member);
+
+/**
+ * Get an array element by index, expanding the array up to that element if
+ * necessary.
+ *
+ * @param document The document.
+ * @param array An array node.
+ * @param index The element's index.
+ * @param element Set to the element node.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if the index is out of range.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_getElement(KSBONJSONDocument* document,
+                                                               KSBONJSONNode* array,
+                                                               size_t index,
+                                                               KSBONJSONNode** element);
+
+/**
+ * Replace a node's value with null.
+ *
+ * Like all of the setters, this may be called on a node of any type. If the
+ * node was a container, its children are discarded.
+ *
+ * @param node The node to modify.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setNull(KSBONJSONNode* node);
+
+/**
+ * Replace a node's value with a boolean.
+ *
+ * @param node The node to modify.
+ * @param value The new value.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setBoolean(KSBONJSONNode* node, bool value);
+
+/**
+ * Replace a node's value with a signed integer.
+ *
+ * @param node The node to modify.
+ * @param value The new value.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setInteger(KSBONJSONNode* node, int64_t value);
+
+/**
+ * Replace a node's value with an unsigned integer.
+ *
+ * @param node The node to modify.
+ * @param value The new value.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setUInteger(KSBONJSONNode* node, uint64_t value);
+
+/**
+ * Replace a node's value with a floating point number.
+ *
+ * @param node The node to modify.
+ * @param value The new value.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setFloat(KSBONJSONNode* node, double value);
+
+/**
+ * Replace a node's value with a string. The string is not copied.
+ *
+ * @param node The node to modify.
+ * @param value The new value.
+ * @param valueLength The length of the new value.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setString(KSBONJSONNode* node, const char* value, size_t valueLength);
+
+/**
+ * Replace a node's value with an empty array.
+ *
+ * @param node The node to modify.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setEmptyArray(KSBONJSONNode* node);
+
+/**
+ * Replace a node's value with an empty object.
+ *
+ * @param node The node to modify.
+ */
+KSBONJSON_PUBLIC void ksbonjson_setEmptyObject(KSBONJSONNode* node);
+
+/**
+ * Add a member to the end of an object (which fully expands it). The new
+ * member's value is null. The name is not copied, and is not checked against
+ * the existing names.
+ *
+ * @param document The document.
+ * @param object An object node.
+ * @param name The member name.
+ * @param nameLength The length of the member name.
+ * @param member Set to the new member's value node.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_addMember(KSBONJSONDocument* document,
+                                                              KSBONJSONNode* object,
+                                                              const char* name,
+                                                              size_t nameLength,
+                                                              KSBONJSONNode** member);
+
+/**
+ * Add an element to the end of an array (which fully expands it). The new
+ * element's value is null.
+ *
+ * @param document The document.
+ * @param array An array node.
+ * @param element Set to the new element node.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_addElement(KSBONJSONDocument* document,
+                                                               KSBONJSONNode* array,
+                                                               KSBONJSONNode** element);
+
+/**
+ * Insert an element into an array, expanding the array up to that point if
+ * necessary. The new element's value is null.
+ *
+ * @param document The document.
+ * @param array An array node.
+ * @param index Where to insert the element (up to the array's length).
+ * @param element Set to the new element node.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if the index is past the end of the array.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_insertElement(KSBONJSONDocument* document,
+                                                                  KSBONJSONNode* array,
+                                                                  size_t index,
+                                                                  KSBONJSONNode** element);
+
+/**
+ * Remove a node (and its member name, if any) from its container. The node
+ * is left detached, and can be given to ksbonjson_setValue().
+ *
+ * @param node The node to remove.
+ * @return KSBONJSON_DOCUMENT_WRONG_TYPE if the node is the document root.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_removeNode(KSBONJSONNode* node);
+
+/**
+ * Make a detached copy of a node's value, for use with ksbonjson_setValue().
+ * The source may be in another document, which must then remain valid for as
+ * long as this one.
+ *
+ * Unmodified values are not expanded or copied: The copy refers to the same
+ * encoded bytes, so it costs a single node.
+ *
+ * @param document The document that the copy will be used in.
+ * @param source The node to copy.
+ * @param copy Set to the copy.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_copyNode(KSBONJSONDocument* document,
+                                                             const KSBONJSONNode* source,
+                                                             KSBONJSONNode** copy);
+
+/**
+ * Replace a node's value with the value of a detached node (from
+ * ksbonjson_copyNode() or ksbonjson_removeNode()). The detached node must
+ * not be used afterwards.
+ *
+ * @param node The node to modify.
+ * @param value The detached node.
+ * @return KSBONJSON_DOCUMENT_WRONG_TYPE if the value is not a detached node.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_setValue(KSBONJSONNode* node, KSBONJSONNode* value);
+
+/**
+ * Encode a document, copying unmodified values from the original document.
+ *
+ * This adds a single element, so it can also be called in the middle of
+ * another encoding process.
+ *
+ * @param document The document to encode.
+ * @param context The encoding context.
+ * @return KSBONJSON_ENCODE_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_encodeDocument(const KSBONJSONDocument* document,
+                                                                 KSBONJSONEncodeContext* context);
+
+/**
+ * Get a description for a document status code.
+ *
+ * @param status The status code.
+ *
+ * @return A statically allocated string describing the status.
+ */
+KSBONJSON_PUBLIC const char* ksbonjson_documentStatusDescription(ksbonjson_documentStatus status);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONDocument_h
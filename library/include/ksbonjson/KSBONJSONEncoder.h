@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include "KSBONJSONStats.h"
 
 
 // ============================================================================
@@ -165,6 +166,21 @@ typedef enum
      */
     KSBONJSON_ENCODE_INF = 8,
 
+    /**
+     * Attempted to append to a document that isn't a closed top-level array.
+     */
+    KSBONJSON_ENCODE_NOT_AN_ARRAY = 9,
+
+    /**
+     * Attempted to add table rows inside an object.
+     */
+    KSBONJSON_ENCODE_NOT_IN_AN_ARRAY = 10,
+
+    /**
+     * A table column has a type that isn't a ksbonjson_tableColumnType.
+     */
+    KSBONJSON_ENCODE_INVALID_COLUMN_TYPE = 11,
+
     /**
      * Generic error code that can be returned from addEncodedData().
      *
@@ -192,12 +208,67 @@ typedef struct
     uint8_t isChunkingString: 1;
 } KSBONJSONContainerState;
 
+typedef enum
+{
+    /**
+     * Integers, from `integers`.
+     */
+    KSBONJSON_TABLE_INT64 = 0,
+
+    /**
+     * Floats, from `floats`.
+     */
+    KSBONJSON_TABLE_FLOAT64 = 1,
+
+    /**
+     * Strings, from `strings`.
+     */
+    KSBONJSON_TABLE_STRING = 2,
+} ksbonjson_tableColumnType;
+
+typedef struct
+{
+    const char* data;
+    size_t length;
+} KSBONJSONStringView;
+
+/**
+ * A column of values to encode as one member of every row.
+ */
+typedef struct
+{
+    /**
+     * The member name.
+     */
+    const char* name;
+    size_t nameLength;
+
+    ksbonjson_tableColumnType type;
+
+    /**
+     * The values (only the array for the column type is used).
+     */
+    const int64_t* integers;
+    const double* floats;
+    const KSBONJSONStringView* strings;
+
+    /**
+     * Optional bitmap of which rows have a value, least significant bit
+     * first (as in Apache Arrow). Rows without a value are encoded as null.
+     * If NULL, every row has a value.
+     */
+    const uint8_t* validity;
+} KSBONJSONTableColumn;
+
 typedef struct
 {
     KSBONJSONAddEncodedDataFunc addEncodedData;
     void* userData;
     int containerDepth;
     KSBONJSONContainerState containers[KSBONJSON_MAX_CONTAINER_DEPTH];
+#if KSBONJSON_STATS
+    KSBONJSONStats stats;
+#endif
 } KSBONJSONEncodeContext;
 
 
@@ -216,6 +287,37 @@ KSBONJSON_PUBLIC void ksbonjson_beginEncode(KSBONJSONEncodeContext* context,
                                             KSBONJSONAddEncodedDataFunc addEncodedData,
                                             void* userData);
 
+/**
+ * Begin appending elements to the top-level array of an existing document,
+ * without decoding or re-encoding what's already there.
+ *
+ * The new data replaces the array's closing byte: write it starting at
+ * appendOffset, and close the array again with ksbonjson_endContainer() (or
+ * ksbonjson_terminateDocument()) before ksbonjson_endEncode().
+ *
+ * Only the first and last bytes of the document are checked, so that
+ * appending costs only as much as the new elements. The caller must
+ * guarantee that the document is a complete array: in a truncated one, the
+ * last byte can be part of an element's payload (such as an int16 ending in
+ * 0xed), which the new data would then overwrite. Decode the document first
+ * if it might have been cut short.
+ *
+ * @param context The encoding context.
+ * @param addEncodedData Function to handle adding data after it's been encoded.
+ * @param userData User-specified data which gets passed to addEncodedData.
+ * @param document The existing document.
+ * @param documentLength The length of the document.
+ * @param appendOffset Set to where the new data goes.
+ * @return KSBONJSON_ENCODE_OK if the process was successful.
+ * @return KSBONJSON_ENCODE_NOT_AN_ARRAY if the document isn't a closed array.
+ */
+KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_beginAppendingToArray(KSBONJSONEncodeContext* context,
+                                                                        KSBONJSONAddEncodedDataFunc addEncodedData,
+                                                                        void* userData,
+                                                                        const uint8_t* document,
+                                                                        size_t documentLength,
+                                                                        size_t* appendOffset);
+
 /**
  * End the encoding process.
  *
@@ -312,6 +414,45 @@ KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_addBONJSONDocument(KSBONJSONEn
                                                                      const uint8_t* KSBONJSON_RESTRICT bonjsonDocument,
                                                                      size_t documentLength);
 
+/** Add already encoded container contents: a series of elements if in an
+ * array, or a series of name/value pairs if in an object.
+ *
+ * @param context The encoding context.
+ * @param contents The encoded contents (without the container's type code and end marker).
+ * @param contentsLength The length of the encoded contents.
+ * @return KSBONJSON_ENCODER_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_addBONJSONContents(KSBONJSONEncodeContext* KSBONJSON_RESTRICT context,
+                                                                     const uint8_t* KSBONJSON_RESTRICT contents,
+                                                                     size_t contentsLength);
+
+/**
+ * Add rows of a table as objects (one per row, with one member per column).
+ *
+ * This is much faster than adding each member separately: the state is only
+ * checked once, and the rows are encoded into a local buffer that is passed
+ * to addEncodedData() in large pieces.
+ *
+ * Usually the rows go into an array, in batches:
+ *
+ *     ksbonjson_beginArray(context);
+ *     // for each batch:
+ *     ksbonjson_addTableRows(context, columns, columnCount, rowCount);
+ *     ksbonjson_endContainer(context);
+ *
+ * @param context The encoding context.
+ * @param columns The columns.
+ * @param columnCount The number of columns.
+ * @param rowCount The number of rows to add (from each column's first row).
+ * @return KSBONJSON_ENCODER_OK if the process was successful.
+ * @return KSBONJSON_ENCODE_NOT_IN_AN_ARRAY if the current container is an object.
+ * @return KSBONJSON_ENCODE_INVALID_COLUMN_TYPE if a column's type is out of range.
+ */
+KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_addTableRows(KSBONJSONEncodeContext* context,
+                                                               const KSBONJSONTableColumn* columns,
+                                                               size_t columnCount,
+                                                               size_t rowCount);
+
 /**
  * Begin a new object container.
  *
@@ -336,6 +477,16 @@ KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_beginArray(KSBONJSONEncodeCont
  */
 KSBONJSON_PUBLIC ksbonjson_encodeStatus ksbonjson_endContainer(KSBONJSONEncodeContext* context);
 
+/**
+ * Get the statistics gathered so far by a encoding process.
+ *
+ * Stats are only gathered when the library is built with KSBONJSON_STATS set to 1.
+ *
+ * @param context The encoding context.
+ * @return The stats, or NULL if the library was built without stats.
+ */
+KSBONJSON_PUBLIC const KSBONJSONStats* ksbonjson_getEncodeStats(const KSBONJSONEncodeContext* context);
+
 /**
  * Get a description for an encoding status code.
  *
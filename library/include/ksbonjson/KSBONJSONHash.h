@@ -0,0 +1,177 @@
+//
+//  KSBONJSONHash.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONHash_h
+#define KSBONJSONHash_h
+
+#include "KSBONJSONDecoder.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    /**
+     * A fast 64-bit hash (8 bytes). Not suitable where an attacker could
+     * choose documents to make them collide.
+     */
+    KSBONJSON_HASH_FAST = 0,
+
+    /**
+     * SHA-256 (32 bytes).
+     */
+    KSBONJSON_HASH_SHA256 = 1,
+} ksbonjson_hashAlgorithm;
+
+/**
+ * Hash flag: Objects with the same members in a different order hash the same.
+ */
+#define KSBONJSON_HASH_UNORDERED_MEMBERS 1
+
+/**
+ * The longest hash that any algorithm produces.
+ */
+#define KSBONJSON_HASH_MAX_LENGTH 32
+
+typedef union
+{
+    uint64_t fast;
+    struct
+    {
+        uint32_t state[8];
+        uint8_t block[64];
+        uint64_t length;
+    } sha256;
+} KSBONJSONHashState;
+
+typedef struct
+{
+    // The hash of the current member's name and value
+    KSBONJSONHashState member;
+    // The sum of the hashes of the members so far
+    uint64_t memberSum[4];
+    uint64_t memberCount;
+} KSBONJSONHashObjectState;
+
+/**
+ * Hashing state that persists between decoder callbacks.
+ *
+ * This is large (the unordered-members state for every possible level of
+ * nesting), so avoid putting it on small stacks.
+ */
+typedef struct
+{
+    ksbonjson_hashAlgorithm algorithm;
+    bool isUnorderedMembers;
+    KSBONJSONHashState root;
+    int containerDepth;
+    KSBONJSONDecodeContainerState containers[KSBONJSON_MAX_CONTAINER_DEPTH];
+    int objectDepth;
+    KSBONJSONHashObjectState objects[KSBONJSON_MAX_CONTAINER_DEPTH];
+} KSBONJSONHashContext;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Hash a BONJSON document by its value rather than its encoding.
+ *
+ * Numbers are hashed by value, so the same number encoded at different widths
+ * (or as an integer and as a float) gives the same hash. Documents that
+ * ksbonjson_isEqualEncoded() considers equal hash the same, as long as
+ * KSBONJSON_HASH_UNORDERED_MEMBERS is set (or their members are in the same
+ * order).
+ *
+ * The document is hashed as it is decoded, without building a tree or
+ * re-encoding it.
+ *
+ * This keeps a KSBONJSONHashContext (about 29 KB) on the stack. Where the stack
+ * is small (such as on embedded targets or in small thread stacks), allocate a
+ * context elsewhere and use ksbonjson_beginHash() with the decoder instead.
+ *
+ * @param document The document to hash.
+ * @param documentLength The length of the document.
+ * @param algorithm The hash algorithm.
+ * @param flags KSBONJSON_HASH_XYZ flags.
+ * @param hash Storage for the hash (ksbonjson_hashLength(algorithm) bytes).
+ * @return KSBONJSON_DECODE_OK on success.
+ */
+KSBONJSON_PUBLIC ksbonjson_decodeStatus ksbonjson_hash(const uint8_t* document,
+                                                       size_t documentLength,
+                                                       ksbonjson_hashAlgorithm algorithm,
+                                                       int flags,
+                                                       uint8_t* hash);
+
+/**
+ * Begin hashing a document that will be decoded separately (for example with
+ * ksbonjson_decodeChunk() as it arrives). Pass ksbonjson_hashCallbacks() and
+ * the hash context to the decoder.
+ *
+ * @param context The hashing context.
+ * @param algorithm The hash algorithm.
+ * @param flags KSBONJSON_HASH_XYZ flags.
+ */
+KSBONJSON_PUBLIC void ksbonjson_beginHash(KSBONJSONHashContext* context,
+                                          ksbonjson_hashAlgorithm algorithm,
+                                          int flags);
+
+/**
+ * Get the decoder callbacks that hash a document.
+ *
+ * @return The callbacks (whose user data must be a hash context).
+ */
+KSBONJSON_PUBLIC const KSBONJSONDecodeCallbacks* ksbonjson_hashCallbacks(void);
+
+/**
+ * End the hashing process, once the whole document has been decoded.
+ *
+ * @param context The hashing context.
+ * @param hash Storage for the hash (ksbonjson_hashLength(algorithm) bytes).
+ */
+KSBONJSON_PUBLIC void ksbonjson_endHash(KSBONJSONHashContext* context, uint8_t* hash);
+
+/**
+ * Get the length of the hashes that an algorithm produces.
+ *
+ * @param algorithm The hash algorithm.
+ * @return The length in bytes.
+ */
+KSBONJSON_PUBLIC size_t ksbonjson_hashLength(ksbonjson_hashAlgorithm algorithm);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONHash_h
@@ -0,0 +1,231 @@
+//
+//  KSBONJSONIndex.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONIndex_h
+#define KSBONJSONIndex_h
+
+#include "KSBONJSONDocument.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The length of an index's header (not counting its key path).
+ */
+#define KSBONJSON_INDEX_HEADER_SIZE 64
+
+/**
+ * What an index's elements are.
+ */
+typedef enum
+{
+    /**
+     * The elements of a top-level array.
+     */
+    KSBONJSON_INDEX_ARRAY = 0,
+
+    /**
+     * A sequence of top-level values, one after the other (as written in
+     * stream mode, for example).
+     */
+    KSBONJSON_INDEX_SEQUENCE = 1,
+
+    /**
+     * The records of a record log (see KSBONJSONRecordLog.h).
+     */
+    KSBONJSON_INDEX_RECORD_LOG = 2,
+} ksbonjson_indexKind;
+
+typedef struct
+{
+    ksbonjson_indexKind kind;
+
+    /**
+     * Record the offset of every Nth element (0 or 1 records every element).
+     * Finding an element skips over up to N-1 elements from the nearest
+     * recorded one, so this trades index size for lookup speed.
+     */
+    size_t stride;
+
+    /**
+     * A JSON Pointer (RFC 6901) to a string or integer inside each element,
+     * which the element can then be found by (NULL for no keys). For example,
+     * "/id" indexes an array of objects by their "id" members. Elements
+     * without a string or integer at the path aren't given keys. A float
+     * with an integer value (such as 3.0) is keyed as that integer.
+     */
+    const char* keyPath;
+    size_t keyPathLength;
+} KSBONJSONIndexOptions;
+
+/**
+ * An index that has been opened (with ksbonjson_openIndex()). The fields
+ * point into the index's data, so the data must stay around while this does.
+ */
+typedef struct
+{
+    ksbonjson_indexKind kind;
+    uint64_t stride;
+    uint64_t elementCount;
+    // The length of the document when it was indexed
+    uint64_t documentLength;
+    const char* keyPath;
+    size_t keyPathLength;
+
+    // Private
+    const uint8_t* document;
+    const uint8_t* offsets;
+    uint64_t offsetCount;
+    const uint8_t* keys;
+    uint64_t keyCount;
+} KSBONJSONIndex;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Build an index of a document's elements, which can be saved alongside the
+ * document (as a "sidecar" file) to find elements without scanning for them.
+ *
+ * The index holds the offset of every stride-th element, and a table of the
+ * keys at options->keyPath (if any) sorted for binary search. Elements are
+ * found by skipping over values, without decoding them.
+ *
+ * @param document The document to index.
+ * @param documentLength The length of the document.
+ * @param options What to index.
+ * @param index Storage for the index (can be NULL if indexSize is 0).
+ * @param indexSize The size of the storage.
+ * @param indexLength Set to the length of the index, which is how big the
+ *                    storage needs to be if it's too small.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL if the storage is too small.
+ * @return KSBONJSON_DOCUMENT_INVALID_PATH if the key path is malformed.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_buildIndex(const uint8_t* document,
+                                                               size_t documentLength,
+                                                               const KSBONJSONIndexOptions* options,
+                                                               uint8_t* index,
+                                                               size_t indexSize,
+                                                               size_t* indexLength);
+
+/**
+ * Open an index to find elements of the document that it was built from.
+ *
+ * An index remains valid as more elements are appended to its document (but
+ * it can only find the elements that were there when it was built).
+ *
+ * @param index The opened index.
+ * @param data The index data (from ksbonjson_buildIndex()).
+ * @param dataLength The length of the index data.
+ * @param document The document.
+ * @param documentLength The length of the document.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_INVALID_INDEX if the data isn't an index, or is
+ *         for a longer document.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_openIndex(KSBONJSONIndex* index,
+                                                              const uint8_t* data,
+                                                              size_t dataLength,
+                                                              const uint8_t* document,
+                                                              size_t documentLength);
+
+/**
+ * Find an element by its position.
+ *
+ * @param index The index.
+ * @param elementIndex The position of the element.
+ * @param value Set to the element (a pointer into the document).
+ * @param valueLength Set to the length of the element.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if the index doesn't have that many elements.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_findIndexedElement(const KSBONJSONIndex* index,
+                                                                       uint64_t elementIndex,
+                                                                       const uint8_t** value,
+                                                                       size_t* valueLength);
+
+/**
+ * Find the element after one that was found with this index (for example to
+ * visit a range of elements without looking each one up).
+ *
+ * @param index The index.
+ * @param value The element (which is replaced by the next one).
+ * @param valueLength The length of the element (which is replaced by the
+ *                    length of the next one).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if it was the last indexed element.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_nextIndexedElement(const KSBONJSONIndex* index,
+                                                                       const uint8_t** value,
+                                                                       size_t* valueLength);
+
+/**
+ * Find the first element whose key is a string.
+ *
+ * @param index The index.
+ * @param key The key.
+ * @param keyLength The length of the key.
+ * @param value Set to the element (a pointer into the document).
+ * @param valueLength Set to the length of the element.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if no element has that key.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_findIndexedString(const KSBONJSONIndex* index,
+                                                                      const char* key,
+                                                                      size_t keyLength,
+                                                                      const uint8_t** value,
+                                                                      size_t* valueLength);
+
+/**
+ * Find the first element whose key is an integer.
+ *
+ * @param index The index.
+ * @param key The key.
+ * @param value Set to the element (a pointer into the document).
+ * @param valueLength Set to the length of the element.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_NOT_FOUND if no element has that key.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_findIndexedInteger(const KSBONJSONIndex* index,
+                                                                       int64_t key,
+                                                                       const uint8_t** value,
+                                                                       size_t* valueLength);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONIndex_h
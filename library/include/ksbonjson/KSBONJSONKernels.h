@@ -0,0 +1,123 @@
+//
+//  KSBONJSONKernels.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONKernels_h
+#define KSBONJSONKernels_h
+
+#include <stdbool.h>
+
+
+// ============================================================================
+// Compile-time Configuration
+// ============================================================================
+
+/**
+ * Set to 0 to build only the portable scalar kernels (for example if your
+ * compiler doesn't support the vector intrinsics of your target).
+ */
+#ifndef KSBONJSON_SIMD
+#   define KSBONJSON_SIMD 1
+#endif
+
+#ifndef KSBONJSON_PUBLIC
+#   if defined _WIN32 || defined __CYGWIN__
+#       define KSBONJSON_PUBLIC __declspec(dllimport)
+#   else
+#       define KSBONJSON_PUBLIC
+#   endif
+#endif
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sets of kernels (the hot loops that can be vectorized) that the library
+ * can use. A set is chosen automatically the first time that one is needed:
+ * SSE2 on x86-64 and NEON on ARM64. AVX2 and AVX-512 only pay off on long
+ * strings, so they must be chosen with ksbonjson_setKernelSet(). Each set
+ * also uses the CPU's CRC32C instructions (SSE4.2 or ARMv8 CRC) if it has them.
+ */
+typedef enum
+{
+    KSBONJSON_KERNELS_SCALAR = 0,
+    KSBONJSON_KERNELS_SSE2 = 1,
+    KSBONJSON_KERNELS_AVX2 = 2,
+    KSBONJSON_KERNELS_AVX512 = 3,
+    KSBONJSON_KERNELS_NEON = 4,
+    KSBONJSON_KERNELS_COUNT,
+} ksbonjson_kernelSet;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Get the set of kernels that is currently in use, choosing one first if
+ * that hasn't happened yet.
+ *
+ * @return The current kernel set.
+ */
+KSBONJSON_PUBLIC ksbonjson_kernelSet ksbonjson_getKernelSet(void);
+
+/**
+ * Choose the set of kernels to use (for example, to force the scalar kernels
+ * while testing). This affects all encoders and decoders in the process, so
+ * only call it when none of them are running.
+ *
+ * @param kernelSet The kernel set to use.
+ * @return false if this build or this CPU doesn't support that kernel set.
+ */
+KSBONJSON_PUBLIC bool ksbonjson_setKernelSet(ksbonjson_kernelSet kernelSet);
+
+/**
+ * Check if this build and this CPU support a set of kernels.
+ *
+ * @param kernelSet The kernel set.
+ * @return true if the kernel set can be used.
+ */
+KSBONJSON_PUBLIC bool ksbonjson_isKernelSetSupported(ksbonjson_kernelSet kernelSet);
+
+/**
+ * Get the name of a kernel set.
+ *
+ * @param kernelSet The kernel set.
+ * @return A statically allocated string such as "avx2".
+ */
+KSBONJSON_PUBLIC const char* ksbonjson_kernelSetName(ksbonjson_kernelSet kernelSet);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONKernels_h
@@ -0,0 +1,88 @@
+//
+//  KSBONJSONPatch.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONPatch_h
+#define KSBONJSONPatch_h
+
+#include "KSBONJSONDocument.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Apply a JSON Patch (RFC 6902) to a document.
+ *
+ * The patch is a BONJSON document containing an array of operation objects.
+ * Only the containers along each operation's paths get expanded, and values
+ * taken from the patch are not copied: They are spliced in from the patch's
+ * encoded bytes when the document is encoded. So the patch document must
+ * remain valid for as long as this document is in use.
+ *
+ * The document's original encoded bytes are never modified, so if the patch
+ * fails (for example because a "test" operation failed), discard the
+ * partially patched document and load the original again.
+ *
+ * Member names in paths that contain escapes ("~0" or "~1") are unescaped
+ * into the name buffer. A buffer as long as the patch is always enough.
+ *
+ * @param document The document to patch.
+ * @param patch The patch.
+ * @param nameBuffer Storage for unescaped member names (may be NULL if none have escapes).
+ * @param nameBufferLength The length of the name buffer.
+ * @param appliedCount Set to the number of operations that were applied.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_applyJSONPatch(KSBONJSONDocument* document,
+                                                                   KSBONJSONDocument* patch,
+                                                                   char* nameBuffer,
+                                                                   size_t nameBufferLength,
+                                                                   size_t* appliedCount);
+
+/**
+ * Apply a JSON Merge Patch (RFC 7396) to a document.
+ *
+ * As with ksbonjson_applyJSONPatch(), only the members named in the patch
+ * get expanded, and the patch must remain valid while the document is in use.
+ *
+ * @param document The document to patch.
+ * @param patch The patch.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_applyMergePatch(KSBONJSONDocument* document,
+                                                                    KSBONJSONDocument* patch);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONPatch_h
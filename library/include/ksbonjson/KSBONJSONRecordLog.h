@@ -0,0 +1,283 @@
+//
+//  KSBONJSONRecordLog.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONRecordLog_h
+#define KSBONJSONRecordLog_h
+
+#include "KSBONJSONEncoder.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A record log is a sequence of records, each of which is a BONJSON document
+ * (or any other data) behind an 8 byte header:
+ *
+ *   - The length of the document (32-bit little endian)
+ *   - The CRC32C of the length field and the document (32-bit little endian)
+ *
+ * Records are only ever appended, so after a crash the log can only be damaged
+ * at the end (a "torn" tail). Reading stops at the first record that is
+ * incomplete or fails its checksum, and everything before it is intact.
+ */
+#define KSBONJSON_RECORD_HEADER_SIZE 8
+
+/**
+ * The longest record that a log can hold.
+ */
+#define KSBONJSON_MAX_RECORD_LENGTH 0xffffffffU
+
+typedef enum
+{
+    /**
+     * Everything completed without error.
+     */
+    KSBONJSON_RECORD_OK = 0,
+
+    /**
+     * There are no more records.
+     */
+    KSBONJSON_RECORD_END = 1,
+
+    /**
+     * The log ends partway through a record (usually a write that was cut
+     * short by a crash).
+     */
+    KSBONJSON_RECORD_TRUNCATED = 2,
+
+    /**
+     * A record's checksum doesn't match its contents.
+     */
+    KSBONJSON_RECORD_CHECKSUM_MISMATCH = 3,
+
+    /**
+     * A record is longer than KSBONJSON_MAX_RECORD_LENGTH.
+     */
+    KSBONJSON_RECORD_TOO_LARGE = 4,
+
+    /**
+     * Generic error code that can be returned from the write and sync functions.
+     *
+     * More specific error codes (> 100) may also be defined by the user if needed.
+     */
+    KSBONJSON_RECORD_COULD_NOT_WRITE = 100,
+} ksbonjson_recordStatus;
+
+/**
+ * Function pointer for writing data to the end of the log.
+ *
+ * @param data The data to write.
+ * @param dataLength The length of the data.
+ * @param userData user-specified contextual data.
+ * @return KSBONJSON_RECORD_OK if the operation was successful.
+ */
+typedef ksbonjson_recordStatus (*KSBONJSONRecordWriteFunc)(const uint8_t* KSBONJSON_RESTRICT data,
+                                                           size_t dataLength,
+                                                           void* KSBONJSON_RESTRICT userData);
+
+/**
+ * Function pointer for making everything written so far durable (for example
+ * with fsync()).
+ *
+ * @param userData user-specified contextual data.
+ * @return KSBONJSON_RECORD_OK if the operation was successful.
+ */
+typedef ksbonjson_recordStatus (*KSBONJSONRecordSyncFunc)(void* userData);
+
+typedef struct
+{
+    KSBONJSONRecordWriteFunc write;
+    KSBONJSONRecordSyncFunc sync;
+    void* userData;
+
+    // Records waiting to be written
+    uint8_t* buffer;
+    size_t bufferSize;
+    size_t bufferLength;
+
+    // Group commit: records are synced together once this much time has
+    // passed since the last commit (in whatever units the caller uses).
+    uint64_t commitInterval;
+    uint64_t lastCommitTime;
+} KSBONJSONRecordWriter;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+} KSBONJSONRecordReader;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Compute or update a CRC32C (Castagnoli) checksum, using the CPU's CRC
+ * instructions if it has them.
+ *
+ * @param crc The checksum so far (0 to start a new one).
+ * @param data The data to add to the checksum.
+ * @param dataLength The length of the data.
+ * @return The updated checksum.
+ */
+KSBONJSON_PUBLIC uint32_t ksbonjson_crc32c(uint32_t crc, const uint8_t* data, size_t dataLength);
+
+/**
+ * Write the header that goes in front of a record.
+ *
+ * @param header Storage for the header (KSBONJSON_RECORD_HEADER_SIZE bytes).
+ * @param record The record.
+ * @param recordLength The length of the record (no more than KSBONJSON_MAX_RECORD_LENGTH).
+ * @return KSBONJSON_RECORD_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_recordStatus ksbonjson_frameRecord(uint8_t* header,
+                                                              const uint8_t* record,
+                                                              size_t recordLength);
+
+/**
+ * Begin writing records to the end of a log.
+ *
+ * Appended records are collected in the buffer and written when it fills up.
+ * Once commitInterval has passed since the last commit, the next append
+ * commits: it writes out the buffer and syncs, so that every record appended
+ * since the last commit shares a single sync. If appends stop, call
+ * ksbonjson_commitRecords() to make the last ones durable.
+ *
+ * @param writer The writer.
+ * @param write Function that writes to the end of the log.
+ * @param sync Function that makes the writes durable (can be NULL).
+ * @param userData User-specified data which gets passed to write and sync.
+ * @param buffer Storage for records waiting to be written.
+ * @param bufferSize The size of the buffer.
+ * @param commitInterval How long to wait between commits (0 = commit every record).
+ * @param now The current time, in the same units as commitInterval.
+ */
+KSBONJSON_PUBLIC void ksbonjson_beginRecordWriting(KSBONJSONRecordWriter* writer,
+                                                   KSBONJSONRecordWriteFunc write,
+                                                   KSBONJSONRecordSyncFunc sync,
+                                                   void* userData,
+                                                   uint8_t* buffer,
+                                                   size_t bufferSize,
+                                                   uint64_t commitInterval,
+                                                   uint64_t now);
+
+/**
+ * Append a record to the log.
+ *
+ * @param writer The writer.
+ * @param record The record (usually a BONJSON document).
+ * @param recordLength The length of the record.
+ * @param now The current time, in the same units as the commit interval.
+ * @return KSBONJSON_RECORD_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_recordStatus ksbonjson_appendRecord(KSBONJSONRecordWriter* writer,
+                                                               const uint8_t* record,
+                                                               size_t recordLength,
+                                                               uint64_t now);
+
+/**
+ * Write out and sync every record appended so far.
+ *
+ * @param writer The writer.
+ * @param now The current time, in the same units as the commit interval.
+ * @return KSBONJSON_RECORD_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_recordStatus ksbonjson_commitRecords(KSBONJSONRecordWriter* writer, uint64_t now);
+
+/**
+ * Begin reading the records in a log (for example a memory-mapped file).
+ *
+ * @param reader The reader.
+ * @param log The log.
+ * @param logLength The length of the log.
+ */
+KSBONJSON_PUBLIC void ksbonjson_beginRecordReading(KSBONJSONRecordReader* reader,
+                                                   const uint8_t* log,
+                                                   size_t logLength);
+
+/**
+ * Read the next record, after checking its checksum. The record isn't copied.
+ *
+ * If this fails, the reader stays where it is, and
+ * ksbonjson_getValidRecordLogLength() is the length of the intact part of the
+ * log (which a writer should truncate the log to before appending).
+ *
+ * @param reader The reader.
+ * @param record Set to the record (which points into the log).
+ * @param recordLength Set to the length of the record.
+ * @return KSBONJSON_RECORD_OK if a record was read, or KSBONJSON_RECORD_END
+ *         if there are no more.
+ */
+KSBONJSON_PUBLIC ksbonjson_recordStatus ksbonjson_readRecord(KSBONJSONRecordReader* reader,
+                                                             const uint8_t** record,
+                                                             size_t* recordLength);
+
+/**
+ * Get the length of the part of the log that has been read and verified.
+ *
+ * @param reader The reader.
+ * @return The length of the log up to the next record.
+ */
+KSBONJSON_PUBLIC size_t ksbonjson_getValidRecordLogLength(const KSBONJSONRecordReader* reader);
+
+/**
+ * Find the length of the intact part of a log (after a crash, for example).
+ *
+ * @param log The log.
+ * @param logLength The length of the log.
+ * @param validLength Set to the length of the intact part of the log.
+ * @param recordCount Set to the number of records in the intact part (can be NULL).
+ * @return KSBONJSON_RECORD_END if the whole log is intact, or the reason the
+ *         rest of it isn't.
+ */
+KSBONJSON_PUBLIC ksbonjson_recordStatus ksbonjson_recoverRecordLog(const uint8_t* log,
+                                                                   size_t logLength,
+                                                                   size_t* validLength,
+                                                                   size_t* recordCount);
+
+/**
+ * Get a description for a record log status code.
+ *
+ * @param status The status code.
+ *
+ * @return A statically allocated string describing the status.
+ */
+KSBONJSON_PUBLIC const char* ksbonjson_recordStatusDescription(ksbonjson_recordStatus status);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONRecordLog_h
@@ -0,0 +1,129 @@
+//
+//  KSBONJSONShard.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONShard_h
+#define KSBONJSONShard_h
+
+#include "KSBONJSONIndex.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A run of consecutive elements of a top-level array.
+ */
+typedef struct
+{
+    /**
+     * Where the shard's first element starts in the document.
+     */
+    size_t offset;
+
+    /**
+     * The length of the shard's elements (not including any array wrapper).
+     */
+    size_t length;
+
+    uint64_t elementCount;
+} KSBONJSONShard;
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Split the elements of a document's top-level array into shards of about
+ * the same size, at element boundaries.
+ *
+ * Each shard is a range of the document's bytes, so it can be copied into its
+ * own array (a TYPE_ARRAY byte, the shard, and a TYPE_END byte) without
+ * decoding anything. Elements are skipped over to find the boundaries, which
+ * also checks the array's structure. If there are fewer elements than shards,
+ * the last shards are empty.
+ *
+ * @param document The document.
+ * @param documentLength The length of the document.
+ * @param shardCount The number of shards (at least 1).
+ * @param shards Set to the shards, in order.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_WRONG_TYPE if the document isn't an array.
+ * @return KSBONJSON_DOCUMENT_INVALID_DATA if the document is malformed or
+ *         shardCount is 0.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_splitArray(const uint8_t* document,
+                                                               size_t documentLength,
+                                                               size_t shardCount,
+                                                               KSBONJSONShard* shards);
+
+/**
+ * Split the elements of an indexed top-level array into shards with about the
+ * same number of elements, using the index to find the boundaries instead of
+ * skipping over every element.
+ *
+ * @param index The index (of kind KSBONJSON_INDEX_ARRAY).
+ * @param shardCount The number of shards (at least 1).
+ * @param shards Set to the shards, in order.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_WRONG_TYPE if the index isn't of an array.
+ * @return KSBONJSON_DOCUMENT_INVALID_DATA if shardCount is 0.
+ * @return KSBONJSON_DOCUMENT_INVALID_INDEX if the array has changed since it
+ *         was indexed.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_splitIndexedArray(const KSBONJSONIndex* index,
+                                                                      size_t shardCount,
+                                                                      KSBONJSONShard* shards);
+
+/**
+ * Find the elements of a document's top-level array, for merging shards by
+ * concatenating their elements inside a new array.
+ *
+ * Only the first and last bytes of the document are checked, so that merging
+ * costs no more than copying.
+ *
+ * @param document The document.
+ * @param documentLength The length of the document.
+ * @param shard Set to the elements (with an element count of 0, since the
+ *              elements aren't counted).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_WRONG_TYPE if the document isn't a closed array.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_getArrayElements(const uint8_t* document,
+                                                                     size_t documentLength,
+                                                                     KSBONJSONShard* shard);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONShard_h
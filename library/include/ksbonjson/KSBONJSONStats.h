@@ -0,0 +1,79 @@
+//
+//  KSBONJSONStats.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONStats_h
+#define KSBONJSONStats_h
+
+#include <stdint.h>
+
+
+// ============================================================================
+// Compile-time Configuration
+// ============================================================================
+
+/**
+ * Set to 1 to have the encoder and decoder count what they process
+ * (see KSBONJSONStats). When 0, the counters don't exist at all and cost nothing.
+ *
+ * The library and everything that uses it must be built with the same setting.
+ */
+#ifndef KSBONJSON_STATS
+#   define KSBONJSON_STATS 0
+#endif
+
+
+// ============================================================================
+// Types
+// ============================================================================
+
+/**
+ * Statistics about an encoding or decoding process.
+ *
+ * Values are counted by type code (the first byte of their encoding), so
+ * small integers are counted individually by value.
+ */
+typedef struct
+{
+    /** Number of values (and container ends) by type code. */
+    uint64_t valueCounts[256];
+
+    /** Number of encoded bytes by type code, including the type code itself. */
+    uint64_t valueBytes[256];
+
+    /** Total length of all string contents (not including delimiters). */
+    uint64_t stringBytes;
+
+    /**
+     * Encoder: Number of calls to the addEncodedData function.
+     * Decoder: Number of callbacks called.
+     */
+    uint64_t sinkCalls;
+
+    /** The deepest container nesting that was reached. */
+    int maxDepth;
+} KSBONJSONStats;
+
+#endif // KSBONJSONStats_h
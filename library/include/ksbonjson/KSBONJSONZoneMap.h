@@ -0,0 +1,213 @@
+//
+//  KSBONJSONZoneMap.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONZoneMap_h
+#define KSBONJSONZoneMap_h
+
+#include "KSBONJSONIndex.h"
+
+
+// ============================================================================
+// Header
+// ============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The most paths that a zone map can summarize.
+ */
+#define KSBONJSON_MAX_ZONE_PATHS 16
+
+/**
+ * The length of a zone map's header (not counting its paths).
+ */
+#define KSBONJSON_ZONE_MAP_HEADER_SIZE 64
+
+typedef struct
+{
+    /**
+     * JSON Pointers (RFC 6901) to the values inside each element to summarize.
+     */
+    const char* const* paths;
+    const size_t* pathLengths;
+    size_t pathCount;
+
+    /**
+     * The size in bytes of each block's Bloom filter of the strings at each
+     * path (0 to only summarize numbers). Larger filters rule out more
+     * blocks: with a byte per element in a block, about 2% of the blocks that
+     * don't contain a string still have to be read when looking for it.
+     */
+    size_t bloomFilterSize;
+} KSBONJSONZoneMapOptions;
+
+/**
+ * A zone map that has been opened (with ksbonjson_openZoneMap()). The fields
+ * point into the zone map's data, so the data must stay around while this does.
+ */
+typedef struct
+{
+    const KSBONJSONIndex* index;
+    uint64_t blockCount;
+    size_t pathCount;
+    const char* paths[KSBONJSON_MAX_ZONE_PATHS];
+    size_t pathLengths[KSBONJSON_MAX_ZONE_PATHS];
+
+    // Private
+    const uint8_t* blocks;
+    size_t blockSize;
+    size_t bloomFilterSize;
+    uint64_t bloomHashCount;
+} KSBONJSONZoneMap;
+
+/**
+ * A condition on the value at one of a zone map's paths.
+ */
+typedef struct
+{
+    /**
+     * Which of the zone map's paths the value is at.
+     */
+    size_t pathIndex;
+
+    /**
+     * If not NULL, the value must be this string. Otherwise it must be a
+     * number from min to max (inclusive).
+     */
+    const char* string;
+    size_t stringLength;
+    double min;
+    double max;
+} KSBONJSONPredicate;
+
+/**
+ * Callback for each element that matches a scan's predicates.
+ *
+ * @param value The element (a pointer into the document).
+ * @param valueLength The length of the element.
+ * @param elementIndex The position of the element.
+ * @param userData user-specified contextual data.
+ * @return KSBONJSON_DOCUMENT_OK to continue the scan, or anything else to
+ *         stop and return that status.
+ */
+typedef ksbonjson_documentStatus (*KSBONJSONMatchCallback)(const uint8_t* value,
+                                                           size_t valueLength,
+                                                           uint64_t elementIndex,
+                                                           void* userData);
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * Get the size of the zone map that ksbonjson_buildZoneMap() would build.
+ *
+ * @param index The index that the zone map will be built on.
+ * @param options What to summarize.
+ * @return The size of the zone map in bytes.
+ */
+KSBONJSON_PUBLIC size_t ksbonjson_zoneMapSize(const KSBONJSONIndex* index, const KSBONJSONZoneMapOptions* options);
+
+/**
+ * Build a zone map: a summary of each block of an index's elements (each
+ * block being the elements from one recorded offset to the next), which lets
+ * ksbonjson_scanZoneMap() skip the blocks that can't match without reading them.
+ *
+ * For each path, each block gets the minimum and maximum of the numbers at
+ * the path, and a Bloom filter of the strings at the path.
+ *
+ * @param index The index to build on (which must record every element's
+ *              offset or every Nth, for a block size of N).
+ * @param options What to summarize.
+ * @param zoneMap Storage for the zone map.
+ * @param zoneMapSize The size of the storage (see ksbonjson_zoneMapSize()).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL if the storage is too small.
+ * @return KSBONJSON_DOCUMENT_INVALID_PATH if a path is malformed or there are
+ *         too many.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_buildZoneMap(const KSBONJSONIndex* index,
+                                                                 const KSBONJSONZoneMapOptions* options,
+                                                                 uint8_t* zoneMap,
+                                                                 size_t zoneMapSize);
+
+/**
+ * Open a zone map that was built on an index.
+ *
+ * @param zoneMap The opened zone map.
+ * @param data The zone map data (from ksbonjson_buildZoneMap()).
+ * @param dataLength The length of the zone map data.
+ * @param index The index that the zone map was built on.
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ * @return KSBONJSON_DOCUMENT_INVALID_INDEX if the data isn't a zone map of this index.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_openZoneMap(KSBONJSONZoneMap* zoneMap,
+                                                                const uint8_t* data,
+                                                                size_t dataLength,
+                                                                const KSBONJSONIndex* index);
+
+/**
+ * Check if any element in a block could match all of the predicates.
+ *
+ * @param zoneMap The zone map.
+ * @param block The block.
+ * @param predicates The predicates.
+ * @param predicateCount The number of predicates.
+ * @return false if no element in the block can match.
+ */
+KSBONJSON_PUBLIC bool ksbonjson_mayBlockMatch(const KSBONJSONZoneMap* zoneMap,
+                                              uint64_t block,
+                                              const KSBONJSONPredicate* predicates,
+                                              size_t predicateCount);
+
+/**
+ * Visit every element that matches all of the predicates, skipping the blocks
+ * that the zone map rules out.
+ *
+ * @param zoneMap The zone map.
+ * @param predicates The predicates.
+ * @param predicateCount The number of predicates.
+ * @param callback Called for each matching element, in order.
+ * @param userData User-specified data which gets passed to the callback.
+ * @param scannedBlockCount Set to the number of blocks that were read (can be NULL).
+ * @return KSBONJSON_DOCUMENT_OK if the process was successful.
+ */
+KSBONJSON_PUBLIC ksbonjson_documentStatus ksbonjson_scanZoneMap(const KSBONJSONZoneMap* zoneMap,
+                                                                const KSBONJSONPredicate* predicates,
+                                                                size_t predicateCount,
+                                                                KSBONJSONMatchCallback callback,
+                                                                void* userData,
+                                                                uint64_t* scannedBlockCount);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSBONJSONZoneMap_h
@@ -0,0 +1,434 @@
+//
+//  KSBONJSONAggregate.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONAggregate.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+// A segment that matches every member or element
+#define SEGMENT_WILDCARD -1
+// A segment that can only match a member name
+#define SEGMENT_NAME -2
+
+/**
+ * Aggregation state that isn't part of the aggregates themselves.
+ */
+typedef struct
+{
+    // The aggregates whose paths continue into this container's children
+    uint64_t mask;
+    // The index of the next element (arrays only)
+    size_t index;
+    bool isObject;
+} AggregateFrame;
+
+typedef struct
+{
+    KSBONJSONAggregate* aggregates;
+    // endMasks[depth] = The aggregates whose paths end at this depth
+    uint64_t endMasks[KSBONJSON_MAX_PATH_SEGMENTS + 1];
+    size_t depth;
+    AggregateFrame frames[KSBONJSON_MAX_PATH_SEGMENTS];
+} Context;
+
+static size_t segmentStart(const KSBONJSONAggregate* const aggregate, const size_t segment)
+{
+    return segment == 0 ? 1 : aggregate->segmentEnds[segment - 1] + 1;
+}
+
+/**
+ * Split a path into segments, and note which ones are wildcards or could be
+ * array indices.
+ */
+static ksbonjson_documentStatus compilePath(KSBONJSONAggregate* const aggregate)
+{
+    const char* const path = aggregate->path;
+    const size_t length = aggregate->pathLength;
+    aggregate->segmentCount = 0;
+    aggregate->escapedSegments = 0;
+    unlikely_if(length > 0 && path[0] != '/')
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATH;
+    }
+
+    size_t pos = 1;
+    while(pos <= length)
+    {
+        unlikely_if(aggregate->segmentCount >= KSBONJSON_MAX_PATH_SEGMENTS)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_PATH;
+        }
+        const size_t start = pos;
+        int64_t index = 0;
+        bool isIndex = true;
+        for(; pos < length && path[pos] != '/'; pos++)
+        {
+            const char ch = path[pos];
+            unlikely_if(ch == '~' && (pos + 1 >= length || (path[pos + 1] != '0' && path[pos + 1] != '1')))
+            {
+                return KSBONJSON_DOCUMENT_INVALID_PATH;
+            }
+            if(ch == '~')
+            {
+                aggregate->escapedSegments |= 1U << aggregate->segmentCount;
+            }
+            // No leading zeroes, and nothing that could overflow
+            isIndex = isIndex && ch >= '0' && ch <= '9' && !(pos > start && path[start] == '0') && pos - start < 18;
+            index = index * 10 + (ch - '0');
+        }
+        const size_t segmentLength = pos - start;
+        int64_t* const segmentIndex = &aggregate->segmentIndices[aggregate->segmentCount];
+        if(segmentLength == 1 && path[start] == '*')
+        {
+            *segmentIndex = SEGMENT_WILDCARD;
+        }
+        else
+        {
+            *segmentIndex = isIndex && segmentLength > 0 ? index : SEGMENT_NAME;
+        }
+        aggregate->segmentEnds[aggregate->segmentCount++] = pos;
+        pos++;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Compare an encoded member name to a path segment (which can contain ~0 and
+ * ~1 escapes).
+ */
+static bool isEscapedSegmentName(const char* const segment,
+                                 const size_t segmentLength,
+                                 const bool isEscaped,
+                                 const uint8_t* const name,
+                                 const size_t nameLength)
+{
+    likely_if(!isEscaped)
+    {
+        return segmentLength == nameLength && memcmp(segment, name, nameLength) == 0;
+    }
+
+    size_t nameIndex = 0;
+    for(size_t i = 0; i < segmentLength; i++)
+    {
+        char ch = segment[i];
+        if(ch == '~')
+        {
+            ch = segment[++i] == '0' ? '~' : '/';
+        }
+        unlikely_if(nameIndex >= nameLength || name[nameIndex++] != (uint8_t)ch)
+        {
+            return false;
+        }
+    }
+    return nameIndex == nameLength;
+}
+
+/**
+ * @return The aggregates in mask whose path segment at this depth matches the member name.
+ */
+static uint64_t matchName(const Context* const ctx,
+                          uint64_t mask,
+                          const size_t segment,
+                          const uint8_t* const name,
+                          const size_t nameLength)
+{
+    uint64_t matched = 0;
+    for(; mask != 0; mask &= mask - 1)
+    {
+        const int i = __builtin_ctzll(mask);
+        const KSBONJSONAggregate* const aggregate = &ctx->aggregates[i];
+        if(aggregate->segmentIndices[segment] == SEGMENT_WILDCARD)
+        {
+            matched |= 1ULL << i;
+            continue;
+        }
+        const size_t start = segmentStart(aggregate, segment);
+        if(isEscapedSegmentName(aggregate->path + start,
+                                aggregate->segmentEnds[segment] - start,
+                                (aggregate->escapedSegments & (1U << segment)) != 0,
+                                name,
+                                nameLength))
+        {
+            matched |= 1ULL << i;
+        }
+    }
+    return matched;
+}
+
+/**
+ * @return The aggregates in mask whose path segment at this depth matches the element index.
+ */
+static uint64_t matchIndex(const Context* const ctx, uint64_t mask, const size_t segment, const size_t index)
+{
+    uint64_t matched = 0;
+    for(; mask != 0; mask &= mask - 1)
+    {
+        const int i = __builtin_ctzll(mask);
+        const int64_t segmentIndex = ctx->aggregates[i].segmentIndices[segment];
+        if(segmentIndex == SEGMENT_WILDCARD || (segmentIndex >= 0 && (uint64_t)segmentIndex == index))
+        {
+            matched |= 1ULL << i;
+        }
+    }
+    return matched;
+}
+
+static size_t findBucket(const KSBONJSONAggregate* const aggregate, const double value)
+{
+    size_t low = 0;
+    size_t high = aggregate->bucketBoundCount;
+    while(low < high)
+    {
+        const size_t middle = low + (high - low) / 2;
+        if(value <= aggregate->bucketBounds[middle])
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+static void addNumber(KSBONJSONAggregate* const aggregate, const Number* const number)
+{
+    const double value = toFloat(number);
+    if(aggregate->count == 0)
+    {
+        aggregate->min = value;
+        aggregate->max = value;
+    }
+    else
+    {
+        aggregate->min = value < aggregate->min ? value : aggregate->min;
+        aggregate->max = value > aggregate->max ? value : aggregate->max;
+    }
+    aggregate->count++;
+    aggregate->sum += value;
+
+    if(aggregate->isIntegerSum)
+    {
+        int64_t integer = 0;
+        unlikely_if(toInteger(number, &integer) != KSBONJSON_DOCUMENT_OK ||
+                    __builtin_add_overflow(aggregate->integerSum, integer, &aggregate->integerSum))
+        {
+            aggregate->isIntegerSum = false;
+        }
+    }
+
+    if(aggregate->bucketCounts != NULL)
+    {
+        aggregate->bucketCounts[findBucket(aggregate, value)]++;
+    }
+}
+
+static void addOther(const Context* const ctx, uint64_t mask)
+{
+    for(; mask != 0; mask &= mask - 1)
+    {
+        ctx->aggregates[__builtin_ctzll(mask)].otherCount++;
+    }
+}
+
+/**
+ * Visit the value at *pos, which the aggregates in mask have matched so far.
+ * Aggregates whose paths end here take the value, and if it's a container
+ * that other paths continue into, it's entered rather than skipped.
+ *
+ * @param depth The number of path segments that the value is at.
+ */
+static ksbonjson_documentStatus visitValue(Context* const ctx,
+                                           const uint8_t** const pos,
+                                           const uint8_t* const end,
+                                           const uint64_t mask,
+                                           const size_t depth)
+{
+    const uint8_t* const value = *pos;
+    unlikely_if(value >= end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    const uint8_t typeCode = *value;
+    const uint64_t endingHere = mask & ctx->endMasks[depth];
+    const uint64_t continuing = mask & ~endingHere;
+
+    if(typeCode <= INTSMALL_MAX || (typeCode >= TYPE_INT8 && typeCode <= TYPE_FLOAT64))
+    {
+        if(endingHere != 0)
+        {
+            Number number;
+            PROPAGATE_ERROR(decodeNumber(value, end, &number, pos));
+            for(uint64_t remaining = endingHere; remaining != 0; remaining &= remaining - 1)
+            {
+                addNumber(&ctx->aggregates[__builtin_ctzll(remaining)], &number);
+            }
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    else if(typeCode == TYPE_ARRAY || typeCode == TYPE_OBJECT)
+    {
+        addOther(ctx, endingHere);
+        if(continuing != 0)
+        {
+            ctx->frames[ctx->depth++] = (AggregateFrame)
+            {
+                .mask = continuing,
+                .index = 0,
+                .isObject = typeCode == TYPE_OBJECT,
+            };
+            *pos = value + 1;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    else
+    {
+        addOther(ctx, endingHere);
+    }
+
+    *pos = skipValue(value, end);
+    unlikely_if(*pos == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_aggregate(const uint8_t* const document,
+                                             const size_t documentLength,
+                                             KSBONJSONAggregate* const aggregates,
+                                             const size_t aggregateCount)
+{
+    unlikely_if(aggregateCount > KSBONJSON_MAX_AGGREGATES)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATH;
+    }
+
+    Context ctx =
+    {
+        .aggregates = aggregates,
+        .depth = 0,
+    };
+    memset(ctx.endMasks, 0, sizeof(ctx.endMasks));
+    for(size_t i = 0; i < aggregateCount; i++)
+    {
+        KSBONJSONAggregate* const aggregate = &aggregates[i];
+        PROPAGATE_ERROR(compilePath(aggregate));
+        aggregate->count = 0;
+        aggregate->otherCount = 0;
+        aggregate->sum = 0;
+        aggregate->min = 0;
+        aggregate->max = 0;
+        aggregate->integerSum = 0;
+        aggregate->isIntegerSum = true;
+        if(aggregate->bucketCounts != NULL)
+        {
+            memset(aggregate->bucketCounts, 0, (aggregate->bucketBoundCount + 1) * sizeof(*aggregate->bucketCounts));
+        }
+        ctx.endMasks[aggregate->segmentCount] |= 1ULL << i;
+    }
+
+    const uint8_t* const end = document + documentLength;
+    const uint8_t* pos = document;
+    const uint64_t all = aggregateCount == 64 ? ~0ULL : (1ULL << aggregateCount) - 1;
+    PROPAGATE_ERROR(visitValue(&ctx, &pos, end, all, 0));
+
+    while(ctx.depth > 0)
+    {
+        AggregateFrame* const frame = &ctx.frames[ctx.depth - 1];
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        if(*pos == TYPE_END)
+        {
+            ctx.depth--;
+            pos++;
+            continue;
+        }
+
+        uint64_t matched = 0;
+        if(frame->isObject)
+        {
+            unlikely_if(*pos != TYPE_STRING)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            const uint8_t* const name = pos + 1;
+            const uint8_t* const nameEnd = CALL_KERNEL(findStringTerminator)(name, end);
+            unlikely_if(nameEnd >= end)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            pos = nameEnd + 1;
+            matched = matchName(&ctx, frame->mask, ctx.depth - 1, name, (size_t)(nameEnd - name));
+        }
+        else
+        {
+            matched = matchIndex(&ctx, frame->mask, ctx.depth - 1, frame->index++);
+        }
+
+        if(matched == 0)
+        {
+            pos = skipValue(pos, end);
+            unlikely_if(pos == NULL)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            continue;
+        }
+        PROPAGATE_ERROR(visitValue(&ctx, &pos, end, matched, ctx.depth));
+    }
+
+    unlikely_if(pos != end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
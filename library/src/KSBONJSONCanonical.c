@@ -0,0 +1,539 @@
+//
+//  KSBONJSONCanonical.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONCanonical.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+#define PROPAGATE_ENCODE_ERROR(CALL) \
+    do \
+    { \
+        unlikely_if((CALL) != KSBONJSON_ENCODE_OK) \
+        { \
+            return KSBONJSON_DOCUMENT_COULD_NOT_ENCODE; \
+        } \
+    } \
+    while(0)
+
+/**
+ * A container that is being re-encoded.
+ */
+typedef struct
+{
+    // Arrays: The next element. Objects: The end of the object.
+    const uint8_t* pos;
+
+    // Objects: The sorted members in the members buffer
+    size_t firstMember;
+    size_t nextMember;
+    size_t endMember;
+
+    bool isObject;
+} CanonicalFrame;
+
+typedef struct
+{
+    KSBONJSONEncodeContext* encoder;
+    const uint8_t* end;
+    KSBONJSONCanonicalMember* members;
+    size_t memberCount;
+    size_t membersInUse;
+    int depth;
+    CanonicalFrame frames[KSBONJSON_MAX_CONTAINER_DEPTH];
+} CanonicalContext;
+
+/**
+ * A container that is being checked.
+ */
+typedef struct
+{
+    // Objects: The previous member's name (NULL at the start)
+    const uint8_t* previousName;
+    const uint8_t* previousNameEnd;
+
+    bool isObject;
+    bool isExpectingName;
+} CheckFrame;
+
+/**
+ * Where a single number gets encoded for comparison.
+ */
+typedef struct
+{
+    uint8_t bytes[16];
+    size_t length;
+} NumberBuffer;
+
+static bool isContainerTypeCode(const uint8_t typeCode)
+{
+    return typeCode == TYPE_ARRAY || typeCode == TYPE_OBJECT;
+}
+
+/**
+ * Compare two encoded member names by their UTF-8 bytes (a shorter name
+ * sorts before any longer name that it's a prefix of).
+ */
+static int compareNames(const uint8_t* const a,
+                        const uint8_t* const aEnd,
+                        const uint8_t* const b,
+                        const uint8_t* const bEnd)
+{
+    // Leave out the string delimiters
+    const size_t aLength = (size_t)(aEnd - a) - 2;
+    const size_t bLength = (size_t)(bEnd - b) - 2;
+    const int result = memcmp(a + 1, b + 1, aLength < bLength ? aLength : bLength);
+    if(result != 0)
+    {
+        return result;
+    }
+    return (aLength > bLength) - (aLength < bLength);
+}
+
+static bool isMemberBefore(const KSBONJSONCanonicalMember* const a, const KSBONJSONCanonicalMember* const b)
+{
+    return compareNames(a->name, a->value, b->name, b->value) < 0;
+}
+
+static void siftDownMember(KSBONJSONCanonicalMember* const members, size_t root, const size_t count)
+{
+    for(;;)
+    {
+        size_t child = root * 2 + 1;
+        if(child >= count)
+        {
+            return;
+        }
+        if(child + 1 < count && isMemberBefore(&members[child], &members[child + 1]))
+        {
+            child++;
+        }
+        if(!isMemberBefore(&members[root], &members[child]))
+        {
+            return;
+        }
+        const KSBONJSONCanonicalMember swap = members[root];
+        members[root] = members[child];
+        members[child] = swap;
+        root = child;
+    }
+}
+
+/**
+ * Sort members by name (heapsort, since it needs no extra space or recursion).
+ */
+static void sortMembers(KSBONJSONCanonicalMember* const members, const size_t count)
+{
+    for(size_t i = count / 2; i > 0; i--)
+    {
+        siftDownMember(members, i - 1, count);
+    }
+    for(size_t i = count; i > 1; i--)
+    {
+        const KSBONJSONCanonicalMember swap = members[0];
+        members[0] = members[i - 1];
+        members[i - 1] = swap;
+        siftDownMember(members, 0, i - 1);
+    }
+}
+
+/**
+ * Encode a number in the smallest type that holds it exactly.
+ */
+static ksbonjson_documentStatus encodeNumber(KSBONJSONEncodeContext* const encoder,
+                                             const uint8_t* const pos,
+                                             const uint8_t* const end)
+{
+    likely_if(*pos <= INTSMALL_MAX)
+    {
+        PROPAGATE_ENCODE_ERROR(ksbonjson_addInteger(encoder, (int64_t)*pos - INTSMALL_BIAS));
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    KSBONJSONDocument document;
+    KSBONJSONNode node;
+    PROPAGATE_ERROR(ksbonjson_loadDocument(&document, pos, (size_t)(end - pos), &node, 1));
+    switch(node.type)
+    {
+        case KSBONJSON_NODE_INTEGER:
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addInteger(encoder, node.value.integer));
+            break;
+        case KSBONJSON_NODE_UINTEGER:
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addUInteger(encoder, node.value.uinteger));
+            break;
+        default:
+        {
+            // The encoder turns floats that fit in an int64 into integers,
+            // but not ones that only fit in a uint64.
+            const double value = node.value.floatingPoint;
+            if(value >= 9223372036854775808.0 && value < 18446744073709551616.0 &&
+               (double)(uint64_t)value == value)
+            {
+                PROPAGATE_ENCODE_ERROR(ksbonjson_addUInteger(encoder, (uint64_t)value));
+                break;
+            }
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addFloat(encoder, value));
+            break;
+        }
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus encodeScalar(KSBONJSONEncodeContext* const encoder,
+                                             const uint8_t* const pos,
+                                             const uint8_t* const end)
+{
+    switch(*pos)
+    {
+        case TYPE_STRING:
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addString(encoder, (const char*)pos + 1, (size_t)(end - pos) - 2));
+            return KSBONJSON_DOCUMENT_OK;
+        case TYPE_NULL:
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addNull(encoder));
+            return KSBONJSON_DOCUMENT_OK;
+        case TYPE_FALSE:
+        case TYPE_TRUE:
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addBoolean(encoder, *pos == TYPE_TRUE));
+            return KSBONJSON_DOCUMENT_OK;
+        default:
+            return encodeNumber(encoder, pos, end);
+    }
+}
+
+/**
+ * Gather an object's members into the members buffer, and sort them.
+ */
+static ksbonjson_documentStatus collectMembers(CanonicalContext* const ctx, CanonicalFrame* const frame)
+{
+    const uint8_t* pos = frame->pos;
+    bool isSorted = true;
+    while(*pos != TYPE_END)
+    {
+        const uint8_t* const nameEnd = skipValue(pos, ctx->end);
+        unlikely_if(*pos != TYPE_STRING || nameEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        const uint8_t* const valueEnd = skipValue(nameEnd, ctx->end);
+        unlikely_if(valueEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        unlikely_if(ctx->membersInUse >= ctx->memberCount)
+        {
+            return KSBONJSON_DOCUMENT_MEMBER_BUFFER_FULL;
+        }
+
+        KSBONJSONCanonicalMember* const member = &ctx->members[ctx->membersInUse++];
+        *member = (KSBONJSONCanonicalMember){.name = pos, .value = nameEnd, .valueEnd = valueEnd};
+        if(isSorted && ctx->membersInUse - frame->firstMember > 1)
+        {
+            isSorted = isMemberBefore(member - 1, member);
+        }
+        pos = valueEnd;
+    }
+    frame->pos = pos + 1;
+    frame->endMember = ctx->membersInUse;
+
+    // Members that were already in order can't have duplicate names.
+    if(!isSorted)
+    {
+        KSBONJSONCanonicalMember* const members = &ctx->members[frame->firstMember];
+        const size_t count = frame->endMember - frame->firstMember;
+        sortMembers(members, count);
+        for(size_t i = 1; i < count; i++)
+        {
+            unlikely_if(!isMemberBefore(&members[i - 1], &members[i]))
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+        }
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus beginCanonicalContainer(CanonicalContext* const ctx, const uint8_t* const pos)
+{
+    unlikely_if(ctx->depth >= KSBONJSON_MAX_CONTAINER_DEPTH)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    CanonicalFrame* const frame = &ctx->frames[ctx->depth++];
+    frame->pos = pos + 1;
+    frame->isObject = *pos == TYPE_OBJECT;
+    frame->firstMember = ctx->membersInUse;
+    frame->nextMember = ctx->membersInUse;
+    if(frame->isObject)
+    {
+        PROPAGATE_ERROR(collectMembers(ctx, frame));
+        PROPAGATE_ENCODE_ERROR(ksbonjson_beginObject(ctx->encoder));
+    }
+    else
+    {
+        PROPAGATE_ENCODE_ERROR(ksbonjson_beginArray(ctx->encoder));
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * @param next Where the container ends in the original document.
+ */
+static ksbonjson_documentStatus endCanonicalContainer(CanonicalContext* const ctx, const uint8_t* const next)
+{
+    ctx->depth--;
+    ctx->membersInUse = ctx->frames[ctx->depth].firstMember;
+    if(ctx->depth > 0 && !ctx->frames[ctx->depth - 1].isObject)
+    {
+        ctx->frames[ctx->depth - 1].pos = next;
+    }
+    PROPAGATE_ENCODE_ERROR(ksbonjson_endContainer(ctx->encoder));
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus encodeValue(CanonicalContext* const ctx,
+                                            const uint8_t* const pos,
+                                            const uint8_t* const end)
+{
+    if(isContainerTypeCode(*pos))
+    {
+        return beginCanonicalContainer(ctx, pos);
+    }
+    return encodeScalar(ctx->encoder, pos, end);
+}
+
+static ksbonjson_documentStatus stepCanonicalArray(CanonicalContext* const ctx, CanonicalFrame* const frame)
+{
+    const uint8_t* const pos = frame->pos;
+    if(*pos == TYPE_END)
+    {
+        return endCanonicalContainer(ctx, pos + 1);
+    }
+    if(isContainerTypeCode(*pos))
+    {
+        // This frame's position gets updated when the container ends.
+        return beginCanonicalContainer(ctx, pos);
+    }
+    const uint8_t* const valueEnd = skipValue(pos, ctx->end);
+    unlikely_if(valueEnd == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    frame->pos = valueEnd;
+    return encodeScalar(ctx->encoder, pos, valueEnd);
+}
+
+static ksbonjson_documentStatus stepCanonicalObject(CanonicalContext* const ctx, CanonicalFrame* const frame)
+{
+    if(frame->nextMember == frame->endMember)
+    {
+        return endCanonicalContainer(ctx, frame->pos);
+    }
+    const KSBONJSONCanonicalMember* const member = &ctx->members[frame->nextMember++];
+    PROPAGATE_ENCODE_ERROR(ksbonjson_addString(ctx->encoder,
+                                               (const char*)member->name + 1,
+                                               (size_t)(member->value - member->name) - 2));
+    return encodeValue(ctx, member->value, member->valueEnd);
+}
+
+static ksbonjson_encodeStatus addToNumberBuffer(const uint8_t* KSBONJSON_RESTRICT data,
+                                                size_t dataLength,
+                                                void* KSBONJSON_RESTRICT userData)
+{
+    NumberBuffer* const buffer = (NumberBuffer*)userData;
+    unlikely_if(dataLength > sizeof(buffer->bytes) - buffer->length)
+    {
+        return KSBONJSON_ENCODE_COULD_NOT_ADD_DATA;
+    }
+    memcpy(buffer->bytes + buffer->length, data, dataLength);
+    buffer->length += dataLength;
+    return KSBONJSON_ENCODE_OK;
+}
+
+/**
+ * Check if a number is encoded the way that encodeNumber() would encode it.
+ * The encoder is kept inside an array so that it will accept any number of
+ * values.
+ */
+static ksbonjson_documentStatus isCanonicalNumber(KSBONJSONEncodeContext* const encoder,
+                                                  NumberBuffer* const buffer,
+                                                  const uint8_t* const pos,
+                                                  const uint8_t* const end,
+                                                  bool* const isCanonical)
+{
+    buffer->length = 0;
+    PROPAGATE_ERROR(encodeNumber(encoder, pos, end));
+    *isCanonical = buffer->length == (size_t)(end - pos) && memcmp(buffer->bytes, pos, buffer->length) == 0;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus checkDocument(const uint8_t* pos,
+                                              const uint8_t* const end,
+                                              CheckFrame* const frames,
+                                              bool* const isCanonical)
+{
+    KSBONJSONEncodeContext encoder;
+    NumberBuffer buffer = {.length = 0};
+    ksbonjson_beginEncode(&encoder, addToNumberBuffer, &buffer);
+    PROPAGATE_ENCODE_ERROR(ksbonjson_beginArray(&encoder));
+
+    int depth = 0;
+    do
+    {
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        CheckFrame* const frame = depth > 0 ? &frames[depth - 1] : NULL;
+        if(frame != NULL && frame->isObject && frame->isExpectingName && *pos != TYPE_END)
+        {
+            const uint8_t* const nameEnd = skipValue(pos, end);
+            unlikely_if(*pos != TYPE_STRING || nameEnd == NULL)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            if(frame->previousName != NULL &&
+               compareNames(frame->previousName, frame->previousNameEnd, pos, nameEnd) >= 0)
+            {
+                *isCanonical = false;
+                return KSBONJSON_DOCUMENT_OK;
+            }
+            frame->previousName = pos;
+            frame->previousNameEnd = nameEnd;
+            frame->isExpectingName = false;
+            pos = nameEnd;
+            continue;
+        }
+        if(*pos == TYPE_END)
+        {
+            // An end marker can't take the place of a member's value.
+            unlikely_if(frame == NULL || !frame->isExpectingName)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            depth--;
+            pos++;
+            continue;
+        }
+        if(frame != NULL)
+        {
+            frame->isExpectingName = true;
+        }
+
+        if(isContainerTypeCode(*pos))
+        {
+            unlikely_if(depth >= KSBONJSON_MAX_CONTAINER_DEPTH)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            frames[depth++] = (CheckFrame){.isObject = *pos == TYPE_OBJECT, .isExpectingName = true};
+            pos++;
+            continue;
+        }
+
+        const uint8_t* const valueEnd = skipValue(pos, end);
+        unlikely_if(valueEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        if(*pos != TYPE_STRING && *pos > TYPE_NULL)
+        {
+            PROPAGATE_ERROR(isCanonicalNumber(&encoder, &buffer, pos, valueEnd, isCanonical));
+            if(!*isCanonical)
+            {
+                return KSBONJSON_DOCUMENT_OK;
+            }
+        }
+        pos = valueEnd;
+    }
+    while(depth > 0);
+
+    unlikely_if(pos != end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    *isCanonical = true;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_canonicalize(const uint8_t* const document,
+                                                const size_t documentLength,
+                                                KSBONJSONCanonicalMember* const members,
+                                                const size_t memberCount,
+                                                KSBONJSONEncodeContext* const encoder)
+{
+    const uint8_t* const end = document + documentLength;
+    unlikely_if(documentLength == 0 || skipValue(document, end) != end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+
+    // The frames don't need clearing.
+    CanonicalContext ctx;
+    ctx.encoder = encoder;
+    ctx.end = end;
+    ctx.members = members;
+    ctx.memberCount = memberCount;
+    ctx.membersInUse = 0;
+    ctx.depth = 0;
+
+    PROPAGATE_ERROR(encodeValue(&ctx, document, end));
+    while(ctx.depth > 0)
+    {
+        CanonicalFrame* const frame = &ctx.frames[ctx.depth - 1];
+        PROPAGATE_ERROR(frame->isObject ? stepCanonicalObject(&ctx, frame) : stepCanonicalArray(&ctx, frame));
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_isCanonical(const uint8_t* const document,
+                                               const size_t documentLength,
+                                               bool* const isCanonical)
+{
+    CheckFrame frames[KSBONJSON_MAX_CONTAINER_DEPTH];
+    *isCanonical = false;
+    return checkDocument(document, document + documentLength, frames, isCanonical);
+}
@@ -0,0 +1,305 @@
+//
+//  KSBONJSONColumns.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONColumns.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+#define KEY_TABLE_SIZE (KSBONJSON_MAX_COLUMNS * 2)
+
+/**
+ * Member names are short, so the length and the first and last bytes are
+ * enough to tell a handful of columns apart.
+ */
+static size_t hashName(const uint8_t* const name, const size_t length)
+{
+    unlikely_if(length == 0)
+    {
+        return 0;
+    }
+    return (length * 31 + (size_t)name[0] * 7 + name[length - 1]) & (KEY_TABLE_SIZE - 1);
+}
+
+/**
+ * @return The index of the column with this name, or -1 if there isn't one.
+ */
+static int findColumn(const KSBONJSONColumnExtractor* const ex, const uint8_t* const name, const size_t length)
+{
+    for(size_t slot = hashName(name, length);; slot = (slot + 1) & (KEY_TABLE_SIZE - 1))
+    {
+        const int entry = ex->keyTable[slot];
+        if(entry == 0)
+        {
+            return -1;
+        }
+        const KSBONJSONColumn* const column = &ex->columns[entry - 1];
+        if(column->nameLength == length && memcmp(column->name, name, length) == 0)
+        {
+            return entry - 1;
+        }
+    }
+}
+
+static ksbonjson_documentStatus buildKeyTable(KSBONJSONColumnExtractor* const ex)
+{
+    memset(ex->keyTable, 0, sizeof(ex->keyTable));
+    for(size_t i = 0; i < ex->columnCount; i++)
+    {
+        const KSBONJSONColumn* const column = &ex->columns[i];
+        const uint8_t* const name = (const uint8_t*)column->name;
+        unlikely_if(column->type > KSBONJSON_COLUMN_STRING || findColumn(ex, name, column->nameLength) >= 0)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_COLUMNS;
+        }
+        size_t slot = hashName(name, column->nameLength);
+        while(ex->keyTable[slot] != 0)
+        {
+            slot = (slot + 1) & (KEY_TABLE_SIZE - 1);
+        }
+        ex->keyTable[slot] = (uint8_t)(i + 1);
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static void setValidity(uint8_t* const validity, const size_t row, const bool isValid)
+{
+    if(validity != NULL)
+    {
+        const uint8_t bit = (uint8_t)(1 << (row & 7));
+        validity[row >> 3] = isValid ? (uint8_t)(validity[row >> 3] | bit) : (uint8_t)(validity[row >> 3] & ~bit);
+    }
+}
+
+static void storeNull(const KSBONJSONColumn* const column, const size_t row)
+{
+    switch(column->type)
+    {
+        case KSBONJSON_COLUMN_INT64:
+            column->integers[row] = 0;
+            break;
+        case KSBONJSON_COLUMN_FLOAT64:
+            column->floats[row] = 0;
+            break;
+        default:
+            column->strings[row] = (KSBONJSONStringSlice){0, 0};
+            break;
+    }
+    setValidity(column->validity, row, false);
+}
+
+/**
+ * Decode the value at *pos into a column.
+ *
+ * @param hasValue Set to false if the value is null.
+ */
+static ksbonjson_documentStatus storeValue(const KSBONJSONColumnExtractor* const ex,
+                                           const KSBONJSONColumn* const column,
+                                           const size_t row,
+                                           const uint8_t** const pos,
+                                           bool* const hasValue)
+{
+    const uint8_t* const value = *pos;
+    const uint8_t* const end = ex->end;
+    if(*value == TYPE_STRING)
+    {
+        unlikely_if(column->type != KSBONJSON_COLUMN_STRING)
+        {
+            return KSBONJSON_DOCUMENT_WRONG_TYPE;
+        }
+        const uint8_t* const terminator = CALL_KERNEL(findStringTerminator)(value + 1, end);
+        unlikely_if(terminator >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        column->strings[row] = (KSBONJSONStringSlice)
+        {
+            .offset = (size_t)(value + 1 - ex->document),
+            .length = (size_t)(terminator - (value + 1)),
+        };
+        *pos = terminator + 1;
+    }
+    else if(*value == TYPE_NULL)
+    {
+        storeNull(column, row);
+        *pos = value + 1;
+        *hasValue = false;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+    else
+    {
+        unlikely_if(column->type == KSBONJSON_COLUMN_STRING)
+        {
+            return *value == TYPE_END ? KSBONJSON_DOCUMENT_INVALID_DATA : KSBONJSON_DOCUMENT_WRONG_TYPE;
+        }
+        Number number;
+        PROPAGATE_ERROR(decodeNumber(value, end, &number, pos));
+        if(column->type == KSBONJSON_COLUMN_INT64)
+        {
+            PROPAGATE_ERROR(toInteger(&number, &column->integers[row]));
+        }
+        else
+        {
+            column->floats[row] = toFloat(&number);
+        }
+    }
+    setValidity(column->validity, row, true);
+    *hasValue = true;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus extractRecord(KSBONJSONColumnExtractor* const ex, const size_t row)
+{
+    const uint8_t* const end = ex->end;
+    const uint8_t* pos = ex->pos;
+    unlikely_if(*pos != TYPE_OBJECT)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    pos++;
+
+    uint64_t hasValue = 0;
+    for(;;)
+    {
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        if(*pos == TYPE_END)
+        {
+            break;
+        }
+        unlikely_if(*pos != TYPE_STRING)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        const uint8_t* const name = pos + 1;
+        const uint8_t* const nameEnd = CALL_KERNEL(findStringTerminator)(name, end);
+        pos = nameEnd + 1;
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+
+        const int index = findColumn(ex, name, (size_t)(nameEnd - name));
+        if(index < 0)
+        {
+            pos = skipValue(pos, end);
+            unlikely_if(pos == NULL)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            continue;
+        }
+        bool isValue = false;
+        PROPAGATE_ERROR(storeValue(ex, &ex->columns[index], row, &pos, &isValue));
+        hasValue = isValue ? hasValue | (1ULL << index) : hasValue & ~(1ULL << index);
+    }
+
+    for(size_t i = 0; i < ex->columnCount; i++)
+    {
+        if((hasValue & (1ULL << i)) == 0)
+        {
+            storeNull(&ex->columns[i], row);
+        }
+    }
+    ex->pos = pos + 1;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_beginColumnExtraction(KSBONJSONColumnExtractor* const extractor,
+                                                         const uint8_t* const document,
+                                                         const size_t documentLength,
+                                                         KSBONJSONColumn* const columns,
+                                                         const size_t columnCount)
+{
+    unlikely_if(columnCount > KSBONJSON_MAX_COLUMNS)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_COLUMNS;
+    }
+    unlikely_if(documentLength < 2 || document[documentLength - 1] != TYPE_END)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    unlikely_if(document[0] != TYPE_ARRAY)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+
+    extractor->columns = columns;
+    extractor->columnCount = columnCount;
+    extractor->document = document;
+    extractor->pos = document + 1;
+    extractor->end = document + documentLength;
+    return buildKeyTable(extractor);
+}
+
+ksbonjson_documentStatus ksbonjson_extractColumns(KSBONJSONColumnExtractor* const extractor,
+                                                  const size_t rowCapacity,
+                                                  size_t* const rowCount)
+{
+    size_t row = 0;
+    *rowCount = 0;
+    while(row < rowCapacity)
+    {
+        unlikely_if(extractor->pos >= extractor->end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        if(*extractor->pos == TYPE_END)
+        {
+            unlikely_if(extractor->pos + 1 != extractor->end)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            break;
+        }
+        PROPAGATE_ERROR(extractRecord(extractor, row));
+        *rowCount = ++row;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
@@ -0,0 +1,675 @@
+//
+//  KSBONJSONCommon.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONCommon_h
+#define KSBONJSONCommon_h
+
+#include <ksbonjson/KSBONJSONDocument.h>
+#include "KSBONJSONDispatch.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Helpers shared by the library's source files, for working with encoded
+// values directly. Everything here is static, so each source file compiles
+// its own copy (and the amalgamation has just one).
+
+// Compiler hints for "if" statements
+#define likely_if(x) if(__builtin_expect(x,1))
+#define unlikely_if(x) if(__builtin_expect(x,0))
+
+enum {
+    TYPE_ARRAY = 0xeb,
+    TYPE_OBJECT = 0xec,
+    TYPE_END = 0xed,
+    TYPE_FALSE = 0xee,
+    TYPE_TRUE = 0xef,
+    TYPE_NULL = 0xf0,
+    TYPE_INT8 = 0xf1,
+    TYPE_INT16 = 0xf2,
+    TYPE_INT24 = 0xf3,
+    TYPE_INT32 = 0xf4,
+    TYPE_INT40 = 0xf5,
+    TYPE_INT48 = 0xf6,
+    TYPE_INT56 = 0xf7,
+    TYPE_INT64 = 0xf8,
+    TYPE_UINT64 = 0xf9,
+    TYPE_BIGPOSITIVE = 0xfa,
+    TYPE_BIGNEGATIVE = 0xfb,
+    TYPE_FLOAT16 = 0xfc,
+    TYPE_FLOAT32 = 0xfd,
+    TYPE_FLOAT64 = 0xfe,
+    TYPE_STRING = 0xff,
+};
+
+#define INTSMALL_MAX 234
+#define INTSMALL_BIAS 117
+
+union int64_u
+{
+    int64_t i64;
+    uint8_t b[8];
+};
+
+union uint64_u
+{
+    uint64_t u64;
+    uint8_t b[8];
+};
+
+union float32_u
+{
+    float f32;
+    uint32_t u32;
+    uint8_t b[4];
+};
+
+union float64_u
+{
+    double f64;
+    uint64_t u64;
+    uint8_t b[8];
+};
+
+/**
+ * Load a little-endian 64-bit value, so that results don't depend on the
+ * host's byte order.
+ */
+static inline uint64_t loadUInt64(const uint8_t* const src)
+{
+#if KSBONJSON_IS_LITTLE_ENDIAN
+    union uint64_u u;
+    memcpy(u.b, src, 8);
+#else
+    union uint64_u u = {.b = {src[7], src[6], src[5], src[4], src[3], src[2], src[1], src[0]}};
+#endif
+    return u.u64;
+}
+
+/**
+ * Store a 64-bit value little-endian, the counterpart to loadUInt64().
+ */
+static inline void storeUInt64(uint8_t* const dst, const uint64_t value)
+{
+    const union uint64_u u = {.u64 = value};
+#if KSBONJSON_IS_LITTLE_ENDIAN
+    memcpy(dst, u.b, 8);
+#else
+    for(int i = 0; i < 8; i++)
+    {
+        dst[i] = u.b[7 - i];
+    }
+#endif
+}
+
+/**
+ * Multiply two 64-bit values, and fold the 128-bit result into 64 bits.
+ */
+static inline uint64_t multiplyFold(const uint64_t a, const uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    const __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    const uint64_t aLow = (uint32_t)a, aHigh = a >> 32;
+    const uint64_t bLow = (uint32_t)b, bHigh = b >> 32;
+    const uint64_t lowLow = aLow * bLow;
+    const uint64_t lowHigh = aLow * bHigh;
+    const uint64_t highLow = aHigh * bLow;
+    const uint64_t highHigh = aHigh * bHigh;
+    const uint64_t middle = (lowLow >> 32) + (uint32_t)lowHigh + (uint32_t)highLow;
+    const uint64_t low = (middle << 32) | (uint32_t)lowLow;
+    const uint64_t high = highHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+    return low ^ high;
+#endif
+}
+
+/**
+ * Compare an encoded member name to a JSON pointer segment, which can contain
+ * ~0 and ~1 escapes.
+ */
+static inline bool isSegmentName(const char* segment,
+                                 const char* const segmentEnd,
+                                 const uint8_t* name,
+                                 const uint8_t* const nameEnd)
+{
+    for(; segment < segmentEnd; segment++, name++)
+    {
+        unlikely_if(name >= nameEnd)
+        {
+            return false;
+        }
+        char ch = *segment;
+        unlikely_if(ch == '~')
+        {
+            segment++;
+            ch = *segment == '0' ? '~' : '/';
+        }
+        unlikely_if((uint8_t)ch != *name)
+        {
+            return false;
+        }
+    }
+    return name == nameEnd;
+}
+
+/**
+ * Parse a JSON pointer segment as an array index (digits with no leading zero).
+ */
+static inline bool parseSegmentIndex(const char* segment, const char* const segmentEnd, uint64_t* const index)
+{
+    unlikely_if(segment == segmentEnd || (*segment == '0' && segmentEnd - segment > 1))
+    {
+        return false;
+    }
+    uint64_t value = 0;
+    for(; segment < segmentEnd; segment++)
+    {
+        unlikely_if(*segment < '0' || *segment > '9' || value > (UINT64_MAX - 9) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + (uint64_t)(*segment - '0');
+    }
+    *index = value;
+    return true;
+}
+
+/**
+ * Check that a path is a JSON pointer.
+ */
+static inline bool isValidPointer(const char* const path, const size_t pathLength)
+{
+    unlikely_if(pathLength > 0 && path[0] != '/')
+    {
+        return false;
+    }
+    for(size_t i = 0; i < pathLength; i++)
+    {
+        unlikely_if(path[i] == '~' && (i + 1 == pathLength || (path[i + 1] != '0' && path[i + 1] != '1')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// String hash constants (from wyhash)
+#define STRING_HASH_SEED 0xa0761d6478bd642fULL
+#define STRING_HASH_WORD_SECRET 0xe7037ed1a0b428dbULL
+#define STRING_HASH_STATE_SECRET 0x8ebc6af09c88c6e3ULL
+#define STRING_HASH_FINAL_SECRET 0x589965cc75374cc3ULL
+
+/**
+ * Hash a string for a stored index or zone map. These can be moved between
+ * machines, so the hash doesn't depend on the byte order.
+ */
+static inline uint64_t hashStringBytes(const uint8_t* pos, size_t remaining)
+{
+    uint64_t hash = multiplyFold(remaining ^ STRING_HASH_WORD_SECRET, STRING_HASH_SEED ^ STRING_HASH_STATE_SECRET);
+    for(; remaining >= 8; pos += 8, remaining -= 8)
+    {
+        hash = multiplyFold(loadUInt64(pos) ^ STRING_HASH_WORD_SECRET, hash ^ STRING_HASH_STATE_SECRET);
+    }
+    likely_if(remaining > 0)
+    {
+        uint8_t tail[8] = {0};
+        memcpy(tail, pos, remaining);
+        hash = multiplyFold(loadUInt64(tail) ^ STRING_HASH_WORD_SECRET, hash ^ STRING_HASH_STATE_SECRET);
+    }
+    return multiplyFold(hash ^ STRING_HASH_FINAL_SECRET, STRING_HASH_WORD_SECRET);
+}
+
+// Advance pos past BYTE_COUNT bytes, returning NULL if there aren't enough.
+#define SKIP_BYTES(BYTE_COUNT) \
+    do \
+    { \
+        unlikely_if((size_t)(end - pos) < (size_t)(BYTE_COUNT)) \
+        { \
+            return NULL; \
+        } \
+        pos += (BYTE_COUNT); \
+    } \
+    while(0)
+
+/**
+ * Find the end of the value that starts at pos, without decoding it.
+ *
+ * @return The end of the value, or NULL if it's invalid or runs past the end.
+ */
+static inline const uint8_t* skipValue(const uint8_t* pos, const uint8_t* const end)
+{
+    int depth = 0;
+    do
+    {
+        unlikely_if(pos >= end)
+        {
+            return NULL;
+        }
+        const uint8_t typeCode = *pos++;
+        likely_if(typeCode <= INTSMALL_MAX)
+        {
+            continue;
+        }
+        switch(typeCode)
+        {
+            case TYPE_STRING:
+                pos = CALL_KERNEL(findStringTerminator)(pos, end);
+                SKIP_BYTES(1);
+                break;
+            case TYPE_ARRAY:
+            case TYPE_OBJECT:
+                depth++;
+                break;
+            case TYPE_END:
+                unlikely_if(depth == 0)
+                {
+                    return NULL;
+                }
+                depth--;
+                break;
+            case TYPE_INT8:
+            case TYPE_INT16:
+            case TYPE_INT24:
+            case TYPE_INT32:
+            case TYPE_INT40:
+            case TYPE_INT48:
+            case TYPE_INT56:
+            case TYPE_INT64:
+                SKIP_BYTES(typeCode - TYPE_INT8 + 1);
+                break;
+            case TYPE_UINT64:
+            case TYPE_FLOAT64:
+                SKIP_BYTES(8);
+                break;
+            case TYPE_FLOAT16:
+                SKIP_BYTES(2);
+                break;
+            case TYPE_FLOAT32:
+                SKIP_BYTES(4);
+                break;
+            case TYPE_BIGPOSITIVE:
+            case TYPE_BIGNEGATIVE:
+            {
+                // ULEB128 header: significand length << 2 | exponent length
+                uint64_t header = 0;
+                int shift = 0;
+                uint8_t nextByte = 0;
+                do
+                {
+                    unlikely_if(pos >= end || shift > 63)
+                    {
+                        return NULL;
+                    }
+                    nextByte = *pos++;
+                    header |= (uint64_t)(nextByte & 0x7f) << shift;
+                    shift += 7;
+                }
+                while((nextByte & 0x80) != 0);
+                SKIP_BYTES((header >> 2) + (header & 3));
+                break;
+            }
+            default:
+                // TYPE_FALSE, TYPE_TRUE, TYPE_NULL
+                break;
+        }
+    }
+    while(depth > 0);
+
+    return pos;
+}
+
+/**
+ * Find the value at a JSON pointer inside the value that starts at pos.
+ *
+ * @return The start of the value at the path, or NULL if there isn't one.
+ */
+static inline const uint8_t* findPointerValue(const uint8_t* pos,
+                                              const uint8_t* const end,
+                                              const char* const path,
+                                              const size_t pathLength)
+{
+    const char* const pathEnd = path + pathLength;
+    for(const char* segment = path; segment < pathEnd;)
+    {
+        const char* const segmentStart = segment + 1;
+        const char* segmentEnd = memchr(segmentStart, '/', (size_t)(pathEnd - segmentStart));
+        likely_if(segmentEnd == NULL)
+        {
+            segmentEnd = pathEnd;
+        }
+        segment = segmentEnd;
+
+        unlikely_if(pos >= end)
+        {
+            return NULL;
+        }
+        const uint8_t typeCode = *pos++;
+        likely_if(typeCode == TYPE_OBJECT)
+        {
+            for(;;)
+            {
+                unlikely_if(pos >= end || *pos != TYPE_STRING)
+                {
+                    return NULL;
+                }
+                const uint8_t* const name = pos + 1;
+                const uint8_t* const nameEnd = CALL_KERNEL(findStringTerminator)(name, end);
+                unlikely_if(nameEnd >= end)
+                {
+                    return NULL;
+                }
+                pos = nameEnd + 1;
+                if(isSegmentName(segmentStart, segmentEnd, name, nameEnd))
+                {
+                    break;
+                }
+                pos = skipValue(pos, end);
+                unlikely_if(pos == NULL)
+                {
+                    return NULL;
+                }
+            }
+        }
+        else if(typeCode == TYPE_ARRAY)
+        {
+            uint64_t index = 0;
+            unlikely_if(!parseSegmentIndex(segmentStart, segmentEnd, &index))
+            {
+                return NULL;
+            }
+            for(; index > 0; index--)
+            {
+                unlikely_if(pos >= end || *pos == TYPE_END)
+                {
+                    return NULL;
+                }
+                pos = skipValue(pos, end);
+                unlikely_if(pos == NULL)
+                {
+                    return NULL;
+                }
+            }
+            unlikely_if(pos >= end || *pos == TYPE_END)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    unlikely_if(pos >= end)
+    {
+        return NULL;
+    }
+    return pos;
+}
+
+/**
+ * A decoded number.
+ */
+typedef struct
+{
+    ksbonjson_nodeType type;
+    union
+    {
+        int64_t integer;
+        uint64_t uinteger;
+        double floatingPoint;
+    } value;
+} Number;
+
+#define SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(BYTE_COUNT) \
+    do \
+    { \
+        unlikely_if((size_t)(end - pos) < (size_t)(BYTE_COUNT)) \
+        { \
+            return KSBONJSON_DOCUMENT_INVALID_DATA; \
+        } \
+    } \
+    while(0)
+
+/**
+ * Decode the number that starts at pos.
+ *
+ * @param next Set to the end of the number.
+ */
+static inline ksbonjson_documentStatus decodeNumber(const uint8_t* pos,
+                                                    const uint8_t* const end,
+                                                    Number* const number,
+                                                    const uint8_t** const next)
+{
+    const uint8_t typeCode = *pos++;
+    likely_if(typeCode <= INTSMALL_MAX)
+    {
+        number->type = KSBONJSON_NODE_INTEGER;
+        number->value.integer = (int64_t)typeCode - INTSMALL_BIAS;
+        *next = pos;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    switch(typeCode)
+    {
+        case TYPE_INT8:
+        {
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(1);
+            int value = (int8_t)*pos;
+            value += (value < 0) ? -INTSMALL_BIAS : (INTSMALL_BIAS+1);
+            number->type = KSBONJSON_NODE_INTEGER;
+            number->value.integer = value;
+            *next = pos + 1;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_INT16:
+        case TYPE_INT24:
+        case TYPE_INT32:
+        case TYPE_INT40:
+        case TYPE_INT48:
+        case TYPE_INT56:
+        case TYPE_INT64:
+        {
+            const int size = typeCode - TYPE_INT8 + 1;
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(size);
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            // Use the highest byte to sign-extend init the int64
+            union int64_u u = {.i64 = (int8_t)pos[size-1]};
+            memcpy(u.b, pos, size);
+#else
+            // Use the highest byte to sign-extend init the int64
+            union int64_u u = {.i64 = (int8_t)pos[size-1]};
+            for(int i = 0; i < size; i++)
+            {
+                u.b[7 - i] = pos[i];
+            }
+#endif
+            number->type = KSBONJSON_NODE_INTEGER;
+            number->value.integer = u.i64;
+            *next = pos + size;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_UINT64:
+        {
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(8);
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            union uint64_u u;
+            memcpy(u.b, pos, 8);
+#else
+            union uint64_u u = {.b = {pos[7], pos[6], pos[5], pos[4], pos[3], pos[2], pos[1], pos[0]}};
+#endif
+            number->type = KSBONJSON_NODE_UINTEGER;
+            number->value.uinteger = u.u64;
+            *next = pos + 8;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_FLOAT16:
+        {
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(2);
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            union float32_u u = {.b = {0, 0, pos[0], pos[1]}};
+#else
+            union float32_u u = {.b = {pos[1], pos[0], 0, 0}};
+#endif
+            number->type = KSBONJSON_NODE_FLOAT;
+            number->value.floatingPoint = u.f32;
+            *next = pos + 2;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_FLOAT32:
+        {
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(4);
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            union float32_u u;
+            memcpy(u.b, pos, 4);
+#else
+            union float32_u u = {.b = {pos[3], pos[2], pos[1], pos[0]}};
+#endif
+            number->type = KSBONJSON_NODE_FLOAT;
+            number->value.floatingPoint = u.f32;
+            *next = pos + 4;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_FLOAT64:
+        {
+            SHOULD_HAVE_ROOM_FOR_NUMBER_BYTES(8);
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            union float64_u u;
+            memcpy(u.b, pos, 8);
+#else
+            union float64_u u = {.b = {pos[7], pos[6], pos[5], pos[4], pos[3], pos[2], pos[1], pos[0]}};
+#endif
+            number->type = KSBONJSON_NODE_FLOAT;
+            number->value.floatingPoint = u.f64;
+            *next = pos + 8;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_BIGPOSITIVE:
+        case TYPE_BIGNEGATIVE:
+        {
+            // Rare enough to leave to the decoder.
+            const uint8_t* const begin = pos - 1;
+            const uint8_t* const valueEnd = skipValue(begin, end);
+            unlikely_if(valueEnd == NULL)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            KSBONJSONDocument document;
+            KSBONJSONNode node;
+            const ksbonjson_documentStatus status = ksbonjson_loadDocument(&document, begin, (size_t)(valueEnd - begin), &node, 1);
+            unlikely_if(status != KSBONJSON_DOCUMENT_OK)
+            {
+                return status;
+            }
+            number->type = node.type;
+            number->value.uinteger = node.value.uinteger;
+            *next = valueEnd;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        case TYPE_END:
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        default:
+            return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+}
+
+static inline ksbonjson_documentStatus toInteger(const Number* const number, int64_t* const value)
+{
+    switch(number->type)
+    {
+        case KSBONJSON_NODE_INTEGER:
+            *value = number->value.integer;
+            return KSBONJSON_DOCUMENT_OK;
+        case KSBONJSON_NODE_UINTEGER:
+            unlikely_if(number->value.uinteger > INT64_MAX)
+            {
+                return KSBONJSON_DOCUMENT_WRONG_TYPE;
+            }
+            *value = (int64_t)number->value.uinteger;
+            return KSBONJSON_DOCUMENT_OK;
+        default:
+        {
+            const double f = number->value.floatingPoint;
+            unlikely_if(!(f >= -9223372036854775808.0 && f < 9223372036854775808.0) || (double)(int64_t)f != f)
+            {
+                return KSBONJSON_DOCUMENT_WRONG_TYPE;
+            }
+            *value = (int64_t)f;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+}
+
+static inline double toFloat(const Number* const number)
+{
+    switch(number->type)
+    {
+        case KSBONJSON_NODE_INTEGER:
+            return (double)number->value.integer;
+        case KSBONJSON_NODE_UINTEGER:
+            return (double)number->value.uinteger;
+        default:
+            return number->value.floatingPoint;
+    }
+}
+
+static inline bool isFloatEqualToInteger(const double value, const KSBONJSONNode* const integer)
+{
+    if(integer->type == KSBONJSON_NODE_INTEGER)
+    {
+        return value >= -9223372036854775808.0 && value < 9223372036854775808.0 &&
+               (int64_t)value == integer->value.integer && (double)(int64_t)value == value;
+    }
+    return value >= 0 && value < 18446744073709551616.0 &&
+           (uint64_t)value == integer->value.uinteger && (double)(uint64_t)value == value;
+}
+
+/**
+ * Compare numbers by value, regardless of how they're encoded.
+ */
+static inline bool isEqualNumber(const KSBONJSONNode* const a, const KSBONJSONNode* const b)
+{
+    if(a->type == KSBONJSON_NODE_FLOAT)
+    {
+        return b->type == KSBONJSON_NODE_FLOAT ? a->value.floatingPoint == b->value.floatingPoint
+                                                : isFloatEqualToInteger(a->value.floatingPoint, b);
+    }
+    if(b->type == KSBONJSON_NODE_FLOAT)
+    {
+        return isFloatEqualToInteger(b->value.floatingPoint, a);
+    }
+    if(a->type == b->type)
+    {
+        return a->value.uinteger == b->value.uinteger;
+    }
+    // One is signed and the other is unsigned.
+    const int64_t signedValue = a->type == KSBONJSON_NODE_INTEGER ? a->value.integer : b->value.integer;
+    const uint64_t unsignedValue = a->type == KSBONJSON_NODE_UINTEGER ? a->value.uinteger : b->value.uinteger;
+    return signedValue >= 0 && (uint64_t)signedValue == unsignedValue;
+}
+
+#endif // KSBONJSONCommon_h
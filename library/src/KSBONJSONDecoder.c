@@ -25,81 +25,17 @@
 //
 
 #include <ksbonjson/KSBONJSONDecoder.h>
+#include "KSBONJSONCommon.h"
+#include "KSBONJSONProbes.h"
 
 #include <string.h>
 
 
-// ============================================================================
-// Helpers
-// ============================================================================
-
-// Compiler hints for "if" statements
-#define likely_if(x) if(__builtin_expect(x,1))
-#define unlikely_if(x) if(__builtin_expect(x,0))
-
-enum {
-    TYPE_ARRAY = 0xeb,
-    TYPE_OBJECT = 0xec,
-    TYPE_END = 0xed,
-    TYPE_FALSE = 0xee,
-    TYPE_TRUE = 0xef,
-    TYPE_NULL = 0xf0,
-    TYPE_INT8 = 0xf1,
-    TYPE_INT16 = 0xf2,
-    TYPE_INT24 = 0xf3,
-    TYPE_INT32 = 0xf4,
-    TYPE_INT40 = 0xf5,
-    TYPE_INT48 = 0xf6,
-    TYPE_INT56 = 0xf7,
-    TYPE_INT64 = 0xf8,
-    TYPE_UINT64 = 0xf9,
-    TYPE_BIGPOSITIVE = 0xfa,
-    TYPE_BIGNEGATIVE = 0xfb,
-    TYPE_FLOAT16 = 0xfc,
-    TYPE_FLOAT32 = 0xfd,
-    TYPE_FLOAT64 = 0xfe,
-    TYPE_STRING = 0xff,
-};
-
-#define INTSMALL_MAX 234
-#define INTSMALL_BIAS 117
-
-union uint64_u
-{
-    uint64_t u64;
-    uint8_t b[8];
-};
-
-union int64_u
-{
-    int64_t i64;
-    uint8_t b[8];
-};
-
-union float32_u
-{
-    float f32;
-    uint32_t u32;
-    uint8_t b[4];
-};
-
-union float64_u
-{
-    double f64;
-    uint64_t u64;
-    uint8_t b[8];
-};
-
 // ============================================================================
 // Implementation
 // ============================================================================
 
-typedef struct
-{
-    uint8_t isObject: 1;
-    uint8_t isExpectingName: 1;
-    uint8_t isChunkingString: 1;
-} ContainerState;
+typedef KSBONJSONDecodeContainerState ContainerState;
 
 typedef struct
 {
@@ -108,8 +44,13 @@ typedef struct
     const uint8_t* const bufferStart;
     const uint8_t* bufferCurrent;
     const uint8_t* const bufferEnd;
+    const uint8_t* valueStart;
+    size_t stringBytesScanned;
     const KSBONJSONDecodeCallbacks* const callbacks;
     void* const userData;
+#if KSBONJSON_STATS
+    KSBONJSONStats* const stats;
+#endif
 } DecodeContext;
 
 #define PROPAGATE_ERROR(CONTEXT, CALL) \
@@ -123,6 +64,23 @@ typedef struct
     } \
     while(0)
 
+#if KSBONJSON_STATS
+#   define STATS_COUNT_VALUE(TYPE_CODE, BYTE_COUNT) \
+    do \
+    { \
+        ctx->stats->valueCounts[TYPE_CODE]++; \
+        ctx->stats->valueBytes[TYPE_CODE] += (BYTE_COUNT); \
+        ctx->stats->sinkCalls++; \
+        if((TYPE_CODE) == TYPE_STRING) \
+        { \
+            ctx->stats->stringBytes += (BYTE_COUNT) - 2; \
+        } \
+    } \
+    while(0)
+#else
+#   define STATS_COUNT_VALUE(TYPE_CODE, BYTE_COUNT) do {} while(0)
+#endif
+
 #define SHOULD_HAVE_ROOM_FOR_BYTES(BYTE_COUNT) \
     do \
     { \
@@ -341,42 +299,62 @@ static ksbonjson_decodeStatus decodeAndReportString(DecodeContext* const ctx)
     const char* const begin = (const char*)pos;
     const uint8_t* const end = ctx->bufferEnd;
 
-    for(; pos < end; pos++)
+    // When resuming a string that was cut off at the end of the previous
+    // chunk, skip the part that is already known not to contain the
+    // terminator. Otherwise a long string would be rescanned from the start
+    // with every chunk.
+    unlikely_if(ctx->stringBytesScanned > 0)
     {
-        if(*pos == TYPE_STRING)
+        likely_if(ctx->stringBytesScanned <= (size_t)(end - pos))
         {
-            const size_t length = pos - ctx->bufferCurrent;
-            ctx->bufferCurrent += length + 1;
-            return ctx->callbacks->onString(begin, length, ctx->userData);
+            pos += ctx->stringBytesScanned;
         }
+        ctx->stringBytesScanned = 0;
     }
 
+    pos = CALL_KERNEL(findStringTerminator)(pos, end);
+    likely_if(pos < end)
+    {
+        const size_t length = pos - ctx->bufferCurrent;
+        ctx->bufferCurrent += length + 1;
+        return ctx->callbacks->onString(begin, length, ctx->userData);
+    }
+
+    ctx->stringBytesScanned = end - ctx->bufferCurrent;
     return KSBONJSON_DECODE_INCOMPLETE;
 }
 
-static ksbonjson_decodeStatus beginContainer(DecodeContext* const ctx, const ContainerState containerState)
+static ksbonjson_decodeStatus enterContainer(DecodeContext* const ctx, const ContainerState containerState)
 {
-    unlikely_if(ctx->containerDepth > KSBONJSON_MAX_CONTAINER_DEPTH)
+    unlikely_if(ctx->containerDepth >= KSBONJSON_MAX_CONTAINER_DEPTH - 1)
     {
         return KSBONJSON_DECODE_CONTAINER_DEPTH_EXCEEDED;
     }
     ctx->containerDepth++;
     ctx->containers[ctx->containerDepth] = containerState;
+#if KSBONJSON_STATS
+    if(ctx->containerDepth > ctx->stats->maxDepth)
+    {
+        ctx->stats->maxDepth = ctx->containerDepth;
+    }
+#endif
+    PROBE_CONTAINER_ENTER(ctx->containerDepth, (int)containerState.isObject);
     return KSBONJSON_DECODE_OK;
 }
 
-static ksbonjson_decodeStatus endContainer(DecodeContext* const ctx)
+static ksbonjson_decodeStatus exitContainer(DecodeContext* const ctx)
 {
     unlikely_if(ctx->containerDepth <= 0)
     {
         return KSBONJSON_DECODE_UNBALANCED_CONTAINERS;
     }
+    PROBE_CONTAINER_EXIT(ctx->containerDepth);
     ctx->containerDepth--;
 
     return KSBONJSON_DECODE_OK;
 }
 
-static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
+static ksbonjson_decodeStatus decodeValues(DecodeContext* const ctx)
 {
     const KSBONJSONDecodeCallbacks* callbacks = ctx->callbacks;
     void* const userData = ctx->userData;
@@ -384,6 +362,7 @@ static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
     while(ctx->bufferCurrent < ctx->bufferEnd)
     {
         ContainerState* const container = &ctx->containers[ctx->containerDepth];
+        ctx->valueStart = ctx->bufferCurrent;
         const uint8_t typeCode = *ctx->bufferCurrent++;
         if(typeCode <= INTSMALL_MAX)
         {
@@ -403,7 +382,7 @@ static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
                 return KSBONJSON_DECODE_EXPECTED_OBJECT_VALUE;
             }
             PROPAGATE_ERROR(ctx, callbacks->onEndContainer(userData));
-            PROPAGATE_ERROR(ctx, endContainer(ctx));
+            PROPAGATE_ERROR(ctx, exitContainer(ctx));
         }
         else
         {
@@ -457,11 +436,11 @@ static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
                     break;
                 case TYPE_ARRAY:
                     PROPAGATE_ERROR(ctx, callbacks->onBeginArray(userData));
-                    PROPAGATE_ERROR(ctx, beginContainer(ctx, (ContainerState){0}));
+                    PROPAGATE_ERROR(ctx, enterContainer(ctx, (ContainerState){0}));
                     break;
                 case TYPE_OBJECT:
                     PROPAGATE_ERROR(ctx, callbacks->onBeginObject(userData));
-                    PROPAGATE_ERROR(ctx, beginContainer(ctx, (ContainerState)
+                    PROPAGATE_ERROR(ctx, enterContainer(ctx, (ContainerState)
                         {
                             .isObject = true,
                             .isExpectingName = true,
@@ -475,14 +454,25 @@ static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
                     break;
             }
         }
+        STATS_COUNT_VALUE(typeCode, (uint64_t)(ctx->bufferCurrent - ctx->valueStart));
         container->isExpectingName = !container->isExpectingName;
     }
 
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus decode(DecodeContext* const ctx)
+{
+    PROPAGATE_ERROR(ctx, decodeValues(ctx));
+
     unlikely_if(ctx->containerDepth > 0)
     {
         return KSBONJSON_DECODE_UNCLOSED_CONTAINERS;
     }
-    return callbacks->onEndData(userData);
+#if KSBONJSON_STATS
+    ctx->stats->sinkCalls++;
+#endif
+    return ctx->callbacks->onEndData(ctx->userData);
 }
 
 
@@ -496,6 +486,10 @@ ksbonjson_decodeStatus ksbonjson_decode(const uint8_t* const document,
                                         void* const userData,
                                         size_t* const decodedOffset)
 {
+#if KSBONJSON_STATS
+    // Nobody can see these, but the decoder needs somewhere to put them.
+    KSBONJSONStats stats = {0};
+#endif
     DecodeContext ctx =
     {
         .bufferStart = document,
@@ -503,13 +497,100 @@ ksbonjson_decodeStatus ksbonjson_decode(const uint8_t* const document,
         .bufferEnd = document + documentLength,
         .callbacks = callbacks,
         .userData = userData,
+#if KSBONJSON_STATS
+        .stats = &stats,
+#endif
     };
 
+    PROBE_DECODE_START(document, documentLength);
     const ksbonjson_decodeStatus result = decode(&ctx);
     *decodedOffset = ctx.bufferCurrent - ctx.bufferStart;
+    unlikely_if(result != KSBONJSON_DECODE_OK)
+    {
+        PROBE_DECODE_ERROR(result, *decodedOffset);
+    }
+    PROBE_DECODE_END(result, *decodedOffset);
+    return result;
+}
+
+void ksbonjson_beginDecode(KSBONJSONDecodeContext* const context,
+                           const KSBONJSONDecodeCallbacks* const callbacks,
+                           void* const userData)
+{
+    *context = (KSBONJSONDecodeContext){0};
+    context->callbacks = callbacks;
+    context->userData = userData;
+}
+
+ksbonjson_decodeStatus ksbonjson_decodeChunk(KSBONJSONDecodeContext* const context,
+                                             const uint8_t* const data,
+                                             const size_t dataLength,
+                                             size_t* const consumedLength)
+{
+    DecodeContext ctx =
+    {
+        .containerDepth = context->containerDepth,
+        .bufferStart = data,
+        .bufferCurrent = data,
+        .bufferEnd = data + dataLength,
+        .valueStart = data,
+        .stringBytesScanned = context->stringBytesScanned,
+        .callbacks = context->callbacks,
+        .userData = context->userData,
+#if KSBONJSON_STATS
+        .stats = &context->stats,
+#endif
+    };
+    memcpy(ctx.containers, context->containers, sizeof(ctx.containers[0]) * (context->containerDepth + 1));
+
+    PROBE_DECODE_START(data, dataLength);
+    ksbonjson_decodeStatus result = decodeValues(&ctx);
+    if(result == KSBONJSON_DECODE_INCOMPLETE)
+    {
+        // Nothing has been reported for the truncated value, so we can
+        // resume from its type code once the caller has more data.
+        ctx.bufferCurrent = ctx.valueStart;
+        result = KSBONJSON_DECODE_OK;
+    }
+    else
+    {
+        ctx.stringBytesScanned = 0;
+    }
+    context->stringBytesScanned = ctx.stringBytesScanned;
+
+    context->containerDepth = ctx.containerDepth;
+    memcpy(context->containers, ctx.containers, sizeof(ctx.containers[0]) * (ctx.containerDepth + 1));
+    *consumedLength = ctx.bufferCurrent - ctx.bufferStart;
+    unlikely_if(result != KSBONJSON_DECODE_OK)
+    {
+        PROBE_DECODE_ERROR(result, *consumedLength);
+    }
+    PROBE_DECODE_END(result, *consumedLength);
     return result;
 }
 
+ksbonjson_decodeStatus ksbonjson_endDecode(KSBONJSONDecodeContext* const context)
+{
+    unlikely_if(context->containerDepth > 0)
+    {
+        return KSBONJSON_DECODE_UNCLOSED_CONTAINERS;
+    }
+#if KSBONJSON_STATS
+    context->stats.sinkCalls++;
+#endif
+    return context->callbacks->onEndData(context->userData);
+}
+
+const KSBONJSONStats* ksbonjson_getDecodeStats(const KSBONJSONDecodeContext* const context)
+{
+#if KSBONJSON_STATS
+    return &context->stats;
+#else
+    (void)context;
+    return NULL;
+#endif
+}
+
 const char* ksbonjson_decodeStatusDescription(const ksbonjson_decodeStatus status)
 {
     switch(status)
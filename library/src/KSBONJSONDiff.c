@@ -0,0 +1,512 @@
+//
+//  KSBONJSONDiff.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONDiff.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// A string literal and its length
+#define LITERAL(STRING) STRING, (sizeof(STRING) - 1)
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+#define PROPAGATE_ENCODE_ERROR(CALL) \
+    do \
+    { \
+        unlikely_if((CALL) != KSBONJSON_ENCODE_OK) \
+        { \
+            return KSBONJSON_DOCUMENT_COULD_NOT_ENCODE; \
+        } \
+    } \
+    while(0)
+
+/**
+ * A container that both documents have at the same path.
+ */
+typedef struct
+{
+    // What hasn't been visited yet (up to the end marker)
+    const uint8_t* fromPos;
+    const uint8_t* fromEnd;
+    const uint8_t* toPos;
+    const uint8_t* toEnd;
+
+    // Objects: Where the members begin, and where to look first for the
+    // next matching member.
+    const uint8_t* fromBegin;
+    const uint8_t* toBegin;
+    const uint8_t* hint;
+
+    size_t index;
+    size_t pathLength;
+    bool isObject;
+    bool isFindingAddedMembers;
+    // Objects: Whether a member was ever found anywhere but at the hint
+    bool isOutOfOrder;
+} DiffFrame;
+
+typedef struct
+{
+    // NULL if only checking for equality
+    KSBONJSONEncodeContext* patch;
+    char* path;
+    size_t pathBufferLength;
+    size_t pathLength;
+    size_t differenceCount;
+    int depth;
+    DiffFrame frames[KSBONJSON_MAX_CONTAINER_DEPTH];
+} DiffContext;
+
+static bool isNumberTypeCode(const uint8_t typeCode)
+{
+    return typeCode <= INTSMALL_MAX || (typeCode >= TYPE_INT8 && typeCode <= TYPE_FLOAT64);
+}
+
+/**
+ * Compare two encoded numbers by value, regardless of how they're encoded.
+ */
+static ksbonjson_documentStatus isEqualEncodedNumber(const uint8_t* const a,
+                                                     const uint8_t* const aEnd,
+                                                     const uint8_t* const b,
+                                                     const uint8_t* const bEnd,
+                                                     bool* const isEqual)
+{
+    KSBONJSONDocument document;
+    KSBONJSONNode nodeA;
+    KSBONJSONNode nodeB;
+    PROPAGATE_ERROR(ksbonjson_loadDocument(&document, a, aEnd - a, &nodeA, 1));
+    PROPAGATE_ERROR(ksbonjson_loadDocument(&document, b, bEnd - b, &nodeB, 1));
+    *isEqual = isEqualNumber(&nodeA, &nodeB);
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Append a reference token to the path, escaping "~" and "/" (RFC 6901).
+ */
+static ksbonjson_documentStatus appendToPath(DiffContext* const ctx, const char* const token, const size_t tokenLength)
+{
+    if(ctx->patch == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OK;
+    }
+    unlikely_if(ctx->pathLength >= ctx->pathBufferLength)
+    {
+        return KSBONJSON_DOCUMENT_PATH_BUFFER_FULL;
+    }
+    ctx->path[ctx->pathLength++] = '/';
+    for(size_t i = 0; i < tokenLength; i++)
+    {
+        const char ch = token[i];
+        const bool isEscaped = ch == '~' || ch == '/';
+        unlikely_if(ctx->pathLength + isEscaped >= ctx->pathBufferLength)
+        {
+            return KSBONJSON_DOCUMENT_PATH_BUFFER_FULL;
+        }
+        if(isEscaped)
+        {
+            ctx->path[ctx->pathLength++] = '~';
+            ctx->path[ctx->pathLength++] = ch == '~' ? '0' : '1';
+        }
+        else
+        {
+            ctx->path[ctx->pathLength++] = ch;
+        }
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus appendIndexToPath(DiffContext* const ctx, size_t index)
+{
+    char digits[20];
+    size_t digitCount = 0;
+    do
+    {
+        digits[sizeof(digits) - ++digitCount] = (char)('0' + index % 10);
+        index /= 10;
+    }
+    while(index > 0);
+    return appendToPath(ctx, digits + sizeof(digits) - digitCount, digitCount);
+}
+
+/**
+ * Record a difference at the current path.
+ *
+ * @param value The value to add or replace with, or NULL for "remove".
+ */
+static ksbonjson_documentStatus addOperation(DiffContext* const ctx,
+                                             const char* const op,
+                                             const size_t opLength,
+                                             const uint8_t* const value,
+                                             const uint8_t* const valueEnd)
+{
+    ctx->differenceCount++;
+    if(ctx->patch == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    KSBONJSONEncodeContext* const patch = ctx->patch;
+    PROPAGATE_ENCODE_ERROR(ksbonjson_beginObject(patch));
+    PROPAGATE_ENCODE_ERROR(ksbonjson_addString(patch, LITERAL("op")));
+    PROPAGATE_ENCODE_ERROR(ksbonjson_addString(patch, op, opLength));
+    PROPAGATE_ENCODE_ERROR(ksbonjson_addString(patch, LITERAL("path")));
+    PROPAGATE_ENCODE_ERROR(ksbonjson_addString(patch, ctx->path, ctx->pathLength));
+    if(value != NULL)
+    {
+        PROPAGATE_ENCODE_ERROR(ksbonjson_addString(patch, LITERAL("value")));
+        PROPAGATE_ENCODE_ERROR(ksbonjson_addBONJSONDocument(patch, value, valueEnd - value));
+    }
+    PROPAGATE_ENCODE_ERROR(ksbonjson_endContainer(patch));
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Compare two values at the current path. Containers of the same type are
+ * pushed, to be compared member by member or element by element.
+ */
+static ksbonjson_documentStatus compareValues(DiffContext* const ctx,
+                                              const uint8_t* const from,
+                                              const uint8_t* const fromEnd,
+                                              const uint8_t* const to,
+                                              const uint8_t* const toEnd)
+{
+    const size_t length = (size_t)(fromEnd - from);
+    likely_if(length == (size_t)(toEnd - to) && memcmp(from, to, length) == 0)
+    {
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    if(*from == *to && (*from == TYPE_ARRAY || *from == TYPE_OBJECT))
+    {
+        unlikely_if(ctx->depth >= KSBONJSON_MAX_CONTAINER_DEPTH)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        ctx->frames[ctx->depth++] = (DiffFrame)
+        {
+            .fromPos = from + 1,
+            .fromEnd = fromEnd - 1,
+            .toPos = to + 1,
+            .toEnd = toEnd - 1,
+            .fromBegin = from + 1,
+            .toBegin = to + 1,
+            .hint = to + 1,
+            .pathLength = ctx->pathLength,
+            .isObject = *from == TYPE_OBJECT,
+        };
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    if(isNumberTypeCode(*from) && isNumberTypeCode(*to))
+    {
+        bool isEqual = false;
+        PROPAGATE_ERROR(isEqualEncodedNumber(from, fromEnd, to, toEnd, &isEqual));
+        if(isEqual)
+        {
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    return addOperation(ctx, LITERAL("replace"), to, toEnd);
+}
+
+/**
+ * Get the extent of an object member's name and value.
+ */
+static ksbonjson_documentStatus getMember(const uint8_t* const pos,
+                                          const uint8_t* const end,
+                                          const uint8_t** const nameEnd,
+                                          const uint8_t** const valueEnd)
+{
+    *nameEnd = skipValue(pos, end);
+    unlikely_if(*pos != TYPE_STRING || *nameEnd == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    *valueEnd = skipValue(*nameEnd, end);
+    unlikely_if(*valueEnd == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Find an object's member by its encoded name, starting at the hint (since
+ * members tend to be in the same order) and then wrapping around.
+ *
+ * @param value Set to the member's value, or NULL if there is no such member.
+ * @param isAtHint Set to true if the member was found right at the hint.
+ */
+static ksbonjson_documentStatus findMember(const uint8_t* const begin,
+                                           const uint8_t* const end,
+                                           const uint8_t** const hint,
+                                           const uint8_t* const name,
+                                           const uint8_t* const nameEnd,
+                                           const uint8_t** const value,
+                                           const uint8_t** const valueEnd,
+                                           bool* const isAtHint)
+{
+    const size_t nameLength = (size_t)(nameEnd - name);
+    const uint8_t* pos = *hint;
+    const uint8_t* stop = end;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        while(pos < stop)
+        {
+            const uint8_t* memberNameEnd = NULL;
+            const uint8_t* memberValueEnd = NULL;
+            PROPAGATE_ERROR(getMember(pos, end, &memberNameEnd, &memberValueEnd));
+            if((size_t)(memberNameEnd - pos) == nameLength && memcmp(pos, name, nameLength) == 0)
+            {
+                *isAtHint = pos == *hint;
+                *value = memberNameEnd;
+                *valueEnd = memberValueEnd;
+                *hint = memberValueEnd;
+                return KSBONJSON_DOCUMENT_OK;
+            }
+            pos = memberValueEnd;
+        }
+        pos = begin;
+        stop = *hint;
+    }
+    *value = NULL;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus stepDiffArray(DiffContext* const ctx, DiffFrame* const frame)
+{
+    ctx->pathLength = frame->pathLength;
+    const bool hasTo = frame->toPos < frame->toEnd;
+    const uint8_t* const to = frame->toPos;
+    const uint8_t* toEnd = NULL;
+    if(hasTo)
+    {
+        toEnd = skipValue(to, frame->toEnd);
+        unlikely_if(toEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        frame->toPos = toEnd;
+    }
+
+    if(frame->fromPos < frame->fromEnd)
+    {
+        const uint8_t* const from = frame->fromPos;
+        const uint8_t* const fromEnd = skipValue(from, frame->fromEnd);
+        unlikely_if(fromEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        frame->fromPos = fromEnd;
+        PROPAGATE_ERROR(appendIndexToPath(ctx, frame->index));
+        if(!hasTo)
+        {
+            // Each removal moves the next element to this index.
+            return addOperation(ctx, LITERAL("remove"), NULL, NULL);
+        }
+        frame->index++;
+        return compareValues(ctx, from, fromEnd, to, toEnd);
+    }
+
+    if(hasTo)
+    {
+        PROPAGATE_ERROR(appendToPath(ctx, LITERAL("-")));
+        return addOperation(ctx, LITERAL("add"), to, toEnd);
+    }
+
+    ctx->depth--;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus stepDiffObject(DiffContext* const ctx, DiffFrame* const frame)
+{
+    ctx->pathLength = frame->pathLength;
+    const uint8_t* value = NULL;
+    const uint8_t* valueEnd = NULL;
+    const uint8_t* nameEnd = NULL;
+    const uint8_t* memberEnd = NULL;
+    bool isAtHint = true;
+
+    if(!frame->isFindingAddedMembers)
+    {
+        // Members that were removed or changed
+        if(frame->fromPos >= frame->fromEnd)
+        {
+            // If every member was found where the previous one left off, the
+            // members before the hint have all been matched.
+            frame->isFindingAddedMembers = true;
+            if(!frame->isOutOfOrder)
+            {
+                frame->toPos = frame->hint;
+            }
+            frame->hint = frame->fromBegin;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        const uint8_t* const name = frame->fromPos;
+        PROPAGATE_ERROR(getMember(name, frame->fromEnd, &nameEnd, &memberEnd));
+        frame->fromPos = memberEnd;
+        PROPAGATE_ERROR(findMember(frame->toBegin, frame->toEnd, &frame->hint, name, nameEnd, &value, &valueEnd, &isAtHint));
+        frame->isOutOfOrder |= !isAtHint;
+        PROPAGATE_ERROR(appendToPath(ctx, (const char*)name + 1, (size_t)(nameEnd - name) - 2));
+        if(value == NULL)
+        {
+            return addOperation(ctx, LITERAL("remove"), NULL, NULL);
+        }
+        return compareValues(ctx, nameEnd, memberEnd, value, valueEnd);
+    }
+
+    // Members that were added
+    if(frame->toPos >= frame->toEnd)
+    {
+        ctx->depth--;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+    const uint8_t* const name = frame->toPos;
+    PROPAGATE_ERROR(getMember(name, frame->toEnd, &nameEnd, &memberEnd));
+    frame->toPos = memberEnd;
+    PROPAGATE_ERROR(findMember(frame->fromBegin, frame->fromEnd, &frame->hint, name, nameEnd, &value, &valueEnd, &isAtHint));
+    if(value != NULL)
+    {
+        return KSBONJSON_DOCUMENT_OK;
+    }
+    PROPAGATE_ERROR(appendToPath(ctx, (const char*)name + 1, (size_t)(nameEnd - name) - 2));
+    return addOperation(ctx, LITERAL("add"), nameEnd, memberEnd);
+}
+
+/**
+ * Check the outline of a document. Containers are checked as they are
+ * compared, and identical values aren't checked at all.
+ */
+static bool isDocument(const uint8_t* const begin, const uint8_t* const end)
+{
+    unlikely_if(begin == end)
+    {
+        return false;
+    }
+    if(*begin == TYPE_ARRAY || *begin == TYPE_OBJECT)
+    {
+        return end - begin >= 2 && end[-1] == TYPE_END;
+    }
+    return skipValue(begin, end) == end;
+}
+
+static ksbonjson_documentStatus compareDocuments(DiffContext* const ctx,
+                                                 const uint8_t* const from,
+                                                 const size_t fromLength,
+                                                 const uint8_t* const to,
+                                                 const size_t toLength)
+{
+    const uint8_t* const fromEnd = from + fromLength;
+    const uint8_t* const toEnd = to + toLength;
+    unlikely_if(!isDocument(from, fromEnd) || !isDocument(to, toEnd))
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+
+    PROPAGATE_ERROR(compareValues(ctx, from, fromEnd, to, toEnd));
+    while(ctx->depth > 0)
+    {
+        if(ctx->patch == NULL && ctx->differenceCount > 0)
+        {
+            break;
+        }
+        DiffFrame* const frame = &ctx->frames[ctx->depth - 1];
+        PROPAGATE_ERROR(frame->isObject ? stepDiffObject(ctx, frame) : stepDiffArray(ctx, frame));
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static void initContext(DiffContext* const ctx,
+                        KSBONJSONEncodeContext* const patch,
+                        char* const pathBuffer,
+                        const size_t pathBufferLength)
+{
+    // The frames don't need clearing.
+    ctx->patch = patch;
+    ctx->path = pathBuffer;
+    ctx->pathBufferLength = pathBufferLength;
+    ctx->pathLength = 0;
+    ctx->differenceCount = 0;
+    ctx->depth = 0;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_isEqualEncoded(const uint8_t* const a,
+                                                  const size_t aLength,
+                                                  const uint8_t* const b,
+                                                  const size_t bLength,
+                                                  bool* const isEqual)
+{
+    DiffContext ctx;
+    initContext(&ctx, NULL, NULL, 0);
+    *isEqual = false;
+    PROPAGATE_ERROR(compareDocuments(&ctx, a, aLength, b, bLength));
+    *isEqual = ctx.differenceCount == 0;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_diff(const uint8_t* const from,
+                                        const size_t fromLength,
+                                        const uint8_t* const to,
+                                        const size_t toLength,
+                                        char* const pathBuffer,
+                                        const size_t pathBufferLength,
+                                        KSBONJSONEncodeContext* const patch,
+                                        size_t* const operationCount)
+{
+    DiffContext ctx;
+    initContext(&ctx, patch, pathBuffer, pathBufferLength);
+    *operationCount = 0;
+    PROPAGATE_ENCODE_ERROR(ksbonjson_beginArray(patch));
+    PROPAGATE_ERROR(compareDocuments(&ctx, from, fromLength, to, toLength));
+    PROPAGATE_ENCODE_ERROR(ksbonjson_endContainer(patch));
+    *operationCount = ctx.differenceCount;
+    return KSBONJSON_DOCUMENT_OK;
+}
@@ -0,0 +1,73 @@
+//
+//  KSBONJSONDispatch.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONDispatch_h
+#define KSBONJSONDispatch_h
+
+#include <ksbonjson/KSBONJSONKernels.h>
+#include <stdint.h>
+
+// The kernel table that the encoder and decoder call through.
+//
+// Every entry starts out pointing at a resolver, which picks the best kernel
+// set for this CPU, fills in the whole table, and then forwards the call. So
+// detection happens once, on first use, and costs nothing afterwards.
+//
+// To add a kernel:
+//   - Add its function pointer here.
+//   - Write a scalar version, plus whichever vector versions are worthwhile,
+//     in KSBONJSONKernels.c.
+//   - Add it to the resolver and to each kernel set's table there.
+
+// The single-header amalgamation makes these static when KSBONJSON_STATIC is set.
+#ifndef KSBONJSON_PRIVATE_DECLARATION
+#   define KSBONJSON_PRIVATE_DECLARATION extern
+#   define KSBONJSON_PRIVATE_DEFINITION
+#endif
+
+typedef struct
+{
+    /**
+     * Find the first TYPE_STRING (0xff) byte.
+     * Returns end if there is none.
+     */
+    const uint8_t* (*findStringTerminator)(const uint8_t* pos, const uint8_t* end);
+
+    /**
+     * Update a CRC32C register (without the initial and final inversions)
+     * with the bytes from pos to end.
+     */
+    uint32_t (*crc32c)(uint32_t crc, const uint8_t* pos, const uint8_t* end);
+} KSBONJSONKernelTable;
+
+KSBONJSON_PRIVATE_DECLARATION KSBONJSONKernelTable ksbonjson_kernelTable;
+
+// Entries can be replaced while other threads are calling through them
+// (when they get resolved), so they have to be loaded atomically. A relaxed
+// load is a plain load on every architecture we care about.
+#define CALL_KERNEL(NAME) (__atomic_load_n(&ksbonjson_kernelTable.NAME, __ATOMIC_RELAXED))
+
+#endif // KSBONJSONDispatch_h
@@ -0,0 +1,821 @@
+//
+//  KSBONJSONDocument.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONDocument.h>
+#include <ksbonjson/KSBONJSONDecoder.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+#define PROPAGATE_ENCODE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_encodeStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_ENCODE_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+static ksbonjson_decodeStatus onBoolean(bool value, void* userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_BOOLEAN;
+    node->value.boolean = value;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onInteger(int64_t value, void* userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_INTEGER;
+    node->value.integer = value;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onUInteger(uint64_t value, void* userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_UINTEGER;
+    node->value.uinteger = value;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onFloat(double value, void* userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_FLOAT;
+    node->value.floatingPoint = value;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onNull(void* userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_NULL;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onString(const char* KSBONJSON_RESTRICT value,
+                                       size_t length,
+                                       void* KSBONJSON_RESTRICT userData)
+{
+    KSBONJSONNode* node = (KSBONJSONNode*)userData;
+    node->type = KSBONJSON_NODE_STRING;
+    node->value.string.value = value;
+    node->value.string.length = length;
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus onContainer(void* userData)
+{
+    // Containers are never passed to the decoder.
+    (void)userData;
+    return KSBONJSON_DECODE_COULD_NOT_PROCESS_DATA;
+}
+
+static ksbonjson_decodeStatus onEndData(void* userData)
+{
+    (void)userData;
+    return KSBONJSON_DECODE_OK;
+}
+
+static const KSBONJSONDecodeCallbacks g_scalarCallbacks =
+{
+    .onBoolean = onBoolean,
+    .onInteger = onInteger,
+    .onUInteger = onUInteger,
+    .onFloat = onFloat,
+    .onNull = onNull,
+    .onString = onString,
+    .onBeginObject = onContainer,
+    .onBeginArray = onContainer,
+    .onEndContainer = onContainer,
+    .onEndData = onEndData,
+};
+
+static KSBONJSONNode* newNode(KSBONJSONDocument* const document)
+{
+    unlikely_if(document->nodesUsed >= document->nodeCount)
+    {
+        return NULL;
+    }
+    KSBONJSONNode* const node = &document->nodes[document->nodesUsed++];
+    *node = (KSBONJSONNode){0};
+    return node;
+}
+
+/**
+ * Fill in a node from its encoded bytes. Containers are left unexpanded.
+ */
+static ksbonjson_documentStatus initNode(KSBONJSONNode* const node,
+                                         const uint8_t* const encoded,
+                                         const uint8_t* const encodedEnd)
+{
+    node->encoded = encoded;
+    node->encodedLength = encodedEnd - encoded;
+    switch(*encoded)
+    {
+        case TYPE_ARRAY:
+            node->type = KSBONJSON_NODE_ARRAY;
+            node->unexpanded = encoded + 1;
+            return KSBONJSON_DOCUMENT_OK;
+        case TYPE_OBJECT:
+            node->type = KSBONJSON_NODE_OBJECT;
+            node->unexpanded = encoded + 1;
+            return KSBONJSON_DOCUMENT_OK;
+        case TYPE_STRING:
+            // Don't scan the string a second time.
+            node->type = KSBONJSON_NODE_STRING;
+            node->value.string.value = (const char*)encoded + 1;
+            node->value.string.length = node->encodedLength - 2;
+            return KSBONJSON_DOCUMENT_OK;
+        default:
+        {
+            size_t decodedOffset = 0;
+            unlikely_if(ksbonjson_decode(node->encoded, node->encodedLength, &g_scalarCallbacks, node, &decodedOffset) != KSBONJSON_DECODE_OK)
+            {
+                return KSBONJSON_DOCUMENT_INVALID_DATA;
+            }
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+}
+
+static void appendChild(KSBONJSONNode* const container, KSBONJSONNode* const child)
+{
+    child->parent = container;
+    if(container->lastChild == NULL)
+    {
+        container->firstChild = child;
+    }
+    else
+    {
+        container->lastChild->nextSibling = child;
+    }
+    container->lastChild = child;
+    container->childCount++;
+}
+
+static const uint8_t* containerContentsEnd(const KSBONJSONNode* const container)
+{
+    // Everything up to the end marker
+    return container->encoded + container->encodedLength - 1;
+}
+
+/**
+ * Give the next unexpanded child of a container a node.
+ *
+ * @param child Set to the new child, or NULL if the container is now fully expanded.
+ */
+static ksbonjson_documentStatus expandNextChild(KSBONJSONDocument* const document,
+                                                KSBONJSONNode* const container,
+                                                KSBONJSONNode** const child)
+{
+    const uint8_t* pos = container->unexpanded;
+    const uint8_t* const end = containerContentsEnd(container);
+    unlikely_if(pos >= end)
+    {
+        container->isExpanded = true;
+        *child = NULL;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    const char* name = NULL;
+    size_t nameLength = 0;
+    if(container->type == KSBONJSON_NODE_OBJECT)
+    {
+        const uint8_t* const nameEnd = skipValue(pos, end);
+        unlikely_if(*pos != TYPE_STRING || nameEnd == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        name = (const char*)pos + 1;
+        nameLength = nameEnd - pos - 2;
+        pos = nameEnd;
+    }
+
+    const uint8_t* const valueEnd = skipValue(pos, end);
+    unlikely_if(valueEnd == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    KSBONJSONNode* const node = newNode(document);
+    unlikely_if(node == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+    }
+    const ksbonjson_documentStatus result = initNode(node, pos, valueEnd);
+    unlikely_if(result != KSBONJSON_DOCUMENT_OK)
+    {
+        document->nodesUsed--;
+        return result;
+    }
+    node->name = name;
+    node->nameLength = nameLength;
+    appendChild(container, node);
+    container->unexpanded = valueEnd;
+    *child = node;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus expandContainer(KSBONJSONDocument* const document, KSBONJSONNode* const container)
+{
+    KSBONJSONNode* child = NULL;
+    while(!container->isExpanded)
+    {
+        PROPAGATE_ERROR(expandNextChild(document, container, &child));
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus checkType(const KSBONJSONNode* const node, const ksbonjson_nodeType type)
+{
+    unlikely_if(node->type != type)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Mark a node and all of its ancestors as needing to be re-encoded.
+ */
+static void markModified(KSBONJSONNode* node)
+{
+    for(; node != NULL && !node->isModified; node = node->parent)
+    {
+        node->isModified = true;
+    }
+}
+
+static void setType(KSBONJSONNode* const node, const ksbonjson_nodeType type)
+{
+    node->type = type;
+    node->firstChild = NULL;
+    node->lastChild = NULL;
+    node->childCount = 0;
+    // A replacement container has no original bytes to expand from.
+    node->isExpanded = true;
+    markModified(node);
+}
+
+/**
+ * Copy a node's value (but not its name or links). An unmodified value
+ * keeps referring to its encoded bytes, and is expanded again when needed.
+ */
+static void copyNodeValue(KSBONJSONNode* const destination, const KSBONJSONNode* const source)
+{
+    destination->encoded = source->encoded;
+    destination->encodedLength = source->encodedLength;
+    destination->value = source->value;
+    destination->type = source->type;
+    destination->isModified = source->isModified;
+    if(source->isModified)
+    {
+        destination->isExpanded = source->isExpanded;
+        destination->unexpanded = source->unexpanded;
+    }
+    else
+    {
+        destination->isExpanded = false;
+        destination->unexpanded = source->encoded + 1;
+    }
+}
+
+static ksbonjson_documentStatus addChild(KSBONJSONDocument* const document,
+                                         KSBONJSONNode* const container,
+                                         const ksbonjson_nodeType type,
+                                         KSBONJSONNode** const child)
+{
+    PROPAGATE_ERROR(checkType(container, type));
+    PROPAGATE_ERROR(expandContainer(document, container));
+    KSBONJSONNode* const node = newNode(document);
+    unlikely_if(node == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+    }
+    appendChild(container, node);
+    setType(node, KSBONJSON_NODE_NULL);
+    *child = node;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * End a modified container, copying the children that were never expanded.
+ */
+static ksbonjson_encodeStatus endModifiedContainer(const KSBONJSONNode* const container,
+                                                   KSBONJSONEncodeContext* const context)
+{
+    if(!container->isExpanded)
+    {
+        const uint8_t* const end = containerContentsEnd(container);
+        if(container->unexpanded < end)
+        {
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addBONJSONContents(context, container->unexpanded, end - container->unexpanded));
+        }
+    }
+    return ksbonjson_endContainer(context);
+}
+
+static ksbonjson_encodeStatus encodeModifiedScalar(const KSBONJSONNode* const node,
+                                                   KSBONJSONEncodeContext* const context)
+{
+    switch(node->type)
+    {
+        case KSBONJSON_NODE_BOOLEAN:
+            return ksbonjson_addBoolean(context, node->value.boolean);
+        case KSBONJSON_NODE_INTEGER:
+            return ksbonjson_addInteger(context, node->value.integer);
+        case KSBONJSON_NODE_UINTEGER:
+            return ksbonjson_addUInteger(context, node->value.uinteger);
+        case KSBONJSON_NODE_FLOAT:
+            return ksbonjson_addFloat(context, node->value.floatingPoint);
+        case KSBONJSON_NODE_STRING:
+            return ksbonjson_addString(context, node->value.string.value, node->value.string.length);
+        default:
+            return ksbonjson_addNull(context);
+    }
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_loadDocument(KSBONJSONDocument* const document,
+                                                const uint8_t* const bonjsonDocument,
+                                                const size_t documentLength,
+                                                KSBONJSONNode* const nodes,
+                                                const size_t nodeCount)
+{
+    *document = (KSBONJSONDocument)
+    {
+        .nodes = nodes,
+        .nodeCount = nodeCount,
+    };
+
+    // A container's contents are checked as they're expanded, but that can
+    // only work if the container really does end at the end of the document.
+    const uint8_t* const end = bonjsonDocument + documentLength;
+    unlikely_if(documentLength == 0)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    if(*bonjsonDocument == TYPE_ARRAY || *bonjsonDocument == TYPE_OBJECT)
+    {
+        unlikely_if(documentLength < 2 || end[-1] != TYPE_END)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+    }
+    else
+    {
+        unlikely_if(skipValue(bonjsonDocument, end) != end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+    }
+    KSBONJSONNode* const root = newNode(document);
+    unlikely_if(root == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+    }
+    PROPAGATE_ERROR(initNode(root, bonjsonDocument, end));
+    document->root = root;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_getFirstChild(KSBONJSONDocument* const document,
+                                                 KSBONJSONNode* const container,
+                                                 KSBONJSONNode** const child)
+{
+    unlikely_if(container->type != KSBONJSON_NODE_ARRAY && container->type != KSBONJSON_NODE_OBJECT)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    PROPAGATE_ERROR(expandContainer(document, container));
+    *child = container->firstChild;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_getNextChild(KSBONJSONDocument* const document,
+                                                KSBONJSONNode* const container,
+                                                KSBONJSONNode* const child,
+                                                KSBONJSONNode** const next)
+{
+    unlikely_if(container->type != KSBONJSON_NODE_ARRAY && container->type != KSBONJSON_NODE_OBJECT)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    KSBONJSONNode* const candidate = child == NULL ? container->firstChild : child->nextSibling;
+    if(candidate == NULL && !container->isExpanded)
+    {
+        return expandNextChild(document, container, next);
+    }
+    *next = candidate;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_getMember(KSBONJSONDocument* const document,
+                                             KSBONJSONNode* const object,
+                                             const char* const name,
+                                             const size_t nameLength,
+                                             KSBONJSONNode** const member)
+{
+    PROPAGATE_ERROR(checkType(object, KSBONJSON_NODE_OBJECT));
+    KSBONJSONNode* node = object->firstChild;
+    for(; node != NULL; node = node->nextSibling)
+    {
+        if(node->nameLength == nameLength && memcmp(node->name, name, nameLength) == 0)
+        {
+            *member = node;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    while(!object->isExpanded)
+    {
+        PROPAGATE_ERROR(expandNextChild(document, object, &node));
+        if(node != NULL && node->nameLength == nameLength && memcmp(node->name, name, nameLength) == 0)
+        {
+            *member = node;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    return KSBONJSON_DOCUMENT_NOT_FOUND;
+}
+
+ksbonjson_documentStatus ksbonjson_getElement(KSBONJSONDocument* const document,
+                                              KSBONJSONNode* const array,
+                                              size_t index,
+                                              KSBONJSONNode** const element)
+{
+    PROPAGATE_ERROR(checkType(array, KSBONJSON_NODE_ARRAY));
+    KSBONJSONNode* child = NULL;
+    while(index >= array->childCount && !array->isExpanded)
+    {
+        PROPAGATE_ERROR(expandNextChild(document, array, &child));
+    }
+    unlikely_if(index >= array->childCount)
+    {
+        return KSBONJSON_DOCUMENT_NOT_FOUND;
+    }
+    KSBONJSONNode* node = array->firstChild;
+    for(; index > 0; index--)
+    {
+        node = node->nextSibling;
+    }
+    *element = node;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+void ksbonjson_setNull(KSBONJSONNode* const node)
+{
+    setType(node, KSBONJSON_NODE_NULL);
+}
+
+void ksbonjson_setBoolean(KSBONJSONNode* const node, const bool value)
+{
+    setType(node, KSBONJSON_NODE_BOOLEAN);
+    node->value.boolean = value;
+}
+
+void ksbonjson_setInteger(KSBONJSONNode* const node, const int64_t value)
+{
+    setType(node, KSBONJSON_NODE_INTEGER);
+    node->value.integer = value;
+}
+
+void ksbonjson_setUInteger(KSBONJSONNode* const node, const uint64_t value)
+{
+    setType(node, KSBONJSON_NODE_UINTEGER);
+    node->value.uinteger = value;
+}
+
+void ksbonjson_setFloat(KSBONJSONNode* const node, const double value)
+{
+    setType(node, KSBONJSON_NODE_FLOAT);
+    node->value.floatingPoint = value;
+}
+
+void ksbonjson_setString(KSBONJSONNode* const node, const char* const value, const size_t valueLength)
+{
+    setType(node, KSBONJSON_NODE_STRING);
+    node->value.string.value = value;
+    node->value.string.length = valueLength;
+}
+
+void ksbonjson_setEmptyArray(KSBONJSONNode* const node)
+{
+    setType(node, KSBONJSON_NODE_ARRAY);
+}
+
+void ksbonjson_setEmptyObject(KSBONJSONNode* const node)
+{
+    setType(node, KSBONJSON_NODE_OBJECT);
+}
+
+ksbonjson_documentStatus ksbonjson_addMember(KSBONJSONDocument* const document,
+                                             KSBONJSONNode* const object,
+                                             const char* const name,
+                                             const size_t nameLength,
+                                             KSBONJSONNode** const member)
+{
+    PROPAGATE_ERROR(addChild(document, object, KSBONJSON_NODE_OBJECT, member));
+    (*member)->name = name;
+    (*member)->nameLength = nameLength;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_addElement(KSBONJSONDocument* const document,
+                                              KSBONJSONNode* const array,
+                                              KSBONJSONNode** const element)
+{
+    return addChild(document, array, KSBONJSON_NODE_ARRAY, element);
+}
+
+ksbonjson_documentStatus ksbonjson_insertElement(KSBONJSONDocument* const document,
+                                                 KSBONJSONNode* const array,
+                                                 const size_t index,
+                                                 KSBONJSONNode** const element)
+{
+    PROPAGATE_ERROR(checkType(array, KSBONJSON_NODE_ARRAY));
+    KSBONJSONNode* child = NULL;
+    while(index > array->childCount && !array->isExpanded)
+    {
+        PROPAGATE_ERROR(expandNextChild(document, array, &child));
+    }
+    unlikely_if(index > array->childCount)
+    {
+        return KSBONJSON_DOCUMENT_NOT_FOUND;
+    }
+    KSBONJSONNode* const node = newNode(document);
+    unlikely_if(node == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+    }
+
+    // When inserting after the last expanded element, the new one becomes
+    // the last, and the unexpanded elements still follow it.
+    if(index == 0)
+    {
+        node->nextSibling = array->firstChild;
+        array->firstChild = node;
+    }
+    else
+    {
+        KSBONJSONNode* previous = array->firstChild;
+        for(size_t i = 1; i < index; i++)
+        {
+            previous = previous->nextSibling;
+        }
+        node->nextSibling = previous->nextSibling;
+        previous->nextSibling = node;
+    }
+    if(node->nextSibling == NULL)
+    {
+        array->lastChild = node;
+    }
+    node->parent = array;
+    array->childCount++;
+    setType(node, KSBONJSON_NODE_NULL);
+    *element = node;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_removeNode(KSBONJSONNode* const node)
+{
+    KSBONJSONNode* const container = node->parent;
+    unlikely_if(container == NULL)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+
+    KSBONJSONNode* previous = NULL;
+    for(KSBONJSONNode* child = container->firstChild; child != node; child = child->nextSibling)
+    {
+        previous = child;
+    }
+    if(previous == NULL)
+    {
+        container->firstChild = node->nextSibling;
+    }
+    else
+    {
+        previous->nextSibling = node->nextSibling;
+    }
+    if(container->lastChild == node)
+    {
+        container->lastChild = previous;
+    }
+    container->childCount--;
+    node->parent = NULL;
+    node->nextSibling = NULL;
+    markModified(container);
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_copyNode(KSBONJSONDocument* const document,
+                                            const KSBONJSONNode* const source,
+                                            KSBONJSONNode** const copy)
+{
+    const size_t nodesUsed = document->nodesUsed;
+    KSBONJSONNode* const root = newNode(document);
+    unlikely_if(root == NULL)
+    {
+        return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+    }
+    copyNodeValue(root, source);
+
+    // Modified containers have to have their children copied, but again,
+    // only as far down as the modifications go.
+    const KSBONJSONNode* from = source->isModified ? source->firstChild : NULL;
+    KSBONJSONNode* parent = root;
+    while(from != NULL)
+    {
+        KSBONJSONNode* const to = newNode(document);
+        unlikely_if(to == NULL)
+        {
+            document->nodesUsed = nodesUsed;
+            return KSBONJSON_DOCUMENT_OUT_OF_NODES;
+        }
+        copyNodeValue(to, from);
+        to->name = from->name;
+        to->nameLength = from->nameLength;
+        appendChild(parent, to);
+
+        if(from->isModified && from->firstChild != NULL)
+        {
+            from = from->firstChild;
+            parent = to;
+            continue;
+        }
+        while(from->nextSibling == NULL && from->parent != source)
+        {
+            from = from->parent;
+            parent = parent->parent;
+        }
+        from = from->nextSibling;
+    }
+
+    *copy = root;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_setValue(KSBONJSONNode* const node, KSBONJSONNode* const value)
+{
+    unlikely_if(value->parent != NULL)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    for(const KSBONJSONNode* ancestor = node; ancestor != NULL; ancestor = ancestor->parent)
+    {
+        unlikely_if(ancestor == value)
+        {
+            return KSBONJSON_DOCUMENT_WRONG_TYPE;
+        }
+    }
+
+    copyNodeValue(node, value);
+    // Take over the children that the value has already expanded, and carry
+    // on expanding after them rather than from its first element again.
+    node->isExpanded = value->isExpanded;
+    node->unexpanded = value->unexpanded;
+    node->firstChild = value->firstChild;
+    node->lastChild = value->lastChild;
+    node->childCount = value->childCount;
+    for(KSBONJSONNode* child = node->firstChild; child != NULL; child = child->nextSibling)
+    {
+        child->parent = node;
+    }
+    // The node itself might now be unmodified (referring to the value's
+    // encoded bytes), but its container has changed either way.
+    markModified(node->parent);
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_encodeStatus ksbonjson_encodeDocument(const KSBONJSONDocument* const document,
+                                                KSBONJSONEncodeContext* const context)
+{
+    // Walk the tree via the parent and sibling links, so that there's no
+    // recursion. Unmodified subtrees are never walked into.
+    const KSBONJSONNode* const root = document->root;
+    const KSBONJSONNode* node = root;
+    for(;;)
+    {
+        if(node->parent != NULL && node->parent->type == KSBONJSON_NODE_OBJECT)
+        {
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addString(context, node->name, node->nameLength));
+        }
+
+        if(!node->isModified)
+        {
+            PROPAGATE_ENCODE_ERROR(ksbonjson_addBONJSONDocument(context, node->encoded, node->encodedLength));
+        }
+        else if(node->type == KSBONJSON_NODE_ARRAY || node->type == KSBONJSON_NODE_OBJECT)
+        {
+            PROPAGATE_ENCODE_ERROR(node->type == KSBONJSON_NODE_OBJECT ? ksbonjson_beginObject(context)
+                                                                      : ksbonjson_beginArray(context));
+            if(node->firstChild != NULL)
+            {
+                node = node->firstChild;
+                continue;
+            }
+            PROPAGATE_ENCODE_ERROR(endModifiedContainer(node, context));
+        }
+        else
+        {
+            PROPAGATE_ENCODE_ERROR(encodeModifiedScalar(node, context));
+        }
+
+        while(node != root && node->nextSibling == NULL)
+        {
+            node = node->parent;
+            PROPAGATE_ENCODE_ERROR(endModifiedContainer(node, context));
+        }
+        if(node == root)
+        {
+            return KSBONJSON_ENCODE_OK;
+        }
+        node = node->nextSibling;
+    }
+}
+
+const char* ksbonjson_documentStatusDescription(const ksbonjson_documentStatus status)
+{
+    switch(status)
+    {
+        case KSBONJSON_DOCUMENT_OK:
+            return "Successful completion";
+        case KSBONJSON_DOCUMENT_INVALID_DATA:
+            return "The document is not valid BONJSON";
+        case KSBONJSON_DOCUMENT_OUT_OF_NODES:
+            return "All of the document's nodes are in use";
+        case KSBONJSON_DOCUMENT_WRONG_TYPE:
+            return "The node is the wrong type for this operation";
+        case KSBONJSON_DOCUMENT_NOT_FOUND:
+            return "No such member or element";
+        case KSBONJSON_DOCUMENT_INVALID_PATCH:
+            return "The patch is malformed";
+        case KSBONJSON_DOCUMENT_TEST_FAILED:
+            return "A patch test operation failed";
+        case KSBONJSON_DOCUMENT_NAME_BUFFER_FULL:
+            return "There was no room to store a member name";
+        case KSBONJSON_DOCUMENT_PATH_BUFFER_FULL:
+            return "There was no room to build a path";
+        case KSBONJSON_DOCUMENT_COULD_NOT_ENCODE:
+            return "Could not encode the result";
+        case KSBONJSON_DOCUMENT_MEMBER_BUFFER_FULL:
+            return "There was no room to sort an object's members";
+        case KSBONJSON_DOCUMENT_INVALID_COLUMNS:
+            return "The column list is invalid";
+        case KSBONJSON_DOCUMENT_INVALID_PATH:
+            return "A path is invalid";
+        case KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL:
+            return "There was no room to build the index";
+        case KSBONJSON_DOCUMENT_INVALID_INDEX:
+            return "The index does not belong to this document";
+        default:
+            return "(unknown status)";
+    }
+}
@@ -25,63 +25,10 @@
 //
 
 #include <ksbonjson/KSBONJSONEncoder.h>
+#include "KSBONJSONCommon.h"
+#include "KSBONJSONProbes.h"
 #include <stddef.h>
-
-
-// ============================================================================
-// Helpers
-// ============================================================================
-
-// Compiler hints for "if" statements
-#define likely_if(x) if(__builtin_expect(x,1))
-#define unlikely_if(x) if(__builtin_expect(x,0))
-
-enum {
-    TYPE_ARRAY = 0xeb,
-    TYPE_OBJECT = 0xec,
-    TYPE_END = 0xed,
-    TYPE_FALSE = 0xee,
-    TYPE_TRUE = 0xef,
-    TYPE_NULL = 0xf0,
-    TYPE_INT8 = 0xf1,
-    TYPE_INT16 = 0xf2,
-    TYPE_INT24 = 0xf3,
-    TYPE_INT32 = 0xf4,
-    TYPE_INT40 = 0xf5,
-    TYPE_INT48 = 0xf6,
-    TYPE_INT56 = 0xf7,
-    TYPE_INT64 = 0xf8,
-    TYPE_UINT64 = 0xf9,
-    TYPE_BIGPOSITIVE = 0xfa,
-    TYPE_BIGNEGATIVE = 0xfb,
-    TYPE_FLOAT16 = 0xfc,
-    TYPE_FLOAT32 = 0xfd,
-    TYPE_FLOAT64 = 0xfe,
-    TYPE_STRING = 0xff,
-};
-
-#define INTSMALL_MAX 234
-#define INTSMALL_BIAS 117
-
-union uint64_u
-{
-    uint64_t u64;
-    uint8_t b[8];
-};
-
-union float32_u
-{
-    float f32;
-    uint32_t u32;
-    uint8_t b[4];
-};
-
-union float64_u
-{
-    double f64;
-    uint64_t u64;
-    uint8_t b[8];
-};
+#include <string.h>
 
 
 // ============================================================================
@@ -131,11 +78,28 @@ union float64_u
         return KSBONJSON_ENCODE_NULL_POINTER; \
     }
 
+#if KSBONJSON_STATS
+#   define STATS_COUNT_VALUE(TYPE_CODE, BYTE_COUNT) \
+    do \
+    { \
+        ctx->stats.valueCounts[TYPE_CODE]++; \
+        ctx->stats.valueBytes[TYPE_CODE] += (BYTE_COUNT); \
+    } \
+    while(0)
+#   define STATS_ADD(FIELD, AMOUNT) (ctx->stats.FIELD += (AMOUNT))
+#else
+#   define STATS_COUNT_VALUE(TYPE_CODE, BYTE_COUNT) do {} while(0)
+#   define STATS_ADD(FIELD, AMOUNT) do {} while(0)
+#endif
+
 static ksbonjson_encodeStatus addBytes(KSBONJSONEncodeContext* const ctx,
                                        const uint8_t* const data,
                                        const size_t length)
 {
-    return ctx->addEncodedData(data, length, ctx->userData);
+    STATS_ADD(sinkCalls, 1);
+    const ksbonjson_encodeStatus status = ctx->addEncodedData(data, length, ctx->userData);
+    PROBE_ENCODE_FLUSH(data, length, status);
+    return status;
 }
 
 static ksbonjson_encodeStatus addByte(KSBONJSONEncodeContext* const ctx, const uint8_t value)
@@ -144,6 +108,133 @@ static ksbonjson_encodeStatus addByte(KSBONJSONEncodeContext* const ctx, const u
     return addBytes(ctx, &b, 1);
 }
 
+/**
+ * Encode an integer at the smallest width that holds it.
+ *
+ * @param dst Where to write the encoding (must have room for 9 bytes).
+ * @return The length of the encoding.
+ */
+static size_t encodeInteger(uint8_t* const dst, const int64_t value)
+{
+    if(value >= -INTSMALL_BIAS && value <= INTSMALL_MAX - INTSMALL_BIAS)
+    {
+        // Small Int
+        dst[0] = (uint8_t)(value + INTSMALL_BIAS);
+        return 1;
+    }
+    if(value >= (-128 - INTSMALL_BIAS) && value <= (127 + INTSMALL_BIAS + 1))
+    {
+        // Int8
+        dst[0] = TYPE_INT8;
+        dst[1] = (uint8_t)(value + (value < 0 ? INTSMALL_BIAS : -INTSMALL_BIAS - 1));
+        return 2;
+    }
+
+    // Integers from 2 to 8 bytes
+    int byteCount = 2;
+    const int64_t endValue = value < 0 ? -1 : 0;
+    for(int64_t v = value >> 15; v != endValue; v >>= 8)
+    {
+        byteCount++;
+    }
+    dst[0] = (uint8_t)(0xf0 + byteCount);
+    union uint64_u u = {.u64 = (uint64_t)value};
+#if KSBONJSON_IS_LITTLE_ENDIAN
+    // Copying all 8 bytes is cheaper than copying only the ones we need.
+    memcpy(dst + 1, u.b, 8);
+#else
+    for(int i = 0; i < byteCount; i++)
+    {
+        dst[1 + i] = u.b[7 - i];
+    }
+#endif
+    return (size_t)byteCount + 1;
+}
+
+/**
+ * @return KSBONJSON_ENCODE_OK, or an error if the value is NaN or infinite.
+ */
+static ksbonjson_encodeStatus checkFloat(const double value)
+{
+    const union float64_u f64 = {.f64 = value};
+
+    // When all exponent bits are set, it signifies an infinite or NaN value
+    unlikely_if((f64.u64 & 0x7ff0000000000000ULL) == 0x7ff0000000000000ULL)
+    {
+        // If the significand is 0, it's infinite
+        if((f64.u64 & 0x000fffffffffffffULL) == 0)
+        {
+            return KSBONJSON_ENCODE_INF;
+        }
+        return KSBONJSON_ENCODE_NAN;
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+/**
+ * Encode a float at the smallest width that holds it exactly (or as an
+ * integer if it has no fractional part).
+ *
+ * @param dst Where to write the encoding (must have room for 9 bytes).
+ * @param length Set to the length of the encoding.
+ * @return KSBONJSON_ENCODE_OK, or an error if the value is NaN or infinite.
+ */
+static ksbonjson_encodeStatus encodeFloat(uint8_t* const dst, const double value, size_t* const length)
+{
+    const int64_t asInt = (int64_t)value;
+    unlikely_if((double)asInt == value)
+    {
+        *length = encodeInteger(dst, asInt);
+        return KSBONJSON_ENCODE_OK;
+    }
+
+    PROPAGATE_ERROR(checkFloat(value));
+
+    const union float64_u f64 = {.f64 = value};
+    const union float32_u f32 = {.f32 = (float)value};
+    if((double)f32.f32 == value)
+    {
+        // Float16 is the upper half of a float32
+        const union float32_u f16 = {.u32 = f32.u32 & 0xffff0000};
+        if((double)f16.f32 == value)
+        {
+            dst[0] = TYPE_FLOAT16;
+#if KSBONJSON_IS_LITTLE_ENDIAN
+            dst[1] = f32.b[2];
+            dst[2] = f32.b[3];
+#else
+            dst[1] = f32.b[1];
+            dst[2] = f32.b[0];
+#endif
+            *length = 3;
+            return KSBONJSON_ENCODE_OK;
+        }
+        dst[0] = TYPE_FLOAT32;
+#if KSBONJSON_IS_LITTLE_ENDIAN
+        memcpy(dst + 1, f32.b, 4);
+#else
+        for(int i = 0; i < 4; i++)
+        {
+            dst[1 + i] = f32.b[3 - i];
+        }
+#endif
+        *length = 5;
+        return KSBONJSON_ENCODE_OK;
+    }
+
+    dst[0] = TYPE_FLOAT64;
+#if KSBONJSON_IS_LITTLE_ENDIAN
+    memcpy(dst + 1, f64.b, 8);
+#else
+    for(int i = 0; i < 8; i++)
+    {
+        dst[1 + i] = f64.b[7 - i];
+    }
+#endif
+    *length = 9;
+    return KSBONJSON_ENCODE_OK;
+}
+
 static ksbonjson_encodeStatus beginContainer(KSBONJSONEncodeContext* const ctx,
                                              const uint8_t typeCode,
                                              const KSBONJSONContainerState containerState)
@@ -155,9 +246,72 @@ static ksbonjson_encodeStatus beginContainer(KSBONJSONEncodeContext* const ctx,
     container->isExpectingName = true;
     ctx->containerDepth++;
     ctx->containers[ctx->containerDepth] = containerState;
+#if KSBONJSON_STATS
+    if(ctx->containerDepth > ctx->stats.maxDepth)
+    {
+        ctx->stats.maxDepth = ctx->containerDepth;
+    }
+#endif
+    STATS_COUNT_VALUE(typeCode, 1);
     return addByte(ctx, typeCode);
 }
 
+// Table rows are encoded into a buffer of this size before being passed on.
+#define TABLE_BUFFER_SIZE 4096
+
+typedef struct
+{
+    KSBONJSONEncodeContext* ctx;
+    size_t length;
+    uint8_t data[TABLE_BUFFER_SIZE];
+} TableBuffer;
+
+static ksbonjson_encodeStatus flushTable(TableBuffer* const buffer)
+{
+    const size_t length = buffer->length;
+    buffer->length = 0;
+    likely_if(length > 0)
+    {
+        return addBytes(buffer->ctx, buffer->data, length);
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+/**
+ * Make sure that there's room for byteCount more bytes (no more than TABLE_BUFFER_SIZE).
+ */
+static ksbonjson_encodeStatus reserveTable(TableBuffer* const buffer, const size_t byteCount)
+{
+    unlikely_if(TABLE_BUFFER_SIZE - buffer->length < byteCount)
+    {
+        return flushTable(buffer);
+    }
+    return KSBONJSON_ENCODE_OK;
+}
+
+static ksbonjson_encodeStatus addTableString(TableBuffer* const buffer, const char* const value, const size_t length)
+{
+    SHOULD_NOT_BE_NULL(value);
+    unlikely_if(TABLE_BUFFER_SIZE - buffer->length < length + 2)
+    {
+        PROPAGATE_ERROR(flushTable(buffer));
+        unlikely_if(length + 2 > TABLE_BUFFER_SIZE)
+        {
+            // Too long to buffer, so pass it straight through.
+            PROPAGATE_ERROR(addByte(buffer->ctx, TYPE_STRING));
+            PROPAGATE_ERROR(addBytes(buffer->ctx, (const uint8_t*)value, length));
+            buffer->data[buffer->length++] = TYPE_STRING;
+            return KSBONJSON_ENCODE_OK;
+        }
+    }
+    uint8_t* const dst = buffer->data + buffer->length;
+    dst[0] = TYPE_STRING;
+    memcpy(dst + 1, value, length);
+    dst[length + 1] = TYPE_STRING;
+    buffer->length += length + 2;
+    return KSBONJSON_ENCODE_OK;
+}
+
 
 // ============================================================================
 // API
@@ -172,6 +326,29 @@ void ksbonjson_beginEncode(KSBONJSONEncodeContext* const ctx,
     ctx->userData = userData;
 }
 
+ksbonjson_encodeStatus ksbonjson_beginAppendingToArray(KSBONJSONEncodeContext* const ctx,
+                                                       const KSBONJSONAddEncodedDataFunc addBytesFunc,
+                                                       void* const userData,
+                                                       const uint8_t* const document,
+                                                       const size_t documentLength,
+                                                       size_t* const appendOffset)
+{
+    unlikely_if(documentLength < 2 || document[0] != TYPE_ARRAY || document[documentLength - 1] != TYPE_END)
+    {
+        return KSBONJSON_ENCODE_NOT_AN_ARRAY;
+    }
+
+    // The same state as after beginArray() at the top level
+    ksbonjson_beginEncode(ctx, addBytesFunc, userData);
+    ctx->containers[0].isExpectingName = true;
+    ctx->containerDepth = 1;
+#if KSBONJSON_STATS
+    ctx->stats.maxDepth = 1;
+#endif
+    *appendOffset = documentLength - 1;
+    return KSBONJSON_ENCODE_OK;
+}
+
 ksbonjson_encodeStatus ksbonjson_endEncode(KSBONJSONEncodeContext* const ctx)
 {
     unlikely_if(ctx->containerDepth > 0)
@@ -201,7 +378,9 @@ ksbonjson_encodeStatus ksbonjson_addBoolean(KSBONJSONEncodeContext* const ctx, c
     SHOULD_NOT_BE_CHUNKING_STRING();
 
     container->isExpectingName = true;
-    return addByte(ctx, value ? TYPE_TRUE : TYPE_FALSE);
+    const uint8_t typeCode = value ? TYPE_TRUE : TYPE_FALSE;
+    STATS_COUNT_VALUE(typeCode, 1);
+    return addByte(ctx, typeCode);
 }
 
 ksbonjson_encodeStatus ksbonjson_addInteger(KSBONJSONEncodeContext* const ctx, const int64_t value)
@@ -211,109 +390,24 @@ ksbonjson_encodeStatus ksbonjson_addInteger(KSBONJSONEncodeContext* const ctx, c
     SHOULD_NOT_BE_CHUNKING_STRING();
 
     container->isExpectingName = true;
-    if(value >= -INTSMALL_BIAS && value <= INTSMALL_MAX - INTSMALL_BIAS)
-    {
-        // Small Int
-        return addByte(ctx, (uint8_t)(value + INTSMALL_BIAS));
-    }
-    if(value >= (-128 - INTSMALL_BIAS) && value <= (127 + INTSMALL_BIAS + 1))
-    {
-        // Int8
-        uint8_t data[] =
-        {
-            TYPE_INT8,
-            (uint8_t)(value + (value < 0 ? INTSMALL_BIAS : -INTSMALL_BIAS - 1)),
-        };
-        return addBytes(ctx, data, sizeof(data));
-    }
-
-    // Integers from 2 to 8 bytes
-    int byteCount = 2;
-    const int64_t endValue = value < 0 ? -1 : 0;
-    for(int64_t v = value >> 15; v != endValue; v >>= 8)
-    {
-        byteCount++;
-    }
-
-    // Allocate 2 unions to give scratch space in front of the encoded u64
-    union uint64_u u[2];
-    u[1].u64 = (uint64_t)value;
-#if KSBONJSON_IS_LITTLE_ENDIAN
-    // The last byte of our scratch space will hold the type code
-    u[0].b[7] = 0xf0 + byteCount;
-    return addBytes(ctx, &u[0].b[7], byteCount + 1);
-#else
-    uint8_t data[byteCount + 1];
-    data[0] = 0xf0 + byteCount; // Type code
-    for(int i = 0; i < byteCount; i++)
-    {
-        data[byteCount - i] = u[1].b[i];
-    }
-    return addBytes(ctx, data, sizeof(data));
-#endif
+    uint8_t data[9];
+    const size_t length = encodeInteger(data, value);
+    STATS_COUNT_VALUE(data[0], length);
+    return addBytes(ctx, data, length);
 }
 
 ksbonjson_encodeStatus ksbonjson_addFloat(KSBONJSONEncodeContext* const ctx, const double value)
 {
-    const int64_t asInt = (int64_t)value;
-    unlikely_if((double)asInt == value)
-    {
-        return ksbonjson_addInteger(ctx, asInt);
-    }
-
     KSBONJSONContainerState* const container = &ctx->containers[ctx->containerDepth];
     SHOULD_NOT_BE_EXPECTING_OBJECT_NAME();
     SHOULD_NOT_BE_CHUNKING_STRING();
 
-    // Allocate 2 unions to give scratch space in front of the encoded f64
-    union float64_u f64[2];
-    f64[1].f64 = value;
-
-    // When all exponent bits are set, it signifies an infinite or NaN value
-    unlikely_if((f64[1].u64 & 0x7ff0000000000000ULL) == 0x7ff0000000000000ULL)
-    {
-        // If the significand is 0, it's infinite
-        if((f64[1].u64 & 0x000fffffffffffffULL) == 0)
-        {
-            return KSBONJSON_ENCODE_INF;
-        }
-        return KSBONJSON_ENCODE_NAN;
-    }
-
+    uint8_t data[9];
+    size_t length = 0;
+    PROPAGATE_ERROR(encodeFloat(data, value, &length));
     container->isExpectingName = true;
-
-    // Allocate 2 unions to give scratch space in front of the encoded f32
-    union float32_u f32[2];
-    f32[1].f32 = value;
-    if((double)f32[1].f32 == value)
-    {
-        // Use our scratch space to build a potential f16 encoding
-        f32[0].f32 = value;
-        f32[0].b[0] = 0;
-        f32[0].b[1] = 0;
-        if((double)f32[0].f32 == value)
-        {
-            f32[0].b[1] = TYPE_FLOAT16;
-            return addBytes(ctx, &f32[0].b[1], 3);
-        }
-#if KSBONJSON_IS_LITTLE_ENDIAN
-        // The last byte of our scratch space will hold the type code
-        f32[0].b[3] = TYPE_FLOAT32;
-        return addBytes(ctx, &f32[0].b[3], 5);
-#else
-        uint8_t data[] = {TYPE_FLOAT32, f32[1].b[3], f32[1].b[2], f32[1].b[1], f32[1].b[0]};
-        return addBytes(ctx, data, sizeof(data));
-#endif
-    }
-
-#if KSBONJSON_IS_LITTLE_ENDIAN
-    // The last byte of our scratch space will hold the type code
-    f64[0].b[7] = TYPE_FLOAT64;
-    return addBytes(ctx, &f64[0].b[7], 9);
-#else
-    uint8_t data[] = {TYPE_FLOAT64, f64[1].b[7], f64[1].b[6], f64[1].b[5], f64[1].b[4], f64[1].b[3], f64[1].b[2], f64[1].b[1], f64[1].b[0]};
-    return addBytes(ctx, data, sizeof(data));
-#endif
+    STATS_COUNT_VALUE(data[0], length);
+    return addBytes(ctx, data, length);
 }
 
 ksbonjson_encodeStatus ksbonjson_addUInteger(KSBONJSONEncodeContext* const ctx, const uint64_t value)
@@ -332,6 +426,7 @@ ksbonjson_encodeStatus ksbonjson_addUInteger(KSBONJSONEncodeContext* const ctx,
     // Allocate 2 unions to give scratch space in front of the encoded u64
     union uint64_u u[2];
     u[1].u64 = value;
+    STATS_COUNT_VALUE(TYPE_UINT64, 9);
 #if KSBONJSON_IS_LITTLE_ENDIAN
     // The last byte of our scratch space will hold the type code
     u[0].b[7] = TYPE_UINT64;
@@ -349,6 +444,7 @@ ksbonjson_encodeStatus ksbonjson_addNull(KSBONJSONEncodeContext* const ctx)
     SHOULD_NOT_BE_CHUNKING_STRING();
 
     container->isExpectingName = true;
+    STATS_COUNT_VALUE(TYPE_NULL, 1);
     return addByte(ctx, TYPE_NULL);
 }
 
@@ -362,6 +458,8 @@ ksbonjson_encodeStatus ksbonjson_addString(KSBONJSONEncodeContext* const ctx,
 
     container->isExpectingName = !container->isExpectingName;
 
+    STATS_COUNT_VALUE(TYPE_STRING, valueLength + 2);
+    STATS_ADD(stringBytes, valueLength);
     PROPAGATE_ERROR(addByte(ctx, TYPE_STRING));
     PROPAGATE_ERROR(addBytes(ctx, (uint8_t*)value, valueLength));
     return addByte(ctx, TYPE_STRING);
@@ -377,8 +475,11 @@ ksbonjson_encodeStatus ksbonjson_chunkString(KSBONJSONEncodeContext* const ctx,
 
     unlikely_if(!container->isChunkingString)
     {
+        STATS_COUNT_VALUE(TYPE_STRING, 1);
         PROPAGATE_ERROR(addByte(ctx, TYPE_STRING));
     }
+    STATS_ADD(valueBytes[TYPE_STRING], chunkLength);
+    STATS_ADD(stringBytes, chunkLength);
     PROPAGATE_ERROR(addBytes(ctx, (uint8_t*)chunk, chunkLength));
 
     likely_if(!isLastChunk)
@@ -389,6 +490,7 @@ ksbonjson_encodeStatus ksbonjson_chunkString(KSBONJSONEncodeContext* const ctx,
 
     container->isChunkingString = false;
     container->isExpectingName = !container->isExpectingName;
+    STATS_ADD(valueBytes[TYPE_STRING], 1);
     return addByte(ctx, TYPE_STRING);
 }
 
@@ -404,6 +506,120 @@ ksbonjson_encodeStatus ksbonjson_addBONJSONDocument(KSBONJSONEncodeContext* cons
     return addBytes(ctx, bonjsonDocument, documentLength);
 }
 
+ksbonjson_encodeStatus ksbonjson_addBONJSONContents(KSBONJSONEncodeContext* const ctx,
+                                                    const uint8_t* const contents,
+                                                    const size_t contentsLength)
+{
+    KSBONJSONContainerState* const container = &ctx->containers[ctx->containerDepth];
+    SHOULD_NOT_BE_EXPECTING_OBJECT_VALUE();
+    SHOULD_NOT_BE_CHUNKING_STRING();
+
+    // Complete members leave an object expecting a name again.
+    return addBytes(ctx, contents, contentsLength);
+}
+
+ksbonjson_encodeStatus ksbonjson_addTableRows(KSBONJSONEncodeContext* const ctx,
+                                              const KSBONJSONTableColumn* const columns,
+                                              const size_t columnCount,
+                                              const size_t rowCount)
+{
+    KSBONJSONContainerState* const container = &ctx->containers[ctx->containerDepth];
+    unlikely_if(container->isObject)
+    {
+        return KSBONJSON_ENCODE_NOT_IN_AN_ARRAY;
+    }
+    SHOULD_NOT_BE_CHUNKING_STRING();
+    for(size_t i = 0; i < columnCount; i++)
+    {
+        const KSBONJSONTableColumn* const column = &columns[i];
+        SHOULD_NOT_BE_NULL(column->name);
+        switch(column->type)
+        {
+            case KSBONJSON_TABLE_INT64:
+                SHOULD_NOT_BE_NULL(column->integers);
+                break;
+            case KSBONJSON_TABLE_FLOAT64:
+                SHOULD_NOT_BE_NULL(column->floats);
+                // Rows are passed on in pieces as they're encoded, so a bad
+                // value has to be caught before any of them are.
+                for(size_t row = 0; row < rowCount; row++)
+                {
+                    likely_if(column->validity == NULL || (column->validity[row >> 3] & (1 << (row & 7))) != 0)
+                    {
+                        PROPAGATE_ERROR(checkFloat(column->floats[row]));
+                    }
+                }
+                break;
+            case KSBONJSON_TABLE_STRING:
+                SHOULD_NOT_BE_NULL(column->strings);
+                break;
+            default:
+                return KSBONJSON_ENCODE_INVALID_COLUMN_TYPE;
+        }
+    }
+
+#if KSBONJSON_STATS
+    if(rowCount > 0 && ctx->containerDepth + 1 > ctx->stats.maxDepth)
+    {
+        ctx->stats.maxDepth = ctx->containerDepth + 1;
+    }
+#endif
+
+    TableBuffer buffer;
+    buffer.ctx = ctx;
+    buffer.length = 0;
+    for(size_t row = 0; row < rowCount; row++)
+    {
+        PROPAGATE_ERROR(reserveTable(&buffer, 1));
+        buffer.data[buffer.length++] = TYPE_OBJECT;
+        STATS_COUNT_VALUE(TYPE_OBJECT, 1);
+
+        for(size_t i = 0; i < columnCount; i++)
+        {
+            const KSBONJSONTableColumn* const column = &columns[i];
+            PROPAGATE_ERROR(addTableString(&buffer, column->name, column->nameLength));
+            STATS_COUNT_VALUE(TYPE_STRING, column->nameLength + 2);
+            STATS_ADD(stringBytes, column->nameLength);
+
+            PROPAGATE_ERROR(reserveTable(&buffer, 9));
+            uint8_t* const dst = buffer.data + buffer.length;
+            unlikely_if(column->validity != NULL && (column->validity[row >> 3] & (1 << (row & 7))) == 0)
+            {
+                dst[0] = TYPE_NULL;
+                buffer.length++;
+                STATS_COUNT_VALUE(TYPE_NULL, 1);
+                continue;
+            }
+
+            size_t length = 0;
+            switch(column->type)
+            {
+                case KSBONJSON_TABLE_INT64:
+                    length = encodeInteger(dst, column->integers[row]);
+                    break;
+                case KSBONJSON_TABLE_FLOAT64:
+                    PROPAGATE_ERROR(encodeFloat(dst, column->floats[row], &length));
+                    break;
+                default:
+                {
+                    const KSBONJSONStringView* const string = &column->strings[row];
+                    PROPAGATE_ERROR(addTableString(&buffer, string->data, string->length));
+                    STATS_COUNT_VALUE(TYPE_STRING, string->length + 2);
+                    STATS_ADD(stringBytes, string->length);
+                    continue;
+                }
+            }
+            buffer.length += length;
+            STATS_COUNT_VALUE(dst[0], length);
+        }
+
+        PROPAGATE_ERROR(reserveTable(&buffer, 1));
+        buffer.data[buffer.length++] = TYPE_END;
+        STATS_COUNT_VALUE(TYPE_END, 1);
+    }
+    return flushTable(&buffer);
+}
+
 ksbonjson_encodeStatus ksbonjson_beginObject(KSBONJSONEncodeContext* const ctx)
 {
     return beginContainer(ctx, TYPE_OBJECT, (KSBONJSONContainerState)
@@ -429,9 +645,20 @@ ksbonjson_encodeStatus ksbonjson_endContainer(KSBONJSONEncodeContext* const ctx)
     }
 
     ctx->containerDepth--;
+    STATS_COUNT_VALUE(TYPE_END, 1);
     return addByte(ctx, TYPE_END);
 }
 
+const KSBONJSONStats* ksbonjson_getEncodeStats(const KSBONJSONEncodeContext* const ctx)
+{
+#if KSBONJSON_STATS
+    return &ctx->stats;
+#else
+    (void)ctx;
+    return NULL;
+#endif
+}
+
 const char* ksbonjson_encodeStatusDescription(const ksbonjson_encodeStatus status)
 {
     switch (status)
@@ -454,6 +681,12 @@ const char* ksbonjson_encodeStatusDescription(const ksbonjson_encodeStatus statu
             return "Attempted to encode a NaN value";
         case KSBONJSON_ENCODE_INF:
             return "Attempted to encode an infinite value";
+        case KSBONJSON_ENCODE_NOT_AN_ARRAY:
+            return "Attempted to append to a document that isn't a closed top-level array";
+        case KSBONJSON_ENCODE_NOT_IN_AN_ARRAY:
+            return "Attempted to add table rows inside an object";
+        case KSBONJSON_ENCODE_INVALID_COLUMN_TYPE:
+            return "A table column has an unknown type";
         case KSBONJSON_ENCODE_COULD_NOT_ADD_DATA:
             return "addBytes() failed to process the passed in data";
         default:
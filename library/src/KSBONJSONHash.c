@@ -0,0 +1,528 @@
+//
+//  KSBONJSONHash.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONHash.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+/**
+ * Every value is hashed as a sequence of 64-bit words, starting with one of
+ * these tags. Equal values always produce the same words.
+ */
+enum
+{
+    TAG_NULL = 1,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INTEGER,
+    TAG_UINTEGER,
+    TAG_FLOAT,
+    TAG_STRING,
+    TAG_ARRAY,
+    TAG_OBJECT,
+    TAG_UNORDERED_OBJECT,
+    TAG_END,
+};
+
+// Fast hash constants (from wyhash)
+#define FAST_SEED 0xa0761d6478bd642fULL
+#define FAST_WORD_SECRET 0xe7037ed1a0b428dbULL
+#define FAST_STATE_SECRET 0x8ebc6af09c88c6e3ULL
+#define FAST_FINAL_SECRET 0x589965cc75374cc3ULL
+
+static const uint32_t g_sha256InitialState[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t g_sha256RoundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+// ============================================================================
+// Fast Hash
+// ============================================================================
+
+static void fastAddWord(KSBONJSONHashState* const state, const uint64_t word)
+{
+    // The product is zero when word is FAST_WORD_SECRET, so fold it into the
+    // state rather than replace the state (which would forget everything
+    // hashed so far).
+    state->fast ^= multiplyFold(word ^ FAST_WORD_SECRET, state->fast ^ FAST_STATE_SECRET);
+}
+
+
+// ============================================================================
+// SHA-256
+// ============================================================================
+
+#define ROTATE_RIGHT(VALUE, BITS) (((VALUE) >> (BITS)) | ((VALUE) << (32 - (BITS))))
+
+static uint32_t readBigEndian32(const uint8_t* const bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static void sha256ProcessBlock(uint32_t* const state, const uint8_t* const block)
+{
+    uint32_t w[64];
+    for(int i = 0; i < 16; i++)
+    {
+        w[i] = readBigEndian32(block + i * 4);
+    }
+    for(int i = 16; i < 64; i++)
+    {
+        const uint32_t s0 = ROTATE_RIGHT(w[i-15], 7) ^ ROTATE_RIGHT(w[i-15], 18) ^ (w[i-15] >> 3);
+        const uint32_t s1 = ROTATE_RIGHT(w[i-2], 17) ^ ROTATE_RIGHT(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for(int i = 0; i < 64; i++)
+    {
+        const uint32_t s1 = ROTATE_RIGHT(e, 6) ^ ROTATE_RIGHT(e, 11) ^ ROTATE_RIGHT(e, 25);
+        const uint32_t choice = (e & f) ^ (~e & g);
+        const uint32_t temp1 = h + s1 + choice + g_sha256RoundConstants[i] + w[i];
+        const uint32_t s0 = ROTATE_RIGHT(a, 2) ^ ROTATE_RIGHT(a, 13) ^ ROTATE_RIGHT(a, 22);
+        const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t temp2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256AddBytes(KSBONJSONHashState* const state, const uint8_t* bytes, size_t length)
+{
+    size_t used = state->sha256.length % 64;
+    state->sha256.length += length;
+    if(used > 0)
+    {
+        const size_t count = length < 64 - used ? length : 64 - used;
+        memcpy(state->sha256.block + used, bytes, count);
+        bytes += count;
+        length -= count;
+        used += count;
+        if(used < 64)
+        {
+            return;
+        }
+        sha256ProcessBlock(state->sha256.state, state->sha256.block);
+    }
+    for(; length >= 64; bytes += 64, length -= 64)
+    {
+        sha256ProcessBlock(state->sha256.state, bytes);
+    }
+    memcpy(state->sha256.block, bytes, length);
+}
+
+static void sha256AddWord(KSBONJSONHashState* const state, const uint64_t word)
+{
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++)
+    {
+        bytes[i] = (uint8_t)(word >> (i * 8));
+    }
+    sha256AddBytes(state, bytes, sizeof(bytes));
+}
+
+static void sha256End(KSBONJSONHashState* const state, uint8_t* const hash)
+{
+    const uint64_t bitLength = state->sha256.length * 8;
+    uint8_t padding[72] = {0x80};
+    const size_t paddingLength = 64 - (state->sha256.length + 8) % 64;
+    for(int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + i] = (uint8_t)(bitLength >> (56 - i * 8));
+    }
+    sha256AddBytes(state, padding, paddingLength + 8);
+    for(int i = 0; i < 8; i++)
+    {
+        const uint32_t value = state->sha256.state[i];
+        hash[i*4] = (uint8_t)(value >> 24);
+        hash[i*4+1] = (uint8_t)(value >> 16);
+        hash[i*4+2] = (uint8_t)(value >> 8);
+        hash[i*4+3] = (uint8_t)value;
+    }
+}
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+static void initState(const KSBONJSONHashContext* const ctx, KSBONJSONHashState* const state)
+{
+    if(ctx->algorithm == KSBONJSON_HASH_SHA256)
+    {
+        memcpy(state->sha256.state, g_sha256InitialState, sizeof(g_sha256InitialState));
+        state->sha256.length = 0;
+    }
+    else
+    {
+        state->fast = FAST_SEED;
+    }
+}
+
+static void addWord(const KSBONJSONHashContext* const ctx, KSBONJSONHashState* const state, const uint64_t word)
+{
+    likely_if(ctx->algorithm == KSBONJSON_HASH_FAST)
+    {
+        fastAddWord(state, word);
+    }
+    else
+    {
+        sha256AddWord(state, word);
+    }
+}
+
+static void addBytesAsWords(const KSBONJSONHashContext* const ctx,
+                            KSBONJSONHashState* const state,
+                            const uint8_t* bytes,
+                            size_t length)
+{
+    unlikely_if(ctx->algorithm == KSBONJSON_HASH_SHA256)
+    {
+        sha256AddBytes(state, bytes, length);
+        return;
+    }
+    for(; length >= 8; bytes += 8, length -= 8)
+    {
+        fastAddWord(state, loadUInt64(bytes));
+    }
+    if(length > 0)
+    {
+        uint8_t tail[8] = {0};
+        memcpy(tail, bytes, length);
+        fastAddWord(state, loadUInt64(tail));
+    }
+}
+
+/**
+ * Get the final hash as four words (the fast hash only uses the first).
+ */
+static void endState(const KSBONJSONHashContext* const ctx, KSBONJSONHashState* const state, uint64_t* const words)
+{
+    if(ctx->algorithm == KSBONJSON_HASH_SHA256)
+    {
+        uint8_t hash[32];
+        sha256End(state, hash);
+        for(int i = 0; i < 4; i++)
+        {
+            words[i] = loadUInt64(hash + i * 8);
+        }
+    }
+    else
+    {
+        words[0] = multiplyFold(state->fast ^ FAST_FINAL_SECRET, FAST_WORD_SECRET);
+        words[1] = words[2] = words[3] = 0;
+    }
+}
+
+static KSBONJSONHashState* currentState(KSBONJSONHashContext* const ctx)
+{
+    likely_if(ctx->objectDepth == 0)
+    {
+        return &ctx->root;
+    }
+    return &ctx->objects[ctx->objectDepth - 1].member;
+}
+
+static bool isInUnorderedObject(const KSBONJSONHashContext* const ctx)
+{
+    return ctx->isUnorderedMembers && ctx->containerDepth > 0 && ctx->containers[ctx->containerDepth - 1].isObject;
+}
+
+/**
+ * Called after each complete value. In an unordered object, this finishes
+ * the member, adding its hash to the object's sum of member hashes.
+ */
+static void endValue(KSBONJSONHashContext* const ctx)
+{
+    likely_if(!isInUnorderedObject(ctx))
+    {
+        return;
+    }
+    KSBONJSONHashObjectState* const object = &ctx->objects[ctx->objectDepth - 1];
+    uint64_t words[4];
+    endState(ctx, &object->member, words);
+    for(int i = 0; i < 4; i++)
+    {
+        object->memberSum[i] += words[i];
+    }
+    object->memberCount++;
+    initState(ctx, &object->member);
+    ctx->containers[ctx->containerDepth - 1].isExpectingName = true;
+}
+
+static ksbonjson_decodeStatus addTaggedValue(KSBONJSONHashContext* const ctx, const uint64_t tag, const uint64_t value)
+{
+    KSBONJSONHashState* const state = currentState(ctx);
+    addWord(ctx, state, tag);
+    addWord(ctx, state, value);
+    endValue(ctx);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus addTag(KSBONJSONHashContext* const ctx, const uint64_t tag)
+{
+    addWord(ctx, currentState(ctx), tag);
+    endValue(ctx);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus hashBoolean(bool value, void* userData)
+{
+    return addTag((KSBONJSONHashContext*)userData, value ? TAG_TRUE : TAG_FALSE);
+}
+
+static ksbonjson_decodeStatus hashNull(void* userData)
+{
+    return addTag((KSBONJSONHashContext*)userData, TAG_NULL);
+}
+
+static ksbonjson_decodeStatus hashInteger(int64_t value, void* userData)
+{
+    return addTaggedValue((KSBONJSONHashContext*)userData, TAG_INTEGER, (uint64_t)value);
+}
+
+static ksbonjson_decodeStatus hashUInteger(uint64_t value, void* userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+    likely_if(value <= INT64_MAX)
+    {
+        return addTaggedValue(ctx, TAG_INTEGER, value);
+    }
+    return addTaggedValue(ctx, TAG_UINTEGER, value);
+}
+
+static ksbonjson_decodeStatus hashFloat(double value, void* userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+
+    // Floats holding whole numbers hash the same as integers.
+    if(value >= -9223372036854775808.0 && value < 9223372036854775808.0 && (double)(int64_t)value == value)
+    {
+        return addTaggedValue(ctx, TAG_INTEGER, (uint64_t)(int64_t)value);
+    }
+    if(value >= 0 && value < 18446744073709551616.0 && (double)(uint64_t)value == value)
+    {
+        return addTaggedValue(ctx, TAG_UINTEGER, (uint64_t)value);
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return addTaggedValue(ctx, TAG_FLOAT, bits);
+}
+
+static ksbonjson_decodeStatus hashString(const char* KSBONJSON_RESTRICT value,
+                                       size_t length,
+                                       void* KSBONJSON_RESTRICT userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+    KSBONJSONHashState* const state = currentState(ctx);
+    addWord(ctx, state, TAG_STRING);
+    addWord(ctx, state, length);
+    addBytesAsWords(ctx, state, (const uint8_t*)value, length);
+
+    if(isInUnorderedObject(ctx) && ctx->containers[ctx->containerDepth - 1].isExpectingName)
+    {
+        // A member name begins the member.
+        ctx->containers[ctx->containerDepth - 1].isExpectingName = false;
+        return KSBONJSON_DECODE_OK;
+    }
+    endValue(ctx);
+    return KSBONJSON_DECODE_OK;
+}
+
+static void pushContainer(KSBONJSONHashContext* const ctx, const bool isObject)
+{
+    if(ctx->isUnorderedMembers)
+    {
+        ctx->containers[ctx->containerDepth++] = (KSBONJSONDecodeContainerState)
+        {
+            .isObject = isObject,
+            .isExpectingName = isObject,
+        };
+    }
+}
+
+static ksbonjson_decodeStatus hashBeginArray(void* userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+    addWord(ctx, currentState(ctx), TAG_ARRAY);
+    pushContainer(ctx, false);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus hashBeginObject(void* userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+    if(ctx->isUnorderedMembers)
+    {
+        KSBONJSONHashObjectState* const object = &ctx->objects[ctx->objectDepth++];
+        initState(ctx, &object->member);
+        object->memberSum[0] = object->memberSum[1] = object->memberSum[2] = object->memberSum[3] = 0;
+        object->memberCount = 0;
+    }
+    else
+    {
+        addWord(ctx, currentState(ctx), TAG_OBJECT);
+    }
+    pushContainer(ctx, true);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus hashEndContainer(void* userData)
+{
+    KSBONJSONHashContext* const ctx = (KSBONJSONHashContext*)userData;
+    if(!ctx->isUnorderedMembers)
+    {
+        addWord(ctx, currentState(ctx), TAG_END);
+        return KSBONJSON_DECODE_OK;
+    }
+
+    const bool isObject = ctx->containers[--ctx->containerDepth].isObject;
+    if(!isObject)
+    {
+        return addTag(ctx, TAG_END);
+    }
+
+    // The object's hash is the sum of its members' hashes, which doesn't
+    // depend on their order.
+    const KSBONJSONHashObjectState* const object = &ctx->objects[--ctx->objectDepth];
+    KSBONJSONHashState* const state = currentState(ctx);
+    addWord(ctx, state, TAG_UNORDERED_OBJECT);
+    for(int i = 0; i < 4; i++)
+    {
+        addWord(ctx, state, object->memberSum[i]);
+    }
+    addWord(ctx, state, object->memberCount);
+    endValue(ctx);
+    return KSBONJSON_DECODE_OK;
+}
+
+static ksbonjson_decodeStatus hashEndData(void* userData)
+{
+    (void)userData;
+    return KSBONJSON_DECODE_OK;
+}
+
+static const KSBONJSONDecodeCallbacks g_hashCallbacks =
+{
+    .onBoolean = hashBoolean,
+    .onInteger = hashInteger,
+    .onUInteger = hashUInteger,
+    .onFloat = hashFloat,
+    .onNull = hashNull,
+    .onString = hashString,
+    .onBeginObject = hashBeginObject,
+    .onBeginArray = hashBeginArray,
+    .onEndContainer = hashEndContainer,
+    .onEndData = hashEndData,
+};
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+void ksbonjson_beginHash(KSBONJSONHashContext* const context,
+                         const ksbonjson_hashAlgorithm algorithm,
+                         const int flags)
+{
+    // The per-level state is initialized as it's used.
+    context->algorithm = algorithm;
+    context->isUnorderedMembers = (flags & KSBONJSON_HASH_UNORDERED_MEMBERS) != 0;
+    context->containerDepth = 0;
+    context->objectDepth = 0;
+    initState(context, &context->root);
+}
+
+const KSBONJSONDecodeCallbacks* ksbonjson_hashCallbacks(void)
+{
+    return &g_hashCallbacks;
+}
+
+void ksbonjson_endHash(KSBONJSONHashContext* const context, uint8_t* const hash)
+{
+    if(context->algorithm == KSBONJSON_HASH_SHA256)
+    {
+        sha256End(&context->root, hash);
+        return;
+    }
+    uint64_t words[4];
+    endState(context, &context->root, words);
+    for(int i = 0; i < 8; i++)
+    {
+        hash[i] = (uint8_t)(words[0] >> (i * 8));
+    }
+}
+
+size_t ksbonjson_hashLength(const ksbonjson_hashAlgorithm algorithm)
+{
+    return algorithm == KSBONJSON_HASH_SHA256 ? 32 : 8;
+}
+
+ksbonjson_decodeStatus ksbonjson_hash(const uint8_t* const document,
+                                      const size_t documentLength,
+                                      const ksbonjson_hashAlgorithm algorithm,
+                                      const int flags,
+                                      uint8_t* const hash)
+{
+    KSBONJSONHashContext context;
+    size_t decodedOffset = 0;
+    ksbonjson_beginHash(&context, algorithm, flags);
+    const ksbonjson_decodeStatus status = ksbonjson_decode(document, documentLength, &g_hashCallbacks, &context, &decodedOffset);
+    unlikely_if(status != KSBONJSON_DECODE_OK)
+    {
+        return status;
+    }
+    ksbonjson_endHash(&context, hash);
+    return KSBONJSON_DECODE_OK;
+}
@@ -0,0 +1,687 @@
+//
+//  KSBONJSONIndex.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONIndex.h>
+#include <ksbonjson/KSBONJSONRecordLog.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+// "BJSNIDX" and the format version
+static const uint8_t g_indexMagic[8] = {'B', 'J', 'S', 'N', 'I', 'D', 'X', 1};
+
+// Header fields (each a 64-bit little endian word)
+enum
+{
+    HEADER_MAGIC = 0,
+    HEADER_KIND = 8,
+    HEADER_STRIDE = 16,
+    HEADER_ELEMENT_COUNT = 24,
+    HEADER_DOCUMENT_LENGTH = 32,
+    HEADER_OFFSET_COUNT = 40,
+    HEADER_KEY_COUNT = 48,
+    HEADER_KEY_PATH_LENGTH = 56,
+};
+
+// A key entry is its hash followed by its element's offset.
+#define OFFSET_SIZE 8
+#define KEY_SIZE 16
+
+// Keeps integer keys from hashing like strings
+#define KEY_INTEGER_TAG 0x1d8e4e27c47d124fULL
+
+/**
+ * A string or integer that an element can be found by.
+ */
+typedef struct
+{
+    bool isString;
+    const uint8_t* string;
+    size_t stringLength;
+    int64_t integer;
+} Key;
+
+typedef struct
+{
+    const uint8_t* document;
+    const KSBONJSONIndexOptions* options;
+    uint64_t stride;
+    uint8_t* index;
+    // Offsets are added after the header, and keys are added from the end of
+    // the storage (and moved next to the offsets once they're all known).
+    size_t offsetsEnd;
+    size_t keysStart;
+    uint64_t elementCount;
+    uint64_t offsetCount;
+    uint64_t keyCount;
+    bool isFull;
+} Builder;
+
+static size_t offsetsStart(const size_t keyPathLength)
+{
+    return KSBONJSON_INDEX_HEADER_SIZE + ((keyPathLength + 7) & ~(size_t)7);
+}
+
+static uint64_t hashKey(const Key* const key)
+{
+    unlikely_if(!key->isString)
+    {
+        return multiplyFold((uint64_t)key->integer ^ STRING_HASH_WORD_SECRET, KEY_INTEGER_TAG ^ STRING_HASH_FINAL_SECRET);
+    }
+    return hashStringBytes(key->string, key->stringLength);
+}
+
+static bool isKeyEqual(const Key* const a, const Key* const b)
+{
+    unlikely_if(a->isString != b->isString)
+    {
+        return false;
+    }
+    likely_if(a->isString)
+    {
+        return a->stringLength == b->stringLength && memcmp(a->string, b->string, a->stringLength) == 0;
+    }
+    return a->integer == b->integer;
+}
+
+/**
+ * Decode the string or integer at pos. A float with an integer value (such
+ * as 3.0) is keyed as that integer.
+ *
+ * @return false if there isn't a string or integer there.
+ */
+static bool decodeKey(const uint8_t* const pos, const uint8_t* const end, Key* const key)
+{
+    unlikely_if(pos >= end)
+    {
+        return false;
+    }
+    likely_if(*pos == TYPE_STRING)
+    {
+        const uint8_t* const stringEnd = CALL_KERNEL(findStringTerminator)(pos + 1, end);
+        unlikely_if(stringEnd >= end)
+        {
+            return false;
+        }
+        key->isString = true;
+        key->string = pos + 1;
+        key->stringLength = (size_t)(stringEnd - key->string);
+        return true;
+    }
+    Number number;
+    const uint8_t* next = NULL;
+    unlikely_if(decodeNumber(pos, end, &number, &next) != KSBONJSON_DOCUMENT_OK ||
+                toInteger(&number, &key->integer) != KSBONJSON_DOCUMENT_OK)
+    {
+        return false;
+    }
+    key->isString = false;
+    return true;
+}
+
+/**
+ * Find the string or integer at a path inside a value.
+ *
+ * @return false if there's no string or integer at the path.
+ */
+static bool findKey(const uint8_t* pos,
+                    const uint8_t* const end,
+                    const char* const path,
+                    const size_t pathLength,
+                    Key* const key)
+{
+    pos = findPointerValue(pos, end, path, pathLength);
+    unlikely_if(pos == NULL)
+    {
+        return false;
+    }
+    return decodeKey(pos, end, key);
+}
+
+static void addOffset(Builder* const builder, const uint64_t offset)
+{
+    builder->offsetCount++;
+    likely_if(!builder->isFull && builder->keysStart - builder->offsetsEnd >= OFFSET_SIZE)
+    {
+        storeUInt64(builder->index + builder->offsetsEnd, offset);
+        builder->offsetsEnd += OFFSET_SIZE;
+        return;
+    }
+    builder->isFull = true;
+}
+
+static void addKey(Builder* const builder, const uint64_t hash, const uint64_t offset)
+{
+    builder->keyCount++;
+    likely_if(!builder->isFull && builder->keysStart - builder->offsetsEnd >= KEY_SIZE)
+    {
+        builder->keysStart -= KEY_SIZE;
+        storeUInt64(builder->index + builder->keysStart, hash);
+        storeUInt64(builder->index + builder->keysStart + 8, offset);
+        return;
+    }
+    builder->isFull = true;
+}
+
+/**
+ * Add an element to the index.
+ *
+ * @param element The start of the element (a record header, for record logs).
+ * @param value The element's value.
+ * @param valueEnd The end of the value.
+ */
+static void addElement(Builder* const builder,
+                       const uint8_t* const element,
+                       const uint8_t* const value,
+                       const uint8_t* const valueEnd)
+{
+    const uint64_t offset = (uint64_t)(element - builder->document);
+    likely_if(builder->elementCount % builder->stride == 0)
+    {
+        addOffset(builder, offset);
+    }
+    builder->elementCount++;
+
+    Key key;
+    if(builder->options->keyPath != NULL &&
+       findKey(value, valueEnd, builder->options->keyPath, builder->options->keyPathLength, &key))
+    {
+        addKey(builder, hashKey(&key), offset);
+    }
+}
+
+static ksbonjson_documentStatus indexArray(Builder* const builder, const uint8_t* pos, const uint8_t* const end)
+{
+    unlikely_if(pos >= end || *pos != TYPE_ARRAY)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    pos++;
+    for(;;)
+    {
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        unlikely_if(*pos == TYPE_END)
+        {
+            pos++;
+            break;
+        }
+        const uint8_t* const next = skipValue(pos, end);
+        unlikely_if(next == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        addElement(builder, pos, pos, next);
+        pos = next;
+    }
+    unlikely_if(pos != end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus indexSequence(Builder* const builder, const uint8_t* pos, const uint8_t* const end)
+{
+    while(pos < end)
+    {
+        const uint8_t* const next = skipValue(pos, end);
+        unlikely_if(next == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        addElement(builder, pos, pos, next);
+        pos = next;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus indexRecordLog(Builder* const builder, const uint8_t* const pos, const uint8_t* const end)
+{
+    KSBONJSONRecordReader reader;
+    ksbonjson_beginRecordReading(&reader, pos, (size_t)(end - pos));
+    const uint8_t* record;
+    size_t recordLength;
+    ksbonjson_recordStatus status;
+    while((status = ksbonjson_readRecord(&reader, &record, &recordLength)) == KSBONJSON_RECORD_OK)
+    {
+        addElement(builder, record - KSBONJSON_RECORD_HEADER_SIZE, record, record + recordLength);
+    }
+    unlikely_if(status != KSBONJSON_RECORD_END)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static bool isKeyEntryLess(const uint8_t* const a, const uint8_t* const b)
+{
+    const uint64_t aHash = loadUInt64(a);
+    const uint64_t bHash = loadUInt64(b);
+    return aHash < bHash || (aHash == bHash && loadUInt64(a + 8) < loadUInt64(b + 8));
+}
+
+static void swapKeyEntries(uint8_t* const a, uint8_t* const b)
+{
+    uint8_t temp[KEY_SIZE];
+    memcpy(temp, a, KEY_SIZE);
+    memcpy(a, b, KEY_SIZE);
+    memcpy(b, temp, KEY_SIZE);
+}
+
+static void siftDownKey(uint8_t* const keys, size_t root, const size_t count)
+{
+    for(;;)
+    {
+        size_t child = root * 2 + 1;
+        if(child >= count)
+        {
+            return;
+        }
+        if(child + 1 < count && isKeyEntryLess(keys + child * KEY_SIZE, keys + (child + 1) * KEY_SIZE))
+        {
+            child++;
+        }
+        if(!isKeyEntryLess(keys + root * KEY_SIZE, keys + child * KEY_SIZE))
+        {
+            return;
+        }
+        swapKeyEntries(keys + root * KEY_SIZE, keys + child * KEY_SIZE);
+        root = child;
+    }
+}
+
+static void heapSortKeys(uint8_t* const keys, const size_t count)
+{
+    for(size_t i = count / 2; i > 0; i--)
+    {
+        siftDownKey(keys, i - 1, count);
+    }
+    for(size_t i = count; i > 1; i--)
+    {
+        swapKeyEntries(keys, keys + (i - 1) * KEY_SIZE);
+        siftDownKey(keys, 0, i - 1);
+    }
+}
+
+static void insertionSortKeys(uint8_t* const keys, const size_t count)
+{
+    for(size_t i = 1; i < count; i++)
+    {
+        for(size_t j = i; j > 0 && isKeyEntryLess(keys + j * KEY_SIZE, keys + (j - 1) * KEY_SIZE); j--)
+        {
+            swapKeyEntries(keys + j * KEY_SIZE, keys + (j - 1) * KEY_SIZE);
+        }
+    }
+}
+
+// Entries are moved into buckets by the top two bytes of their hashes, and
+// then sorted within those.
+#define SORT_LAST_RADIX_BYTE 6
+#define SORT_INSERTION_COUNT 32
+
+/**
+ * Sort key entries by hash, then offset (in place, so that the index storage
+ * is all the memory that building an index needs).
+ *
+ * The hashes are evenly distributed, so moving entries into buckets by the
+ * high bytes of their hashes (an in-place radix sort) leaves small buckets
+ * to finish sorting.
+ */
+static void sortKeys(uint8_t* const keys, const size_t count, const int byteIndex)
+{
+    likely_if(count <= SORT_INSERTION_COUNT)
+    {
+        insertionSortKeys(keys, count);
+        return;
+    }
+    unlikely_if(byteIndex < SORT_LAST_RADIX_BYTE)
+    {
+        heapSortKeys(keys, count);
+        return;
+    }
+
+    size_t bucketEnds[256] = {0};
+    for(size_t i = 0; i < count; i++)
+    {
+        bucketEnds[keys[i * KEY_SIZE + byteIndex]]++;
+    }
+    size_t nextInBucket[256];
+    size_t start = 0;
+    for(int bucket = 0; bucket < 256; bucket++)
+    {
+        nextInBucket[bucket] = start;
+        start += bucketEnds[bucket];
+        bucketEnds[bucket] = start;
+    }
+
+    for(int bucket = 0; bucket < 256; bucket++)
+    {
+        while(nextInBucket[bucket] < bucketEnds[bucket])
+        {
+            uint8_t* const entry = keys + nextInBucket[bucket] * KEY_SIZE;
+            const uint8_t entryBucket = entry[byteIndex];
+            if(entryBucket == bucket)
+            {
+                nextInBucket[bucket]++;
+            }
+            else
+            {
+                swapKeyEntries(entry, keys + nextInBucket[entryBucket] * KEY_SIZE);
+                nextInBucket[entryBucket]++;
+            }
+        }
+    }
+
+    start = 0;
+    for(int bucket = 0; bucket < 256; bucket++)
+    {
+        sortKeys(keys + start * KEY_SIZE, bucketEnds[bucket] - start, byteIndex - 1);
+        start = bucketEnds[bucket];
+    }
+}
+
+/**
+ * Find an element's value, and where the next element starts.
+ */
+static ksbonjson_documentStatus getElement(const KSBONJSONIndex* const index,
+                                           const uint64_t offset,
+                                           const uint8_t** const value,
+                                           size_t* const valueLength,
+                                           const uint8_t** const next)
+{
+    unlikely_if(offset >= index->documentLength)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+    const uint8_t* const pos = index->document + offset;
+    const uint8_t* const end = index->document + index->documentLength;
+
+    unlikely_if(index->kind == KSBONJSON_INDEX_RECORD_LOG)
+    {
+        KSBONJSONRecordReader reader;
+        ksbonjson_beginRecordReading(&reader, pos, (size_t)(end - pos));
+        unlikely_if(ksbonjson_readRecord(&reader, value, valueLength) != KSBONJSON_RECORD_OK)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        *next = *value + *valueLength;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    const uint8_t* const valueEnd = skipValue(pos, end);
+    unlikely_if(valueEnd == NULL)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    *value = pos;
+    *valueLength = (size_t)(valueEnd - pos);
+    *next = valueEnd;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus findKeyedElement(const KSBONJSONIndex* const index,
+                                                 const Key* const key,
+                                                 const uint8_t** const value,
+                                                 size_t* const valueLength)
+{
+    // Find the first entry with this hash
+    const uint64_t hash = hashKey(key);
+    uint64_t low = 0;
+    uint64_t high = index->keyCount;
+    while(low < high)
+    {
+        const uint64_t middle = low + (high - low) / 2;
+        if(loadUInt64(index->keys + middle * KEY_SIZE) < hash)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    // Check each element with this hash until the key matches
+    for(; low < index->keyCount && loadUInt64(index->keys + low * KEY_SIZE) == hash; low++)
+    {
+        const uint8_t* element;
+        size_t elementLength;
+        const uint8_t* next;
+        PROPAGATE_ERROR(getElement(index, loadUInt64(index->keys + low * KEY_SIZE + 8), &element, &elementLength, &next));
+        Key elementKey;
+        if(findKey(element, next, index->keyPath, index->keyPathLength, &elementKey) && isKeyEqual(key, &elementKey))
+        {
+            *value = element;
+            *valueLength = elementLength;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+    }
+    return KSBONJSON_DOCUMENT_NOT_FOUND;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_buildIndex(const uint8_t* const document,
+                                              const size_t documentLength,
+                                              const KSBONJSONIndexOptions* const options,
+                                              uint8_t* const index,
+                                              const size_t indexSize,
+                                              size_t* const indexLength)
+{
+    unlikely_if(options->keyPath != NULL && !isValidPointer(options->keyPath, options->keyPathLength))
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATH;
+    }
+
+    const size_t keyPathLength = options->keyPath == NULL ? 0 : options->keyPathLength;
+    Builder builder =
+    {
+        .document = document,
+        .options = options,
+        .stride = options->stride > 1 ? options->stride : 1,
+        .index = index,
+        .offsetsEnd = offsetsStart(keyPathLength),
+        .keysStart = indexSize,
+    };
+    builder.isFull = index == NULL || indexSize < builder.offsetsEnd;
+
+    const uint8_t* const end = document + documentLength;
+    switch(options->kind)
+    {
+        case KSBONJSON_INDEX_ARRAY:
+            PROPAGATE_ERROR(indexArray(&builder, document, end));
+            break;
+        case KSBONJSON_INDEX_SEQUENCE:
+            PROPAGATE_ERROR(indexSequence(&builder, document, end));
+            break;
+        case KSBONJSON_INDEX_RECORD_LOG:
+            PROPAGATE_ERROR(indexRecordLog(&builder, document, end));
+            break;
+        default:
+            return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    *indexLength = offsetsStart(keyPathLength) + builder.offsetCount * OFFSET_SIZE + builder.keyCount * KEY_SIZE;
+    unlikely_if(builder.isFull)
+    {
+        return KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL;
+    }
+
+    memmove(index + builder.offsetsEnd, index + builder.keysStart, builder.keyCount * KEY_SIZE);
+    sortKeys(index + builder.offsetsEnd, builder.keyCount, 7);
+
+    memcpy(index + HEADER_MAGIC, g_indexMagic, sizeof(g_indexMagic));
+    storeUInt64(index + HEADER_KIND, (uint64_t)options->kind);
+    storeUInt64(index + HEADER_STRIDE, builder.stride);
+    storeUInt64(index + HEADER_ELEMENT_COUNT, builder.elementCount);
+    storeUInt64(index + HEADER_DOCUMENT_LENGTH, documentLength);
+    storeUInt64(index + HEADER_OFFSET_COUNT, builder.offsetCount);
+    storeUInt64(index + HEADER_KEY_COUNT, builder.keyCount);
+    storeUInt64(index + HEADER_KEY_PATH_LENGTH, keyPathLength);
+    memset(index + KSBONJSON_INDEX_HEADER_SIZE, 0, offsetsStart(keyPathLength) - KSBONJSON_INDEX_HEADER_SIZE);
+    likely_if(keyPathLength > 0)
+    {
+        memcpy(index + KSBONJSON_INDEX_HEADER_SIZE, options->keyPath, keyPathLength);
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_openIndex(KSBONJSONIndex* const index,
+                                             const uint8_t* const data,
+                                             const size_t dataLength,
+                                             const uint8_t* const document,
+                                             const size_t documentLength)
+{
+    unlikely_if(dataLength < KSBONJSON_INDEX_HEADER_SIZE || memcmp(data, g_indexMagic, sizeof(g_indexMagic)) != 0)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    const uint64_t kind = loadUInt64(data + HEADER_KIND);
+    const uint64_t stride = loadUInt64(data + HEADER_STRIDE);
+    const uint64_t elementCount = loadUInt64(data + HEADER_ELEMENT_COUNT);
+    const uint64_t indexedLength = loadUInt64(data + HEADER_DOCUMENT_LENGTH);
+    const uint64_t offsetCount = loadUInt64(data + HEADER_OFFSET_COUNT);
+    const uint64_t keyCount = loadUInt64(data + HEADER_KEY_COUNT);
+    const uint64_t keyPathLength = loadUInt64(data + HEADER_KEY_PATH_LENGTH);
+    const uint64_t available = dataLength - KSBONJSON_INDEX_HEADER_SIZE;
+    unlikely_if(kind > KSBONJSON_INDEX_RECORD_LOG ||
+                stride == 0 ||
+                offsetCount != elementCount / stride + (elementCount % stride != 0) ||
+                keyPathLength > available ||
+                offsetCount > available / OFFSET_SIZE ||
+                keyCount > available / KEY_SIZE ||
+                offsetsStart((size_t)keyPathLength) + offsetCount * OFFSET_SIZE + keyCount * KEY_SIZE != dataLength ||
+                indexedLength > documentLength ||
+                (kind == KSBONJSON_INDEX_ARRAY && indexedLength < 2) ||
+                !isValidPointer((const char*)data + KSBONJSON_INDEX_HEADER_SIZE, (size_t)keyPathLength))
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    index->kind = (ksbonjson_indexKind)kind;
+    index->stride = stride;
+    index->elementCount = elementCount;
+    index->documentLength = indexedLength;
+    index->keyPath = (const char*)data + KSBONJSON_INDEX_HEADER_SIZE;
+    index->keyPathLength = (size_t)keyPathLength;
+    index->document = document;
+    index->offsets = data + offsetsStart((size_t)keyPathLength);
+    index->offsetCount = offsetCount;
+    index->keys = index->offsets + offsetCount * OFFSET_SIZE;
+    index->keyCount = keyCount;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_findIndexedElement(const KSBONJSONIndex* const index,
+                                                      const uint64_t elementIndex,
+                                                      const uint8_t** const value,
+                                                      size_t* const valueLength)
+{
+    unlikely_if(elementIndex >= index->elementCount)
+    {
+        return KSBONJSON_DOCUMENT_NOT_FOUND;
+    }
+
+    uint64_t offset = loadUInt64(index->offsets + elementIndex / index->stride * OFFSET_SIZE);
+    for(uint64_t skip = elementIndex % index->stride;; skip--)
+    {
+        const uint8_t* next;
+        PROPAGATE_ERROR(getElement(index, offset, value, valueLength, &next));
+        likely_if(skip == 0)
+        {
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        offset = (uint64_t)(next - index->document);
+    }
+}
+
+ksbonjson_documentStatus ksbonjson_nextIndexedElement(const KSBONJSONIndex* const index,
+                                                      const uint8_t** const value,
+                                                      size_t* const valueLength)
+{
+    // The indexed elements end where the document did when it was indexed
+    // (before the array's closing byte), so elements appended since then
+    // (even in place of that closing byte) aren't visited.
+    const uint64_t elementsEnd = index->documentLength - (index->kind == KSBONJSON_INDEX_ARRAY ? 1 : 0);
+    const uint64_t offset = (uint64_t)(*value + *valueLength - index->document);
+    unlikely_if(offset >= elementsEnd)
+    {
+        return KSBONJSON_DOCUMENT_NOT_FOUND;
+    }
+    const uint8_t* next;
+    return getElement(index, offset, value, valueLength, &next);
+}
+
+ksbonjson_documentStatus ksbonjson_findIndexedString(const KSBONJSONIndex* const index,
+                                                     const char* const key,
+                                                     const size_t keyLength,
+                                                     const uint8_t** const value,
+                                                     size_t* const valueLength)
+{
+    const Key searchKey =
+    {
+        .isString = true,
+        .string = (const uint8_t*)key,
+        .stringLength = keyLength,
+    };
+    return findKeyedElement(index, &searchKey, value, valueLength);
+}
+
+ksbonjson_documentStatus ksbonjson_findIndexedInteger(const KSBONJSONIndex* const index,
+                                                      const int64_t key,
+                                                      const uint8_t** const value,
+                                                      size_t* const valueLength)
+{
+    const Key searchKey =
+    {
+        .isString = false,
+        .integer = key,
+    };
+    return findKeyedElement(index, &searchKey, value, valueLength);
+}
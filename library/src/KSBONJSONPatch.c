@@ -0,0 +1,617 @@
+//
+//  KSBONJSONPatch.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONPatch.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// A string literal and its length
+#define LITERAL(STRING) STRING, (sizeof(STRING) - 1)
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+typedef struct
+{
+    char* buffer;
+    size_t length;
+    size_t used;
+} NameBuffer;
+
+/**
+ * Where a JSON Pointer leads: The container that the last token refers into,
+ * and the node that it refers to (if there is one).
+ */
+typedef struct
+{
+    KSBONJSONNode* parent;
+    KSBONJSONNode* node;
+    const char* token;
+    size_t tokenLength;
+    size_t index;
+    bool isEndOfArray;
+} Location;
+
+static bool isEqualString(const char* const a, const size_t aLength, const char* const b, const size_t bLength)
+{
+    return aLength == bLength && memcmp(a, b, aLength) == 0;
+}
+
+/**
+ * Compare a member name to a pointer token, which may contain "~0" ("~")
+ * and "~1" ("/"). The escapes have already been checked.
+ */
+static bool isEqualToken(const char* const name,
+                         const size_t nameLength,
+                         const char* const token,
+                         const size_t tokenLength)
+{
+    size_t nameIndex = 0;
+    for(size_t i = 0; i < tokenLength; i++, nameIndex++)
+    {
+        char ch = token[i];
+        if(ch == '~')
+        {
+            ch = token[++i] == '1' ? '/' : '~';
+        }
+        if(nameIndex >= nameLength || name[nameIndex] != ch)
+        {
+            return false;
+        }
+    }
+    return nameIndex == nameLength;
+}
+
+static ksbonjson_documentStatus unescapeToken(NameBuffer* const names,
+                                              const char* const token,
+                                              const size_t tokenLength,
+                                              const char** const name,
+                                              size_t* const nameLength)
+{
+    if(memchr(token, '~', tokenLength) == NULL)
+    {
+        *name = token;
+        *nameLength = tokenLength;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    char* const begin = names->buffer + names->used;
+    char* pos = begin;
+    for(size_t i = 0; i < tokenLength; i++)
+    {
+        unlikely_if(names->used + (pos - begin) >= names->length)
+        {
+            return KSBONJSON_DOCUMENT_NAME_BUFFER_FULL;
+        }
+        char ch = token[i];
+        if(ch == '~')
+        {
+            ch = token[++i] == '1' ? '/' : '~';
+        }
+        *pos++ = ch;
+    }
+    names->used += pos - begin;
+    *name = begin;
+    *nameLength = pos - begin;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus parseIndex(const char* const token, const size_t tokenLength, size_t* const index)
+{
+    // No leading zeroes, and small enough to not overflow.
+    unlikely_if(tokenLength == 0 || tokenLength > 18 || (tokenLength > 1 && token[0] == '0'))
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+    size_t value = 0;
+    for(size_t i = 0; i < tokenLength; i++)
+    {
+        unlikely_if(token[i] < '0' || token[i] > '9')
+        {
+            return KSBONJSON_DOCUMENT_INVALID_PATCH;
+        }
+        value = value * 10 + (token[i] - '0');
+    }
+    *index = value;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus findChild(KSBONJSONDocument* const document, Location* const location)
+{
+    KSBONJSONNode* const container = location->parent;
+    if(container->type == KSBONJSON_NODE_OBJECT)
+    {
+        KSBONJSONNode* child = NULL;
+        do
+        {
+            PROPAGATE_ERROR(ksbonjson_getNextChild(document, container, child, &child));
+        }
+        while(child != NULL && !isEqualToken(child->name, child->nameLength, location->token, location->tokenLength));
+        location->node = child;
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    if(container->type == KSBONJSON_NODE_ARRAY)
+    {
+        if(isEqualString(location->token, location->tokenLength, LITERAL("-")))
+        {
+            location->isEndOfArray = true;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        PROPAGATE_ERROR(parseIndex(location->token, location->tokenLength, &location->index));
+        const ksbonjson_documentStatus result = ksbonjson_getElement(document, container, location->index, &location->node);
+        unlikely_if(result != KSBONJSON_DOCUMENT_OK && result != KSBONJSON_DOCUMENT_NOT_FOUND)
+        {
+            return result;
+        }
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    return KSBONJSON_DOCUMENT_NOT_FOUND;
+}
+
+/**
+ * Follow a JSON Pointer (RFC 6901). Every token but the last must lead to an
+ * existing node.
+ */
+static ksbonjson_documentStatus resolvePointer(KSBONJSONDocument* const document,
+                                               const char* const pointer,
+                                               const size_t pointerLength,
+                                               Location* const location)
+{
+    *location = (Location){.node = document->root};
+    unlikely_if(pointerLength > 0 && pointer[0] != '/')
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+
+    const char* pos = pointer;
+    const char* const end = pointer + pointerLength;
+    while(pos < end)
+    {
+        unlikely_if(location->node == NULL)
+        {
+            return KSBONJSON_DOCUMENT_NOT_FOUND;
+        }
+
+        const char* const token = ++pos;
+        while(pos < end && *pos != '/')
+        {
+            if(*pos == '~')
+            {
+                unlikely_if(pos + 1 >= end || (pos[1] != '0' && pos[1] != '1'))
+                {
+                    return KSBONJSON_DOCUMENT_INVALID_PATCH;
+                }
+                pos++;
+            }
+            pos++;
+        }
+
+        *location = (Location)
+        {
+            .parent = location->node,
+            .token = token,
+            .tokenLength = pos - token,
+        };
+        PROPAGATE_ERROR(findChild(document, location));
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static bool isNumber(const KSBONJSONNode* const node)
+{
+    return node->type == KSBONJSON_NODE_INTEGER ||
+           node->type == KSBONJSON_NODE_UINTEGER ||
+           node->type == KSBONJSON_NODE_FLOAT;
+}
+
+/**
+ * Compare two values as JSON values (as a "test" operation does).
+ */
+static ksbonjson_documentStatus isEqualNode(KSBONJSONDocument* const documentA,
+                                            KSBONJSONNode* const a,
+                                            KSBONJSONDocument* const documentB,
+                                            KSBONJSONNode* const b,
+                                            const int depth,
+                                            bool* const isEqual)
+{
+    *isEqual = false;
+    unlikely_if(depth > KSBONJSON_MAX_CONTAINER_DEPTH)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+
+    if(isNumber(a))
+    {
+        *isEqual = isNumber(b) && isEqualNumber(a, b);
+        return KSBONJSON_DOCUMENT_OK;
+    }
+    if(a->type != b->type)
+    {
+        return KSBONJSON_DOCUMENT_OK;
+    }
+
+    KSBONJSONNode* childA = NULL;
+    KSBONJSONNode* childB = NULL;
+    switch(a->type)
+    {
+        case KSBONJSON_NODE_BOOLEAN:
+            *isEqual = a->value.boolean == b->value.boolean;
+            return KSBONJSON_DOCUMENT_OK;
+        case KSBONJSON_NODE_STRING:
+            *isEqual = isEqualString(a->value.string.value, a->value.string.length,
+                                     b->value.string.value, b->value.string.length);
+            return KSBONJSON_DOCUMENT_OK;
+        case KSBONJSON_NODE_ARRAY:
+            for(;;)
+            {
+                PROPAGATE_ERROR(ksbonjson_getNextChild(documentA, a, childA, &childA));
+                PROPAGATE_ERROR(ksbonjson_getNextChild(documentB, b, childB, &childB));
+                if(childA == NULL || childB == NULL)
+                {
+                    *isEqual = childA == childB;
+                    return KSBONJSON_DOCUMENT_OK;
+                }
+                PROPAGATE_ERROR(isEqualNode(documentA, childA, documentB, childB, depth + 1, isEqual));
+                if(!*isEqual)
+                {
+                    return KSBONJSON_DOCUMENT_OK;
+                }
+            }
+        case KSBONJSON_NODE_OBJECT:
+        {
+            // Members can be in any order.
+            size_t memberCount = 0;
+            for(;;)
+            {
+                PROPAGATE_ERROR(ksbonjson_getNextChild(documentA, a, childA, &childA));
+                if(childA == NULL)
+                {
+                    break;
+                }
+                memberCount++;
+                const ksbonjson_documentStatus result = ksbonjson_getMember(documentB, b, childA->name, childA->nameLength, &childB);
+                if(result == KSBONJSON_DOCUMENT_NOT_FOUND)
+                {
+                    return KSBONJSON_DOCUMENT_OK;
+                }
+                PROPAGATE_ERROR(result);
+                PROPAGATE_ERROR(isEqualNode(documentA, childA, documentB, childB, depth + 1, isEqual));
+                if(!*isEqual)
+                {
+                    return KSBONJSON_DOCUMENT_OK;
+                }
+            }
+            PROPAGATE_ERROR(ksbonjson_getFirstChild(documentB, b, &childB));
+            *isEqual = b->childCount == memberCount;
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        default:
+            // KSBONJSON_NODE_NULL
+            *isEqual = true;
+            return KSBONJSON_DOCUMENT_OK;
+    }
+}
+
+/**
+ * Get a member of a patch operation.
+ */
+static ksbonjson_documentStatus getOperand(KSBONJSONDocument* const patch,
+                                           KSBONJSONNode* const operation,
+                                           const char* const name,
+                                           const size_t nameLength,
+                                           KSBONJSONNode** const operand)
+{
+    const ksbonjson_documentStatus result = ksbonjson_getMember(patch, operation, name, nameLength, operand);
+    unlikely_if(result == KSBONJSON_DOCUMENT_NOT_FOUND || result == KSBONJSON_DOCUMENT_WRONG_TYPE)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+    return result;
+}
+
+static ksbonjson_documentStatus getStringOperand(KSBONJSONDocument* const patch,
+                                                 KSBONJSONNode* const operation,
+                                                 const char* const name,
+                                                 const size_t nameLength,
+                                                 const char** const value,
+                                                 size_t* const valueLength)
+{
+    KSBONJSONNode* operand = NULL;
+    PROPAGATE_ERROR(getOperand(patch, operation, name, nameLength, &operand));
+    unlikely_if(operand->type != KSBONJSON_NODE_STRING)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+    *value = operand->value.string.value;
+    *valueLength = operand->value.string.length;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+/**
+ * Put a detached value at a location (the "add" operation).
+ */
+static ksbonjson_documentStatus addValue(KSBONJSONDocument* const document,
+                                         const char* const path,
+                                         const size_t pathLength,
+                                         KSBONJSONNode* const value,
+                                         NameBuffer* const names)
+{
+    Location location;
+    PROPAGATE_ERROR(resolvePointer(document, path, pathLength, &location));
+    KSBONJSONNode* destination = location.node;
+    if(location.parent == NULL)
+    {
+        destination = document->root;
+    }
+    else if(location.parent->type == KSBONJSON_NODE_OBJECT)
+    {
+        if(destination == NULL)
+        {
+            const char* name = NULL;
+            size_t nameLength = 0;
+            PROPAGATE_ERROR(unescapeToken(names, location.token, location.tokenLength, &name, &nameLength));
+            PROPAGATE_ERROR(ksbonjson_addMember(document, location.parent, name, nameLength, &destination));
+        }
+    }
+    else if(location.isEndOfArray)
+    {
+        PROPAGATE_ERROR(ksbonjson_addElement(document, location.parent, &destination));
+    }
+    else
+    {
+        PROPAGATE_ERROR(ksbonjson_insertElement(document, location.parent, location.index, &destination));
+    }
+    return ksbonjson_setValue(destination, value);
+}
+
+/**
+ * Find the node that a path refers to, which must exist.
+ */
+static ksbonjson_documentStatus findNode(KSBONJSONDocument* const document,
+                                         const char* const path,
+                                         const size_t pathLength,
+                                         KSBONJSONNode** const node)
+{
+    Location location;
+    PROPAGATE_ERROR(resolvePointer(document, path, pathLength, &location));
+    unlikely_if(location.node == NULL)
+    {
+        return KSBONJSON_DOCUMENT_NOT_FOUND;
+    }
+    *node = location.node;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static ksbonjson_documentStatus applyOperation(KSBONJSONDocument* const document,
+                                               KSBONJSONDocument* const patch,
+                                               KSBONJSONNode* const operation,
+                                               NameBuffer* const names)
+{
+    const char* op = NULL;
+    size_t opLength = 0;
+    const char* path = NULL;
+    size_t pathLength = 0;
+    const char* from = NULL;
+    size_t fromLength = 0;
+    KSBONJSONNode* value = NULL;
+    KSBONJSONNode* node = NULL;
+    KSBONJSONNode* copy = NULL;
+
+    unlikely_if(operation->type != KSBONJSON_NODE_OBJECT)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+    PROPAGATE_ERROR(getStringOperand(patch, operation, LITERAL("op"), &op, &opLength));
+    PROPAGATE_ERROR(getStringOperand(patch, operation, LITERAL("path"), &path, &pathLength));
+
+    if(isEqualString(op, opLength, LITERAL("add")))
+    {
+        PROPAGATE_ERROR(getOperand(patch, operation, LITERAL("value"), &value));
+        PROPAGATE_ERROR(ksbonjson_copyNode(document, value, &copy));
+        return addValue(document, path, pathLength, copy, names);
+    }
+    if(isEqualString(op, opLength, LITERAL("remove")))
+    {
+        PROPAGATE_ERROR(findNode(document, path, pathLength, &node));
+        return ksbonjson_removeNode(node);
+    }
+    if(isEqualString(op, opLength, LITERAL("replace")))
+    {
+        PROPAGATE_ERROR(getOperand(patch, operation, LITERAL("value"), &value));
+        PROPAGATE_ERROR(findNode(document, path, pathLength, &node));
+        PROPAGATE_ERROR(ksbonjson_copyNode(document, value, &copy));
+        return ksbonjson_setValue(node, copy);
+    }
+    if(isEqualString(op, opLength, LITERAL("move")))
+    {
+        PROPAGATE_ERROR(getStringOperand(patch, operation, LITERAL("from"), &from, &fromLength));
+        if(isEqualString(path, pathLength, from, fromLength))
+        {
+            PROPAGATE_ERROR(findNode(document, from, fromLength, &node));
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        // A value can't be moved into itself.
+        unlikely_if(pathLength > fromLength && memcmp(path, from, fromLength) == 0 && path[fromLength] == '/')
+        {
+            return KSBONJSON_DOCUMENT_INVALID_PATCH;
+        }
+        PROPAGATE_ERROR(findNode(document, from, fromLength, &node));
+        PROPAGATE_ERROR(ksbonjson_removeNode(node));
+        return addValue(document, path, pathLength, node, names);
+    }
+    if(isEqualString(op, opLength, LITERAL("copy")))
+    {
+        PROPAGATE_ERROR(getStringOperand(patch, operation, LITERAL("from"), &from, &fromLength));
+        PROPAGATE_ERROR(findNode(document, from, fromLength, &node));
+        PROPAGATE_ERROR(ksbonjson_copyNode(document, node, &copy));
+        return addValue(document, path, pathLength, copy, names);
+    }
+    if(isEqualString(op, opLength, LITERAL("test")))
+    {
+        bool isEqual = false;
+        PROPAGATE_ERROR(getOperand(patch, operation, LITERAL("value"), &value));
+        const ksbonjson_documentStatus result = findNode(document, path, pathLength, &node);
+        unlikely_if(result == KSBONJSON_DOCUMENT_NOT_FOUND)
+        {
+            return KSBONJSON_DOCUMENT_TEST_FAILED;
+        }
+        PROPAGATE_ERROR(result);
+        PROPAGATE_ERROR(isEqualNode(document, node, patch, value, 0, &isEqual));
+        return isEqual ? KSBONJSON_DOCUMENT_OK : KSBONJSON_DOCUMENT_TEST_FAILED;
+    }
+    return KSBONJSON_DOCUMENT_INVALID_PATCH;
+}
+
+static ksbonjson_documentStatus replaceWithCopy(KSBONJSONDocument* const document,
+                                                KSBONJSONNode* const node,
+                                                const KSBONJSONNode* const source)
+{
+    KSBONJSONNode* copy = NULL;
+    PROPAGATE_ERROR(ksbonjson_copyNode(document, source, &copy));
+    return ksbonjson_setValue(node, copy);
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_applyJSONPatch(KSBONJSONDocument* const document,
+                                                  KSBONJSONDocument* const patch,
+                                                  char* const nameBuffer,
+                                                  const size_t nameBufferLength,
+                                                  size_t* const appliedCount)
+{
+    NameBuffer names =
+    {
+        .buffer = nameBuffer,
+        .length = nameBufferLength,
+    };
+    *appliedCount = 0;
+    unlikely_if(patch->root->type != KSBONJSON_NODE_ARRAY)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATCH;
+    }
+
+    KSBONJSONNode* operation = NULL;
+    for(;;)
+    {
+        PROPAGATE_ERROR(ksbonjson_getNextChild(patch, patch->root, operation, &operation));
+        if(operation == NULL)
+        {
+            return KSBONJSON_DOCUMENT_OK;
+        }
+        PROPAGATE_ERROR(applyOperation(document, patch, operation, &names));
+        (*appliedCount)++;
+    }
+}
+
+ksbonjson_documentStatus ksbonjson_applyMergePatch(KSBONJSONDocument* const document,
+                                                   KSBONJSONDocument* const patch)
+{
+    KSBONJSONNode* const patchRoot = patch->root;
+    if(patchRoot->type != KSBONJSON_NODE_OBJECT)
+    {
+        return replaceWithCopy(document, document->root, patchRoot);
+    }
+
+    // Walk the patch's objects without recursion, keeping the target in step.
+    KSBONJSONNode* patchObject = patchRoot;
+    KSBONJSONNode* target = document->root;
+    KSBONJSONNode* member = NULL;
+    if(target->type != KSBONJSON_NODE_OBJECT)
+    {
+        ksbonjson_setEmptyObject(target);
+    }
+    for(;;)
+    {
+        PROPAGATE_ERROR(ksbonjson_getNextChild(patch, patchObject, member, &member));
+        if(member == NULL)
+        {
+            if(patchObject == patchRoot)
+            {
+                return KSBONJSON_DOCUMENT_OK;
+            }
+            member = patchObject;
+            patchObject = patchObject->parent;
+            target = target->parent;
+            continue;
+        }
+
+        KSBONJSONNode* existing = NULL;
+        const ksbonjson_documentStatus result = ksbonjson_getMember(document, target, member->name, member->nameLength, &existing);
+        unlikely_if(result != KSBONJSON_DOCUMENT_OK && result != KSBONJSON_DOCUMENT_NOT_FOUND)
+        {
+            return result;
+        }
+
+        if(member->type == KSBONJSON_NODE_NULL)
+        {
+            if(existing != NULL)
+            {
+                PROPAGATE_ERROR(ksbonjson_removeNode(existing));
+            }
+            continue;
+        }
+        if(existing == NULL)
+        {
+            PROPAGATE_ERROR(ksbonjson_addMember(document, target, member->name, member->nameLength, &existing));
+        }
+        if(member->type == KSBONJSON_NODE_OBJECT)
+        {
+            if(existing->type != KSBONJSON_NODE_OBJECT)
+            {
+                ksbonjson_setEmptyObject(existing);
+            }
+            patchObject = member;
+            target = existing;
+            member = NULL;
+            continue;
+        }
+        PROPAGATE_ERROR(replaceWithCopy(document, existing, member));
+    }
+}
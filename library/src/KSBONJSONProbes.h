@@ -0,0 +1,75 @@
+//
+//  KSBONJSONProbes.h
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef KSBONJSONProbes_h
+#define KSBONJSONProbes_h
+
+// Static tracepoints (USDT) for tools such as bpftrace, perf, and SystemTap.
+//
+// When KSBONJSON_PROBES is 1, each probe compiles to a single nop instruction
+// plus an ELF note describing where its arguments live. Nothing else happens
+// unless a tracer attaches to it. When 0, the probes don't exist at all.
+//
+// Provider: ksbonjson
+//
+// decode-start(document, length)      ksbonjson_decode() or ksbonjson_decodeChunk() started
+// decode-end(status, consumed)        ksbonjson_decode() or ksbonjson_decodeChunk() finished
+// decode-error(status, offset)        Decoding failed at this offset in the data
+// container-enter(depth, isObject)    The decoder entered a container
+// container-exit(depth)               The decoder left a container
+// encode-flush(data, length, status)  The encoder passed data to addEncodedData
+//
+// Example:
+//   bpftrace -e 'usdt:./libbonjson.so:ksbonjson:decode-error { printf("%d at %d\n", arg0, arg1); }'
+
+#ifndef KSBONJSON_PROBES
+#   define KSBONJSON_PROBES 0
+#endif
+
+#if KSBONJSON_PROBES
+#   include <sys/sdt.h>
+#   define PROBE_DECODE_START(DOCUMENT, LENGTH) \
+        DTRACE_PROBE2(ksbonjson, decode__start, DOCUMENT, LENGTH)
+#   define PROBE_DECODE_END(STATUS, CONSUMED) \
+        DTRACE_PROBE2(ksbonjson, decode__end, STATUS, CONSUMED)
+#   define PROBE_DECODE_ERROR(STATUS, OFFSET) \
+        DTRACE_PROBE2(ksbonjson, decode__error, STATUS, OFFSET)
+#   define PROBE_CONTAINER_ENTER(DEPTH, IS_OBJECT) \
+        DTRACE_PROBE2(ksbonjson, container__enter, DEPTH, IS_OBJECT)
+#   define PROBE_CONTAINER_EXIT(DEPTH) \
+        DTRACE_PROBE1(ksbonjson, container__exit, DEPTH)
+#   define PROBE_ENCODE_FLUSH(DATA, LENGTH, STATUS) \
+        DTRACE_PROBE3(ksbonjson, encode__flush, DATA, LENGTH, STATUS)
+#else
+#   define PROBE_DECODE_START(DOCUMENT, LENGTH) do {} while(0)
+#   define PROBE_DECODE_END(STATUS, CONSUMED) do {} while(0)
+#   define PROBE_DECODE_ERROR(STATUS, OFFSET) do {} while(0)
+#   define PROBE_CONTAINER_ENTER(DEPTH, IS_OBJECT) do {} while(0)
+#   define PROBE_CONTAINER_EXIT(DEPTH) do {} while(0)
+#   define PROBE_ENCODE_FLUSH(DATA, LENGTH, STATUS) do {} while(0)
+#endif
+
+#endif // KSBONJSONProbes_h
@@ -0,0 +1,281 @@
+//
+//  KSBONJSONRecordLog.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONRecordLog.h>
+#include "KSBONJSONCommon.h"
+
+#include <string.h>
+
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_recordStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_RECORD_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+static void writeUInt32(uint8_t* dst, uint32_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t readUInt32(const uint8_t* src)
+{
+    return (uint32_t)src[0] |
+           ((uint32_t)src[1] << 8) |
+           ((uint32_t)src[2] << 16) |
+           ((uint32_t)src[3] << 24);
+}
+
+// The checksum covers the length field too, so that a damaged length can't
+// point the reader at a different (but self-consistent) stretch of the log.
+static uint32_t recordChecksum(const uint8_t* header, const uint8_t* record, size_t recordLength)
+{
+    uint32_t crc = CALL_KERNEL(crc32c)(0xffffffffU, header, header + 4);
+    likely_if(recordLength > 0)
+    {
+        // An empty record can be NULL, which can't be offset.
+        crc = CALL_KERNEL(crc32c)(crc, record, record + recordLength);
+    }
+    return ~crc;
+}
+
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+static ksbonjson_recordStatus flushBuffer(KSBONJSONRecordWriter* writer)
+{
+    likely_if(writer->bufferLength > 0)
+    {
+        const size_t length = writer->bufferLength;
+        writer->bufferLength = 0;
+        return writer->write(writer->buffer, length, writer->userData);
+    }
+    return KSBONJSON_RECORD_OK;
+}
+
+static ksbonjson_recordStatus commit(KSBONJSONRecordWriter* writer, uint64_t now)
+{
+    PROPAGATE_ERROR(flushBuffer(writer));
+    writer->lastCommitTime = now;
+    likely_if(writer->sync != NULL)
+    {
+        return writer->sync(writer->userData);
+    }
+    return KSBONJSON_RECORD_OK;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+uint32_t ksbonjson_crc32c(uint32_t crc, const uint8_t* data, size_t dataLength)
+{
+    return ~CALL_KERNEL(crc32c)(~crc, data, data + dataLength);
+}
+
+ksbonjson_recordStatus ksbonjson_frameRecord(uint8_t* header,
+                                             const uint8_t* record,
+                                             size_t recordLength)
+{
+    unlikely_if(recordLength > KSBONJSON_MAX_RECORD_LENGTH)
+    {
+        return KSBONJSON_RECORD_TOO_LARGE;
+    }
+    writeUInt32(header, (uint32_t)recordLength);
+    writeUInt32(header + 4, recordChecksum(header, record, recordLength));
+    return KSBONJSON_RECORD_OK;
+}
+
+void ksbonjson_beginRecordWriting(KSBONJSONRecordWriter* writer,
+                                  KSBONJSONRecordWriteFunc write,
+                                  KSBONJSONRecordSyncFunc sync,
+                                  void* userData,
+                                  uint8_t* buffer,
+                                  size_t bufferSize,
+                                  uint64_t commitInterval,
+                                  uint64_t now)
+{
+    writer->write = write;
+    writer->sync = sync;
+    writer->userData = userData;
+    writer->buffer = buffer;
+    writer->bufferSize = buffer == NULL ? 0 : bufferSize;
+    writer->bufferLength = 0;
+    writer->commitInterval = commitInterval;
+    writer->lastCommitTime = now;
+}
+
+ksbonjson_recordStatus ksbonjson_appendRecord(KSBONJSONRecordWriter* writer,
+                                              const uint8_t* record,
+                                              size_t recordLength,
+                                              uint64_t now)
+{
+    uint8_t header[KSBONJSON_RECORD_HEADER_SIZE];
+    PROPAGATE_ERROR(ksbonjson_frameRecord(header, record, recordLength));
+
+    const size_t framedLength = KSBONJSON_RECORD_HEADER_SIZE + recordLength;
+    unlikely_if(framedLength > writer->bufferSize - writer->bufferLength)
+    {
+        PROPAGATE_ERROR(flushBuffer(writer));
+    }
+
+    likely_if(framedLength <= writer->bufferSize)
+    {
+        uint8_t* dst = writer->buffer + writer->bufferLength;
+        memcpy(dst, header, KSBONJSON_RECORD_HEADER_SIZE);
+        likely_if(recordLength > 0)
+        {
+            memcpy(dst + KSBONJSON_RECORD_HEADER_SIZE, record, recordLength);
+        }
+        writer->bufferLength += framedLength;
+    }
+    else
+    {
+        // Too big to buffer, so write it in place (the buffer is empty now).
+        PROPAGATE_ERROR(writer->write(header, KSBONJSON_RECORD_HEADER_SIZE, writer->userData));
+        likely_if(recordLength > 0)
+        {
+            PROPAGATE_ERROR(writer->write(record, recordLength, writer->userData));
+        }
+    }
+
+    unlikely_if(now - writer->lastCommitTime >= writer->commitInterval)
+    {
+        return commit(writer, now);
+    }
+    return KSBONJSON_RECORD_OK;
+}
+
+ksbonjson_recordStatus ksbonjson_commitRecords(KSBONJSONRecordWriter* writer, uint64_t now)
+{
+    return commit(writer, now);
+}
+
+void ksbonjson_beginRecordReading(KSBONJSONRecordReader* reader,
+                                  const uint8_t* log,
+                                  size_t logLength)
+{
+    reader->data = log;
+    reader->length = logLength;
+    reader->pos = 0;
+}
+
+ksbonjson_recordStatus ksbonjson_readRecord(KSBONJSONRecordReader* reader,
+                                            const uint8_t** record,
+                                            size_t* recordLength)
+{
+    const size_t remaining = reader->length - reader->pos;
+    unlikely_if(remaining == 0)
+    {
+        return KSBONJSON_RECORD_END;
+    }
+    unlikely_if(remaining < KSBONJSON_RECORD_HEADER_SIZE)
+    {
+        return KSBONJSON_RECORD_TRUNCATED;
+    }
+
+    const uint8_t* header = reader->data + reader->pos;
+    const size_t length = readUInt32(header);
+    unlikely_if(length > remaining - KSBONJSON_RECORD_HEADER_SIZE)
+    {
+        return KSBONJSON_RECORD_TRUNCATED;
+    }
+
+    const uint8_t* payload = header + KSBONJSON_RECORD_HEADER_SIZE;
+    unlikely_if(recordChecksum(header, payload, length) != readUInt32(header + 4))
+    {
+        return KSBONJSON_RECORD_CHECKSUM_MISMATCH;
+    }
+
+    reader->pos += KSBONJSON_RECORD_HEADER_SIZE + length;
+    *record = payload;
+    *recordLength = length;
+    return KSBONJSON_RECORD_OK;
+}
+
+size_t ksbonjson_getValidRecordLogLength(const KSBONJSONRecordReader* reader)
+{
+    return reader->pos;
+}
+
+ksbonjson_recordStatus ksbonjson_recoverRecordLog(const uint8_t* log,
+                                                  size_t logLength,
+                                                  size_t* validLength,
+                                                  size_t* recordCount)
+{
+    KSBONJSONRecordReader reader;
+    ksbonjson_beginRecordReading(&reader, log, logLength);
+    const uint8_t* record;
+    size_t length;
+    size_t count = 0;
+    ksbonjson_recordStatus status;
+    while((status = ksbonjson_readRecord(&reader, &record, &length)) == KSBONJSON_RECORD_OK)
+    {
+        count++;
+    }
+    *validLength = reader.pos;
+    if(recordCount != NULL)
+    {
+        *recordCount = count;
+    }
+    return status;
+}
+
+const char* ksbonjson_recordStatusDescription(ksbonjson_recordStatus status)
+{
+    switch(status)
+    {
+        case KSBONJSON_RECORD_OK:
+            return "Successful completion";
+        case KSBONJSON_RECORD_END:
+            return "There are no more records";
+        case KSBONJSON_RECORD_TRUNCATED:
+            return "The log ends partway through a record";
+        case KSBONJSON_RECORD_CHECKSUM_MISMATCH:
+            return "A record's checksum does not match its contents";
+        case KSBONJSON_RECORD_TOO_LARGE:
+            return "The record is too large";
+        case KSBONJSON_RECORD_COULD_NOT_WRITE:
+            return "Could not write to the log";
+        default:
+            return "(unknown status - was it a user-defined status code?)";
+    }
+}
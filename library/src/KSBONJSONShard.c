@@ -0,0 +1,168 @@
+//
+//  KSBONJSONShard.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONShard.h>
+#include "KSBONJSONCommon.h"
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+ksbonjson_documentStatus ksbonjson_splitArray(const uint8_t* const document,
+                                              const size_t documentLength,
+                                              const size_t shardCount,
+                                              KSBONJSONShard* const shards)
+{
+    unlikely_if(documentLength == 0 || document[0] != TYPE_ARRAY)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    unlikely_if(shardCount == 0 || documentLength < 2)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+
+    // A valid array's elements are everything between its first and last bytes.
+    const uint8_t* const end = document + documentLength;
+    const uint8_t* const elements = document + 1;
+    const uint64_t elementsLength = documentLength - 2;
+    const uint8_t* pos = elements;
+    size_t shard = 0;
+    uint64_t nextShardStart = elementsLength / shardCount;
+    shards[0] = (KSBONJSONShard){.offset = 1};
+    for(;;)
+    {
+        unlikely_if(pos >= end)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        unlikely_if(*pos == TYPE_END)
+        {
+            break;
+        }
+        while(shard + 1 < shardCount && (uint64_t)(pos - elements) >= nextShardStart)
+        {
+            shards[shard].length = (size_t)(pos - document) - shards[shard].offset;
+            shard++;
+            shards[shard] = (KSBONJSONShard){.offset = (size_t)(pos - document)};
+            nextShardStart = elementsLength * (shard + 1) / shardCount;
+        }
+        pos = skipValue(pos, end);
+        unlikely_if(pos == NULL)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_DATA;
+        }
+        shards[shard].elementCount++;
+    }
+    unlikely_if(pos + 1 != end)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+
+    shards[shard].length = (size_t)(pos - document) - shards[shard].offset;
+    while(++shard < shardCount)
+    {
+        shards[shard] = (KSBONJSONShard){.offset = (size_t)(pos - document)};
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_splitIndexedArray(const KSBONJSONIndex* const index,
+                                                     const size_t shardCount,
+                                                     KSBONJSONShard* const shards)
+{
+    unlikely_if(index->kind != KSBONJSON_INDEX_ARRAY)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    unlikely_if(shardCount == 0)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_DATA;
+    }
+    unlikely_if(index->documentLength < 2)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+    // Appending in place moves the array's closing byte.
+    const uint64_t elementsEnd = index->documentLength - 1;
+    unlikely_if(index->document[elementsEnd] != TYPE_END)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    uint64_t offset = 1;
+    uint64_t firstElement = 0;
+    for(size_t i = 0; i < shardCount; i++)
+    {
+        const uint64_t nextFirstElement = index->elementCount * (i + 1) / shardCount;
+        uint64_t nextOffset = elementsEnd;
+        likely_if(nextFirstElement < index->elementCount)
+        {
+            const uint8_t* element;
+            size_t elementLength;
+            PROPAGATE_ERROR(ksbonjson_findIndexedElement(index, nextFirstElement, &element, &elementLength));
+            nextOffset = (uint64_t)(element - index->document);
+        }
+        shards[i] = (KSBONJSONShard)
+        {
+            .offset = (size_t)offset,
+            .length = (size_t)(nextOffset - offset),
+            .elementCount = nextFirstElement - firstElement,
+        };
+        offset = nextOffset;
+        firstElement = nextFirstElement;
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_getArrayElements(const uint8_t* const document,
+                                                    const size_t documentLength,
+                                                    KSBONJSONShard* const shard)
+{
+    unlikely_if(documentLength < 2 || document[0] != TYPE_ARRAY || document[documentLength - 1] != TYPE_END)
+    {
+        return KSBONJSON_DOCUMENT_WRONG_TYPE;
+    }
+    *shard = (KSBONJSONShard){.offset = 1, .length = documentLength - 2};
+    return KSBONJSON_DOCUMENT_OK;
+}
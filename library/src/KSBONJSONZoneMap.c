@@ -0,0 +1,519 @@
+//
+//  KSBONJSONZoneMap.c
+//
+//  Created by Karl Stenerud on 2024-07-07.
+//
+//  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <ksbonjson/KSBONJSONZoneMap.h>
+#include "KSBONJSONCommon.h"
+
+#include <math.h>
+#include <string.h>
+
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+#define PROPAGATE_ERROR(CALL) \
+    do \
+    { \
+        const ksbonjson_documentStatus propagatedResult = CALL; \
+        unlikely_if(propagatedResult != KSBONJSON_DOCUMENT_OK) \
+        { \
+            return propagatedResult; \
+        } \
+    } \
+    while(0)
+
+// "BJSNZMP" and the format version
+static const uint8_t g_zoneMapMagic[8] = {'B', 'J', 'S', 'N', 'Z', 'M', 'P', 1};
+
+// Header fields (each a 64-bit little endian word)
+enum
+{
+    ZONE_MAP_HEADER_MAGIC = 0,
+    ZONE_MAP_HEADER_STRIDE = 8,
+    ZONE_MAP_HEADER_ELEMENT_COUNT = 16,
+    ZONE_MAP_HEADER_DOCUMENT_LENGTH = 24,
+    ZONE_MAP_HEADER_BLOCK_COUNT = 32,
+    ZONE_MAP_HEADER_PATH_COUNT = 40,
+    ZONE_MAP_HEADER_BLOOM_FILTER_SIZE = 48,
+    ZONE_MAP_HEADER_BLOOM_HASH_COUNT = 56,
+};
+
+// The header is followed by each path's length (a 64-bit word), the paths
+// (padded to 8 bytes), and then the blocks. A block holds each path's
+// minimum number, maximum number, and Bloom filter.
+#define PATH_LENGTH_SIZE 8
+#define ZONE_MIN 0
+#define ZONE_MAX 8
+#define ZONE_BLOOM_FILTER 16
+
+#define MAX_BLOOM_HASH_COUNT 8
+
+static double loadFloat64(const uint8_t* const src)
+{
+    const union float64_u u = {.u64 = loadUInt64(src)};
+    return u.f64;
+}
+
+static void storeFloat64(uint8_t* const dst, const double value)
+{
+    const union float64_u u = {.f64 = value};
+    storeUInt64(dst, u.u64);
+}
+
+static uint64_t countBlocks(const KSBONJSONIndex* const index)
+{
+    return index->elementCount / index->stride + (index->elementCount % index->stride != 0);
+}
+
+static size_t pathsEnd(const size_t pathCount, const size_t pathsLength)
+{
+    return KSBONJSON_ZONE_MAP_HEADER_SIZE + pathCount * PATH_LENGTH_SIZE + ((pathsLength + 7) & ~(size_t)7);
+}
+
+static size_t zoneSize(const size_t bloomFilterSize)
+{
+    return ZONE_BLOOM_FILTER + bloomFilterSize;
+}
+
+/**
+ * Choose how many bits of a Bloom filter to set per string, for the fewest
+ * false positives when each element of a block has a different string.
+ */
+static uint64_t chooseBloomHashCount(const uint64_t stride, const size_t bloomFilterSize)
+{
+    // The best count is bits / strings * ln(2)
+    const uint64_t count = ((uint64_t)bloomFilterSize * 8 * 693 / stride + 500) / 1000;
+    return count < 1 ? 1 : count > MAX_BLOOM_HASH_COUNT ? MAX_BLOOM_HASH_COUNT : count;
+}
+
+/**
+ * Get the Nth bit of a string's hash (by double hashing).
+ */
+static uint64_t getBloomBit(const uint64_t hash, const uint64_t n, const size_t bloomFilterSize)
+{
+    const uint64_t step = ((hash >> 32) | (hash << 32)) | 1;
+    return (hash + n * step) % ((uint64_t)bloomFilterSize * 8);
+}
+
+static void addToBloomFilter(uint8_t* const filter,
+                             const size_t bloomFilterSize,
+                             const uint64_t hashCount,
+                             const uint64_t hash)
+{
+    for(uint64_t i = 0; i < hashCount; i++)
+    {
+        const uint64_t bit = getBloomBit(hash, i, bloomFilterSize);
+        filter[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+}
+
+static bool mayBloomFilterContain(const uint8_t* const filter,
+                                  const size_t bloomFilterSize,
+                                  const uint64_t hashCount,
+                                  const uint64_t hash)
+{
+    for(uint64_t i = 0; i < hashCount; i++)
+    {
+        const uint64_t bit = getBloomBit(hash, i, bloomFilterSize);
+        unlikely_if((filter[bit / 8] & (1 << (bit % 8))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find the string that starts at pos.
+ *
+ * @return false if there isn't a string there.
+ */
+static bool findString(const uint8_t* const pos,
+                       const uint8_t* const end,
+                       const uint8_t** const string,
+                       size_t* const stringLength)
+{
+    unlikely_if(*pos != TYPE_STRING)
+    {
+        return false;
+    }
+    const uint8_t* const stringEnd = CALL_KERNEL(findStringTerminator)(pos + 1, end);
+    unlikely_if(stringEnd >= end)
+    {
+        return false;
+    }
+    *string = pos + 1;
+    *stringLength = (size_t)(stringEnd - pos - 1);
+    return true;
+}
+
+/**
+ * Find the number that starts at pos (as a double).
+ *
+ * @return false if there isn't a number there.
+ */
+static bool findNumber(const uint8_t* const pos, const uint8_t* const end, double* const value)
+{
+    Number number;
+    const uint8_t* next;
+    unlikely_if(decodeNumber(pos, end, &number, &next) != KSBONJSON_DOCUMENT_OK)
+    {
+        return false;
+    }
+    *value = toFloat(&number);
+    return true;
+}
+
+/**
+ * Add the value at a path to a block's zone for that path.
+ */
+static void addToZone(uint8_t* const zone,
+                      const size_t bloomFilterSize,
+                      const uint64_t hashCount,
+                      double* const min,
+                      double* const max,
+                      const uint8_t* const value,
+                      const uint8_t* const end)
+{
+    unlikely_if(value == NULL)
+    {
+        return;
+    }
+    const uint8_t* string;
+    size_t stringLength;
+    if(findString(value, end, &string, &stringLength))
+    {
+        likely_if(bloomFilterSize > 0)
+        {
+            addToBloomFilter(zone + ZONE_BLOOM_FILTER, bloomFilterSize, hashCount, hashStringBytes(string, stringLength));
+        }
+        return;
+    }
+    // NaN is never in a range, so it's left out.
+    double number;
+    likely_if(findNumber(value, end, &number))
+    {
+        if(number < *min)
+        {
+            *min = number;
+        }
+        if(number > *max)
+        {
+            *max = number;
+        }
+    }
+}
+
+static bool matchesPredicate(const KSBONJSONZoneMap* const zoneMap,
+                             const KSBONJSONPredicate* const predicate,
+                             const uint8_t* const element,
+                             const uint8_t* const end)
+{
+    const uint8_t* const value = findPointerValue(element,
+                                                  end,
+                                                  zoneMap->paths[predicate->pathIndex],
+                                                  zoneMap->pathLengths[predicate->pathIndex]);
+    unlikely_if(value == NULL)
+    {
+        return false;
+    }
+    if(predicate->string != NULL)
+    {
+        const uint8_t* string;
+        size_t stringLength;
+        return findString(value, end, &string, &stringLength) &&
+               stringLength == predicate->stringLength &&
+               memcmp(string, predicate->string, stringLength) == 0;
+    }
+    double number;
+    return findNumber(value, end, &number) && number >= predicate->min && number <= predicate->max;
+}
+
+
+// ============================================================================
+// API
+// ============================================================================
+
+size_t ksbonjson_zoneMapSize(const KSBONJSONIndex* const index, const KSBONJSONZoneMapOptions* const options)
+{
+    size_t pathsLength = 0;
+    for(size_t i = 0; i < options->pathCount; i++)
+    {
+        pathsLength += options->pathLengths[i];
+    }
+    return pathsEnd(options->pathCount, pathsLength) +
+           (size_t)countBlocks(index) * options->pathCount * zoneSize(options->bloomFilterSize);
+}
+
+ksbonjson_documentStatus ksbonjson_buildZoneMap(const KSBONJSONIndex* const index,
+                                                const KSBONJSONZoneMapOptions* const options,
+                                                uint8_t* const zoneMap,
+                                                const size_t zoneMapSize)
+{
+    const size_t pathCount = options->pathCount;
+    unlikely_if(pathCount > KSBONJSON_MAX_ZONE_PATHS)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_PATH;
+    }
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        unlikely_if(!isValidPointer(options->paths[i], options->pathLengths[i]))
+        {
+            return KSBONJSON_DOCUMENT_INVALID_PATH;
+        }
+    }
+    const size_t size = ksbonjson_zoneMapSize(index, options);
+    unlikely_if(zoneMapSize < size)
+    {
+        return KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL;
+    }
+
+    const size_t bloomFilterSize = options->bloomFilterSize;
+    const uint64_t hashCount = chooseBloomHashCount(index->stride, bloomFilterSize);
+    const uint64_t blockCount = countBlocks(index);
+    memset(zoneMap, 0, size);
+    memcpy(zoneMap, g_zoneMapMagic, sizeof(g_zoneMapMagic));
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_STRIDE, index->stride);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_ELEMENT_COUNT, index->elementCount);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_DOCUMENT_LENGTH, index->documentLength);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_BLOCK_COUNT, blockCount);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_PATH_COUNT, pathCount);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_BLOOM_FILTER_SIZE, bloomFilterSize);
+    storeUInt64(zoneMap + ZONE_MAP_HEADER_BLOOM_HASH_COUNT, hashCount);
+
+    uint8_t* path = zoneMap + KSBONJSON_ZONE_MAP_HEADER_SIZE + pathCount * PATH_LENGTH_SIZE;
+    size_t pathsLength = 0;
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        storeUInt64(zoneMap + KSBONJSON_ZONE_MAP_HEADER_SIZE + i * PATH_LENGTH_SIZE, options->pathLengths[i]);
+        memcpy(path, options->paths[i], options->pathLengths[i]);
+        path += options->pathLengths[i];
+        pathsLength += options->pathLengths[i];
+    }
+
+    const size_t zoneLength = zoneSize(bloomFilterSize);
+    uint8_t* block = zoneMap + pathsEnd(pathCount, pathsLength);
+    for(uint64_t blockIndex = 0; blockIndex < blockCount; blockIndex++, block += pathCount * zoneLength)
+    {
+        double mins[KSBONJSON_MAX_ZONE_PATHS];
+        double maxes[KSBONJSON_MAX_ZONE_PATHS];
+        for(size_t i = 0; i < pathCount; i++)
+        {
+            mins[i] = INFINITY;
+            maxes[i] = -INFINITY;
+        }
+
+        const uint64_t firstElement = blockIndex * index->stride;
+        const uint64_t remaining = index->elementCount - firstElement;
+        const uint64_t elementCount = remaining < index->stride ? remaining : index->stride;
+        const uint8_t* element;
+        size_t elementLength;
+        PROPAGATE_ERROR(ksbonjson_findIndexedElement(index, firstElement, &element, &elementLength));
+        for(uint64_t i = 0;;)
+        {
+            const uint8_t* const end = element + elementLength;
+            for(size_t j = 0; j < pathCount; j++)
+            {
+                addToZone(block + j * zoneLength,
+                          bloomFilterSize,
+                          hashCount,
+                          &mins[j],
+                          &maxes[j],
+                          findPointerValue(element, end, options->paths[j], options->pathLengths[j]),
+                          end);
+            }
+            if(++i == elementCount)
+            {
+                break;
+            }
+            PROPAGATE_ERROR(ksbonjson_nextIndexedElement(index, &element, &elementLength));
+        }
+
+        for(size_t i = 0; i < pathCount; i++)
+        {
+            storeFloat64(block + i * zoneLength + ZONE_MIN, mins[i]);
+            storeFloat64(block + i * zoneLength + ZONE_MAX, maxes[i]);
+        }
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+ksbonjson_documentStatus ksbonjson_openZoneMap(KSBONJSONZoneMap* const zoneMap,
+                                               const uint8_t* const data,
+                                               const size_t dataLength,
+                                               const KSBONJSONIndex* const index)
+{
+    unlikely_if(dataLength < KSBONJSON_ZONE_MAP_HEADER_SIZE ||
+                memcmp(data, g_zoneMapMagic, sizeof(g_zoneMapMagic)) != 0)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    const uint64_t blockCount = loadUInt64(data + ZONE_MAP_HEADER_BLOCK_COUNT);
+    const uint64_t pathCount = loadUInt64(data + ZONE_MAP_HEADER_PATH_COUNT);
+    const uint64_t bloomFilterSize = loadUInt64(data + ZONE_MAP_HEADER_BLOOM_FILTER_SIZE);
+    const uint64_t hashCount = loadUInt64(data + ZONE_MAP_HEADER_BLOOM_HASH_COUNT);
+    unlikely_if(loadUInt64(data + ZONE_MAP_HEADER_STRIDE) != index->stride ||
+                loadUInt64(data + ZONE_MAP_HEADER_ELEMENT_COUNT) != index->elementCount ||
+                loadUInt64(data + ZONE_MAP_HEADER_DOCUMENT_LENGTH) != index->documentLength ||
+                blockCount != countBlocks(index) ||
+                pathCount > KSBONJSON_MAX_ZONE_PATHS ||
+                bloomFilterSize > dataLength ||
+                hashCount < 1 || hashCount > MAX_BLOOM_HASH_COUNT ||
+                dataLength - KSBONJSON_ZONE_MAP_HEADER_SIZE < pathCount * PATH_LENGTH_SIZE)
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    const char* path = (const char*)data + KSBONJSON_ZONE_MAP_HEADER_SIZE + pathCount * PATH_LENGTH_SIZE;
+    size_t pathsLength = 0;
+    for(size_t i = 0; i < pathCount; i++)
+    {
+        const uint64_t pathLength = loadUInt64(data + KSBONJSON_ZONE_MAP_HEADER_SIZE + i * PATH_LENGTH_SIZE);
+        unlikely_if(pathLength > (size_t)((const char*)data + dataLength - path) ||
+                    !isValidPointer(path, pathLength))
+        {
+            return KSBONJSON_DOCUMENT_INVALID_INDEX;
+        }
+        zoneMap->paths[i] = path;
+        zoneMap->pathLengths[i] = pathLength;
+        path += pathLength;
+        pathsLength += pathLength;
+    }
+
+    const size_t blocksStart = pathsEnd(pathCount, pathsLength);
+    const size_t blockSize = pathCount * zoneSize(bloomFilterSize);
+    unlikely_if(blocksStart > dataLength ||
+                (blockSize == 0 ? dataLength != blocksStart :
+                 (dataLength - blocksStart) % blockSize != 0 || (dataLength - blocksStart) / blockSize != blockCount))
+    {
+        return KSBONJSON_DOCUMENT_INVALID_INDEX;
+    }
+
+    zoneMap->index = index;
+    zoneMap->blockCount = blockCount;
+    zoneMap->pathCount = pathCount;
+    zoneMap->blocks = data + blocksStart;
+    zoneMap->blockSize = blockSize;
+    zoneMap->bloomFilterSize = bloomFilterSize;
+    zoneMap->bloomHashCount = hashCount;
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+bool ksbonjson_mayBlockMatch(const KSBONJSONZoneMap* const zoneMap,
+                             const uint64_t block,
+                             const KSBONJSONPredicate* const predicates,
+                             const size_t predicateCount)
+{
+    unlikely_if(block >= zoneMap->blockCount)
+    {
+        return false;
+    }
+    const size_t zoneLength = zoneSize(zoneMap->bloomFilterSize);
+    for(size_t i = 0; i < predicateCount; i++)
+    {
+        const KSBONJSONPredicate* const predicate = &predicates[i];
+        unlikely_if(predicate->pathIndex >= zoneMap->pathCount)
+        {
+            continue;
+        }
+        const uint8_t* const zone = zoneMap->blocks + block * zoneMap->blockSize + predicate->pathIndex * zoneLength;
+        if(predicate->string != NULL)
+        {
+            if(zoneMap->bloomFilterSize > 0 &&
+               !mayBloomFilterContain(zone + ZONE_BLOOM_FILTER,
+                                      zoneMap->bloomFilterSize,
+                                      zoneMap->bloomHashCount,
+                                      hashStringBytes((const uint8_t*)predicate->string, predicate->stringLength)))
+            {
+                return false;
+            }
+        }
+        else if(loadFloat64(zone + ZONE_MAX) < predicate->min || loadFloat64(zone + ZONE_MIN) > predicate->max)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+ksbonjson_documentStatus ksbonjson_scanZoneMap(const KSBONJSONZoneMap* const zoneMap,
+                                               const KSBONJSONPredicate* const predicates,
+                                               const size_t predicateCount,
+                                               const KSBONJSONMatchCallback callback,
+                                               void* const userData,
+                                               uint64_t* scannedBlockCount)
+{
+    uint64_t unusedScannedBlockCount;
+    if(scannedBlockCount == NULL)
+    {
+        scannedBlockCount = &unusedScannedBlockCount;
+    }
+    *scannedBlockCount = 0;
+    for(size_t i = 0; i < predicateCount; i++)
+    {
+        unlikely_if(predicates[i].pathIndex >= zoneMap->pathCount)
+        {
+            return KSBONJSON_DOCUMENT_INVALID_PATH;
+        }
+    }
+
+    const KSBONJSONIndex* const index = zoneMap->index;
+    for(uint64_t block = 0; block < zoneMap->blockCount; block++)
+    {
+        likely_if(!ksbonjson_mayBlockMatch(zoneMap, block, predicates, predicateCount))
+        {
+            continue;
+        }
+        (*scannedBlockCount)++;
+
+        const uint64_t firstElement = block * index->stride;
+        const uint64_t remaining = index->elementCount - firstElement;
+        const uint64_t elementCount = remaining < index->stride ? remaining : index->stride;
+        const uint8_t* element;
+        size_t elementLength;
+        PROPAGATE_ERROR(ksbonjson_findIndexedElement(index, firstElement, &element, &elementLength));
+        for(uint64_t i = 0;;)
+        {
+            size_t j = 0;
+            while(j < predicateCount && matchesPredicate(zoneMap, &predicates[j], element, element + elementLength))
+            {
+                j++;
+            }
+            if(j == predicateCount)
+            {
+                PROPAGATE_ERROR(callback(element, elementLength, firstElement + i, userData));
+            }
+            if(++i == elementCount)
+            {
+                break;
+            }
+            PROPAGATE_ERROR(ksbonjson_nextIndexedElement(index, &element, &elementLength));
+        }
+    }
+    return KSBONJSON_DOCUMENT_OK;
+}
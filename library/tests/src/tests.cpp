@@ -26,9 +26,22 @@
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <limits>
 
 #include <ksbonjson/KSBONJSONEncoder.h>
 #include <ksbonjson/KSBONJSONDecoder.h>
+#include <ksbonjson/KSBONJSONDocument.h>
+#include <ksbonjson/KSBONJSONPatch.h>
+#include <ksbonjson/KSBONJSONDiff.h>
+#include <ksbonjson/KSBONJSONHash.h>
+#include <ksbonjson/KSBONJSONCanonical.h>
+#include <ksbonjson/KSBONJSONColumns.h>
+#include <ksbonjson/KSBONJSONAggregate.h>
+#include <ksbonjson/KSBONJSONRecordLog.h>
+#include <ksbonjson/KSBONJSONIndex.h>
+#include <ksbonjson/KSBONJSONZoneMap.h>
+#include <ksbonjson/KSBONJSONShard.h>
+#include <ksbonjson/KSBONJSONKernels.h>
 
 
 #define REPORT_DECODING false
@@ -713,6 +726,34 @@ void assert_encode_failure(std::vector<std::shared_ptr<Event>> events)
     FAIL();
 }
 
+void assert_decode_chunked(std::vector<uint8_t> document, size_t chunkSize)
+{
+    if(REPORT_DECODING)
+    {
+        printf("\n[assert_decode_chunked]\n");
+    }
+
+    DecoderContext expected;
+    size_t decodedOffset = 0;
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decode(document.data(), document.size(), &expected.callbacks, &expected, &decodedOffset));
+
+    DecoderContext actual;
+    KSBONJSONDecodeContext dContext;
+    ksbonjson_beginDecode(&dContext, &actual.callbacks, &actual);
+    std::vector<uint8_t> pending;
+    for(size_t offset = 0; offset < document.size(); offset += chunkSize)
+    {
+        size_t end = std::min(offset + chunkSize, document.size());
+        pending.insert(pending.end(), document.begin() + offset, document.begin() + end);
+        size_t consumed = 0;
+        ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decodeChunk(&dContext, pending.data(), pending.size(), &consumed));
+        pending.erase(pending.begin(), pending.begin() + consumed);
+    }
+    ASSERT_EQ(0U, pending.size());
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_endDecode(&dContext));
+    assert_events_equal(expected.events, actual.events);
+}
+
 void assert_decode_failure(std::vector<uint8_t> document)
 {
     if(REPORT_DECODING)
@@ -1753,6 +1794,206 @@ TEST(Encoder, string_chunking)
     });
 }
 
+TEST(Encoder, bonjson_contents)
+{
+    EncoderContext eCtx(100);
+    KSBONJSONEncodeContext eContext;
+    std::vector<uint8_t> members = {TYPE_STRING, 'a', TYPE_STRING, SMALL(1), TYPE_STRING, 'b', TYPE_STRING, TYPE_NULL};
+    std::vector<uint8_t> elements = {SMALL(1), TYPE_NULL};
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addBONJSONContents(&eContext, members.data(), members.size()));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "c", 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_EXPECTED_OBJECT_VALUE, ksbonjson_addBONJSONContents(&eContext, members.data(), members.size()));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginArray(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addBONJSONContents(&eContext, elements.data(), elements.size()));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+
+    std::vector<uint8_t> expected = {TYPE_OBJECT};
+    expected.insert(expected.end(), members.begin(), members.end());
+    expected.insert(expected.end(), {TYPE_STRING, 'c', TYPE_STRING, TYPE_ARRAY, SMALL(1), TYPE_NULL, TYPE_END, TYPE_END});
+    ASSERT_EQ(expected, eCtx.get());
+}
+
+TEST(Encoder, append_to_array)
+{
+    const std::vector<uint8_t> document = {TYPE_ARRAY, SMALL(1), TYPE_STRING, 'a', TYPE_STRING, TYPE_END};
+    EncoderContext eCtx(100);
+    KSBONJSONEncodeContext eContext;
+    size_t appendOffset = 0;
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginAppendingToArray(&eContext, addEncodedDataCallback, &eCtx,
+                                                                   document.data(), document.size(), &appendOffset));
+    ASSERT_EQ(document.size() - 1, appendOffset);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addInteger(&eContext, 2));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "b", 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addNull(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_CONTAINERS_ARE_STILL_OPEN, ksbonjson_endEncode(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_CLOSED_TOO_MANY_CONTAINERS, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+
+    std::vector<uint8_t> appended(document.begin(), document.begin() + appendOffset);
+    const std::vector<uint8_t> added = eCtx.get();
+    appended.insert(appended.end(), added.begin(), added.end());
+    const std::vector<uint8_t> expected =
+    {
+        TYPE_ARRAY, SMALL(1), TYPE_STRING, 'a', TYPE_STRING, SMALL(2),
+            TYPE_OBJECT, TYPE_STRING, 'b', TYPE_STRING, TYPE_NULL, TYPE_END,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, appended);
+
+    // Appending nothing rewrites the closing byte
+    const std::vector<uint8_t> empty = {TYPE_ARRAY, TYPE_END};
+    eCtx.reset();
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginAppendingToArray(&eContext, addEncodedDataCallback, &eCtx,
+                                                                   empty.data(), empty.size(), &appendOffset));
+    ASSERT_EQ(1u, appendOffset);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_terminateDocument(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_END}), eCtx.get());
+
+    for(const std::vector<uint8_t>& notAnArray: std::vector<std::vector<uint8_t>>
+    {
+        {},
+        {TYPE_ARRAY},
+        {TYPE_END},
+        {TYPE_ARRAY, SMALL(1)},
+        {TYPE_OBJECT, TYPE_END},
+        {TYPE_INT8, TYPE_END},
+    })
+    {
+        ASSERT_EQ(KSBONJSON_ENCODE_NOT_AN_ARRAY, ksbonjson_beginAppendingToArray(&eContext, addEncodedDataCallback, &eCtx,
+                                                                                 notAnArray.data(), notAnArray.size(), &appendOffset));
+    }
+}
+
+TEST(Encoder, table_rows)
+{
+    const size_t rowCount = 600;
+    const std::string longString(5000, 'x');
+    std::vector<int64_t> ids(rowCount);
+    std::vector<double> prices(rowCount);
+    std::vector<KSBONJSONStringView> names(rowCount);
+    std::vector<uint8_t> priceValidity(rowCount / 8 + 1);
+    for(size_t i = 0; i < rowCount; i++)
+    {
+        ids[i] = (int64_t)(i * i * i * i * i * i) * (i & 1 ? -1 : 1);
+        prices[i] = i % 3 == 0 ? 1.5 : i % 3 == 1 ? 0.1 : (double)i;
+        names[i] = i == 100 ? KSBONJSONStringView{longString.data(), longString.size()} : KSBONJSONStringView{"name", i % 5};
+        priceValidity[i >> 3] |= (uint8_t)((i % 7 != 0) << (i & 7));
+    }
+    KSBONJSONTableColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_TABLE_INT64, ids.data(), nullptr, nullptr, nullptr},
+        {"price", 5, KSBONJSON_TABLE_FLOAT64, nullptr, prices.data(), nullptr, priceValidity.data()},
+        {"name", 4, KSBONJSON_TABLE_STRING, nullptr, nullptr, names.data(), nullptr},
+    };
+
+    // The same rows, one value at a time
+    EncoderContext expectedCtx(100000);
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &expectedCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginArray(&eContext));
+    for(size_t i = 0; i < rowCount; i++)
+    {
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "id", 2));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addInteger(&eContext, ids[i]));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "price", 5));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, i % 7 != 0 ? ksbonjson_addFloat(&eContext, prices[i]) : ksbonjson_addNull(&eContext));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "name", 4));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, names[i].data, names[i].length));
+        ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    }
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+
+    // In two batches
+    EncoderContext eCtx(100000);
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginArray(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addTableRows(&eContext, columns, 3, 400));
+    for(KSBONJSONTableColumn& column: columns)
+    {
+        column.integers = column.integers ? column.integers + 400 : nullptr;
+        column.floats = column.floats ? column.floats + 400 : nullptr;
+        column.strings = column.strings ? column.strings + 400 : nullptr;
+        column.validity = column.validity ? column.validity + 400 / 8 : nullptr;
+    }
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addTableRows(&eContext, columns, 3, rowCount - 400));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    ASSERT_EQ(expectedCtx.get(), eCtx.get());
+}
+
+TEST(Encoder, table_rows_failure_modes)
+{
+    int64_t ids[] = {1};
+    double prices[] = {std::numeric_limits<double>::quiet_NaN()};
+    KSBONJSONStringView names[] = {{nullptr, 0}};
+    KSBONJSONTableColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_TABLE_INT64, ids, nullptr, nullptr, nullptr},
+        {"price", 5, KSBONJSON_TABLE_FLOAT64, nullptr, prices, nullptr, nullptr},
+        {"name", 4, KSBONJSON_TABLE_STRING, nullptr, nullptr, names, nullptr},
+    };
+    EncoderContext eCtx(1000);
+    KSBONJSONEncodeContext eContext;
+
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_NOT_IN_AN_ARRAY, ksbonjson_addTableRows(&eContext, columns, 1, 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "rows", 4));
+    ASSERT_EQ(KSBONJSON_ENCODE_NOT_IN_AN_ARRAY, ksbonjson_addTableRows(&eContext, columns, 1, 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginArray(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addTableRows(&eContext, columns, 1, 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    std::vector<uint8_t> expected = {TYPE_OBJECT, TYPE_STRING, 'r', 'o', 'w', 's', TYPE_STRING,
+                                     TYPE_ARRAY, TYPE_OBJECT, TYPE_STRING, 'i', 'd', TYPE_STRING, SMALL(1), TYPE_END, TYPE_END,
+                                     TYPE_END};
+    ASSERT_EQ(expected, eCtx.get());
+
+    ksbonjson_beginEncode(&eContext, addEncodedDataFailCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_COULD_NOT_ADD_DATA, ksbonjson_addTableRows(&eContext, columns, 1, 1));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addTableRows(&eContext, columns, 1, 0));
+
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_NAN, ksbonjson_addTableRows(&eContext, columns, 2, 1));
+
+    // A bad float past the first buffer's worth of rows fails before any are added
+    std::vector<int64_t> manyIds(400, 1000000);
+    std::vector<double> manyPrices(400, 1.5);
+    manyPrices[300] = std::numeric_limits<double>::infinity();
+    const KSBONJSONTableColumn manyColumns[] =
+    {
+        {"id", 2, KSBONJSON_TABLE_INT64, manyIds.data(), nullptr, nullptr, nullptr},
+        {"price", 5, KSBONJSON_TABLE_FLOAT64, nullptr, manyPrices.data(), nullptr, nullptr},
+    };
+    EncoderContext manyCtx(100000);
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &manyCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_INF, ksbonjson_addTableRows(&eContext, manyColumns, 2, 400));
+    ASSERT_EQ(0U, manyCtx.get().size());
+    // Unless the row is null
+    std::vector<uint8_t> validity(400 / 8, 0xff);
+    validity[300 / 8] &= ~(1 << (300 % 8));
+    KSBONJSONTableColumn nullablePrices = manyColumns[1];
+    nullablePrices.validity = validity.data();
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addTableRows(&eContext, &nullablePrices, 1, 400));
+    ASSERT_EQ(KSBONJSON_ENCODE_NULL_POINTER, ksbonjson_addTableRows(&eContext, columns + 2, 1, 1));
+    columns[0].integers = nullptr;
+    ASSERT_EQ(KSBONJSON_ENCODE_NULL_POINTER, ksbonjson_addTableRows(&eContext, columns, 1, 1));
+    columns[1].type = KSBONJSON_TABLE_STRING;
+    ASSERT_EQ(KSBONJSON_ENCODE_NULL_POINTER, ksbonjson_addTableRows(&eContext, columns + 1, 1, 1));
+    columns[1].type = (ksbonjson_tableColumnType)100;
+    ASSERT_EQ(KSBONJSON_ENCODE_INVALID_COLUMN_TYPE, ksbonjson_addTableRows(&eContext, columns + 1, 1, 1));
+}
+
 TEST(Encoder, containers)
 {
     assert_encode_failure(
@@ -1877,6 +2118,2312 @@ TEST(Decoder, big_number_length_field)
     // assert_decode_failure({0x96, 0x01, 0x00});
 }
 
+TEST(Decoder, chunked)
+{
+    std::vector<uint8_t> document =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'a', TYPE_STRING, TYPE_INT16, 0xe8, 0x03,
+            TYPE_STRING, 'b', 'c', TYPE_STRING, TYPE_ARRAY,
+                TYPE_FLOAT64, 0x58, 0x39, 0xb4, 0xc8, 0x76, 0xbe, 0xf3, 0x3f,
+                TYPE_STRING, 'x', 'y', 'z', TYPE_STRING,
+                TYPE_BIGPOSITIVE, 0x04, 0x01,
+                TYPE_NULL,
+                SMALL(5),
+            TYPE_END,
+        TYPE_END,
+        TYPE_TRUE,
+    };
+    for(size_t chunkSize = 1; chunkSize <= document.size(); chunkSize++)
+    {
+        assert_decode_chunked(document, chunkSize);
+    }
+}
+
+TEST(Decoder, chunked_truncated)
+{
+    DecoderContext dCtx;
+    KSBONJSONDecodeContext dContext;
+    ksbonjson_beginDecode(&dContext, &dCtx.callbacks, &dCtx);
+    std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_INT32, 0x01, 0x02};
+    size_t consumed = 0;
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decodeChunk(&dContext, document.data(), document.size(), &consumed));
+    ASSERT_EQ(1U, consumed);
+    ASSERT_EQ(KSBONJSON_DECODE_UNCLOSED_CONTAINERS, ksbonjson_endDecode(&dContext));
+
+    ksbonjson_beginDecode(&dContext, &dCtx.callbacks, &dCtx);
+    document = {TYPE_ARRAY, TYPE_END, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DECODE_UNBALANCED_CONTAINERS, ksbonjson_decodeChunk(&dContext, document.data(), document.size(), &consumed));
+}
+
+TEST(Decoder, chunked_long_string)
+{
+    std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_STRING};
+    document.insert(document.end(), 1000, 'x');
+    document.insert(document.end(), {TYPE_STRING, TYPE_STRING, 'a', 'b', TYPE_STRING, TYPE_END});
+    for(size_t chunkSize: {1, 7, 64, 999})
+    {
+        assert_decode_chunked(document, chunkSize);
+    }
+}
+
+TEST(Decoder, max_container_depth)
+{
+    std::vector<uint8_t> document(KSBONJSON_MAX_CONTAINER_DEPTH - 1, TYPE_ARRAY);
+    document.insert(document.end(), KSBONJSON_MAX_CONTAINER_DEPTH - 1, TYPE_END);
+    DecoderContext dCtx;
+    size_t decodedOffset = 0;
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decode(document.data(), document.size(), &dCtx.callbacks, &dCtx, &decodedOffset));
+
+    document.assign(KSBONJSON_MAX_CONTAINER_DEPTH, TYPE_ARRAY);
+    document.insert(document.end(), KSBONJSON_MAX_CONTAINER_DEPTH, TYPE_END);
+    ASSERT_EQ(KSBONJSON_DECODE_CONTAINER_DEPTH_EXCEEDED, ksbonjson_decode(document.data(), document.size(), &dCtx.callbacks, &dCtx, &decodedOffset));
+
+    document.assign(10000, TYPE_ARRAY);
+    ASSERT_EQ(KSBONJSON_DECODE_CONTAINER_DEPTH_EXCEEDED, ksbonjson_decode(document.data(), document.size(), &dCtx.callbacks, &dCtx, &decodedOffset));
+}
+
+
+// ------------------------------------
+// Document Tests
+// ------------------------------------
+
+static ksbonjson_encodeStatus addEncodedDataRecordCallback(const uint8_t* KSBONJSON_RESTRICT data,
+                                                           size_t dataLength,
+                                                           void* KSBONJSON_RESTRICT userData)
+{
+    std::vector<std::vector<uint8_t>>* calls = (std::vector<std::vector<uint8_t>>*)userData;
+    calls->push_back(std::vector<uint8_t>(data, data + dataLength));
+    return KSBONJSON_ENCODE_OK;
+}
+
+// Encode a document, returning the data from each addEncodedData call
+static std::vector<std::vector<uint8_t>> encodeDocumentCalls(const KSBONJSONDocument* document)
+{
+    std::vector<std::vector<uint8_t>> calls;
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_encodeDocument(document, &eContext));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    return calls;
+}
+
+static std::vector<uint8_t> encodeDocument(const KSBONJSONDocument* document)
+{
+    std::vector<uint8_t> encoded;
+    for(const std::vector<uint8_t>& call: encodeDocumentCalls(document))
+    {
+        encoded.insert(encoded.end(), call.begin(), call.end());
+    }
+    return encoded;
+}
+
+static const std::vector<uint8_t> g_editableDocument =
+{
+    TYPE_OBJECT,
+        TYPE_STRING, 'i', 'd', TYPE_STRING, TYPE_INT16, 0xe8, 0x03,
+        TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_STRING, 'a', 'b', 'c', TYPE_STRING,
+        TYPE_STRING, 'l', 'i', 's', 't', TYPE_STRING, TYPE_ARRAY,
+            TYPE_TRUE,
+            TYPE_BIGPOSITIVE, 0x04, 0x01,
+            TYPE_OBJECT, TYPE_STRING, 'x', TYPE_STRING, SMALL(1), TYPE_END,
+        TYPE_END,
+    TYPE_END,
+};
+
+TEST(Document, unmodified)
+{
+    KSBONJSONNode nodes[10];
+    KSBONJSONDocument document;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, g_editableDocument.data(), g_editableDocument.size(), nodes, 10));
+
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "id", 2, &node));
+    ASSERT_EQ(KSBONJSON_NODE_INTEGER, node->type);
+    ASSERT_EQ(1000, node->value.integer);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "name", 4, &node));
+    ASSERT_EQ(KSBONJSON_NODE_STRING, node->type);
+    ASSERT_EQ(std::string("abc"), std::string(node->value.string.value, node->value.string.length));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_getMember(&document, document.root, "nam", 3, &node));
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "list", 4, &node));
+    ASSERT_EQ(KSBONJSON_NODE_ARRAY, node->type);
+    ASSERT_FALSE(node->isExpanded);
+    KSBONJSONNode* element = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, node, 1, &element));
+    ASSERT_EQ(KSBONJSON_NODE_UINTEGER, element->type);
+    ASSERT_EQ(1U, element->value.uinteger);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_getElement(&document, node, 3, &element));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_getElement(&document, document.root, 0, &element));
+
+    // Nothing was modified, so the whole document is copied at once.
+    std::vector<std::vector<uint8_t>> calls = encodeDocumentCalls(&document);
+    ASSERT_EQ(1U, calls.size());
+    ASSERT_EQ(g_editableDocument, calls[0]);
+}
+
+TEST(Document, edit)
+{
+    KSBONJSONNode nodes[10];
+    KSBONJSONDocument document;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, g_editableDocument.data(), g_editableDocument.size(), nodes, 10));
+
+    // Only the members up to "id" get expanded.
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "id", 2, &node));
+    ASSERT_EQ(1U, document.root->childCount);
+    ASSERT_EQ(2U, document.nodesUsed);
+    ksbonjson_setInteger(node, 5);
+
+    std::vector<uint8_t> expected =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'i', 'd', TYPE_STRING, SMALL(5),
+            TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_STRING, 'a', 'b', 'c', TYPE_STRING,
+            TYPE_STRING, 'l', 'i', 's', 't', TYPE_STRING, TYPE_ARRAY,
+                TYPE_TRUE,
+                TYPE_BIGPOSITIVE, 0x04, 0x01,
+                TYPE_OBJECT, TYPE_STRING, 'x', TYPE_STRING, SMALL(1), TYPE_END,
+            TYPE_END,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, encodeDocument(&document));
+
+    // The unexpanded members (including the list and its big number) are copied at once.
+    std::vector<uint8_t> rest(g_editableDocument.begin() + 8, g_editableDocument.end() - 1);
+    std::vector<std::vector<uint8_t>> calls = encodeDocumentCalls(&document);
+    ASSERT_NE(calls.end(), std::find(calls.begin(), calls.end(), rest));
+
+    // Once expanded, the unmodified list is copied by itself.
+    std::vector<uint8_t> list(g_editableDocument.begin() + 25, g_editableDocument.end() - 1);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getFirstChild(&document, document.root, &node));
+    ASSERT_EQ(3U, document.root->childCount);
+    calls = encodeDocumentCalls(&document);
+    ASSERT_NE(calls.end(), std::find(calls.begin(), calls.end(), list));
+
+    // Edit inside the list's nested object, replace the list's first element
+    // with a container, and replace the name's value.
+    KSBONJSONNode* list_node = nullptr;
+    KSBONJSONNode* element = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "list", 4, &list_node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, list_node, 2, &element));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, element, "x", 1, &node));
+    ksbonjson_setFloat(node, 1.5);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, list_node, 0, &element));
+    ksbonjson_setEmptyArray(element);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "name", 4, &node));
+    ksbonjson_setString(node, "xy", 2);
+
+    expected =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'i', 'd', TYPE_STRING, SMALL(5),
+            TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_STRING, 'x', 'y', TYPE_STRING,
+            TYPE_STRING, 'l', 'i', 's', 't', TYPE_STRING, TYPE_ARRAY,
+                TYPE_ARRAY, TYPE_END,
+                TYPE_BIGPOSITIVE, 0x04, 0x01,
+                TYPE_OBJECT, TYPE_STRING, 'x', TYPE_STRING, TYPE_FLOAT16, 0xc0, 0x3f, TYPE_END,
+            TYPE_END,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, encodeDocument(&document));
+}
+
+TEST(Document, add_remove)
+{
+    KSBONJSONNode nodes[10];
+    KSBONJSONDocument document;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, g_editableDocument.data(), g_editableDocument.size(), nodes, 10));
+
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "id", 2, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_removeNode(node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getMember(&document, document.root, "list", 4, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_removeNode(node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_removeNode(document.root));
+    ASSERT_EQ(1U, document.root->childCount);
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addMember(&document, document.root, "new", 3, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_addMember(&document, node, "a", 1, &node));
+    ksbonjson_setEmptyObject(node);
+    KSBONJSONNode* member = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addMember(&document, node, "a", 1, &member));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addMember(&document, node, "b", 1, &member));
+    ksbonjson_setEmptyArray(member);
+    KSBONJSONNode* element = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addElement(&document, member, &element));
+    ksbonjson_setBoolean(element, false);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addElement(&document, member, &element));
+    ksbonjson_setUInteger(element, 0xffffffffffffffffULL);
+
+    std::vector<uint8_t> expected =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_STRING, 'a', 'b', 'c', TYPE_STRING,
+            TYPE_STRING, 'n', 'e', 'w', TYPE_STRING, TYPE_OBJECT,
+                TYPE_STRING, 'a', TYPE_STRING, TYPE_NULL,
+                TYPE_STRING, 'b', TYPE_STRING, TYPE_ARRAY,
+                    TYPE_FALSE,
+                    TYPE_UINT64, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                TYPE_END,
+            TYPE_END,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, encodeDocument(&document));
+
+    // Removing the last member and then adding one must keep the list intact.
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_removeNode(node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_addMember(&document, document.root, "z", 1, &node));
+    expected =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_STRING, 'a', 'b', 'c', TYPE_STRING,
+            TYPE_STRING, 'z', TYPE_STRING, TYPE_NULL,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, encodeDocument(&document));
+}
+
+TEST(Document, scalar_root)
+{
+    std::vector<uint8_t> encoded = {TYPE_FLOAT64, 0x58, 0x39, 0xb4, 0xc8, 0x76, 0xbe, 0xf3, 0x3f};
+    KSBONJSONNode nodes[1];
+    KSBONJSONDocument document;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 1));
+    ASSERT_EQ(KSBONJSON_NODE_FLOAT, document.root->type);
+    ASSERT_EQ(1.234, document.root->value.floatingPoint);
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_getFirstChild(&document, document.root, &node));
+    ksbonjson_setNull(document.root);
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_NULL}), encodeDocument(&document));
+}
+
+TEST(Document, failure_modes)
+{
+    KSBONJSONNode nodes[3];
+    KSBONJSONDocument document;
+    std::vector<std::vector<uint8_t>> invalid =
+    {
+        {},
+        {TYPE_ARRAY},
+        {TYPE_END},
+        {TYPE_INT32, 0x01, 0x02},
+        {TYPE_STRING, 'a'},
+        {TYPE_BIGPOSITIVE, 0x08},
+        {TYPE_NULL, TYPE_NULL},
+        {TYPE_ARRAY, TYPE_END, TYPE_NULL},
+    };
+    for(const std::vector<uint8_t>& encoded: invalid)
+    {
+        ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    }
+
+    // Problems inside a container are found when it is expanded.
+    std::vector<uint8_t> encoded = {TYPE_OBJECT, SMALL(1), SMALL(2), TYPE_END};
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_getFirstChild(&document, document.root, &node));
+    encoded = {TYPE_ARRAY, TYPE_END, TYPE_ARRAY, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_getFirstChild(&document, document.root, &node));
+    encoded = {TYPE_ARRAY, TYPE_STRING, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_getFirstChild(&document, document.root, &node));
+    encoded = {TYPE_OBJECT, TYPE_STRING, TYPE_STRING, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_getFirstChild(&document, document.root, &node));
+
+    // Running out of nodes keeps what was expanded so far.
+    encoded = {TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(3), TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OUT_OF_NODES, ksbonjson_getFirstChild(&document, document.root, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, document.root, 1, &node));
+    ASSERT_EQ(2, node->value.integer);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OUT_OF_NODES, ksbonjson_getElement(&document, document.root, 2, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OUT_OF_NODES, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 0));
+}
+
+TEST(Document, move_and_copy)
+{
+    KSBONJSONNode nodes[20];
+    KSBONJSONDocument document;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, g_editableDocument.data(), g_editableDocument.size(), nodes, 20));
+
+    // Iterating expands one child at a time.
+    KSBONJSONNode* node = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getNextChild(&document, document.root, nullptr, &node));
+    ASSERT_EQ(2U, document.nodesUsed);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getNextChild(&document, document.root, node, &node));
+    ASSERT_EQ(3U, document.nodesUsed);
+    ASSERT_EQ(std::string("name"), std::string(node->name, node->nameLength));
+    KSBONJSONNode* name = node;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getNextChild(&document, document.root, node, &node));
+    KSBONJSONNode* list = node;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getNextChild(&document, document.root, node, &node));
+    ASSERT_EQ(nullptr, node);
+
+    // An unmodified copy costs one node.
+    KSBONJSONNode* copy = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_copyNode(&document, list, &copy));
+    ASSERT_EQ(5U, document.nodesUsed);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_setValue(name, list));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_setValue(name, copy));
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_insertElement(&document, list, 1, &node));
+    ksbonjson_setInteger(node, 7);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_insertElement(&document, list, 4, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_insertElement(&document, list, 6, &node));
+
+    // Move the list's first element into the inserted slot at the end.
+    KSBONJSONNode* element = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, list, 0, &element));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_removeNode(element));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_setValue(node, element));
+
+    std::vector<uint8_t> expected =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'i', 'd', TYPE_STRING, TYPE_INT16, 0xe8, 0x03,
+            TYPE_STRING, 'n', 'a', 'm', 'e', TYPE_STRING, TYPE_ARRAY,
+                TYPE_TRUE,
+                TYPE_BIGPOSITIVE, 0x04, 0x01,
+                TYPE_OBJECT, TYPE_STRING, 'x', TYPE_STRING, SMALL(1), TYPE_END,
+            TYPE_END,
+            TYPE_STRING, 'l', 'i', 's', 't', TYPE_STRING, TYPE_ARRAY,
+                SMALL(7),
+                TYPE_BIGPOSITIVE, 0x04, 0x01,
+                TYPE_OBJECT, TYPE_STRING, 'x', TYPE_STRING, SMALL(1), TYPE_END,
+                TYPE_TRUE,
+            TYPE_END,
+        TYPE_END,
+    };
+    ASSERT_EQ(expected, encodeDocument(&document));
+
+    // Moving a partly expanded container keeps its children, and expands
+    // the rest after them.
+    const std::vector<uint8_t> nested =
+    {
+        TYPE_ARRAY, TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(3), SMALL(4), SMALL(5), TYPE_END, SMALL(9), TYPE_END,
+    };
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, nested.data(), nested.size(), nodes, 20));
+    KSBONJSONNode* inner = nullptr;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, document.root, 0, &inner));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, inner, 1, &element));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_removeNode(inner));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, document.root, 0, &node));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_setValue(node, inner));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getElement(&document, node, 2, &element));
+    ASSERT_EQ(std::vector<uint8_t>{SMALL(3)}, std::vector<uint8_t>(element->encoded, element->encoded + element->encodedLength));
+    ksbonjson_setInteger(element, 100);
+    expected = {TYPE_ARRAY, TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(100), SMALL(4), SMALL(5), TYPE_END, TYPE_END};
+    ASSERT_EQ(expected, encodeDocument(&document));
+}
+
+
+// ------------------------------------
+// Patch Tests
+// ------------------------------------
+
+static std::vector<uint8_t> encodedString(const std::string& value)
+{
+    std::vector<uint8_t> encoded = {TYPE_STRING};
+    encoded.insert(encoded.end(), value.begin(), value.end());
+    encoded.push_back(TYPE_STRING);
+    return encoded;
+}
+
+static std::vector<uint8_t> concatenate(std::initializer_list<std::vector<uint8_t>> parts)
+{
+    std::vector<uint8_t> result;
+    for(const std::vector<uint8_t>& part: parts)
+    {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
+
+static std::vector<uint8_t> patchOperation(const char* op,
+                                           const char* path,
+                                           std::vector<uint8_t> value,
+                                           const char* from = nullptr)
+{
+    std::vector<uint8_t> operation = concatenate({
+        {TYPE_OBJECT},
+        encodedString("op"), encodedString(op),
+        encodedString("path"), encodedString(path),
+    });
+    if(!value.empty())
+    {
+        operation = concatenate({operation, encodedString("value"), value});
+    }
+    if(from != nullptr)
+    {
+        operation = concatenate({operation, encodedString("from"), encodedString(from)});
+    }
+    operation.push_back(TYPE_END);
+    return operation;
+}
+
+// {"a":1,"b":[true,null],"c":{"d":"x"}}
+static const std::vector<uint8_t> g_patchableDocument = concatenate({
+    {TYPE_OBJECT},
+        encodedString("a"), {SMALL(1)},
+        encodedString("b"), {TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END},
+        encodedString("c"), {TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END},
+    {TYPE_END},
+});
+
+static ksbonjson_documentStatus applyJSONPatch(const std::vector<uint8_t>& encoded,
+                                               std::vector<std::vector<uint8_t>> operations,
+                                               std::vector<uint8_t>& result,
+                                               size_t* appliedCount = nullptr)
+{
+    std::vector<uint8_t> encodedPatch = {TYPE_ARRAY};
+    for(const std::vector<uint8_t>& operation: operations)
+    {
+        encodedPatch.insert(encodedPatch.end(), operation.begin(), operation.end());
+    }
+    encodedPatch.push_back(TYPE_END);
+
+    KSBONJSONNode nodes[50];
+    KSBONJSONNode patchNodes[50];
+    KSBONJSONDocument document;
+    KSBONJSONDocument patch;
+    char nameBuffer[4];
+    size_t count = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 50));
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&patch, encodedPatch.data(), encodedPatch.size(), patchNodes, 50));
+    ksbonjson_documentStatus status = ksbonjson_applyJSONPatch(&document, &patch, nameBuffer, sizeof(nameBuffer), &count);
+    if(appliedCount != nullptr)
+    {
+        *appliedCount = count;
+    }
+    if(status == KSBONJSON_DOCUMENT_OK)
+    {
+        result = encodeDocument(&document);
+    }
+    return status;
+}
+
+static std::vector<uint8_t> applyMergePatch(const std::vector<uint8_t>& encoded, const std::vector<uint8_t>& encodedPatch)
+{
+    KSBONJSONNode nodes[50];
+    KSBONJSONNode patchNodes[50];
+    KSBONJSONDocument document;
+    KSBONJSONDocument patch;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, encoded.data(), encoded.size(), nodes, 50));
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&patch, encodedPatch.data(), encodedPatch.size(), patchNodes, 50));
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_applyMergePatch(&document, &patch));
+    return encodeDocument(&document);
+}
+
+TEST(Patch, add_remove_replace)
+{
+    std::vector<uint8_t> result;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument,
+    {
+        patchOperation("add", "/e", encodedString("y")),
+        patchOperation("add", "/b/1", {SMALL(5)}),
+        patchOperation("add", "/b/-", {TYPE_FALSE}),
+        patchOperation("remove", "/a", {}),
+        patchOperation("replace", "/c/d", {SMALL(2)}),
+        patchOperation("add", "/c/d", {SMALL(3)}),
+    }, result));
+    std::vector<uint8_t> expected = concatenate({
+        {TYPE_OBJECT},
+            encodedString("b"), {TYPE_ARRAY, TYPE_TRUE, SMALL(5), TYPE_NULL, TYPE_FALSE, TYPE_END},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("d"), {SMALL(3), TYPE_END},
+            encodedString("e"), encodedString("y"),
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, result);
+
+    // Replacing the root.
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument, {patchOperation("replace", "", {TYPE_NULL})}, result));
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_NULL}), result);
+}
+
+TEST(Patch, move_copy)
+{
+    std::vector<uint8_t> result;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument,
+    {
+        patchOperation("copy", "/c/e", {}, "/c"),
+        patchOperation("move", "/b/0", {}, "/c/d"),
+        patchOperation("move", "/a", {}, "/a"),
+    }, result));
+    std::vector<uint8_t> expected = concatenate({
+        {TYPE_OBJECT},
+            encodedString("a"), {SMALL(1)},
+            encodedString("b"), {TYPE_ARRAY}, encodedString("x"), {TYPE_TRUE, TYPE_NULL, TYPE_END},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("e"), {TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END, TYPE_END},
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, result);
+
+    // Moving an array that a test has partly expanded
+    const std::vector<uint8_t> numbers = concatenate({
+        {TYPE_OBJECT}, encodedString("a"), {TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(3), SMALL(4), SMALL(5), TYPE_END}, {TYPE_END},
+    });
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(numbers,
+    {
+        patchOperation("test", "/a/1", {SMALL(2)}),
+        patchOperation("move", "/b", {}, "/a"),
+        patchOperation("replace", "/b/2", {SMALL(100)}),
+    }, result));
+    expected = concatenate({
+        {TYPE_OBJECT}, encodedString("b"), {TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(100), SMALL(4), SMALL(5), TYPE_END}, {TYPE_END},
+    });
+    ASSERT_EQ(expected, result);
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("move", "/c/d/e", {}, "/c")}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, applyJSONPatch(g_patchableDocument, {patchOperation("copy", "/x", {}, "/y")}, result));
+}
+
+TEST(Patch, test)
+{
+    std::vector<uint8_t> result;
+    size_t appliedCount = 0;
+    std::vector<uint8_t> object = concatenate({{TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument,
+    {
+        // Numbers compare by value, whatever their encoding.
+        patchOperation("test", "/a", {TYPE_FLOAT32, 0x00, 0x00, 0x80, 0x3f}),
+        patchOperation("test", "/a", {TYPE_UINT64, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}),
+        patchOperation("test", "/b", {TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END}),
+        patchOperation("test", "/c", object),
+    }, result));
+    ASSERT_EQ(g_patchableDocument, result);
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_TEST_FAILED, applyJSONPatch(g_patchableDocument,
+    {
+        patchOperation("remove", "/a", {}),
+        patchOperation("test", "/a", {SMALL(1)}),
+    }, result, &appliedCount));
+    ASSERT_EQ(1U, appliedCount);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_TEST_FAILED, applyJSONPatch(g_patchableDocument, {patchOperation("test", "/a", {SMALL(2)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_TEST_FAILED, applyJSONPatch(g_patchableDocument, {patchOperation("test", "/b", {TYPE_ARRAY, TYPE_TRUE, TYPE_END})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_TEST_FAILED, applyJSONPatch(g_patchableDocument, {patchOperation("test", "/c", {TYPE_OBJECT, TYPE_END})}, result));
+}
+
+TEST(Patch, escaped_names)
+{
+    std::vector<uint8_t> result;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument,
+    {
+        patchOperation("add", "/a~1~0", {SMALL(1)}),
+        patchOperation("replace", "/a~1~0", {SMALL(2)}),
+        patchOperation("test", "/a~1~0", {SMALL(2)}),
+    }, result));
+    std::vector<uint8_t> expected(g_patchableDocument.begin(), g_patchableDocument.end() - 1);
+    expected = concatenate({expected, encodedString("a/~"), {SMALL(2), TYPE_END}});
+    ASSERT_EQ(expected, result);
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NAME_BUFFER_FULL, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/~0~0~0~0~0", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/~2", {SMALL(1)})}, result));
+}
+
+TEST(Patch, failure_modes)
+{
+    std::vector<uint8_t> result;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, applyJSONPatch(g_patchableDocument, {patchOperation("remove", "/z", {})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/z/y", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/b/3", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/a/b", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, applyJSONPatch(g_patchableDocument, {patchOperation("remove", "", {})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/b/01", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("add", "a", {SMALL(1)})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("add", "/a", {})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {patchOperation("bogus", "/a", {})}, result));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATCH, applyJSONPatch(g_patchableDocument, {{TYPE_NULL}}, result));
+}
+
+TEST(Patch, values_are_spliced)
+{
+    // The value is copied from the patch as is.
+    std::vector<uint8_t> value = {TYPE_ARRAY, TYPE_BIGPOSITIVE, 0x04, 0x01, TYPE_INT16, 0x00, 0x01, TYPE_END};
+    std::vector<uint8_t> result;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, applyJSONPatch(g_patchableDocument, {patchOperation("replace", "/b", value)}, result));
+    ASSERT_NE(result.end(), std::search(result.begin(), result.end(), value.begin(), value.end()));
+}
+
+TEST(Patch, merge)
+{
+    // {"a":null,"c":{"d":null,"e":{"f":2}},"b":"z","g":[1]}
+    std::vector<uint8_t> patch = concatenate({
+        {TYPE_OBJECT},
+            encodedString("a"), {TYPE_NULL},
+            encodedString("c"), {TYPE_OBJECT},
+                encodedString("d"), {TYPE_NULL},
+                encodedString("e"), {TYPE_OBJECT}, encodedString("f"), {SMALL(2), TYPE_END},
+            {TYPE_END},
+            encodedString("b"), encodedString("z"),
+            encodedString("g"), {TYPE_ARRAY, SMALL(1), TYPE_END},
+        {TYPE_END},
+    });
+    std::vector<uint8_t> expected = concatenate({
+        {TYPE_OBJECT},
+            encodedString("b"), encodedString("z"),
+            encodedString("c"), {TYPE_OBJECT}, encodedString("e"), {TYPE_OBJECT}, encodedString("f"), {SMALL(2), TYPE_END, TYPE_END},
+            encodedString("g"), {TYPE_ARRAY, SMALL(1), TYPE_END},
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, applyMergePatch(g_patchableDocument, patch));
+
+    // Anything but an object replaces the target.
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_ARRAY, SMALL(1), TYPE_END}), applyMergePatch(g_patchableDocument, {TYPE_ARRAY, SMALL(1), TYPE_END}));
+    patch = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1), TYPE_END}});
+    ASSERT_EQ(patch, applyMergePatch({SMALL(5)}, patch));
+
+    // An empty patch changes nothing.
+    ASSERT_EQ(g_patchableDocument, applyMergePatch(g_patchableDocument, {TYPE_OBJECT, TYPE_END}));
+}
+
+// ------------------------------------
+// Diff Tests
+// ------------------------------------
+
+static bool isEqualEncoded(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+    bool isEqual = false;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_isEqualEncoded(a.data(), a.size(), b.data(), b.size(), &isEqual));
+    return isEqual;
+}
+
+static std::vector<uint8_t> diff(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to, size_t* operationCount = nullptr)
+{
+    std::vector<std::vector<uint8_t>> calls;
+    KSBONJSONEncodeContext eContext;
+    char pathBuffer[100];
+    size_t count = 0;
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_diff(from.data(), from.size(), to.data(), to.size(), pathBuffer, sizeof(pathBuffer), &eContext, &count));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    if(operationCount != nullptr)
+    {
+        *operationCount = count;
+    }
+    std::vector<uint8_t> encoded;
+    for(const std::vector<uint8_t>& call: calls)
+    {
+        encoded.insert(encoded.end(), call.begin(), call.end());
+    }
+    return encoded;
+}
+
+// Diff two documents, and check that the diff turns one into the other.
+static void assert_diff_applies(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to)
+{
+    std::vector<uint8_t> encodedPatch = diff(from, to);
+    KSBONJSONNode nodes[50];
+    KSBONJSONNode patchNodes[50];
+    KSBONJSONDocument document;
+    KSBONJSONDocument patch;
+    char nameBuffer[100];
+    size_t appliedCount = 0;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&document, from.data(), from.size(), nodes, 50));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_loadDocument(&patch, encodedPatch.data(), encodedPatch.size(), patchNodes, 50));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_applyJSONPatch(&document, &patch, nameBuffer, sizeof(nameBuffer), &appliedCount));
+    ASSERT_TRUE(isEqualEncoded(to, encodeDocument(&document)));
+}
+
+TEST(Diff, equality)
+{
+    ASSERT_TRUE(isEqualEncoded(g_patchableDocument, g_patchableDocument));
+    ASSERT_TRUE(isEqualEncoded({SMALL(5)}, {TYPE_INT16, 0x05, 0x00}));
+    ASSERT_TRUE(isEqualEncoded({SMALL(1)}, {TYPE_FLOAT16, 0x80, 0x3f}));
+    ASSERT_TRUE(isEqualEncoded({TYPE_FLOAT32, 0x00, 0x00, 0xc0, 0x3f}, {TYPE_FLOAT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x3f}));
+    ASSERT_TRUE(isEqualEncoded({TYPE_INT16, 0x80, 0xff}, {TYPE_BIGNEGATIVE, 0x04, 0x80}));
+    ASSERT_FALSE(isEqualEncoded({SMALL(5)}, {SMALL(6)}));
+    ASSERT_FALSE(isEqualEncoded({SMALL(1)}, {TYPE_FLOAT16, 0x90, 0x3f}));
+    ASSERT_FALSE(isEqualEncoded({SMALL(0)}, {TYPE_FALSE}));
+    ASSERT_FALSE(isEqualEncoded({TYPE_ARRAY, TYPE_END}, {TYPE_OBJECT, TYPE_END}));
+
+    // Members can be in any order.
+    std::vector<uint8_t> reordered = concatenate({
+        {TYPE_OBJECT},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END},
+            encodedString("b"), {TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END},
+            encodedString("a"), {TYPE_INT32, 0x01, 0x00, 0x00, 0x00},
+        {TYPE_END},
+    });
+    ASSERT_TRUE(isEqualEncoded(g_patchableDocument, reordered));
+    reordered[reordered.size() - 5] = 2;
+    ASSERT_FALSE(isEqualEncoded(g_patchableDocument, reordered));
+    ASSERT_FALSE(isEqualEncoded(g_patchableDocument, {TYPE_OBJECT, TYPE_END}));
+    ASSERT_FALSE(isEqualEncoded({TYPE_OBJECT, TYPE_END}, g_patchableDocument));
+    ASSERT_FALSE(isEqualEncoded({TYPE_ARRAY, SMALL(1), TYPE_END}, {TYPE_ARRAY, SMALL(1), SMALL(1), TYPE_END}));
+
+    bool isEqual = true;
+    std::vector<uint8_t> invalid = {TYPE_ARRAY, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_isEqualEncoded(invalid.data(), invalid.size(), invalid.data(), invalid.size(), &isEqual));
+    ASSERT_FALSE(isEqual);
+    invalid = {TYPE_OBJECT, SMALL(1), SMALL(1), TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_isEqualEncoded(invalid.data(), invalid.size(), g_patchableDocument.data(), g_patchableDocument.size(), &isEqual));
+}
+
+TEST(Diff, patch)
+{
+    size_t operationCount = 0;
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_ARRAY, TYPE_END}), diff(g_patchableDocument, g_patchableDocument, &operationCount));
+    ASSERT_EQ(0U, operationCount);
+
+    // {"a":1.0,"b":[false,null,5],"c":{"e/~":"x"},"f":"y"}
+    std::vector<uint8_t> changed = concatenate({
+        {TYPE_OBJECT},
+            encodedString("a"), {TYPE_FLOAT16, 0x80, 0x3f},
+            encodedString("b"), {TYPE_ARRAY, TYPE_FALSE, TYPE_NULL, SMALL(5), TYPE_END},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("e/~"), encodedString("x"), {TYPE_END},
+            encodedString("f"), encodedString("y"),
+        {TYPE_END},
+    });
+    std::vector<uint8_t> expected = concatenate({
+        {TYPE_ARRAY},
+            patchOperation("replace", "/b/0", {TYPE_FALSE}),
+            patchOperation("add", "/b/-", {SMALL(5)}),
+            patchOperation("remove", "/c/d", {}),
+            patchOperation("add", "/c/e~1~0", encodedString("x")),
+            patchOperation("add", "/f", encodedString("y")),
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, diff(g_patchableDocument, changed, &operationCount));
+    ASSERT_EQ(5U, operationCount);
+    assert_diff_applies(g_patchableDocument, changed);
+    assert_diff_applies(changed, g_patchableDocument);
+
+    // Added members are found wherever they are.
+    std::vector<uint8_t> ab = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1)}, encodedString("b"), {SMALL(2), TYPE_END}});
+    std::vector<uint8_t> axb = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1)}, encodedString("x"), {SMALL(3)}, encodedString("b"), {SMALL(2), TYPE_END}});
+    std::vector<uint8_t> xba = concatenate({{TYPE_OBJECT}, encodedString("x"), {SMALL(3)}, encodedString("b"), {SMALL(2)}, encodedString("a"), {SMALL(1), TYPE_END}});
+    expected = concatenate({{TYPE_ARRAY}, patchOperation("add", "/x", {SMALL(3)}), {TYPE_END}});
+    ASSERT_EQ(expected, diff(ab, axb));
+    ASSERT_EQ(expected, diff(ab, xba));
+    expected = concatenate({{TYPE_ARRAY}, patchOperation("remove", "/x", {}), {TYPE_END}});
+    ASSERT_EQ(expected, diff(xba, ab));
+
+    // Removed elements are all removed at the same index.
+    expected = concatenate({
+        {TYPE_ARRAY},
+            patchOperation("remove", "/1", {}),
+            patchOperation("remove", "/1", {}),
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, diff({TYPE_ARRAY, SMALL(1), SMALL(2), SMALL(3), TYPE_END}, {TYPE_ARRAY, SMALL(1), TYPE_END}));
+
+    // Different types replace the whole value.
+    expected = concatenate({{TYPE_ARRAY}, patchOperation("replace", "", {TYPE_ARRAY, TYPE_END}), {TYPE_END}});
+    ASSERT_EQ(expected, diff(g_patchableDocument, {TYPE_ARRAY, TYPE_END}));
+    assert_diff_applies({SMALL(1)}, g_patchableDocument);
+}
+
+TEST(Diff, failure_modes)
+{
+    KSBONJSONEncodeContext eContext;
+    char pathBuffer[3];
+    size_t operationCount = 0;
+    std::vector<uint8_t> to = concatenate({{TYPE_OBJECT}, encodedString("abc"), {TYPE_NULL, TYPE_END}});
+    std::vector<uint8_t> from = {TYPE_OBJECT, TYPE_END};
+    EncoderContext eCtx(1000);
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_PATH_BUFFER_FULL, ksbonjson_diff(from.data(), from.size(), to.data(), to.size(), pathBuffer, sizeof(pathBuffer), &eContext, &operationCount));
+    ksbonjson_beginEncode(&eContext, addEncodedDataFailCallback, nullptr);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_COULD_NOT_ENCODE, ksbonjson_diff(from.data(), from.size(), to.data(), to.size(), pathBuffer, sizeof(pathBuffer), &eContext, &operationCount));
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_diff(from.data(), 0, to.data(), to.size(), pathBuffer, sizeof(pathBuffer), &eContext, &operationCount));
+}
+
+// ------------------------------------
+// Hash Tests
+// ------------------------------------
+
+static std::vector<uint8_t> hashDocument(const std::vector<uint8_t>& document,
+                                         int flags = 0,
+                                         ksbonjson_hashAlgorithm algorithm = KSBONJSON_HASH_FAST)
+{
+    std::vector<uint8_t> hash(ksbonjson_hashLength(algorithm));
+    EXPECT_EQ(KSBONJSON_DECODE_OK, ksbonjson_hash(document.data(), document.size(), algorithm, flags, hash.data()));
+    return hash;
+}
+
+TEST(Hash, numbers)
+{
+    ASSERT_EQ(8U, hashDocument({TYPE_NULL}).size());
+    ASSERT_EQ(hashDocument({SMALL(5)}), hashDocument({TYPE_INT32, 0x05, 0x00, 0x00, 0x00}));
+    ASSERT_EQ(hashDocument({SMALL(1)}), hashDocument({TYPE_FLOAT16, 0x80, 0x3f}));
+    ASSERT_EQ(hashDocument({SMALL(0)}), hashDocument({TYPE_FLOAT16, 0x00, 0x80}));
+    ASSERT_EQ(hashDocument({TYPE_FLOAT32, 0x00, 0x00, 0xc0, 0x3f}), hashDocument({TYPE_FLOAT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x3f}));
+    ASSERT_EQ(hashDocument({TYPE_INT16, 0x80, 0xff}), hashDocument({TYPE_BIGNEGATIVE, 0x04, 0x80}));
+    ASSERT_EQ(hashDocument({TYPE_UINT64, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}), hashDocument({SMALL(5)}));
+    ASSERT_NE(hashDocument({TYPE_UINT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80}), hashDocument({TYPE_INT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80}));
+    ASSERT_NE(hashDocument({SMALL(1)}), hashDocument({TYPE_FLOAT16, 0x90, 0x3f}));
+    ASSERT_NE(hashDocument({SMALL(0)}), hashDocument({TYPE_FALSE}));
+    ASSERT_NE(hashDocument({TYPE_NULL}), hashDocument({TYPE_ARRAY, TYPE_END}));
+    ASSERT_NE(hashDocument({TYPE_ARRAY, TYPE_END}), hashDocument({TYPE_OBJECT, TYPE_END}));
+
+    // A word equal to the fast hash's secret doesn't wipe out what came before it.
+    ASSERT_NE(hashDocument({TYPE_ARRAY, SMALL(1), TYPE_UINT64, 0xdb, 0x28, 0xb4, 0xa0, 0xd1, 0x7e, 0x03, 0xe7, TYPE_END}),
+              hashDocument({TYPE_ARRAY, SMALL(2), TYPE_UINT64, 0xdb, 0x28, 0xb4, 0xa0, 0xd1, 0x7e, 0x03, 0xe7, TYPE_END}));
+}
+
+TEST(Hash, member_order)
+{
+    std::vector<uint8_t> reordered = concatenate({
+        {TYPE_OBJECT},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END},
+            encodedString("b"), {TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END},
+            encodedString("a"), {TYPE_INT32, 0x01, 0x00, 0x00, 0x00},
+        {TYPE_END},
+    });
+    ASSERT_NE(hashDocument(g_patchableDocument), hashDocument(reordered));
+    ASSERT_EQ(hashDocument(g_patchableDocument, KSBONJSON_HASH_UNORDERED_MEMBERS), hashDocument(reordered, KSBONJSON_HASH_UNORDERED_MEMBERS));
+    ASSERT_EQ(hashDocument(g_patchableDocument, KSBONJSON_HASH_UNORDERED_MEMBERS, KSBONJSON_HASH_SHA256),
+              hashDocument(reordered, KSBONJSON_HASH_UNORDERED_MEMBERS, KSBONJSON_HASH_SHA256));
+
+    // Names stay with their values.
+    std::vector<uint8_t> ab = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1)}, encodedString("b"), {SMALL(2), TYPE_END}});
+    std::vector<uint8_t> ba = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(2)}, encodedString("b"), {SMALL(1), TYPE_END}});
+    ASSERT_NE(hashDocument(ab, KSBONJSON_HASH_UNORDERED_MEMBERS), hashDocument(ba, KSBONJSON_HASH_UNORDERED_MEMBERS));
+
+    // Element order still matters.
+    std::vector<uint8_t> elements = {TYPE_ARRAY, SMALL(1), SMALL(2), TYPE_END};
+    std::vector<uint8_t> reversed = {TYPE_ARRAY, SMALL(2), SMALL(1), TYPE_END};
+    ASSERT_NE(hashDocument(elements, KSBONJSON_HASH_UNORDERED_MEMBERS), hashDocument(reversed, KSBONJSON_HASH_UNORDERED_MEMBERS));
+}
+
+TEST(Hash, sha256)
+{
+    // SHA-256 of the words {TAG_NULL}, and {TAG_STRING, 100, "aaa..."}
+    std::vector<uint8_t> expected =
+    {
+        0x7c, 0x9f, 0xa1, 0x36, 0xd4, 0x41, 0x3f, 0xa6, 0x17, 0x36, 0x37, 0xe8, 0x83, 0xb6, 0x99, 0x8d,
+        0x32, 0xe1, 0xd6, 0x75, 0xf8, 0x8c, 0xdd, 0xff, 0x9d, 0xcb, 0xcf, 0x33, 0x18, 0x20, 0xf4, 0xb8,
+    };
+    ASSERT_EQ(expected, hashDocument({TYPE_NULL}, 0, KSBONJSON_HASH_SHA256));
+    expected =
+    {
+        0x0a, 0xe3, 0x95, 0x36, 0x73, 0x39, 0x6f, 0xc5, 0xc4, 0xb1, 0xb1, 0x77, 0xcb, 0x44, 0xa3, 0x91,
+        0x4e, 0x2e, 0xba, 0xc4, 0x1a, 0x09, 0x26, 0x37, 0xf5, 0xd9, 0x0a, 0x3d, 0xa0, 0x9c, 0x47, 0x86,
+    };
+    ASSERT_EQ(expected, hashDocument(encodedString(std::string(100, 'a')), 0, KSBONJSON_HASH_SHA256));
+}
+
+TEST(Hash, byte_order)
+{
+    // Pinned, so that a host with a different byte order gets the same hashes
+    // (the string covers whole words and a partial word).
+    std::vector<uint8_t> expected = {0xc3, 0x78, 0xed, 0x9c, 0xdf, 0xc3, 0x21, 0xde};
+    ASSERT_EQ(expected, hashDocument(encodedString("hello, world")));
+
+    // Unordered members sum their hashes as words.
+    const std::vector<uint8_t> object = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1)}, encodedString("b"), {SMALL(2), TYPE_END}});
+    expected =
+    {
+        0x2b, 0x48, 0x19, 0x37, 0xc2, 0xb4, 0x9e, 0x8f, 0xd6, 0x23, 0xcc, 0x0c, 0x85, 0x77, 0x89, 0x1a,
+        0xcc, 0x48, 0x8d, 0x2d, 0xc8, 0x12, 0x81, 0x6b, 0x4a, 0x4b, 0xd6, 0x31, 0x4f, 0xab, 0xee, 0x14,
+    };
+    ASSERT_EQ(expected, hashDocument(object, KSBONJSON_HASH_UNORDERED_MEMBERS, KSBONJSON_HASH_SHA256));
+}
+
+TEST(Hash, incremental)
+{
+    KSBONJSONHashContext hContext;
+    KSBONJSONDecodeContext dContext;
+    std::vector<uint8_t> hash(8);
+    size_t consumed = 0;
+    ksbonjson_beginHash(&hContext, KSBONJSON_HASH_FAST, KSBONJSON_HASH_UNORDERED_MEMBERS);
+    ksbonjson_beginDecode(&dContext, ksbonjson_hashCallbacks(), &hContext);
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decodeChunk(&dContext, g_patchableDocument.data(), 10, &consumed));
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decodeChunk(&dContext, g_patchableDocument.data() + consumed, g_patchableDocument.size() - consumed, &consumed));
+    ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_endDecode(&dContext));
+    ksbonjson_endHash(&hContext, hash.data());
+    ASSERT_EQ(hashDocument(g_patchableDocument, KSBONJSON_HASH_UNORDERED_MEMBERS), hash);
+
+    std::vector<uint8_t> invalid = {TYPE_ARRAY, SMALL(1)};
+    ASSERT_NE(KSBONJSON_DECODE_OK, ksbonjson_hash(invalid.data(), invalid.size(), KSBONJSON_HASH_FAST, 0, hash.data()));
+}
+
+// ------------------------------------
+// Canonical Tests
+// ------------------------------------
+
+static std::vector<uint8_t> canonicalize(const std::vector<uint8_t>& document, size_t memberCount = 20)
+{
+    std::vector<std::vector<uint8_t>> calls;
+    std::vector<KSBONJSONCanonicalMember> members(memberCount);
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_canonicalize(document.data(), document.size(), members.data(), members.size(), &eContext));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    std::vector<uint8_t> encoded;
+    for(const std::vector<uint8_t>& call: calls)
+    {
+        encoded.insert(encoded.end(), call.begin(), call.end());
+    }
+    return encoded;
+}
+
+static bool isCanonical(const std::vector<uint8_t>& document)
+{
+    bool result = false;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_isCanonical(document.data(), document.size(), &result));
+    return result;
+}
+
+TEST(Canonical, numbers)
+{
+    ASSERT_EQ(std::vector<uint8_t>({SMALL(5)}), canonicalize({TYPE_INT32, 0x05, 0x00, 0x00, 0x00}));
+    ASSERT_EQ(std::vector<uint8_t>({SMALL(1)}), canonicalize({TYPE_FLOAT16, 0x80, 0x3f}));
+    ASSERT_EQ(std::vector<uint8_t>({SMALL(0)}), canonicalize({TYPE_FLOAT16, 0x00, 0x80}));
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_FLOAT16, 0xc0, 0x3f}), canonicalize({TYPE_FLOAT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x3f}));
+    ASSERT_EQ(canonicalize({TYPE_INT16, 0x80, 0xff}), canonicalize({TYPE_BIGNEGATIVE, 0x04, 0x80}));
+    ASSERT_EQ(std::vector<uint8_t>({TYPE_UINT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80}),
+              canonicalize({TYPE_FLOAT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0x43}));
+
+    ASSERT_TRUE(isCanonical({SMALL(5)}));
+    ASSERT_TRUE(isCanonical(canonicalize({TYPE_INT16, 0x80, 0xff})));
+    ASSERT_TRUE(isCanonical({TYPE_FLOAT16, 0xc0, 0x3f}));
+    ASSERT_TRUE(isCanonical({TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END}));
+    ASSERT_FALSE(isCanonical({TYPE_INT32, 0x05, 0x00, 0x00, 0x00}));
+    ASSERT_FALSE(isCanonical({TYPE_ARRAY, TYPE_NULL, TYPE_FLOAT32, 0x00, 0x00, 0xc0, 0x3f, TYPE_END}));
+}
+
+TEST(Canonical, member_order)
+{
+    std::vector<uint8_t> reordered = concatenate({
+        {TYPE_OBJECT},
+            encodedString("c"), {TYPE_OBJECT}, encodedString("d"), encodedString("x"), {TYPE_END},
+            encodedString("b"), {TYPE_ARRAY, TYPE_TRUE, TYPE_NULL, TYPE_END},
+            encodedString("a"), {TYPE_INT32, 0x01, 0x00, 0x00, 0x00},
+        {TYPE_END},
+    });
+    ASSERT_EQ(g_patchableDocument, canonicalize(reordered));
+    ASSERT_EQ(g_patchableDocument, canonicalize(g_patchableDocument));
+    ASSERT_TRUE(isCanonical(g_patchableDocument));
+    ASSERT_FALSE(isCanonical(reordered));
+
+    // Names are compared by their bytes, and prefixes come first.
+    std::vector<uint8_t> unsorted = concatenate({
+        {TYPE_OBJECT},
+            encodedString("\xc3\xa9"), {SMALL(1)},
+            encodedString("ab"), {SMALL(2)},
+            encodedString("a"), {SMALL(3)},
+            encodedString("B"), {SMALL(4)},
+        {TYPE_END},
+    });
+    std::vector<uint8_t> sorted = concatenate({
+        {TYPE_OBJECT},
+            encodedString("B"), {SMALL(4)},
+            encodedString("a"), {SMALL(3)},
+            encodedString("ab"), {SMALL(2)},
+            encodedString("\xc3\xa9"), {SMALL(1)},
+        {TYPE_END},
+    });
+    ASSERT_EQ(sorted, canonicalize(unsorted));
+    ASSERT_TRUE(isCanonical(sorted));
+    ASSERT_FALSE(isCanonical(unsorted));
+
+    // [{"b":1,"a":2},[{"d":1,"c":{"f":1,"e":2}}],3]
+    std::vector<uint8_t> nested = concatenate({
+        {TYPE_ARRAY},
+            {TYPE_OBJECT}, encodedString("b"), {SMALL(1)}, encodedString("a"), {SMALL(2), TYPE_END},
+            {TYPE_ARRAY, TYPE_OBJECT},
+                encodedString("d"), {SMALL(1)},
+                encodedString("c"), {TYPE_OBJECT}, encodedString("f"), {SMALL(1)}, encodedString("e"), {SMALL(2), TYPE_END},
+            {TYPE_END, TYPE_END},
+            {TYPE_INT16, 0x03, 0x00},
+        {TYPE_END},
+    });
+    std::vector<uint8_t> expected = concatenate({
+        {TYPE_ARRAY},
+            {TYPE_OBJECT}, encodedString("a"), {SMALL(2)}, encodedString("b"), {SMALL(1), TYPE_END},
+            {TYPE_ARRAY, TYPE_OBJECT},
+                encodedString("c"), {TYPE_OBJECT}, encodedString("e"), {SMALL(2)}, encodedString("f"), {SMALL(1), TYPE_END},
+                encodedString("d"), {SMALL(1)},
+            {TYPE_END, TYPE_END},
+            {SMALL(3)},
+        {TYPE_END},
+    });
+    ASSERT_EQ(expected, canonicalize(nested));
+    ASSERT_TRUE(isCanonical(expected));
+    ASSERT_TRUE(isEqualEncoded(nested, expected));
+}
+
+TEST(Canonical, failure_modes)
+{
+    std::vector<std::vector<uint8_t>> calls;
+    KSBONJSONCanonicalMember members[4];
+    KSBONJSONEncodeContext eContext;
+    bool result = true;
+
+    // The nested object's members are sorted after its parent's.
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_MEMBER_BUFFER_FULL, ksbonjson_canonicalize(g_patchableDocument.data(), g_patchableDocument.size(), members, 3, &eContext));
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_canonicalize(g_patchableDocument.data(), g_patchableDocument.size(), members, 4, &eContext));
+    ksbonjson_beginEncode(&eContext, addEncodedDataFailCallback, nullptr);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_COULD_NOT_ENCODE, ksbonjson_canonicalize(g_patchableDocument.data(), g_patchableDocument.size(), members, 4, &eContext));
+
+    // Duplicate names have no canonical order.
+    std::vector<uint8_t> duplicates = concatenate({{TYPE_OBJECT}, encodedString("b"), {SMALL(1)}, encodedString("a"), {SMALL(2)}, encodedString("b"), {SMALL(3), TYPE_END}});
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_canonicalize(duplicates.data(), duplicates.size(), members, 4, &eContext));
+    duplicates = concatenate({{TYPE_OBJECT}, encodedString("a"), {SMALL(1)}, encodedString("a"), {SMALL(2), TYPE_END}});
+    ASSERT_FALSE(isCanonical(duplicates));
+
+    std::vector<uint8_t> invalid = {TYPE_ARRAY, SMALL(1)};
+    ksbonjson_beginEncode(&eContext, addEncodedDataRecordCallback, &calls);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_canonicalize(invalid.data(), invalid.size(), members, 4, &eContext));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_isCanonical(invalid.data(), invalid.size(), &result));
+    ASSERT_FALSE(result);
+    invalid = concatenate({{TYPE_OBJECT}, encodedString("a"), {TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_isCanonical(invalid.data(), invalid.size(), &result));
+    invalid = {SMALL(1), SMALL(2)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_isCanonical(invalid.data(), invalid.size(), &result));
+}
+
+// ------------------------------------
+// Column Tests
+// ------------------------------------
+
+// [{"id":1,"price":1.5,"name":"a","tags":[1,2]},{"name":"bb","id":300,"price":2},{"id":null},{}]
+static const std::vector<uint8_t> g_records = concatenate({
+    {TYPE_ARRAY},
+        {TYPE_OBJECT},
+            encodedString("id"), {SMALL(1)},
+            encodedString("price"), {TYPE_FLOAT16, 0xc0, 0x3f},
+            encodedString("name"), encodedString("a"),
+            encodedString("tags"), {TYPE_ARRAY, SMALL(1), SMALL(2), TYPE_END},
+        {TYPE_END},
+        {TYPE_OBJECT},
+            encodedString("name"), encodedString("bb"),
+            encodedString("id"), {TYPE_INT16, 0x2c, 0x01},
+            encodedString("price"), {SMALL(2)},
+        {TYPE_END},
+        {TYPE_OBJECT}, encodedString("id"), {TYPE_NULL, TYPE_END},
+        {TYPE_OBJECT, TYPE_END},
+    {TYPE_END},
+});
+
+static std::string sliceString(const std::vector<uint8_t>& document, const KSBONJSONStringSlice& slice)
+{
+    return std::string((const char*)document.data() + slice.offset, slice.length);
+}
+
+TEST(Columns, extract)
+{
+    int64_t ids[4];
+    double prices[4];
+    KSBONJSONStringSlice names[4];
+    uint8_t idValidity = 0;
+    uint8_t priceValidity = 0;
+    uint8_t nameValidity = 0;
+    KSBONJSONColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_COLUMN_INT64, ids, nullptr, nullptr, &idValidity},
+        {"price", 5, KSBONJSON_COLUMN_FLOAT64, nullptr, prices, nullptr, &priceValidity},
+        {"name", 4, KSBONJSON_COLUMN_STRING, nullptr, nullptr, names, &nameValidity},
+    };
+    KSBONJSONColumnExtractor extractor;
+    size_t rowCount = 0;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, g_records.data(), g_records.size(), columns, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(4U, rowCount);
+    ASSERT_EQ(1, ids[0]);
+    ASSERT_EQ(300, ids[1]);
+    ASSERT_EQ(0, ids[2]);
+    ASSERT_EQ(0, ids[3]);
+    ASSERT_EQ(0x03, idValidity);
+    ASSERT_EQ(1.5, prices[0]);
+    ASSERT_EQ(2.0, prices[1]);
+    ASSERT_EQ(0x03, priceValidity);
+    ASSERT_EQ("a", sliceString(g_records, names[0]));
+    ASSERT_EQ("bb", sliceString(g_records, names[1]));
+    ASSERT_EQ(0U, names[2].length);
+    ASSERT_EQ(0x03, nameValidity);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(0U, rowCount);
+
+    // In batches
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, g_records.data(), g_records.size(), columns, 3));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 3, &rowCount));
+    ASSERT_EQ(3U, rowCount);
+    ASSERT_EQ(300, ids[1]);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 3, &rowCount));
+    ASSERT_EQ(1U, rowCount);
+    ASSERT_EQ(0x02, idValidity);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 3, &rowCount));
+    ASSERT_EQ(0U, rowCount);
+
+    // Integral floats fit in integer columns, and integers in float columns.
+    std::vector<uint8_t> converted = concatenate({
+        {TYPE_ARRAY, TYPE_OBJECT},
+            encodedString("id"), {TYPE_FLOAT16, 0x80, 0x3f},
+            encodedString("price"), {TYPE_UINT64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80},
+        {TYPE_END, TYPE_END},
+    });
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, converted.data(), converted.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(1U, rowCount);
+    ASSERT_EQ(1, ids[0]);
+    ASSERT_EQ(9223372036854775808.0, prices[0]);
+}
+
+TEST(Columns, key_table)
+{
+    // Many similar names, so that they collide in the key table.
+    const size_t columnCount = KSBONJSON_MAX_COLUMNS;
+    std::vector<std::string> names;
+    std::vector<int64_t> values(columnCount);
+    std::vector<KSBONJSONColumn> columns;
+    for(size_t i = 0; i < columnCount; i++)
+    {
+        names.push_back("c" + std::to_string(i));
+    }
+    for(size_t i = 0; i < columnCount; i++)
+    {
+        columns.push_back({names[i].c_str(), names[i].size(), KSBONJSON_COLUMN_INT64, &values[i], nullptr, nullptr, nullptr});
+    }
+
+    // Members in reverse order, with others in between.
+    std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_OBJECT};
+    for(size_t i = columnCount; i > 0; i--)
+    {
+        document = concatenate({document, encodedString(names[i - 1]), {SMALL((int)i)}, encodedString("x" + names[i - 1]), {TYPE_TRUE}});
+    }
+    document.insert(document.end(), {TYPE_END, TYPE_END});
+
+    KSBONJSONColumnExtractor extractor;
+    size_t rowCount = 0;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns.data(), columns.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_extractColumns(&extractor, 1, &rowCount));
+    ASSERT_EQ(1U, rowCount);
+    for(size_t i = 0; i < columnCount; i++)
+    {
+        ASSERT_EQ((int64_t)i + 1, values[i]);
+    }
+
+    // Too many columns, or the same one twice
+    columns.push_back(columns[0]);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_COLUMNS, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns.data(), columns.size()));
+    columns[1] = columns[0];
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_COLUMNS, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns.data(), 2));
+}
+
+TEST(Columns, failure_modes)
+{
+    int64_t ids[4];
+    KSBONJSONStringSlice names[4];
+    KSBONJSONColumn columns[] =
+    {
+        {"id", 2, KSBONJSON_COLUMN_INT64, ids, nullptr, nullptr, nullptr},
+        {"name", 4, KSBONJSON_COLUMN_STRING, nullptr, nullptr, names, nullptr},
+    };
+    KSBONJSONColumnExtractor extractor;
+    size_t rowCount = 0;
+
+    std::vector<uint8_t> document = concatenate({
+        {TYPE_ARRAY},
+            {TYPE_OBJECT}, encodedString("id"), {SMALL(1), TYPE_END},
+            {TYPE_OBJECT}, encodedString("id"), {TYPE_FLOAT16, 0xc0, 0x3f, TYPE_END},
+        {TYPE_END},
+    });
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(1U, rowCount);
+
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("name"), {SMALL(1), TYPE_END, TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(0U, rowCount);
+
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("id"), {TYPE_ARRAY, TYPE_END, TYPE_END, TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+
+    document = {TYPE_ARRAY, SMALL(1), TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+
+    document = {TYPE_OBJECT, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("id"), {TYPE_END, TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("other"), {TYPE_INT32, 0x01, TYPE_END}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+
+    document = {TYPE_ARRAY, TYPE_OBJECT, TYPE_END, TYPE_END, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_beginColumnExtraction(&extractor, document.data(), document.size(), columns, 2));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_extractColumns(&extractor, 4, &rowCount));
+    ASSERT_EQ(1U, rowCount);
+}
+
+// ------------------------------------
+// Aggregate Tests
+// ------------------------------------
+
+static KSBONJSONAggregate makeAggregate(const char* path)
+{
+    KSBONJSONAggregate aggregate = {};
+    aggregate.path = path;
+    aggregate.pathLength = strlen(path);
+    return aggregate;
+}
+
+TEST(Aggregate, paths)
+{
+    const double bounds[] = {10, 100};
+    uint64_t buckets[3];
+    KSBONJSONAggregate aggregates[] =
+    {
+        makeAggregate("/*/price"),
+        makeAggregate("/*/id"),
+        makeAggregate("/0/tags/*"),
+        makeAggregate("/1/name"),
+        makeAggregate(""),
+        makeAggregate("/*"),
+        makeAggregate("/4/id"),
+    };
+    aggregates[1].bucketBounds = bounds;
+    aggregates[1].bucketBoundCount = 2;
+    aggregates[1].bucketCounts = buckets;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_aggregate(g_records.data(), g_records.size(), aggregates, 7));
+
+    ASSERT_EQ(2U, aggregates[0].count);
+    ASSERT_EQ(0U, aggregates[0].otherCount);
+    ASSERT_EQ(3.5, aggregates[0].sum);
+    ASSERT_EQ(1.5, aggregates[0].min);
+    ASSERT_EQ(2.0, aggregates[0].max);
+    ASSERT_FALSE(aggregates[0].isIntegerSum);
+
+    ASSERT_EQ(2U, aggregates[1].count);
+    ASSERT_EQ(1U, aggregates[1].otherCount);
+    ASSERT_EQ(301.0, aggregates[1].sum);
+    ASSERT_TRUE(aggregates[1].isIntegerSum);
+    ASSERT_EQ(301, aggregates[1].integerSum);
+    ASSERT_EQ(1U, buckets[0]);
+    ASSERT_EQ(0U, buckets[1]);
+    ASSERT_EQ(1U, buckets[2]);
+
+    ASSERT_EQ(2U, aggregates[2].count);
+    ASSERT_EQ(3, aggregates[2].integerSum);
+    ASSERT_EQ(0U, aggregates[3].count);
+    ASSERT_EQ(1U, aggregates[3].otherCount);
+    ASSERT_EQ(1U, aggregates[4].otherCount);
+    ASSERT_EQ(4U, aggregates[5].otherCount);
+    ASSERT_EQ(0U, aggregates[6].count + aggregates[6].otherCount);
+
+    // Escaped names, and indices that are really names
+    std::vector<uint8_t> document = concatenate({
+        {TYPE_OBJECT},
+            encodedString("a/b"), {TYPE_OBJECT}, encodedString("~"), {SMALL(5), TYPE_END},
+            encodedString("0"), {SMALL(6)},
+            encodedString("list"), {TYPE_ARRAY, SMALL(7), SMALL(8), TYPE_END},
+        {TYPE_END},
+    });
+    KSBONJSONAggregate named[] =
+    {
+        makeAggregate("/a~1b/~0"),
+        makeAggregate("/0"),
+        makeAggregate("/list/1"),
+        makeAggregate("/list/01"),
+    };
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_aggregate(document.data(), document.size(), named, 4));
+    ASSERT_EQ(5, named[0].integerSum);
+    ASSERT_EQ(6, named[1].integerSum);
+    ASSERT_EQ(8, named[2].integerSum);
+    ASSERT_EQ(0U, named[3].count);
+
+    // Integer sums that overflow
+    document = {TYPE_ARRAY,
+                TYPE_INT64, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f,
+                TYPE_INT64, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f,
+                TYPE_END};
+    KSBONJSONAggregate large = makeAggregate("/*");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_aggregate(document.data(), document.size(), &large, 1));
+    ASSERT_EQ(2U, large.count);
+    ASSERT_FALSE(large.isIntegerSum);
+    ASSERT_EQ(2 * 9223372036854775807.0, large.sum);
+}
+
+TEST(Aggregate, failure_modes)
+{
+    KSBONJSONAggregate aggregate = makeAggregate("price");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_aggregate(g_records.data(), g_records.size(), &aggregate, 1));
+    aggregate = makeAggregate("/a~2");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_aggregate(g_records.data(), g_records.size(), &aggregate, 1));
+    aggregate = makeAggregate("/a~");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_aggregate(g_records.data(), g_records.size(), &aggregate, 1));
+    std::string deep;
+    for(int i = 0; i <= KSBONJSON_MAX_PATH_SEGMENTS; i++)
+    {
+        deep += "/*";
+    }
+    aggregate = makeAggregate(deep.c_str());
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_aggregate(g_records.data(), g_records.size(), &aggregate, 1));
+    std::vector<KSBONJSONAggregate> many(KSBONJSON_MAX_AGGREGATES + 1, makeAggregate("/*"));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_aggregate(g_records.data(), g_records.size(), many.data(), many.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_aggregate(g_records.data(), g_records.size(), many.data(), many.size() - 1));
+    ASSERT_EQ(4U, many[KSBONJSON_MAX_AGGREGATES - 1].otherCount);
+
+    aggregate = makeAggregate("/*/id");
+    std::vector<uint8_t> document = {TYPE_ARRAY, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = {TYPE_ARRAY, TYPE_END, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = {TYPE_ARRAY, TYPE_OBJECT, SMALL(1), SMALL(1), TYPE_END, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = {TYPE_ARRAY, TYPE_OBJECT, TYPE_STRING, 'i', 'd'};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("id"), {TYPE_INT32, 0x01}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = concatenate({{TYPE_ARRAY, TYPE_OBJECT}, encodedString("other"), {TYPE_INT32, 0x01}});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+    document = {};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_aggregate(document.data(), document.size(), &aggregate, 1));
+}
+
+// ------------------------------------
+// Record Log Tests
+// ------------------------------------
+
+struct RecordLogFile
+{
+    std::vector<uint8_t> data;
+    std::vector<size_t> writeSizes;
+    int syncCount = 0;
+    bool failWrites = false;
+};
+
+static ksbonjson_recordStatus writeRecordLog(const uint8_t* data, size_t dataLength, void* userData)
+{
+    RecordLogFile* file = (RecordLogFile*)userData;
+    if(file->failWrites)
+    {
+        return KSBONJSON_RECORD_COULD_NOT_WRITE;
+    }
+    file->data.insert(file->data.end(), data, data + dataLength);
+    file->writeSizes.push_back(dataLength);
+    return KSBONJSON_RECORD_OK;
+}
+
+static ksbonjson_recordStatus syncRecordLog(void* userData)
+{
+    ((RecordLogFile*)userData)->syncCount++;
+    return KSBONJSON_RECORD_OK;
+}
+
+static std::vector<std::vector<uint8_t>> readRecordLog(const std::vector<uint8_t>& log, ksbonjson_recordStatus expectedStatus)
+{
+    std::vector<std::vector<uint8_t>> records;
+    KSBONJSONRecordReader reader;
+    ksbonjson_beginRecordReading(&reader, log.data(), log.size());
+    const uint8_t* record;
+    size_t length;
+    ksbonjson_recordStatus status;
+    while((status = ksbonjson_readRecord(&reader, &record, &length)) == KSBONJSON_RECORD_OK)
+    {
+        EXPECT_GE(record, log.data());
+        EXPECT_LE(record + length, log.data() + log.size());
+        records.push_back(std::vector<uint8_t>(record, record + length));
+    }
+    EXPECT_EQ(expectedStatus, status);
+    return records;
+}
+
+TEST(RecordLog, round_trip)
+{
+    std::vector<std::vector<uint8_t>> documents =
+    {
+        {TYPE_ARRAY, SMALL(1), SMALL(2), TYPE_END},
+        {},
+        concatenate({{TYPE_OBJECT}, encodedString("a"), {TYPE_NULL, TYPE_END}}),
+        std::vector<uint8_t>(300, SMALL(5)),
+    };
+
+    RecordLogFile file;
+    uint8_t buffer[100];
+    KSBONJSONRecordWriter writer;
+    ksbonjson_beginRecordWriting(&writer, writeRecordLog, syncRecordLog, &file, buffer, sizeof(buffer), 1000, 0);
+    for(const auto& document: documents)
+    {
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_appendRecord(&writer, document.data(), document.size(), 1));
+    }
+    ASSERT_EQ(0, file.syncCount);
+    ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_commitRecords(&writer, 2));
+    ASSERT_EQ(1, file.syncCount);
+
+    // The record that doesn't fit in the buffer goes straight through
+    ASSERT_EQ((std::vector<size_t>{34, KSBONJSON_RECORD_HEADER_SIZE, 300}), file.writeSizes);
+    ASSERT_EQ(documents, readRecordLog(file.data, KSBONJSON_RECORD_END));
+
+    size_t validLength = 0;
+    size_t recordCount = 0;
+    ASSERT_EQ(KSBONJSON_RECORD_END, ksbonjson_recoverRecordLog(file.data.data(), file.data.size(), &validLength, &recordCount));
+    ASSERT_EQ(file.data.size(), validLength);
+    ASSERT_EQ(documents.size(), recordCount);
+
+    // Framing by hand gives the same bytes
+    std::vector<uint8_t> log;
+    for(const auto& document: documents)
+    {
+        uint8_t header[KSBONJSON_RECORD_HEADER_SIZE];
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_frameRecord(header, document.data(), document.size()));
+        log.insert(log.end(), header, header + sizeof(header));
+        log.insert(log.end(), document.begin(), document.end());
+    }
+    ASSERT_EQ(file.data, log);
+}
+
+TEST(RecordLog, group_commit)
+{
+    const std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_END};
+    RecordLogFile file;
+    uint8_t buffer[1000];
+    KSBONJSONRecordWriter writer;
+    ksbonjson_beginRecordWriting(&writer, writeRecordLog, syncRecordLog, &file, buffer, sizeof(buffer), 10, 100);
+    for(uint64_t now = 100; now < 150; now++)
+    {
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_appendRecord(&writer, document.data(), document.size(), now));
+    }
+    // Commits at 110, 120, 130 and 140, each with all records since the last one
+    ASSERT_EQ(4, file.syncCount);
+    ASSERT_EQ((std::vector<size_t>{110, 100, 100, 100}), file.writeSizes);
+    ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_commitRecords(&writer, 150));
+    ASSERT_EQ(5, file.syncCount);
+    ASSERT_EQ(50U, readRecordLog(file.data, KSBONJSON_RECORD_END).size());
+
+    // An interval of 0 commits every record, and a writer needn't have a buffer
+    file = RecordLogFile();
+    ksbonjson_beginRecordWriting(&writer, writeRecordLog, syncRecordLog, &file, NULL, 0, 0, 0);
+    for(int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_appendRecord(&writer, document.data(), document.size(), 0));
+    }
+    ASSERT_EQ(3, file.syncCount);
+    ASSERT_EQ(3U, readRecordLog(file.data, KSBONJSON_RECORD_END).size());
+
+    file = RecordLogFile();
+    file.failWrites = true;
+    ksbonjson_beginRecordWriting(&writer, writeRecordLog, syncRecordLog, &file, buffer, sizeof(buffer), 0, 0);
+    ASSERT_EQ(KSBONJSON_RECORD_COULD_NOT_WRITE, ksbonjson_appendRecord(&writer, document.data(), document.size(), 0));
+    ASSERT_EQ(0, file.syncCount);
+}
+
+TEST(RecordLog, recovery)
+{
+    RecordLogFile file;
+    uint8_t buffer[1000];
+    KSBONJSONRecordWriter writer;
+    ksbonjson_beginRecordWriting(&writer, writeRecordLog, NULL, &file, buffer, sizeof(buffer), 0, 0);
+    std::vector<std::vector<uint8_t>> documents;
+    std::vector<size_t> ends;
+    for(int i = 0; i < 5; i++)
+    {
+        documents.push_back(std::vector<uint8_t>(i * 7, (uint8_t)SMALL(i)));
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_appendRecord(&writer, documents.back().data(), documents.back().size(), 0));
+        ends.push_back(file.data.size());
+    }
+
+    // Torn tails of every length keep the whole records before them
+    for(size_t length = 0; length < file.data.size(); length++)
+    {
+        std::vector<uint8_t> log(file.data.begin(), file.data.begin() + length);
+        const size_t intact = (size_t)(std::upper_bound(ends.begin(), ends.end(), length) - ends.begin());
+        size_t validLength = 0;
+        size_t recordCount = 0;
+        const ksbonjson_recordStatus status = ksbonjson_recoverRecordLog(log.data(), log.size(), &validLength, &recordCount);
+        ASSERT_EQ(intact, recordCount);
+        ASSERT_EQ(intact == 0 ? 0 : ends[intact - 1], validLength);
+        ASSERT_EQ(validLength == length ? KSBONJSON_RECORD_END : KSBONJSON_RECORD_TRUNCATED, status);
+        ASSERT_EQ(std::vector<std::vector<uint8_t>>(documents.begin(), documents.begin() + intact),
+                  readRecordLog(log, status));
+    }
+
+    // Damage anywhere in a record (including its length) is caught
+    for(size_t offset = ends[1]; offset < ends[2]; offset++)
+    {
+        std::vector<uint8_t> log = file.data;
+        log[offset] ^= 0x10;
+        KSBONJSONRecordReader reader;
+        ksbonjson_beginRecordReading(&reader, log.data(), log.size());
+        const uint8_t* record;
+        size_t length;
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_readRecord(&reader, &record, &length));
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_readRecord(&reader, &record, &length));
+        const ksbonjson_recordStatus status = ksbonjson_readRecord(&reader, &record, &length);
+        ASSERT_TRUE(status == KSBONJSON_RECORD_CHECKSUM_MISMATCH || status == KSBONJSON_RECORD_TRUNCATED);
+        ASSERT_EQ(ends[1], ksbonjson_getValidRecordLogLength(&reader));
+        // The reader stays put
+        ASSERT_EQ(status, ksbonjson_readRecord(&reader, &record, &length));
+    }
+}
+
+// ------------------------------------
+// Index Tests
+// ------------------------------------
+
+static std::vector<uint8_t> encodeIndexedRecord(int64_t id, const std::string& name)
+{
+    EncoderContext eCtx(1000);
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "id", 2));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addInteger(&eContext, id));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "name", 4));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, name.data(), name.size()));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endContainer(&eContext));
+    EXPECT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+    return eCtx.get();
+}
+
+// Records with ids -5000, -4000, ... 14000, then a null, a string id and a duplicate id.
+static std::vector<std::vector<uint8_t>> indexedRecords()
+{
+    std::vector<std::vector<uint8_t>> records;
+    for(int i = 0; i < 20; i++)
+    {
+        records.push_back(encodeIndexedRecord(i * 1000 - 5000, "record" + std::to_string(i)));
+    }
+    records.push_back({TYPE_NULL});
+    records.push_back(concatenate({{TYPE_OBJECT}, encodedString("id"), encodedString("x"), {TYPE_END}}));
+    records.push_back(encodeIndexedRecord(0, "duplicate"));
+    return records;
+}
+
+static std::vector<uint8_t> buildIndex(const std::vector<uint8_t>& document, ksbonjson_indexKind kind, size_t stride, const char* keyPath)
+{
+    const KSBONJSONIndexOptions options = {kind, stride, keyPath, keyPath == NULL ? 0 : strlen(keyPath)};
+    size_t length = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL, ksbonjson_buildIndex(document.data(), document.size(), &options, NULL, 0, &length));
+    std::vector<uint8_t> index(length);
+    size_t smallerLength = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL, ksbonjson_buildIndex(document.data(), document.size(), &options, index.data(), length - 1, &smallerLength));
+    EXPECT_EQ(length, smallerLength);
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_buildIndex(document.data(), document.size(), &options, index.data(), index.size(), &length));
+    EXPECT_EQ(index.size(), length);
+    return index;
+}
+
+static std::vector<uint8_t> indexedElement(const KSBONJSONIndex& index, uint64_t elementIndex)
+{
+    const uint8_t* value = nullptr;
+    size_t valueLength = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedElement(&index, elementIndex, &value, &valueLength));
+    return std::vector<uint8_t>(value, value + valueLength);
+}
+
+static std::vector<uint8_t> keyedElement(const KSBONJSONIndex& index, int64_t key)
+{
+    const uint8_t* value = nullptr;
+    size_t valueLength = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedInteger(&index, key, &value, &valueLength));
+    return std::vector<uint8_t>(value, value + valueLength);
+}
+
+static std::vector<uint8_t> keyedElement(const KSBONJSONIndex& index, const std::string& key)
+{
+    const uint8_t* value = nullptr;
+    size_t valueLength = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedString(&index, key.data(), key.size(), &value, &valueLength));
+    return std::vector<uint8_t>(value, value + valueLength);
+}
+
+TEST(Index, array)
+{
+    const std::vector<std::vector<uint8_t>> records = indexedRecords();
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    for(const auto& record: records)
+    {
+        document.insert(document.end(), record.begin(), record.end());
+    }
+    document.push_back(TYPE_END);
+
+    for(size_t stride: {0, 1, 3, 100})
+    {
+        SCOPED_TRACE(stride);
+        const std::vector<uint8_t> data = buildIndex(document, KSBONJSON_INDEX_ARRAY, stride, "/id");
+        KSBONJSONIndex index;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size()));
+        ASSERT_EQ(records.size(), index.elementCount);
+        ASSERT_EQ(std::string("/id"), std::string(index.keyPath, index.keyPathLength));
+
+        for(size_t i = 0; i < records.size(); i++)
+        {
+            ASSERT_EQ(records[i], indexedElement(index, i));
+        }
+        for(int i = 0; i < 20; i++)
+        {
+            ASSERT_EQ(records[i], keyedElement(index, i * 1000 - 5000));
+        }
+        ASSERT_EQ(records[21], keyedElement(index, "x"));
+
+        const uint8_t* value;
+        size_t valueLength;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedElement(&index, 2, &value, &valueLength));
+        for(size_t i = 3; i < records.size(); i++)
+        {
+            ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_nextIndexedElement(&index, &value, &valueLength));
+            ASSERT_EQ(records[i], std::vector<uint8_t>(value, value + valueLength));
+        }
+        ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_nextIndexedElement(&index, &value, &valueLength));
+        ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedElement(&index, records.size(), &value, &valueLength));
+        ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedInteger(&index, 1, &value, &valueLength));
+        ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedString(&index, "record1", 7, &value, &valueLength));
+        ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedString(&index, "", 0, &value, &valueLength));
+    }
+
+    // Floats with integer values are keyed as integers
+    const std::vector<uint8_t> floats = concatenate({
+        {TYPE_ARRAY, TYPE_OBJECT}, encodedString("id"), {TYPE_FLOAT16, 0x20, 0x40, TYPE_END},
+        {TYPE_OBJECT}, encodedString("id"), {TYPE_FLOAT16, 0x40, 0x40, TYPE_END, TYPE_END},
+    });
+    const std::vector<uint8_t> floatData = buildIndex(floats, KSBONJSON_INDEX_ARRAY, 1, "/id");
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, floatData.data(), floatData.size(), floats.data(), floats.size()));
+    ASSERT_EQ(indexedElement(index, 1), keyedElement(index, 3));
+    const uint8_t* value;
+    size_t valueLength;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedInteger(&index, 2, &value, &valueLength));
+
+    // Without keys
+    const std::vector<uint8_t> data = buildIndex(document, KSBONJSON_INDEX_ARRAY, 4, NULL);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size()));
+    ASSERT_EQ(records[13], indexedElement(index, 13));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedInteger(&index, 0, &value, &valueLength));
+
+    // Elements appended in place of the closing byte aren't visited
+    std::vector<uint8_t> appended(document.begin(), document.end() - 1);
+    appended.insert(appended.end(), {SMALL(1), SMALL(2), TYPE_END});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), appended.data(), appended.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedElement(&index, records.size() - 1, &value, &valueLength));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_nextIndexedElement(&index, &value, &valueLength));
+}
+
+TEST(Index, sequences_and_logs)
+{
+    const std::vector<std::vector<uint8_t>> records = indexedRecords();
+    std::vector<uint8_t> sequence;
+    std::vector<uint8_t> log;
+    for(const auto& record: records)
+    {
+        sequence.insert(sequence.end(), record.begin(), record.end());
+        uint8_t header[KSBONJSON_RECORD_HEADER_SIZE];
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_frameRecord(header, record.data(), record.size()));
+        log.insert(log.end(), header, header + sizeof(header));
+        log.insert(log.end(), record.begin(), record.end());
+    }
+
+    std::vector<uint8_t> data = buildIndex(sequence, KSBONJSON_INDEX_SEQUENCE, 2, "/name");
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), sequence.data(), sequence.size()));
+    ASSERT_EQ(records.size(), index.elementCount);
+    ASSERT_EQ(records[7], keyedElement(index, "record7"));
+    ASSERT_EQ(records[22], keyedElement(index, "duplicate"));
+    ASSERT_EQ(records[21], indexedElement(index, 21));
+
+    // Elements appended after indexing don't invalidate the index
+    data = buildIndex(log, KSBONJSON_INDEX_RECORD_LOG, 5, "/id");
+    const std::vector<uint8_t> appended = concatenate({log, log});
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), appended.data(), appended.size()));
+    ASSERT_EQ(records.size(), index.elementCount);
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        ASSERT_EQ(records[i], indexedElement(index, i));
+    }
+    ASSERT_EQ(records[5], keyedElement(index, 0));
+    ASSERT_EQ(records[19], keyedElement(index, 14000));
+
+    // Paths into nested values, and an empty path for the elements themselves
+    const std::vector<uint8_t> nested = concatenate(
+    {
+        {TYPE_OBJECT}, encodedString("a/b"), {TYPE_ARRAY, SMALL(5), TYPE_INT16, 0xe8, 0x03, TYPE_END}, {TYPE_END},
+        {TYPE_OBJECT}, encodedString("a~b"), {TYPE_ARRAY, SMALL(5), SMALL(6), TYPE_END}, {TYPE_END},
+    });
+    data = buildIndex(nested, KSBONJSON_INDEX_SEQUENCE, 1, "/a~1b/1");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), nested.data(), nested.size()));
+    ASSERT_EQ(indexedElement(index, 0), keyedElement(index, 1000));
+    const uint8_t* value;
+    size_t valueLength;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_findIndexedInteger(&index, 6, &value, &valueLength));
+    data = buildIndex(nested, KSBONJSON_INDEX_SEQUENCE, 1, "/a~0b/1");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), nested.data(), nested.size()));
+    ASSERT_EQ(indexedElement(index, 1), keyedElement(index, 6));
+
+    const std::vector<uint8_t> scalars = concatenate({{SMALL(1)}, encodedString("a"), {TYPE_INT64, 0, 0, 0, 0, 0, 0, 0, 0x80}});
+    data = buildIndex(scalars, KSBONJSON_INDEX_SEQUENCE, 1, "");
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), scalars.data(), scalars.size()));
+    ASSERT_EQ(std::vector<uint8_t>{SMALL(1)}, keyedElement(index, 1));
+    ASSERT_EQ(encodedString("a"), keyedElement(index, "a"));
+    ASSERT_EQ(indexedElement(index, 2), keyedElement(index, INT64_MIN));
+}
+
+TEST(Index, many_keys)
+{
+    // Enough keys to be sorted in buckets, and duplicates that all land in one bucket
+    std::vector<uint8_t> document;
+    std::vector<size_t> offsets;
+    for(int i = 0; i < 20000; i++)
+    {
+        offsets.push_back(document.size());
+        const int key = i < 10000 ? i * 7 : i % 3;
+        document.insert(document.end(), {TYPE_INT32, (uint8_t)key, (uint8_t)(key >> 8), (uint8_t)(key >> 16), 0});
+    }
+
+    const std::vector<uint8_t> data = buildIndex(document, KSBONJSON_INDEX_SEQUENCE, 16, "");
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size()));
+    for(int i = 0; i < 10000; i++)
+    {
+        const uint8_t* value;
+        size_t valueLength;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedInteger(&index, i * 7, &value, &valueLength));
+        ASSERT_EQ(offsets[i], (size_t)(value - document.data()));
+    }
+    for(int key = 1; key < 3; key++)
+    {
+        // The first element with the key
+        const uint8_t* value;
+        size_t valueLength;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_findIndexedInteger(&index, key, &value, &valueLength));
+        ASSERT_EQ(offsets[10000 + key - 1], (size_t)(value - document.data()));
+    }
+}
+
+TEST(Index, failure_modes)
+{
+    const std::vector<uint8_t> document = {TYPE_ARRAY, SMALL(1), SMALL(2), TYPE_END};
+    size_t length = 0;
+    uint8_t buffer[1000];
+    for(const char* path: {"id", "/a~2", "/a~"})
+    {
+        const KSBONJSONIndexOptions options = {KSBONJSON_INDEX_ARRAY, 1, path, strlen(path)};
+        ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_buildIndex(document.data(), document.size(), &options, buffer, sizeof(buffer), &length));
+    }
+
+    const KSBONJSONIndexOptions arrayOptions = {KSBONJSON_INDEX_ARRAY, 1, NULL, 0};
+    std::vector<uint8_t> bad = {TYPE_OBJECT, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_buildIndex(bad.data(), bad.size(), &arrayOptions, buffer, sizeof(buffer), &length));
+    bad = {TYPE_ARRAY, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_buildIndex(bad.data(), bad.size(), &arrayOptions, buffer, sizeof(buffer), &length));
+    bad = {TYPE_ARRAY, TYPE_END, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_buildIndex(bad.data(), bad.size(), &arrayOptions, buffer, sizeof(buffer), &length));
+    bad = {SMALL(1), TYPE_STRING, 'a'};
+    const KSBONJSONIndexOptions sequenceOptions = {KSBONJSON_INDEX_SEQUENCE, 1, NULL, 0};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_buildIndex(bad.data(), bad.size(), &sequenceOptions, buffer, sizeof(buffer), &length));
+    const KSBONJSONIndexOptions logOptions = {KSBONJSON_INDEX_RECORD_LOG, 1, NULL, 0};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_buildIndex(bad.data(), bad.size(), &logOptions, buffer, sizeof(buffer), &length));
+
+    const std::vector<uint8_t> data = buildIndex(document, KSBONJSON_INDEX_ARRAY, 1, "/x");
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, data.data(), data.size() - 1, document.data(), document.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, data.data(), 10, document.data(), document.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, data.data(), data.size(), document.data(), document.size() - 1));
+    for(size_t i = 0; i < KSBONJSON_INDEX_HEADER_SIZE; i++)
+    {
+        // Corrupting any count or the magic number is caught
+        if(i >= 32 && i < 40)
+        {
+            continue; // The document length (checked above)
+        }
+        std::vector<uint8_t> corrupted = data;
+        corrupted[i] ^= 0x40;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, corrupted.data(), corrupted.size(), document.data(), document.size())) << i;
+    }
+
+    // An array is at least two bytes long
+    std::vector<uint8_t> corrupted = data;
+    std::fill(corrupted.begin() + 32, corrupted.begin() + 40, 0);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, corrupted.data(), corrupted.size(), document.data(), document.size()));
+    corrupted[32] = 1;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openIndex(&index, corrupted.data(), corrupted.size(), document.data(), document.size()));
+}
+
+// ------------------------------------
+// Zone Map Tests
+// ------------------------------------
+
+static std::vector<uint8_t> buildZoneMap(const KSBONJSONIndex& index, const std::vector<const char*>& paths, size_t bloomFilterSize)
+{
+    std::vector<size_t> pathLengths;
+    for(const char* path: paths)
+    {
+        pathLengths.push_back(strlen(path));
+    }
+    const KSBONJSONZoneMapOptions options = {paths.data(), pathLengths.data(), paths.size(), bloomFilterSize};
+    std::vector<uint8_t> zoneMap(ksbonjson_zoneMapSize(&index, &options));
+    EXPECT_EQ(KSBONJSON_DOCUMENT_INDEX_BUFFER_FULL, ksbonjson_buildZoneMap(&index, &options, zoneMap.data(), zoneMap.size() - 1));
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_buildZoneMap(&index, &options, zoneMap.data(), zoneMap.size()));
+    return zoneMap;
+}
+
+static ksbonjson_documentStatus onZoneMapMatch(const uint8_t*, size_t, uint64_t elementIndex, void* userData)
+{
+    static_cast<std::vector<uint64_t>*>(userData)->push_back(elementIndex);
+    return KSBONJSON_DOCUMENT_OK;
+}
+
+static std::vector<uint64_t> scanZoneMap(const KSBONJSONZoneMap& zoneMap,
+                                         const std::vector<KSBONJSONPredicate>& predicates,
+                                         uint64_t expectedScannedBlockCount)
+{
+    std::vector<uint64_t> matches;
+    uint64_t scannedBlockCount = 0;
+    EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_scanZoneMap(&zoneMap, predicates.data(), predicates.size(), onZoneMapMatch, &matches, &scannedBlockCount));
+    EXPECT_EQ(expectedScannedBlockCount, scannedBlockCount);
+    return matches;
+}
+
+static KSBONJSONPredicate rangePredicate(size_t pathIndex, double min, double max)
+{
+    return {pathIndex, NULL, 0, min, max};
+}
+
+static KSBONJSONPredicate equalsPredicate(size_t pathIndex, const char* string)
+{
+    return {pathIndex, string, strlen(string), 0, 0};
+}
+
+TEST(ZoneMap, scan)
+{
+    // Ids 0-199, in blocks of 10 sharing a name
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    for(int i = 0; i < 200; i++)
+    {
+        const std::vector<uint8_t> record = encodeIndexedRecord(i, "block" + std::to_string(i / 10));
+        document.insert(document.end(), record.begin(), record.end());
+    }
+    document.push_back(TYPE_END);
+    const std::vector<uint8_t> indexData = buildIndex(document, KSBONJSON_INDEX_ARRAY, 10, NULL);
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size()));
+    const std::vector<uint8_t> data = buildZoneMap(index, {"/id", "/name"}, 16);
+    KSBONJSONZoneMap zoneMap;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openZoneMap(&zoneMap, data.data(), data.size(), &index));
+    ASSERT_EQ(20u, zoneMap.blockCount);
+    ASSERT_EQ(std::string("/name"), std::string(zoneMap.paths[1], zoneMap.pathLengths[1]));
+
+    std::vector<uint64_t> expected = {35, 36, 37, 38, 39, 40, 41, 42};
+    ASSERT_EQ(expected, scanZoneMap(zoneMap, {rangePredicate(0, 35, 42.5)}, 2));
+    expected = {50, 51, 52, 53, 54, 55, 56, 57, 58, 59};
+    ASSERT_EQ(expected, scanZoneMap(zoneMap, {equalsPredicate(1, "block5")}, 1));
+    expected = {58, 59};
+    ASSERT_EQ(expected, scanZoneMap(zoneMap, {rangePredicate(0, 58, 1000), equalsPredicate(1, "block5")}, 1));
+    ASSERT_EQ(std::vector<uint64_t>(), scanZoneMap(zoneMap, {rangePredicate(0, 60, 1000), equalsPredicate(1, "block5")}, 0));
+    ASSERT_EQ(std::vector<uint64_t>(), scanZoneMap(zoneMap, {equalsPredicate(1, "block")}, 0));
+    ASSERT_EQ(std::vector<uint64_t>(), scanZoneMap(zoneMap, {rangePredicate(1, -1e300, 1e300)}, 0));
+    ASSERT_EQ(std::vector<uint64_t>(), scanZoneMap(zoneMap, {rangePredicate(0, 200, 300)}, 0));
+    ASSERT_EQ(200u, scanZoneMap(zoneMap, {}, 20).size());
+
+    // Mixed types, a short last block, and a record log
+    const std::vector<std::vector<uint8_t>> records = indexedRecords();
+    std::vector<uint8_t> log;
+    for(const auto& record: records)
+    {
+        uint8_t header[KSBONJSON_RECORD_HEADER_SIZE];
+        ASSERT_EQ(KSBONJSON_RECORD_OK, ksbonjson_frameRecord(header, record.data(), record.size()));
+        log.insert(log.end(), header, header + sizeof(header));
+        log.insert(log.end(), record.begin(), record.end());
+    }
+    const std::vector<uint8_t> logIndexData = buildIndex(log, KSBONJSON_INDEX_RECORD_LOG, 3, NULL);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, logIndexData.data(), logIndexData.size(), log.data(), log.size()));
+    const std::vector<uint8_t> logData = buildZoneMap(index, {"/id"}, 0);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openZoneMap(&zoneMap, logData.data(), logData.size(), &index));
+    expected = {4, 5, 6, 22};
+    ASSERT_EQ(expected, scanZoneMap(zoneMap, {rangePredicate(0, -1000, 1000)}, 3));
+    expected = {21};
+    ASSERT_EQ(expected, scanZoneMap(zoneMap, {equalsPredicate(0, "x")}, 8));
+}
+
+static ksbonjson_documentStatus onZoneMapMatchStop(const uint8_t*, size_t, uint64_t, void*)
+{
+    return KSBONJSON_DOCUMENT_NOT_FOUND;
+}
+
+TEST(ZoneMap, failure_modes)
+{
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    for(int i = 0; i < 10; i++)
+    {
+        const std::vector<uint8_t> record = encodeIndexedRecord(i, "x");
+        document.insert(document.end(), record.begin(), record.end());
+    }
+    document.push_back(TYPE_END);
+    const std::vector<uint8_t> indexData = buildIndex(document, KSBONJSON_INDEX_ARRAY, 4, NULL);
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size()));
+
+    uint8_t buffer[4096];
+    for(const char* path: {"id", "/a~", "/a~2"})
+    {
+        SCOPED_TRACE(path);
+        const size_t pathLength = strlen(path);
+        const KSBONJSONZoneMapOptions options = {&path, &pathLength, 1, 8};
+        ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_buildZoneMap(&index, &options, buffer, sizeof(buffer)));
+    }
+    const char* paths[KSBONJSON_MAX_ZONE_PATHS + 1];
+    size_t pathLengths[KSBONJSON_MAX_ZONE_PATHS + 1];
+    for(size_t i = 0; i <= KSBONJSON_MAX_ZONE_PATHS; i++)
+    {
+        paths[i] = "/id";
+        pathLengths[i] = 3;
+    }
+    const KSBONJSONZoneMapOptions options = {paths, pathLengths, KSBONJSON_MAX_ZONE_PATHS + 1, 8};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_buildZoneMap(&index, &options, buffer, sizeof(buffer)));
+
+    const std::vector<uint8_t> data = buildZoneMap(index, {"/id"}, 8);
+    KSBONJSONZoneMap zoneMap;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openZoneMap(&zoneMap, data.data(), data.size(), &index));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openZoneMap(&zoneMap, data.data(), data.size() - 1, &index));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openZoneMap(&zoneMap, data.data(), 10, &index));
+    for(size_t i = 0; i < KSBONJSON_ZONE_MAP_HEADER_SIZE + 8; i++)
+    {
+        // Corrupting the magic number, any count, or the path length is caught
+        std::vector<uint8_t> corrupted = data;
+        corrupted[i] ^= 0x40;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openZoneMap(&zoneMap, corrupted.data(), corrupted.size(), &index)) << i;
+    }
+
+    // A zone map only works with the index it was built on
+    const std::vector<uint8_t> otherIndexData = buildIndex(document, KSBONJSON_INDEX_ARRAY, 5, NULL);
+    KSBONJSONIndex otherIndex;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&otherIndex, otherIndexData.data(), otherIndexData.size(), document.data(), document.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_openZoneMap(&zoneMap, data.data(), data.size(), &otherIndex));
+
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openZoneMap(&zoneMap, data.data(), data.size(), &index));
+    const KSBONJSONPredicate badPredicate = rangePredicate(1, 0, 1);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_PATH, ksbonjson_scanZoneMap(&zoneMap, &badPredicate, 1, onZoneMapMatch, NULL, NULL));
+    const KSBONJSONPredicate predicate = rangePredicate(0, 5, 6);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_NOT_FOUND, ksbonjson_scanZoneMap(&zoneMap, &predicate, 1, onZoneMapMatchStop, NULL, NULL));
+    ASSERT_FALSE(ksbonjson_mayBlockMatch(&zoneMap, 0, &predicate, 1));
+    ASSERT_TRUE(ksbonjson_mayBlockMatch(&zoneMap, 1, &predicate, 1));
+    ASSERT_FALSE(ksbonjson_mayBlockMatch(&zoneMap, 3, &predicate, 1));
+}
+
+// ------------------------------------
+// Shard Tests
+// ------------------------------------
+
+static std::vector<uint8_t> shardDocument(const std::vector<uint8_t>& document, const KSBONJSONShard& shard)
+{
+    std::vector<uint8_t> result = {TYPE_ARRAY};
+    result.insert(result.end(), document.begin() + shard.offset, document.begin() + shard.offset + shard.length);
+    result.push_back(TYPE_END);
+    return result;
+}
+
+static std::vector<uint8_t> mergeShards(const std::vector<std::vector<uint8_t>>& documents)
+{
+    std::vector<uint8_t> result = {TYPE_ARRAY};
+    for(const auto& document: documents)
+    {
+        KSBONJSONShard shard;
+        EXPECT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_getArrayElements(document.data(), document.size(), &shard));
+        result.insert(result.end(), document.begin() + shard.offset, document.begin() + shard.offset + shard.length);
+    }
+    result.push_back(TYPE_END);
+    return result;
+}
+
+static void assert_shards(const std::vector<uint8_t>& document, const std::vector<KSBONJSONShard>& shards, uint64_t elementCount)
+{
+    std::vector<std::vector<uint8_t>> documents;
+    uint64_t count = 0;
+    for(const auto& shard: shards)
+    {
+        documents.push_back(shardDocument(document, shard));
+        KSBONJSONShard check;
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_splitArray(documents.back().data(), documents.back().size(), 1, &check));
+        ASSERT_EQ(shard.elementCount, check.elementCount);
+        count += shard.elementCount;
+    }
+    ASSERT_EQ(elementCount, count);
+    ASSERT_EQ(document, mergeShards(documents));
+}
+
+TEST(Shard, split)
+{
+    // Records of different sizes, with strings containing end and string bytes
+    std::vector<uint8_t> document = {TYPE_ARRAY};
+    for(int i = 0; i < 100; i++)
+    {
+        const std::vector<uint8_t> record = encodeIndexedRecord(i, std::string((size_t)(i % 7) * 10, (char)(i % 2 ? TYPE_END : TYPE_STRING)));
+        document.insert(document.end(), record.begin(), record.end());
+    }
+    document.push_back(TYPE_END);
+    const std::vector<uint8_t> indexData = buildIndex(document, KSBONJSON_INDEX_ARRAY, 3, NULL);
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size()));
+
+    for(size_t shardCount: {1, 2, 3, 7, 100, 150})
+    {
+        SCOPED_TRACE(shardCount);
+        std::vector<KSBONJSONShard> shards(shardCount);
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_splitArray(document.data(), document.size(), shardCount, shards.data()));
+        assert_shards(document, shards, 100);
+        for(const auto& shard: shards)
+        {
+            // Balanced by size, to within an element
+            if(shardCount <= 7)
+            {
+                ASSERT_LT(shard.length, (document.size() - 2) / shardCount + 100);
+            }
+        }
+
+        ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_splitIndexedArray(&index, shardCount, shards.data()));
+        assert_shards(document, shards, 100);
+        for(const auto& shard: shards)
+        {
+            // Balanced by element count
+            ASSERT_LE(shard.elementCount, (100 + shardCount - 1) / shardCount);
+        }
+    }
+
+    const std::vector<uint8_t> empty = {TYPE_ARRAY, TYPE_END};
+    std::vector<KSBONJSONShard> shards(3);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_splitArray(empty.data(), empty.size(), 3, shards.data()));
+    assert_shards(empty, shards, 0);
+}
+
+TEST(Shard, failure_modes)
+{
+    KSBONJSONShard shards[2];
+    std::vector<uint8_t> bad = {TYPE_OBJECT, TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_splitArray(bad.data(), bad.size(), 2, shards));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_getArrayElements(bad.data(), bad.size(), shards));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_splitArray(bad.data(), 0, 2, shards));
+    bad = {TYPE_ARRAY, SMALL(1), TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_splitArray(bad.data(), bad.size(), 0, shards));
+    bad = {TYPE_ARRAY, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_splitArray(bad.data(), bad.size(), 2, shards));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_getArrayElements(bad.data(), bad.size(), shards));
+    bad = {TYPE_ARRAY, TYPE_END, SMALL(1)};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_splitArray(bad.data(), bad.size(), 2, shards));
+    bad = {TYPE_ARRAY, TYPE_STRING, 'a', TYPE_END};
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_splitArray(bad.data(), bad.size(), 2, shards));
+
+    std::vector<uint8_t> document = {TYPE_ARRAY, SMALL(1), SMALL(2), TYPE_END};
+    const std::vector<uint8_t> indexData = buildIndex(document, KSBONJSON_INDEX_ARRAY, 1, NULL);
+    KSBONJSONIndex index;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, indexData.data(), indexData.size(), document.data(), document.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_DATA, ksbonjson_splitIndexedArray(&index, 0, shards));
+    document[3] = SMALL(3);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_splitIndexedArray(&index, 2, shards));
+    KSBONJSONIndex emptyIndex = index;
+    emptyIndex.documentLength = 0;
+    ASSERT_EQ(KSBONJSON_DOCUMENT_INVALID_INDEX, ksbonjson_splitIndexedArray(&emptyIndex, 2, shards));
+
+    const std::vector<uint8_t> sequence = {SMALL(1), SMALL(2)};
+    const std::vector<uint8_t> sequenceIndexData = buildIndex(sequence, KSBONJSON_INDEX_SEQUENCE, 1, NULL);
+    ASSERT_EQ(KSBONJSON_DOCUMENT_OK, ksbonjson_openIndex(&index, sequenceIndexData.data(), sequenceIndexData.size(), sequence.data(), sequence.size()));
+    ASSERT_EQ(KSBONJSON_DOCUMENT_WRONG_TYPE, ksbonjson_splitIndexedArray(&index, 2, shards));
+}
+
+// ------------------------------------
+// Kernel Tests
+// ------------------------------------
+
+TEST(Kernels, string_terminator)
+{
+    const ksbonjson_kernelSet originalKernelSet = ksbonjson_getKernelSet();
+    ASSERT_TRUE(ksbonjson_isKernelSetSupported(KSBONJSON_KERNELS_SCALAR));
+
+    for(int i = 0; i < KSBONJSON_KERNELS_COUNT; i++)
+    {
+        const ksbonjson_kernelSet kernelSet = (ksbonjson_kernelSet)i;
+        if(!ksbonjson_setKernelSet(kernelSet))
+        {
+            ASSERT_FALSE(ksbonjson_isKernelSetSupported(kernelSet));
+            continue;
+        }
+        SCOPED_TRACE(ksbonjson_kernelSetName(kernelSet));
+        ASSERT_EQ(kernelSet, ksbonjson_getKernelSet());
+
+        // Every length across several vector widths, with every byte value
+        // except the terminator, so that the terminator lands in every lane.
+        std::string value;
+        for(size_t length = 0; length <= 200; length++)
+        {
+            std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_STRING};
+            document.insert(document.end(), value.begin(), value.end());
+            document.insert(document.end(), {TYPE_STRING, TYPE_END});
+            assert_decode(document,
+                {
+                    std::make_shared<ArrayBeginEvent>(),
+                    std::make_shared<StringEvent>(value),
+                    std::make_shared<ContainerEndEvent>(),
+                });
+
+            // Unterminated
+            document.resize(2 + length);
+            assert_decode_failure(document);
+
+            value += (char)(length * 37 % 255);
+        }
+
+        std::vector<uint8_t> document = {TYPE_ARRAY, TYPE_STRING};
+        document.insert(document.end(), 1000, 0xfe);
+        document.insert(document.end(), {TYPE_STRING, TYPE_END});
+        for(size_t chunkSize: {1, 15, 33, 100})
+        {
+            assert_decode_chunked(document, chunkSize);
+        }
+    }
+
+    ASSERT_TRUE(ksbonjson_setKernelSet(originalKernelSet));
+}
+
+TEST(Kernels, crc32c)
+{
+    const ksbonjson_kernelSet originalKernelSet = ksbonjson_getKernelSet();
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    std::vector<uint8_t> data(300);
+    for(size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    ASSERT_TRUE(ksbonjson_setKernelSet(KSBONJSON_KERNELS_SCALAR));
+    ASSERT_EQ(0U, ksbonjson_crc32c(0, NULL, 0));
+    ASSERT_EQ(0xe3069283U, ksbonjson_crc32c(0, check, sizeof(check)));
+    std::vector<uint32_t> expected;
+    for(size_t offset = 0; offset < 8; offset++)
+    {
+        for(size_t length = 0; offset + length <= data.size(); length += 13)
+        {
+            expected.push_back(ksbonjson_crc32c(0, data.data() + offset, length));
+        }
+    }
+
+    for(int i = 0; i < KSBONJSON_KERNELS_COUNT; i++)
+    {
+        const ksbonjson_kernelSet kernelSet = (ksbonjson_kernelSet)i;
+        if(!ksbonjson_setKernelSet(kernelSet))
+        {
+            continue;
+        }
+        SCOPED_TRACE(ksbonjson_kernelSetName(kernelSet));
+        ASSERT_EQ(0xe3069283U, ksbonjson_crc32c(0, check, sizeof(check)));
+        // Continuing a checksum is the same as doing it all at once
+        ASSERT_EQ(0xe3069283U, ksbonjson_crc32c(ksbonjson_crc32c(0, check, 4), check + 4, 5));
+
+        size_t index = 0;
+        for(size_t offset = 0; offset < 8; offset++)
+        {
+            for(size_t length = 0; offset + length <= data.size(); length += 13)
+            {
+                ASSERT_EQ(expected[index++], ksbonjson_crc32c(0, data.data() + offset, length));
+            }
+        }
+    }
+
+    ASSERT_TRUE(ksbonjson_setKernelSet(originalKernelSet));
+}
+
+// ------------------------------------
+// Stats Tests
+// ------------------------------------
+
+#if KSBONJSON_STATS
+TEST(Stats, encode)
+{
+    EncoderContext eCtx(1000);
+    KSBONJSONEncodeContext eContext;
+    ksbonjson_beginEncode(&eContext, addEncodedDataCallback, &eCtx);
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginObject(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addString(&eContext, "abc", 3));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_beginArray(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addInteger(&eContext, 5));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addInteger(&eContext, 1000));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_addFloat(&eContext, 1.5));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_chunkString(&eContext, "de", 2, false));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_chunkString(&eContext, "f", 1, true));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_terminateDocument(&eContext));
+    ASSERT_EQ(KSBONJSON_ENCODE_OK, ksbonjson_endEncode(&eContext));
+
+    const KSBONJSONStats* stats = ksbonjson_getEncodeStats(&eContext);
+    ASSERT_NE(nullptr, stats);
+    ASSERT_EQ(1U, stats->valueCounts[TYPE_OBJECT]);
+    ASSERT_EQ(1U, stats->valueCounts[TYPE_ARRAY]);
+    ASSERT_EQ(2U, stats->valueCounts[TYPE_END]);
+    ASSERT_EQ(1U, stats->valueCounts[SMALL(5)]);
+    ASSERT_EQ(1U, stats->valueCounts[TYPE_INT16]);
+    ASSERT_EQ(3U, stats->valueBytes[TYPE_INT16]);
+    ASSERT_EQ(1U, stats->valueCounts[TYPE_FLOAT16]);
+    ASSERT_EQ(2U, stats->valueCounts[TYPE_STRING]);
+    ASSERT_EQ(10U, stats->valueBytes[TYPE_STRING]);
+    ASSERT_EQ(6U, stats->stringBytes);
+    ASSERT_EQ(2, stats->maxDepth);
+
+    uint64_t totalBytes = 0;
+    for(uint64_t bytes: stats->valueBytes)
+    {
+        totalBytes += bytes;
+    }
+    ASSERT_EQ(eCtx.get().size(), totalBytes);
+}
+
+TEST(Stats, decode)
+{
+    std::vector<uint8_t> document =
+    {
+        TYPE_OBJECT,
+            TYPE_STRING, 'a', TYPE_STRING, TYPE_INT16, 0xe8, 0x03,
+            TYPE_STRING, 'b', 'c', TYPE_STRING, TYPE_ARRAY,
+                TYPE_FLOAT64, 0x58, 0x39, 0xb4, 0xc8, 0x76, 0xbe, 0xf3, 0x3f,
+                TYPE_NULL,
+                SMALL(5),
+            TYPE_END,
+        TYPE_END,
+    };
+
+    // Stats must come out the same no matter where the chunks are split
+    for(size_t chunkSize: {(size_t)1, (size_t)3, document.size()})
+    {
+        DecoderContext dCtx;
+        KSBONJSONDecodeContext dContext;
+        ksbonjson_beginDecode(&dContext, &dCtx.callbacks, &dCtx);
+        size_t offset = 0;
+        size_t pending = 0;
+        while(offset < document.size())
+        {
+            pending = std::min(pending + chunkSize, document.size() - offset);
+            size_t consumed = 0;
+            ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_decodeChunk(&dContext, document.data() + offset, pending, &consumed));
+            offset += consumed;
+            pending -= consumed;
+        }
+        ASSERT_EQ(KSBONJSON_DECODE_OK, ksbonjson_endDecode(&dContext));
+
+        const KSBONJSONStats* stats = ksbonjson_getDecodeStats(&dContext);
+        ASSERT_NE(nullptr, stats);
+        ASSERT_EQ(2U, stats->valueCounts[TYPE_STRING]);
+        ASSERT_EQ(7U, stats->valueBytes[TYPE_STRING]);
+        ASSERT_EQ(3U, stats->stringBytes);
+        ASSERT_EQ(1U, stats->valueCounts[TYPE_INT16]);
+        ASSERT_EQ(9U, stats->valueBytes[TYPE_FLOAT64]);
+        ASSERT_EQ(1U, stats->valueCounts[SMALL(5)]);
+        ASSERT_EQ(2U, stats->valueCounts[TYPE_END]);
+        ASSERT_EQ(2, stats->maxDepth);
+        // 10 values and container ends, plus onEndData()
+        ASSERT_EQ(11U, stats->sinkCalls);
+    }
+}
+#else
+TEST(Stats, disabled)
+{
+    KSBONJSONEncodeContext eContext;
+    KSBONJSONDecodeContext dContext;
+    ASSERT_EQ(nullptr, ksbonjson_getEncodeStats(&eContext));
+    ASSERT_EQ(nullptr, ksbonjson_getDecodeStats(&dContext));
+}
+#endif
+
 
 // ------------------------------------
 // Example Tests
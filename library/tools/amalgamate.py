@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+#  amalgamate.py
+#
+#  Created by Karl Stenerud on 2024-07-07.
+#
+#  Copyright (c) 2024 Karl Stenerud. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall remain in place
+# in this source code.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+
+"""
+Generates ksbonjson.h: the whole library as a single header.
+
+    amalgamate.py <library dir> <output file>
+
+Usage (in exactly one C file):
+
+    #define KSBONJSON_IMPLEMENTATION
+    #include "ksbonjson.h"
+
+Or, to compile a private copy into a C file so that the compiler can inline
+the API into its callers:
+
+    #define KSBONJSON_STATIC
+    #include "ksbonjson.h"
+
+The type codes and helpers that the source files share are in private
+headers, which are included once. Everything else at file scope must have a
+name that no other source file uses (this script refuses to generate the
+header otherwise), and each file's macros are undefined at the end of that
+file.
+"""
+
+import os
+import re
+import sys
+
+HEADERS = [
+    "include/ksbonjson/KSBONJSONStats.h",
+    "include/ksbonjson/KSBONJSONEncoder.h",
+    "include/ksbonjson/KSBONJSONDecoder.h",
+    "include/ksbonjson/KSBONJSONDocument.h",
+    "include/ksbonjson/KSBONJSONPatch.h",
+    "include/ksbonjson/KSBONJSONDiff.h",
+    "include/ksbonjson/KSBONJSONHash.h",
+    "include/ksbonjson/KSBONJSONCanonical.h",
+    "include/ksbonjson/KSBONJSONColumns.h",
+    "include/ksbonjson/KSBONJSONAggregate.h",
+    "include/ksbonjson/KSBONJSONRecordLog.h",
+    "include/ksbonjson/KSBONJSONIndex.h",
+    "include/ksbonjson/KSBONJSONZoneMap.h",
+    "include/ksbonjson/KSBONJSONShard.h",
+    "include/ksbonjson/KSBONJSONKernels.h",
+]
+
+SOURCES = [
+    "src/KSBONJSONKernels.c",
+    "src/KSBONJSONEncoder.c",
+    "src/KSBONJSONDecoder.c",
+    "src/KSBONJSONDocument.c",
+    "src/KSBONJSONPatch.c",
+    "src/KSBONJSONDiff.c",
+    "src/KSBONJSONHash.c",
+    "src/KSBONJSONCanonical.c",
+    "src/KSBONJSONColumns.c",
+    "src/KSBONJSONAggregate.c",
+    "src/KSBONJSONRecordLog.c",
+    "src/KSBONJSONIndex.c",
+    "src/KSBONJSONZoneMap.c",
+    "src/KSBONJSONShard.c",
+]
+
+INCLUDE_RE = re.compile(r'^\s*#\s*include\s+[<"]([^>"]+)[>"]')
+DEFINE_RE = re.compile(r'^\s*#\s*define\s+(\w+)', re.MULTILINE)
+STATIC_FUNCTION_RE = re.compile(r'^static\s[^(;=]*?\b(\w+)\(', re.MULTILINE)
+TAG_RE = re.compile(r'^(?:union|struct|enum)\s+(\w+)\s*$', re.MULTILINE)
+TYPEDEF_RE = re.compile(r'^\}\s*(\w+);', re.MULTILINE)
+ENUM_RE = re.compile(r'^enum\s*(?:\w+\s*)?\{(.*?)\};', re.MULTILINE | re.DOTALL)
+ENUMERATOR_RE = re.compile(r'^\s*(\w+)\s*(?:=[^,]*)?,', re.MULTILINE)
+
+
+def read_file(library_dir, path):
+    with open(os.path.join(library_dir, path)) as f:
+        return f.read()
+
+def strip_license(text):
+    # Every file starts with the same comment block. Keep only the first one.
+    lines = text.split("\n")
+    index = 0
+    while index < len(lines) and lines[index].startswith("//"):
+        index += 1
+    return "\n".join(lines[index:]).strip("\n") + "\n"
+
+def inline_includes(library_dir, text, included):
+    # Replace includes of our own files with their contents (once only).
+    output = []
+    for line in text.split("\n"):
+        match = INCLUDE_RE.match(line)
+        if match:
+            name = os.path.basename(match.group(1))
+            for directory in ["include/ksbonjson", "src"]:
+                path = os.path.join(directory, name)
+                if name.startswith("KSBONJSON") and os.path.exists(os.path.join(library_dir, path)):
+                    if path not in included:
+                        included.add(path)
+                        contents = strip_license(read_file(library_dir, path))
+                        output.append(inline_includes(library_dir, contents, included))
+                    line = None
+                    break
+        if line is not None:
+            output.append(line)
+    return "\n".join(output)
+
+def file_scope_names(text):
+    names = set(STATIC_FUNCTION_RE.findall(text))
+    names |= set(TAG_RE.findall(text))
+    names |= set(TYPEDEF_RE.findall(text))
+    for body in ENUM_RE.findall(text):
+        names |= set(ENUMERATOR_RE.findall(body))
+    return names
+
+def amalgamate(library_dir):
+    license = read_file(library_dir, HEADERS[0]).split("\n\n")[0]
+    license = license.replace("KSBONJSONStats.h", "ksbonjson.h")
+    included = set()
+
+    output = [license, "", "// Generated by tools/amalgamate.py. Do not edit.", ""]
+    output.append("""#ifndef ksbonjson_h
+#define ksbonjson_h
+
+#ifdef KSBONJSON_STATIC
+#   define KSBONJSON_IMPLEMENTATION
+#   define KSBONJSON_PRIVATE_DECLARATION static
+#   define KSBONJSON_PRIVATE_DEFINITION static
+#endif
+
+#ifndef KSBONJSON_PUBLIC
+#   ifdef KSBONJSON_STATIC
+#       define KSBONJSON_PUBLIC static inline
+#   else
+#       define KSBONJSON_PUBLIC
+#   endif
+#endif
+""")
+    for path in HEADERS:
+        if path not in included:
+            included.add(path)
+            output.append(inline_includes(library_dir, strip_license(read_file(library_dir, path)), included))
+
+    output.append("#endif // ksbonjson_h")
+    output.append("")
+    output.append("")
+    output.append("#if defined(KSBONJSON_IMPLEMENTATION) && !defined(ksbonjson_implementation)")
+    output.append("#define ksbonjson_implementation")
+    output.append("")
+
+    # Private headers go first, so that their macros aren't mistaken for
+    # macros belonging to the first source file that includes them.
+    for path in SOURCES:
+        for line in read_file(library_dir, path).split("\n"):
+            match = INCLUDE_RE.match(line)
+            if match and match.group(1).startswith("KSBONJSON"):
+                output.append(inline_includes(library_dir, line, included))
+    output.append("")
+
+    owners = {}
+    for path in SOURCES:
+        source = inline_includes(library_dir, strip_license(read_file(library_dir, path)), included)
+        for name in sorted(file_scope_names(source)):
+            if name in owners:
+                raise ValueError("%s is defined in both %s and %s" % (name, owners[name], path))
+            owners[name] = path
+
+        output.append("// " + "=" * 76)
+        output.append("// " + os.path.basename(path))
+        output.append("// " + "=" * 76)
+        output.append("")
+        output.append(source)
+        for name in sorted(set(DEFINE_RE.findall(source))):
+            output.append("#undef " + name)
+        output.append("")
+
+    output.append("#endif // KSBONJSON_IMPLEMENTATION")
+    return "\n".join(output) + "\n"
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: %s <library dir> <output file>" % sys.argv[0], file=sys.stderr)
+        return 1
+    with open(sys.argv[2], "w") as f:
+        f.write(amalgamate(sys.argv[1]))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())